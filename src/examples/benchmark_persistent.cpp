@@ -1,7 +1,10 @@
 #include <cstdlib>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <functional>
 #include <random>
+#include <string>
 
 #include "lhf/lhf.hpp"
 
@@ -32,7 +35,7 @@ T clamp(const T& v, const T& l, const T& h) {
 
 int main(int argc, char **argv) {
 	if (argc < 3) {
-		printf("Usage: %s [num_unique_properties] [num_iterations] [distribution (optional) = 'normal' | 'uniform'] [stddev (optional)]\n", argv[0]);
+		printf("Usage: %s [num_unique_properties] [num_iterations] [distribution (optional) = 'normal' | 'uniform'] [stddev (optional)] [warm start file (optional)]\n", argv[0]);
 		return 1;
 	}
 
@@ -57,6 +60,13 @@ int main(int argc, char **argv) {
 		stddev = atof(argv[4]);
 	}
 
+	// With a warm start file, the run is deterministic, and starts from the
+	// sets and caches of the previous run with the same arguments.
+	std::string warm_start_path;
+	if (argc >= 6) {
+		warm_start_path = argv[5];
+	}
+
 	if (num_unique_properties <= 0 || num_iterations <= 0 || stddev <= 0) {
 		std::cout << "All numerical arguments must be values greater than 0." << std::endl;
 		return 1;
@@ -65,53 +75,69 @@ int main(int argc, char **argv) {
 
 	LHF l;
 
+	std::uint64_t tag = std::hash<std::string>()(
+		std::to_string(num_unique_properties) + " " + std::to_string(num_iterations) + " " +
+		std::to_string(use_normal_dist) + " " + std::to_string(stddev));
+
+	if (!warm_start_path.empty()) {
+		std::cout << (l.warm_start(warm_start_path, tag) ? "Warm start" : "Cold start") << std::endl;
+	}
+
 	std::random_device rd;
-	std::mt19937 eng(rd());
+	std::mt19937 eng(warm_start_path.empty() ? rd() : 0);
+
+	// Number of sets this run has produced so far. After a warm start, the
+	// LHF holds more sets than that, but operands are only picked from those
+	// of this run, so that it repeats the previous one.
+	lhf::Size num_sets = 1;
+	auto track = [&num_sets](const Index &i) {
+		num_sets = std::max(num_sets, lhf::Size(i.value) + 1);
+	};
 	std::uniform_int_distribution<> unique_prop_gen(0, num_unique_properties - 1);
 	std::bernoulli_distribution decision_gen(0.6);
 	std::uniform_int_distribution<> operation_decision_gen(0, DECISION_MAX - 1);
 
 	for (int i = 0; i < num_iterations; i++) {
-		if (l.property_set_count() < PROPERTYSET_MIN_THRESHOLD || (decision_gen(eng))) {
+		if (num_sets < PROPERTYSET_MIN_THRESHOLD || (decision_gen(eng))) {
 			int unique_prop = unique_prop_gen(eng);
 			// std::cout << "* Insert " << unique_prop <<  std::endl;
-			l.register_set_single(unique_prop);
+			track(l.register_set_single(unique_prop));
 		} else {
 			Index arg1;
 			Index arg2;
 			// std::cout << "* CValuesize " << l.property_sets.size() << std::endl;
 			if (!use_normal_dist) {
-				std::uniform_int_distribution<> index_gen(0, l.property_set_count() - 1);
+				std::uniform_int_distribution<> index_gen(0, num_sets - 1);
 				arg1 = index_gen(eng);
 				arg2 = index_gen(eng);
 			} else {
 				std::normal_distribution<> index_gen(0, stddev);
 				arg1 =
 					clamp(
-						Index(std::abs(index_gen(eng)) * (l.property_set_count() - 1)),
+						Index(std::abs(index_gen(eng)) * (num_sets - 1)),
 						Index(0),
-						Index(l.property_set_count() - 1));
+						Index(num_sets - 1));
 				arg2 =
 					clamp(
-						Index(std::abs(index_gen(eng)) * (l.property_set_count() - 1)),
+						Index(std::abs(index_gen(eng)) * (num_sets - 1)),
 						Index(0),
-						Index(l.property_set_count() - 1));
+						Index(num_sets - 1));
 			}
 
 			switch (operation_decision_gen(eng)) {
 			case UNION:
 				// std::cout << "* Union " << arg1 << " " << arg2 << std::endl;
-				l.set_union(arg1, arg2);
+				track(l.set_union(arg1, arg2));
 				break;
 
 			case DIFFERENCE:
 				// std::cout << "* Difference " << arg1 << " " << arg2 << std::endl;
-				l.set_difference(arg1, arg2);
+				track(l.set_difference(arg1, arg2));
 				break;
 
 			case INTERSECTION:
 				// std::cout << "* Intersection " << arg1 << " " << arg2 << std::endl;
-				l.set_intersection(arg1, arg2);
+				track(l.set_intersection(arg1, arg2));
 				break;
 			}
 		}
@@ -119,6 +145,10 @@ int main(int argc, char **argv) {
 		std::cout << "Completed: " << i << "/" << num_iterations << std::endl;
 	}
 
+	if (!warm_start_path.empty()) {
+		l.save_warm_start(warm_start_path, tag);
+	}
+
 	std::cout << l.dump_perf();
 	// std::cout << l.dump();
 
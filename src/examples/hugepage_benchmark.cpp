@@ -0,0 +1,88 @@
+/**
+ * Compares the default allocator with transparent huge page backing
+ * (`HugePageLHFConfig`) on random-access workloads, which are dominated by
+ * TLB misses once the forest spans many pages.
+ *
+ * Usage: hugepage_benchmark [number of sets] [number of queries]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "lhf/lhf.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+template<typename LHF>
+void run(const char *name, lhf::Size num_sets, lhf::Size num_queries) {
+	using Index = typename LHF::Index;
+
+	std::mt19937_64 rng(42);
+	LHF l;
+	std::vector<Index> sets;
+	std::vector<std::pair<Index, Index>> pairs;
+
+	auto start = Clock::now();
+
+	for (lhf::Size i = 0; i < num_sets; i++) {
+		sets.push_back(l.register_set({int(i), int(i + num_sets)}));
+	}
+
+	std::uniform_int_distribution<lhf::Size> pick(0, num_sets - 1);
+	for (lhf::Size i = 0; i < num_sets; i++) {
+		Index a = sets[pick(rng)], b = sets[pick(rng)];
+		l.set_union(a, b);
+		pairs.push_back({a, b});
+	}
+
+	auto built = Clock::now();
+
+	// Random reads of set contents.
+	long sum = 0;
+	for (lhf::Size i = 0; i < num_queries; i++) {
+		sum += l.get_value(sets[pick(rng)]).front().get_key();
+	}
+
+	auto read = Clock::now();
+
+	// Random probes of the union cache.
+	lhf::Size hits = 0;
+	std::uniform_int_distribution<lhf::Size> pick_pair(0, pairs.size() - 1);
+	for (lhf::Size i = 0; i < num_queries; i++) {
+		const auto &p = pairs[pick_pair(rng)];
+		hits += l.find_cached_operation(lhf::OperationKind::UNION, p.first, p.second).is_present();
+	}
+
+	auto probed = Clock::now();
+
+	auto ms = [](auto d) {
+		return std::chrono::duration<double, std::milli>(d).count();
+	};
+	auto ns_per_query = [&](auto d) {
+		return std::chrono::duration<double, std::nano>(d).count() / num_queries;
+	};
+
+	std::cout
+		<< name << ":\n"
+		<< "    Build:     " << ms(built - start) << " ms\n"
+		<< "    get_value: " << ns_per_query(read - built) << " ns/query\n"
+		<< "    Probe:     " << ns_per_query(probed - read) << " ns/query\n"
+		<< "    (checksum " << sum << ", " << hits << " hits)\n";
+}
+
+int main(int argc, char **argv) {
+	lhf::Size num_sets = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1 << 20);
+	lhf::Size num_queries = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : (1 << 23);
+
+	if (num_sets == 0 || num_queries == 0) {
+		std::cout << "Usage: " << argv[0] << " [number of sets] [number of queries]\n";
+		return 1;
+	}
+
+	run<lhf::LatticeHashForest<lhf::LHFConfig<int>>>("Default", num_sets, num_queries);
+	run<lhf::LatticeHashForest<lhf::HugePageLHFConfig<int>>>("Huge pages", num_sets, num_queries);
+	std::cout << "Huge page mappings:\n" << lhf::get_huge_page_stats().to_string();
+	return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * Compares merging an independently built LHF with `merge_from()` against
+ * registering its sets one at a time with `register_set()`. Half of the sets
+ * are already in the target LHF, as when workers analyze overlapping parts
+ * of a program. `merge_from()` looks the sets up in parallel and appends the
+ * new ones in a single pass. The other LHF holds no cached operations, so
+ * both only intern sets.
+ *
+ * Usage: merge_benchmark [number of sets] [mean set size]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "lhf/lhf.hpp"
+
+using Clock = std::chrono::steady_clock;
+using LHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+
+static double ms(Clock::duration d) {
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/// Registers `num_sets` random sets in `l`. `seed` picks the sets, so LHFs
+/// built with the same seed share them.
+static void build(LHF &l, lhf::Size num_sets, lhf::Size mean_size, std::uint64_t seed) {
+	std::mt19937_64 rng(seed);
+	std::uniform_int_distribution<lhf::Size> size(1, 2 * mean_size);
+	std::geometric_distribution<int> gap(0.3);
+	std::uniform_int_distribution<int> base(0, 1 << 24);
+
+	for (lhf::Size i = 0; i < num_sets; i++) {
+		LHF::PropertySet s;
+		int key = base(rng);
+		for (lhf::Size k = size(rng); k > 0; k--) {
+			key += 1 + gap(rng);
+			s.push_back(key);
+		}
+		l.register_set(std::move(s));
+	}
+}
+
+int main(int argc, char **argv) {
+	lhf::Size num_sets = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1 << 18);
+	lhf::Size mean_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 16;
+
+	if (num_sets == 0 || mean_size == 0) {
+		std::cout << "Usage: " << argv[0] << " [number of sets] [mean set size]\n";
+		return 1;
+	}
+
+	LHF other;
+	build(other, num_sets, mean_size, 1);
+	build(other, num_sets, mean_size, 2);
+
+	double one_at_a_time;
+	{
+		LHF l;
+		build(l, num_sets, mean_size, 1);
+		auto start = Clock::now();
+		for (lhf::Size i = 0; i < other.property_set_count(); i++) {
+			l.register_set<true>(other.get_value(i));
+		}
+		one_at_a_time = ms(Clock::now() - start);
+	}
+
+	double merged;
+	lhf::Size before;
+	{
+		LHF l;
+		build(l, num_sets, mean_size, 1);
+		before = l.property_set_count();
+		auto start = Clock::now();
+		l.merge_from(other);
+		merged = ms(Clock::now() - start);
+	}
+
+	std::cout
+		<< "Merging " << other.property_set_count() << " sets into an LHF of "
+		<< before << " sets:\n"
+		<< "    register_set(): " << one_at_a_time << " ms\n"
+		<< "    merge_from():   " << merged << " ms\n";
+	return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * Compares raw and delta-encoded snapshots (`SnapshotEncoding`): the size of
+ * the file, the time to write and open it, and the throughput of decoding
+ * the sets. Raw snapshots are mapped and queried in place, so opening them
+ * does not decode anything. `load_snapshot()` is measured for both.
+ *
+ * Usage: snapshot_benchmark [number of sets] [mean set size] [path]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "lhf/lhf.hpp"
+
+using Clock = std::chrono::steady_clock;
+using LHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+
+static double ms(Clock::duration d) {
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+void run(const LHF &l, lhf::SnapshotEncoding encoding, const char *name, const std::string &path) {
+	lhf::Size elements = 0;
+	for (lhf::Size i = 0; i < l.property_set_count(); i++) {
+		elements += l.get_value(i).size();
+	}
+
+	auto start = Clock::now();
+	l.write_snapshot(path, encoding);
+	auto written = Clock::now();
+
+	lhf::Size bytes;
+	long sum = 0;
+	{
+		LHF::MappedSnapshot m(path);
+		bytes = m.file_size();
+		for (lhf::Size i = 0; i < m.property_set_count(); i++) {
+			auto s = m.get_value(i);
+			sum += s.empty() ? 0 : s.begin()->get_key();
+		}
+	}
+	auto opened = Clock::now();
+
+	LHF r;
+	r.load_snapshot(path);
+	auto loaded = Clock::now();
+
+	std::cout
+		<< name << ":\n"
+		<< "    Size:          " << bytes / 1048576.0 << " MiB ("
+		<< double(bytes) / elements << " bytes/element)\n"
+		<< "    Write:         " << ms(written - start) << " ms\n"
+		<< "    Open and scan: " << ms(opened - written) << " ms ("
+		<< elements / 1e6 / (ms(opened - written) / 1000) << " M elements/s)\n"
+		<< "    load_snapshot: " << ms(loaded - opened) << " ms\n"
+		<< "    (checksum " << sum << ")\n";
+
+	std::remove(path.c_str());
+}
+
+int main(int argc, char **argv) {
+	lhf::Size num_sets = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1 << 18);
+	lhf::Size mean_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 32;
+	std::string path = argc > 3 ? argv[3] : "snapshot_benchmark.bin";
+
+	if (num_sets == 0 || mean_size == 0) {
+		std::cout << "Usage: " << argv[0] << " [number of sets] [mean set size] [path]\n";
+		return 1;
+	}
+
+	// Sets of nearby keys, as produced by dataflow analyses over numbered
+	// program points.
+	std::mt19937_64 rng(42);
+	std::uniform_int_distribution<lhf::Size> size(1, 2 * mean_size);
+	std::geometric_distribution<int> gap(0.3);
+	std::uniform_int_distribution<int> base(0, 1 << 24);
+
+	LHF l;
+	std::vector<LHF::Index> sets;
+	for (lhf::Size i = 0; i < num_sets; i++) {
+		LHF::PropertySet s;
+		int key = base(rng);
+		for (lhf::Size k = size(rng); k > 0; k--) {
+			key += 1 + gap(rng);
+			s.push_back(key);
+		}
+		sets.push_back(l.register_set(std::move(s)));
+	}
+
+	std::uniform_int_distribution<lhf::Size> pick(0, num_sets - 1);
+	for (lhf::Size i = 0; i < num_sets / 4; i++) {
+		l.set_union(sets[pick(rng)], sets[pick(rng)]);
+	}
+
+	run(l, lhf::SnapshotEncoding::RAW, "Raw", path);
+	run(l, lhf::SnapshotEncoding::DELTA, "Delta", path);
+	return 0;
+}
@@ -7,11 +7,31 @@
 #define LHF_HPP
 
 #include "lhf_common.hpp"
+#include "lhf_parallel.hpp"
 #include "profiling.hpp"
+#include "lhf_hugepage.hpp"
+#include "lhf_codec.hpp"
+#include "lhf_snapshot.hpp"
+#include "lhf_journal.hpp"
 
+#ifdef LHF_ENABLE_SERIALIZATION
+#include "lhf_serialization.hpp"
+#include "lhf_bundle.hpp"
+#endif
+
+#ifdef LHF_ENABLE_EVICTION
+#include "lhf_spill.hpp"
+#endif
+
+#include <array>
 #include <tuple>
 #include <utility>
 #include <algorithm>
+#include <limits>
+#include <optional>
+#include <future>
+#include <deque>
+#include <typeinfo>
 
 namespace lhf {
 
@@ -42,6 +62,21 @@ inline std::ostream &operator<<(std::ostream &os, const OperationNode &op) {
 	return os << op.to_string();
 }
 
+/**
+ * @brief      Names an operation of LHF at runtime. Used where operations are
+ *             described as data, such as in operation batches.
+ */
+enum class OperationKind {
+	UNION,
+	INTERSECTION,
+	DIFFERENCE,
+	INSERT
+};
+
+/// Numbers garbage collections and reorganizations. It is shared by all LHFs,
+/// so that an LHF nested in several others is only processed once per pass.
+inline std::atomic<Size> gc_epoch_counter = 0;
+
 } // END namespace lhf
 
 /************************** START GLOBAL NAMESPACE ****************************/
@@ -108,10 +143,16 @@ template<
 	typename ElementHash = DefaultHash<ElementT>>
 struct SetHash {
 	Size operator()(const SetT *k) const {
+		return (*this)(k->begin(), k->end());
+	}
+
+	/// Hashes the elements `[first, last)` like a set holding them.
+	template<typename Iterator>
+	Size operator()(Iterator first, Iterator last) const {
 		// Adapted from boost::hash_combine
 		size_t hash_value = 0;
-		for (const auto &value : *k) {
-			hash_value = compose_hash<ElementT, ElementHash>(hash_value, value);
+		for (; first != last; ++first) {
+			hash_value = compose_hash<ElementT, ElementHash>(hash_value, *first);
 		}
 
 		return hash_value;
@@ -201,9 +242,9 @@ struct Unreachable : public std::runtime_error {
 
 #define __LHF_EXCEPT(__msg) AssertError(__msg " [At: " __FILE__ ":" __LHF_STR(__LINE__) "]")
 
-#ifdef LHF_DEBUG
+#ifdef LHF_ENABLE_DEBUG
 #define __LHF_ASSERT(__cond, __msg_arg) \
-	{ if (!(__cond)) { __LHF_EXCEPT(__msg_arg); } }
+	{ if (!(__cond)) { throw __LHF_EXCEPT(__msg_arg); } }
 #else
 #define __LHF_ASSERT(__cond, __msg_arg)
 #endif
@@ -705,1572 +746,6296 @@ struct NestingBase {
 
 
 /**
- * @def        MapAdapter
- * @brief      Enables the interface used by LHF for using a map data structure
- *             for any given map implementation. This preprocessor if-ladder
- *             should be expanded as needed for any newer implementations.
- *
- * @tparam     MapClass The Map implementation to adapt.
+ * @brief      Replacement policy of a bounded operation cache (see
+ *             `MapAdapter::set_capacity()`).
  */
+enum class CachePolicy {
+	/// CLOCK (second chance) eviction. Every new entry is admitted.
+	CLOCK,
+
+	/// CLOCK eviction with TinyLFU admission: when the cache is full, a new
+	/// entry only replaces the eviction victim if it has been requested at
+	/// least as often recently, as estimated by a count-min sketch.
+	TINYLFU
+};
 
-#ifdef LHF_ENABLE_TBB
+/**
+ * @brief      Occupancy and eviction counters of an operation cache.
+ */
+struct CacheStats {
+	Size size = 0;
+	Size capacity = 0;
+	Size evictions = 0;
+	Size rejections = 0;
 
-template<typename MapClass>
-class MapAdapter {
-public:
-	using Map = MapClass;
-	using Key = typename Map::key_type;
-	using MappedType = typename Map::mapped_type;
-	using KeyValuePair = typename Map::value_type;
+	String to_string() const {
+		std::stringstream s;
+		s << "    " << "Size:       " << size << "\n"
+		  << "    " << "Capacity:   " << (capacity ? std::to_string(capacity) : "unbounded") << "\n"
+		  << "    " << "Evictions:  " << evictions << "\n"
+		  << "    " << "Rejections: " << rejections << "\n";
+		return s.str();
+	}
+};
 
-protected:
-	using Accessor = typename Map::const_accessor;
-	Map data;
+/**
+ * @brief      Estimated memory used by a map (see `MapAdapter::memory()`).
+ */
+struct MapMemoryUsage {
+	Size entries = 0;
+	Size node_bytes = 0;
+	Size bucket_bytes = 0;
 
-public:
-	Optional<MappedType> find(const Key &key) const {
-		Accessor acc;
-		bool found = data.find(acc, key);
-		if (!found) {
-			return Optional<MappedType>::absent();
-		} else {
-			return acc->second;
-		}
+	Size total_bytes() const {
+		return node_bytes + bucket_bytes;
 	}
 
-	void insert(KeyValuePair &&v) {
-		data.insert(std::move(v));
+	String to_string() const {
+		std::stringstream s;
+		s << entries << " entries, "
+		  << node_bytes << " node bytes, "
+		  << bucket_bytes << " bucket bytes";
+		return s.str();
 	}
+};
 
-	void clear() {
-		data.clear();
-	}
+/**
+ * @brief      Estimated memory used by an LHF and the LHFs nested in it (see
+ *             `LatticeHashForest::memory_usage()`). All sizes are in bytes.
+ */
+struct MemoryUsage {
+	String name = "";
 
-	Size size() const {
-		return data.size();
-	}
+	/// Number of sets, including evicted and collected ones.
+	Size sets = 0;
 
-	typename Map::const_iterator begin() const {
-		return data.begin();
+	/// Elements of the resident sets.
+	Size element_bytes = 0;
+
+	/// Allocated but unused capacity of the resident sets.
+	Size slack_bytes = 0;
+
+	/// Set holders in the storage (including reserved slots), and the
+	/// vector headers of the resident sets.
+	Size holder_bytes = 0;
+
+	MapMemoryUsage property_set_map = {};
+	MapMemoryUsage unions = {};
+	MapMemoryUsage intersections = {};
+	MapMemoryUsage differences = {};
+	MapMemoryUsage subsets = {};
+
+	/// Usage of the nested LHFs, in the order of the reference list.
+	Vector<MemoryUsage> children = {};
+
+	/// Bytes used by this LHF alone.
+	Size own_bytes() const {
+		return
+			element_bytes + slack_bytes + holder_bytes +
+			property_set_map.total_bytes() +
+			unions.total_bytes() +
+			intersections.total_bytes() +
+			differences.total_bytes() +
+			subsets.total_bytes();
 	}
 
-	typename Map::const_iterator end() const {
-		return data.end();
+	/// Bytes used by this LHF and the LHFs nested in it.
+	Size total_bytes() const {
+		Size ret = own_bytes();
+		for (const MemoryUsage &c : children) {
+			ret += c.total_bytes();
+		}
+		return ret;
 	}
 
-	String to_string() const {
+	String to_string(Size indent = 0) const {
+		String pad(indent, ' ');
 		std::stringstream s;
-
-		for (auto i : data) {
-			s << "      {" << i.first << " -> " << i.second << "} \n";
+		s << pad << "LHF " << name << ": " << total_bytes() << " bytes\n"
+		  << pad << "    " << "Sets:             " << sets << "\n"
+		  << pad << "    " << "Element Bytes:    " << element_bytes << "\n"
+		  << pad << "    " << "Slack Bytes:      " << slack_bytes << "\n"
+		  << pad << "    " << "Holder Bytes:     " << holder_bytes << "\n"
+		  << pad << "    " << "Property Set Map: " << property_set_map.to_string() << "\n"
+		  << pad << "    " << "Unions:           " << unions.to_string() << "\n"
+		  << pad << "    " << "Intersections:    " << intersections.to_string() << "\n"
+		  << pad << "    " << "Differences:      " << differences.to_string() << "\n"
+		  << pad << "    " << "Subsets:          " << subsets.to_string() << "\n";
+		for (const MemoryUsage &c : children) {
+			s << c.to_string(indent + 4);
 		}
-
 		return s.str();
 	}
-
 };
 
-#else
+/**
+ * @brief      Bookkeeping for a map with a capacity limit. The keys of the
+ *             map are kept in a ring of `capacity` slots swept by a CLOCK
+ *             hand. Access bits, and the frequency sketch for TinyLFU, are
+ *             kept in hashed arrays of atomics, so recording an access does
+ *             not take a lock and does not need to locate the key's slot.
+ *             A hash collision only gives an entry an extra second chance.
+ *
+ * @tparam     Key   The key type of the map.
+ */
+template<typename Key>
+class CacheBound {
+protected:
+	static constexpr Size SKETCH_DEPTH = 4;
+	static constexpr std::uint8_t SKETCH_MAX = 15;
 
-template<typename MapClass>
-class MapAdapter {
-public:
-	using Map = MapClass;
-	using Key = typename Map::key_type;
-	using MappedType = typename Map::mapped_type;
-	using KeyValuePair = typename Map::value_type;
+	const Size capacity;
+	const CachePolicy policy;
 
-protected:
-	Map data;
-	LHF_PARALLEL(mutable RWMutex mutex;)
+	Vector<Key> slots = {};
+	Size hand = 0;
 
-public:
-	Optional<MappedType> find(const Key &key) const {
-		LHF_PARALLEL(ReadLock m(mutex);)
-		auto value = data.find(key);
-		if (value == data.end()) {
-			return Optional<MappedType>::absent();
-		} else {
-			return value->second;
-		}
-	}
+	Vector<std::atomic<bool>> referenced;
+	Vector<std::atomic<std::uint8_t>> sketch;
+	Size mask = 0;
+	std::atomic<Size> samples = 0;
 
-	void insert(KeyValuePair &&v) {
-		LHF_PARALLEL(WriteLock m(mutex);)
-		data.insert(std::move(v));
+	Size evictions = 0;
+	Size rejections = 0;
+
+	std::mutex mutex;
+
+	static Size mix(const Key &key, Size seed) {
+		std::uint64_t h = std::hash<Key>()(key) + seed * 0x9e3779b97f4a7c15ULL;
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		return h ^ (h >> 31);
 	}
 
-	void clear() {
-		LHF_PARALLEL(WriteLock m(mutex);)
-		data.clear();
+	/// Estimated number of recent requests for a key.
+	std::uint8_t frequency(const Key &key) const {
+		std::uint8_t ret = SKETCH_MAX;
+		for (Size d = 0; d < SKETCH_DEPTH; d++) {
+			ret = std::min(ret, sketch[d * (mask + 1) + (mix(key, d + 1) & mask)].load(
+				std::memory_order_relaxed));
+		}
+		return ret;
 	}
 
-	Size size() const {
-		LHF_PARALLEL(ReadLock m(mutex);)
-		return data.size();
+	/// Ages the sketch by halving every counter, so that it tracks recent
+	/// popularity.
+	void age() {
+		for (auto &c : sketch) {
+			c.store(c.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+		}
 	}
 
-	typename Map::const_iterator begin() const {
-		return data.begin();
+public:
+	CacheBound(Size capacity, CachePolicy policy):
+		capacity(capacity), policy(policy) {
+		Size width = 1;
+		while (width < capacity) {
+			width <<= 1;
+		}
+
+		mask = width - 1;
+		referenced = Vector<std::atomic<bool>>(width);
+		if (policy == CachePolicy::TINYLFU) {
+			sketch = Vector<std::atomic<std::uint8_t>>(width * SKETCH_DEPTH);
+		}
 	}
 
-	typename Map::const_iterator end() const {
-		return data.end();
+	/**
+	 * @brief      Records a request for `key`, whether it hits or not. This
+	 *             only updates relaxed atomics; concurrent updates may
+	 *             occasionally be lost, which only makes the estimates less
+	 *             precise.
+	 */
+	void record_access(const Key &key) {
+		referenced[mix(key, 0) & mask].store(true, std::memory_order_relaxed);
+
+		if (policy == CachePolicy::TINYLFU) {
+			for (Size d = 0; d < SKETCH_DEPTH; d++) {
+				auto &c = sketch[d * (mask + 1) + (mix(key, d + 1) & mask)];
+				std::uint8_t v = c.load(std::memory_order_relaxed);
+				if (v < SKETCH_MAX) {
+					c.store(v + 1, std::memory_order_relaxed);
+				}
+			}
+
+			if (++samples >= 10 * (mask + 1)) {
+				samples = 0;
+				age();
+			}
+		}
 	}
 
-	String to_string() const {
-		LHF_PARALLEL(ReadLock m(mutex);)
-		std::stringstream s;
+	/**
+	 * @brief      Decides whether a new key is stored, and picks the entry it
+	 *             replaces if the cache is full.
+	 *
+	 * @param[in]  key    The new key
+	 * @param[in]  erase  Called with the evicted key, to remove it from the
+	 *                    map.
+	 *
+	 * @return     `true` if the key should be inserted.
+	 */
+	template<typename Erase>
+	bool admit(const Key &key, Erase erase) {
+		std::lock_guard<std::mutex> m(mutex);
 
-		for (auto i : data) {
-			s << "      {" << i.first << " -> " << i.second << "} \n";
+		if (slots.size() < capacity) {
+			slots.push_back(key);
+			return true;
 		}
 
-		return s.str();
+		// Skip entries that were accessed since the hand last passed them, at
+		// most one revolution.
+		for (Size i = 0; i < capacity; i++) {
+			if (!referenced[mix(slots[hand], 0) & mask].exchange(false, std::memory_order_relaxed)) {
+				break;
+			}
+			hand = (hand + 1) % capacity;
+		}
+
+		if (policy == CachePolicy::TINYLFU && frequency(key) < frequency(slots[hand])) {
+			rejections++;
+			return false;
+		}
+
+		erase(slots[hand]);
+		evictions++;
+		slots[hand] = key;
+		hand = (hand + 1) % capacity;
+		return true;
 	}
 
-};
+	void clear() {
+		std::lock_guard<std::mutex> m(mutex);
+		slots.clear();
+		hand = 0;
+	}
 
-#endif
+	/**
+	 * @brief      Drops the slots of the keys for which `pred` holds (such as
+	 *             keys that were erased from the map), so that they no longer
+	 *             count against the capacity.
+	 */
+	template<typename Predicate>
+	void forget(Predicate pred) {
+		std::lock_guard<std::mutex> m(mutex);
+		slots.erase(std::remove_if(slots.begin(), slots.end(), pred), slots.end());
+		hand = slots.empty() ? 0 : hand % slots.size();
+	}
 
+	CacheStats stats(Size size) {
+		std::lock_guard<std::mutex> m(mutex);
+		return {size, capacity, evictions, rejections};
+	}
+};
 
 /**
- * @def        InternalMap
- * @brief      Convenience declaration for using simple maps in LHF.
+ * @brief      A hash map that grows without rehashing all of its entries at
+ *             once. When the table is about to exceed its load factor, it
+ *             becomes the "old" table and a new table with twice the
+ *             capacity is allocated. Every subsequent write then moves
+ *             `LHF_INCREMENTAL_REHASH_STEP` entries of the old table to the
+ *             new one (relinking the nodes without copying them), and
+ *             lookups check both tables until the migration is done. The new
+ *             table has room for all entries of the old table plus one
+ *             insertion per migration step, so it never rehashes during a
+ *             migration.
+ *
+ *             It implements the subset of the `std::unordered_map` interface
+ *             used by `MapAdapter`. Lookups never modify the table.
  */
+template<
+	typename K, typename V,
+	typename Hash = DefaultHash<K>,
+	typename Equal = DefaultEqual<K>,
+	typename Allocator = std::allocator<std::pair<const K, V>>>
+class IncrementalHashMap {
+public:
+	using Table = std::unordered_map<K, V, Hash, Equal, Allocator>;
+	using key_type = K;
+	using mapped_type = V;
+	using value_type = typename Table::value_type;
+	using allocator_type = Allocator;
 
-#ifdef LHF_ENABLE_TBB
+	/**
+	 * @brief      Iterates over the new table, then the old one.
+	 */
+	template<typename Map, typename It>
+	class Iterator {
+		friend class IncrementalHashMap;
+
+		Map *map;
+		It it;
+		bool in_old;
+
+		void skip_to_old() {
+			if (!in_old && it == map->current.end()) {
+				in_old = true;
+				it = map->old.begin();
+			}
+		}
 
-template<typename K, typename V>
-using InternalMap = MapAdapter<tbb::concurrent_hash_map<K, V>>;
+	public:
+		Iterator(Map *map, It it, bool in_old): map(map), it(it), in_old(in_old) {
+			skip_to_old();
+		}
 
-#else
+		auto &operator*() const {
+			return *it;
+		}
 
-template<typename K, typename V>
-using InternalMap = MapAdapter<HashMap<K, V>>;
+		auto *operator->() const {
+			return &*it;
+		}
 
-#endif
+		Iterator &operator++() {
+			++it;
+			skip_to_old();
+			return *this;
+		}
 
-/**
- * Defines the map of operations in LHF. Template parameter can be used to set
- * an operation of any arity.
- */
-template<typename T>
-using OperationMap =  InternalMap<T, IndexValue>;
+		bool operator==(const Iterator &b) const {
+			return in_old == b.in_old && it == b.it;
+		}
 
-/**
- * @brief      Operation performance Statistics.
- */
-struct OperationPerf {
-	/// Number of direct hits (operation pair in map)
-	size_t hits = 0;
+		bool operator!=(const Iterator &b) const {
+			return !(*this == b);
+		}
+	};
 
-	/// Number of equal hits (both arguments consist of the same set)
-	size_t equal_hits = 0;
+	using iterator = Iterator<IncrementalHashMap, typename Table::iterator>;
+	using const_iterator = Iterator<const IncrementalHashMap, typename Table::const_iterator>;
 
-	/// Number of subset hits (operation pair not in but resolvable using
-	/// subset relation)
-	size_t subset_hits = 0;
+protected:
+	Table current;
+	Table old;
 
-	/// Number of empty hits (operation is optimised because at least one of
-	/// the sets is empty)
-	size_t empty_hits = 0;
+	void migrate_step() {
+		for (Size i = 0; i < LHF_INCREMENTAL_REHASH_STEP && !old.empty(); i++) {
+			current.insert(old.extract(old.begin()));
+		}
 
-	/// Number of cold misses (operation pair not in map, and neither
-	/// resultant set in map. Neither node in lattice exists, nor the edges)
-	size_t cold_misses = 0;
+		// Free the bucket array of the old table.
+		if (old.empty()) {
+			Table(old.get_allocator()).swap(old);
+		}
+	}
 
-	/// Number of edge misses (operation pair not in map, but resultant set
-	/// in map. Node in lattice exists, but not the edges)
-	size_t edge_misses = 0;
+	void finish_migration() {
+		while (!old.empty()) {
+			migrate_step();
+		}
+	}
 
-	String to_string() const {
-		std::stringstream s;
-		s << "      " << "Hits       : " << hits << "\n"
-		  << "      " << "Equal Hits : " << equal_hits << "\n"
-		  << "      " << "Subset Hits: " << subset_hits << "\n"
-		  << "      " << "Empty Hits : " << empty_hits << "\n"
-		  << "      " << "Cold Misses: " << cold_misses << "\n"
-		  << "      " << "Edge Misses: " << edge_misses << "\n";
-		return s.str();
+	/// Starts a migration if the next insertion could make the new table
+	/// rehash.
+	void grow_if_needed() {
+		if (current.size() + 1 <= current.bucket_count() * current.max_load_factor()) {
+			return;
+		}
+
+		finish_migration();
+		old.swap(current);
+		current.reserve(std::max<Size>(2 * old.size(), 16));
 	}
-};
 
-/**
- * @def        LHF_PERF_INC(__oper, __category)
- * @brief      Increments the invocation count of the given category and operator.
- *
- * @note       Conditionally enabled if `LHF_ENABLE_PERFORMANCE_METRICS` is set.
- *
- * @param      __oper      The operator (e.g. `unions`)
- * @param      __category  The category (e.g. `hits`)
- */
+public:
+	IncrementalHashMap() = default;
 
-#ifdef LHF_ENABLE_PERFORMANCE_METRICS
-#define LHF_PERF_INC(__oper, __category) (perf[__LHF_STR(__oper)] . __category ++)
-#else
-#define LHF_PERF_INC(__oper, __category)
-#endif
+	explicit IncrementalHashMap(const Allocator &allocator):
+		current(allocator), old(allocator) {}
 
-template <typename T>
-struct LHFConfig {
-	static constexpr const char* name = "";
+	iterator begin() {
+		return iterator(this, current.begin(), false);
+	}
 
-	using PropertyT          = T;
-	using PropertyLess       = DefaultLess<PropertyT>;
-	using PropertyHash       = DefaultHash<PropertyT>;
-	using PropertyEqual      = DefaultEqual<PropertyT>;
-	using PropertyPrinter    = DefaultPrinter<PropertyT>;
+	iterator end() {
+		return iterator(this, old.end(), true);
+	}
 
-	static constexpr Size BLOCK_SHIFT = LHF_DEFAULT_BLOCK_SHIFT;
-	static constexpr Size BLOCK_SIZE  = LHF_DEFAULT_BLOCK_SIZE;
-	static constexpr Size BLOCK_MASK  = LHF_DEFAULT_BLOCK_MASK;
-};
+	const_iterator begin() const {
+		return const_iterator(this, current.begin(), false);
+	}
 
-/**
- * @brief      The main LatticeHashForest structure.
- *             This class can be used as-is with a type or derived for
- *             additional functionality as needed
- *
- *
- * @tparam     PropertyT      The type of the property.
- *                            The property type must satisfy the following:
- *                            * It must be hashable with std::hash
- *                            * It must be less-than comparable
- *                            * It can be checked for equality
+	const_iterator end() const {
+		return const_iterator(this, old.end(), true);
+	}
+
+	iterator find(const K &key) {
+		auto i = current.find(key);
+		if (i != current.end()) {
+			return iterator(this, i, false);
+		}
+		return iterator(this, old.find(key), true);
+	}
+
+	const_iterator find(const K &key) const {
+		auto i = current.find(key);
+		if (i != current.end()) {
+			return const_iterator(this, i, false);
+		}
+		return const_iterator(this, old.find(key), true);
+	}
+
+	Size count(const K &key) const {
+		return current.count(key) + old.count(key);
+	}
+
+	/// Inserts `v` unless its key is present. Returns whether it was
+	/// inserted.
+	bool insert(value_type &&v) {
+		if (!old.empty()) {
+			migrate_step();
+			if (old.count(v.first)) {
+				return false;
+			}
+		}
+
+		grow_if_needed();
+		return current.insert(std::move(v)).second;
+	}
+
+	Size erase(const K &key) {
+		if (!old.empty()) {
+			migrate_step();
+		}
+		return current.erase(key) + old.erase(key);
+	}
+
+	iterator erase(iterator i) {
+		if (i.in_old) {
+			return iterator(this, old.erase(i.it), true);
+		}
+		return iterator(this, current.erase(i.it), false);
+	}
+
+	void clear() {
+		current.clear();
+		old.clear();
+	}
+
+	/// Makes room for `n` entries, finishing any migration first.
+	void reserve(Size n) {
+		finish_migration();
+		current.reserve(n);
+	}
+
+	void swap(IncrementalHashMap &b) {
+		current.swap(b.current);
+		old.swap(b.old);
+	}
+
+	Size size() const {
+		return current.size() + old.size();
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	Size bucket_count() const {
+		return current.bucket_count() + old.bucket_count();
+	}
+
+	/// Whether entries are still being moved out of the old table.
+	bool is_migrating() const {
+		return !old.empty();
+	}
+
+	allocator_type get_allocator() const {
+		return current.get_allocator();
+	}
+};
+
+/**
+ * @def        MapAdapter
+ * @brief      Enables the interface used by LHF for using a map data structure
+ *             for any given map implementation. This preprocessor if-ladder
+ *             should be expanded as needed for any newer implementations.
  *
- * @tparam     PropertyLess     Custom less-than comparator (if required)
- * @tparam     PropertyHash     Custom hasher (if required)
- * @tparam     PropertyEqual    Custom equality comaparator (if required)
- * @tparam     PropertyPrinter  PropertyT string representation generator
- * @tparam     NestingT         Nesting behaviour of the LHF
+ * @tparam     MapClass The Map implementation to adapt.
  */
-template <
-	typename Config,
-	typename NestingT = NestingNone<typename Config::PropertyT>>
-class LatticeHashForest {
+
+#ifdef LHF_ENABLE_TBB
+
+template<typename MapClass>
+class MapAdapter {
 public:
-	using PropertyT          = typename Config::PropertyT;
-	using PropertyLess       = typename Config::PropertyLess;
-	using PropertyHash       = typename Config::PropertyHash;
-	using PropertyEqual      = typename Config::PropertyEqual;
-	using PropertyPrinter    = typename Config::PropertyPrinter;
-	using Nesting            = NestingT;
+	using Map = MapClass;
+	using Key = typename Map::key_type;
+	using MappedType = typename Map::mapped_type;
+	using KeyValuePair = typename Map::value_type;
+
+	/// Estimated size of an entry: the key-value pair, plus the next pointer
+	/// and lock of its node.
+	static constexpr Size ENTRY_BYTES = sizeof(KeyValuePair) + 2 * sizeof(void *);
+
+protected:
+	using Accessor = typename Map::const_accessor;
+	Map data;
+	UniquePointer<CacheBound<Key>> bound = nullptr;
+
+	// Traversing a concurrent_hash_map is not safe while entries are added
+	// or removed, or while lookups rehash buckets. `for_each()` takes
+	// `traversal` exclusively, raises `traversing` and waits for the
+	// accesses in flight. These are counted on a stripe picked by the
+	// thread, so that they do not contend on a counter, and take
+	// `traversal` shared only while `traversing` is raised.
+	static constexpr Size WRITER_STRIPES = 16;
+
+	struct alignas(64) WriterStripe {
+		std::atomic<Size> count = 0;
+	};
+
+	mutable std::shared_mutex traversal;
+	mutable std::atomic<bool> traversing = false;
+	mutable WriterStripe writers[WRITER_STRIPES];
+
+	static Size writer_stripe() {
+		thread_local Size stripe =
+			std::hash<std::thread::id>()(std::this_thread::get_id()) % WRITER_STRIPES;
+		return stripe;
+	}
+
+	/// Runs `f`, which accesses `data`, so that it does not overlap with a
+	/// traversal.
+	template<typename F>
+	auto access(F f) const {
+		if (!traversing) {
+			std::atomic<Size> &count = writers[writer_stripe()].count;
+			count++;
+			if (!traversing) {
+				struct Done {
+					std::atomic<Size> &count;
+					~Done() { count--; }
+				} done{count};
+				return f();
+			}
+			count--;
+		}
+
+		std::shared_lock<std::shared_mutex> t(traversal);
+		return f();
+	}
+
+	/// Estimated size of the bucket array (a lock and a node pointer per
+	/// bucket).
+	Size bucket_bytes() const {
+		return data.bucket_count() * 2 * sizeof(void *);
+	}
+
+public:
+	MapAdapter() = default;
+
+	explicit MapAdapter(const typename Map::allocator_type &allocator): data(allocator) {}
+
+	Optional<MappedType> find(const Key &key) const {
+		if (bound) {
+			bound->record_access(key);
+		}
+
+		return access([this, &key]() {
+			Accessor acc;
+			bool found = data.find(acc, key);
+			if (!found) {
+				return Optional<MappedType>::absent();
+			} else {
+				return Optional<MappedType>(acc->second);
+			}
+		});
+	}
+
+	void insert(KeyValuePair &&v) {
+		access([this, &v]() {
+			Key key = v.first;
+			// Only a key that was not present takes a slot of the bound, so
+			// that racing insertions of the same entry are admitted once.
+			if (data.insert(std::move(v)) && bound &&
+			    !bound->admit(key, [this](const Key &k) { data.erase(k); })) {
+				data.erase(key);
+			}
+		});
+	}
+
+	void erase(const Key &key) {
+		access([this, &key]() {
+			data.erase(key);
+		});
+	}
+
+	/**
+	 * @brief      Calls `f(key, value)` for every entry. Other accesses
+	 *             wait until it returns.
+	 */
+	template<typename F>
+	void for_each(F f) const {
+		std::lock_guard<std::shared_mutex> t(traversal);
+		traversing = true;
+		for (const WriterStripe &w : writers) {
+			while (w.count > 0) {
+				std::this_thread::yield();
+			}
+		}
+
+		struct Lower {
+			std::atomic<bool> &traversing;
+			~Lower() { traversing = false; }
+		} lower{traversing};
+
+		for (const auto &i : data) {
+			f(i.first, i.second);
+		}
+	}
+
+	void clear() {
+		data.clear();
+		if (bound) {
+			bound->clear();
+		}
+	}
+
+	/**
+	 * @brief      Removes the entries for which `pred(key, value)` holds.
+	 *
+	 * @note       This must not run concurrently with other operations on
+	 *             the map.
+	 *
+	 * @return     Number of entries removed.
+	 */
+	template<typename Predicate>
+	Size erase_if(Predicate pred) {
+		Vector<Key> keys;
+		for (const auto &i : data) {
+			if (pred(i.first, i.second)) {
+				keys.push_back(i.first);
+			}
+		}
+
+		for (const Key &k : keys) {
+			data.erase(k);
+		}
+
+		if (bound && !keys.empty()) {
+			bound->forget([this](const Key &k) { return data.count(k) == 0; });
+		}
+
+		return keys.size();
+	}
+
+	/**
+	 * @brief      Removes all entries and frees the bucket array as well,
+	 *             which `clear()` keeps.
+	 *
+	 * @note       This must not run concurrently with other operations on
+	 *             the map.
+	 *
+	 * @return     Estimated number of bytes freed.
+	 */
+	Size release() {
+		Size bytes = data.size() * ENTRY_BYTES + bucket_bytes();
+		Map empty(data.get_allocator());
+		data.swap(empty);
+		if (bound) {
+			bound->clear();
+		}
+		return bytes - bucket_bytes();
+	}
+
+	/**
+	 * @brief      Limits the map to `capacity` entries, evicting entries
+	 *             according to `policy` (see `CachePolicy`). 0 removes the
+	 *             limit. Existing entries beyond the capacity are dropped.
+	 *
+	 * @note       This must not run concurrently with other operations on
+	 *             the map.
+	 */
+	void set_capacity(Size capacity, CachePolicy policy = CachePolicy::CLOCK) {
+		bound.reset(capacity ? new CacheBound<Key>(capacity, policy) : nullptr);
+		if (bound) {
+			Vector<Key> keys;
+			for (const auto &i : data) {
+				keys.push_back(i.first);
+			}
+			for (const Key &k : keys) {
+				bound->admit(k, [this](const Key &victim) { data.erase(victim); });
+			}
+		}
+	}
+
+	CacheStats get_cache_stats() const {
+		return bound ? bound->stats(data.size()) : CacheStats{data.size()};
+	}
+
+	/**
+	 * @brief      Makes room for `n` entries without growing the table.
+	 *
+	 * @note       This must not run concurrently with other operations on
+	 *             the map.
+	 */
+	void reserve(Size n) {
+		data.rehash(n);
+	}
+
+	MapMemoryUsage memory() const {
+		return {data.size(), data.size() * ENTRY_BYTES, bucket_bytes()};
+	}
+
+	Size size() const {
+		return data.size();
+	}
+
+	typename Map::const_iterator begin() const {
+		return data.begin();
+	}
+
+	typename Map::const_iterator end() const {
+		return data.end();
+	}
+
+	String to_string() const {
+		std::stringstream s;
+
+		for (auto i : data) {
+			s << "      {" << i.first << " -> " << i.second << "} \n";
+		}
+
+		return s.str();
+	}
+
+};
+
+#else
+
+template<typename MapClass>
+class MapAdapter {
+public:
+	using Map = MapClass;
+	using Key = typename Map::key_type;
+	using MappedType = typename Map::mapped_type;
+	using KeyValuePair = typename Map::value_type;
+
+	/// Estimated size of an entry: the key-value pair, plus the next pointer
+	/// and cached hash of its node.
+	static constexpr Size ENTRY_BYTES = sizeof(KeyValuePair) + 2 * sizeof(void *);
+
+protected:
+	Map data;
+	UniquePointer<CacheBound<Key>> bound = nullptr;
+	LHF_PARALLEL(mutable RWMutex mutex;)
+
+public:
+	MapAdapter() = default;
+
+	explicit MapAdapter(const typename Map::allocator_type &allocator): data(allocator) {}
+
+	Optional<MappedType> find(const Key &key) const {
+		LHF_PARALLEL(ReadLock m(mutex);)
+		if (bound) {
+			bound->record_access(key);
+		}
+
+		auto value = data.find(key);
+		if (value == data.end()) {
+			return Optional<MappedType>::absent();
+		} else {
+			return value->second;
+		}
+	}
+
+	void insert(KeyValuePair &&v) {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		// A key that is already present keeps its slot of the bound.
+		if (data.count(v.first) > 0) {
+			return;
+		}
+		if (bound && !bound->admit(v.first, [this](const Key &k) { data.erase(k); })) {
+			return;
+		}
+		data.insert(std::move(v));
+	}
+
+	/**
+	 * @brief      Calls `f(key, value)` for every entry. Insertions wait
+	 *             until it returns, lookups do not.
+	 */
+	template<typename F>
+	void for_each(F f) const {
+		LHF_PARALLEL(ReadLock m(mutex);)
+		for (const auto &i : data) {
+			f(i.first, i.second);
+		}
+	}
+
+	void erase(const Key &key) {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		data.erase(key);
+	}
+
+	void clear() {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		data.clear();
+		if (bound) {
+			bound->clear();
+		}
+	}
+
+	/**
+	 * @brief      Removes the entries for which `pred(key, value)` holds.
+	 *
+	 * @return     Number of entries removed.
+	 */
+	template<typename Predicate>
+	Size erase_if(Predicate pred) {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		Size count = 0;
+		for (auto i = data.begin(); i != data.end();) {
+			if (pred(i->first, i->second)) {
+				i = data.erase(i);
+				count++;
+			} else {
+				++i;
+			}
+		}
+
+		if (bound && count > 0) {
+			bound->forget([this](const Key &k) { return data.count(k) == 0; });
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief      Removes all entries and frees the bucket array as well,
+	 *             which `clear()` keeps.
+	 *
+	 * @return     Estimated number of bytes freed.
+	 */
+	Size release() {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		Size bytes = data.size() * ENTRY_BYTES + data.bucket_count() * sizeof(void *);
+		Map empty(data.get_allocator());
+		data.swap(empty);
+		if (bound) {
+			bound->clear();
+		}
+		return bytes - data.bucket_count() * sizeof(void *);
+	}
+
+	/**
+	 * @brief      Limits the map to `capacity` entries, evicting entries
+	 *             according to `policy` (see `CachePolicy`). 0 removes the
+	 *             limit. Existing entries beyond the capacity are dropped.
+	 */
+	void set_capacity(Size capacity, CachePolicy policy = CachePolicy::CLOCK) {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		bound.reset(capacity ? new CacheBound<Key>(capacity, policy) : nullptr);
+		if (bound) {
+			Vector<Key> keys;
+			for (const auto &i : data) {
+				keys.push_back(i.first);
+			}
+			for (const Key &k : keys) {
+				bound->admit(k, [this](const Key &victim) { data.erase(victim); });
+			}
+		}
+	}
+
+	CacheStats get_cache_stats() const {
+		LHF_PARALLEL(ReadLock m(mutex);)
+		return bound ? bound->stats(data.size()) : CacheStats{data.size()};
+	}
+
+	/// Makes room for `n` entries without growing the table.
+	void reserve(Size n) {
+		LHF_PARALLEL(WriteLock m(mutex);)
+		data.reserve(n);
+	}
+
+	MapMemoryUsage memory() const {
+		LHF_PARALLEL(ReadLock m(mutex);)
+		return {
+			data.size(),
+			data.size() * ENTRY_BYTES,
+			data.bucket_count() * sizeof(void *)
+		};
+	}
+
+	Size size() const {
+		LHF_PARALLEL(ReadLock m(mutex);)
+		return data.size();
+	}
+
+	typename Map::const_iterator begin() const {
+		return data.begin();
+	}
+
+	typename Map::const_iterator end() const {
+		return data.end();
+	}
+
+	String to_string() const {
+		LHF_PARALLEL(ReadLock m(mutex);)
+		std::stringstream s;
+
+		for (auto i : data) {
+			s << "      {" << i.first << " -> " << i.second << "} \n";
+		}
+
+		return s.str();
+	}
+
+};
+
+#endif
+
+
+/**
+ * @def        InternalMap
+ * @brief      Convenience declaration for using simple maps in LHF.
+ */
+
+#ifdef LHF_ENABLE_TBB
+
+template<typename K, typename V, typename Allocator = DefaultAllocator>
+using InternalMap = MapAdapter<tbb::concurrent_hash_map<
+	K, V,
+	tbb::tbb_hash_compare<K>,
+	RebindAllocator<Allocator, std::pair<const K, V>>>>;
+
+#elif defined(LHF_ENABLE_INCREMENTAL_REHASH)
+
+template<typename K, typename V, typename Allocator = DefaultAllocator>
+using InternalMap = MapAdapter<IncrementalHashMap<
+	K, V,
+	DefaultHash<K>,
+	DefaultEqual<K>,
+	RebindAllocator<Allocator, std::pair<const K, V>>>>;
+
+#else
+
+template<typename K, typename V, typename Allocator = DefaultAllocator>
+using InternalMap = MapAdapter<std::unordered_map<
+	K, V,
+	DefaultHash<K>,
+	DefaultEqual<K>,
+	RebindAllocator<Allocator, std::pair<const K, V>>>>;
+
+#endif
+
+/**
+ * Defines the map of operations in LHF. Template parameter can be used to set
+ * an operation of any arity.
+ */
+template<typename T, typename Allocator = DefaultAllocator>
+using OperationMap =  InternalMap<T, IndexValue, Allocator>;
+
+/**
+ * @brief      An immutable open-addressing hash table keyed by operand pairs.
+ *             It is built once from an `InternalMap` that has stopped
+ *             changing, and lookups probe a flat array (linear probing, load
+ *             factor at most 1/2) without taking any locks.
+ *
+ * @tparam     V     The mapped type.
+ */
+template<typename V>
+class FlatOperationMap {
+public:
+	struct Slot {
+		OperationNode key;
+		V value;
+	};
+
+	static constexpr IndexValue EMPTY_SLOT = std::numeric_limits<IndexValue>::max();
+
+	/// The operands are small, dense integers, so they are mixed
+	/// (splitmix64 finalizer) instead of using `std::hash<OperationNode>`.
+	static Size slot_hash(const OperationNode &k) {
+		std::uint64_t h = compose_hash(k.left, k.right);
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+		return h;
+	}
+
+	/**
+	 * @brief      Lookups over slots owned elsewhere, such as the slots of a
+	 *             mapped snapshot (see `LatticeHashForest::MappedSnapshot`).
+	 */
+	class View {
+	protected:
+		const Slot *slots = nullptr;
+		Size capacity = 0;
+		Size count = 0;
+
+	public:
+		View() = default;
+
+		/// `capacity` must be 0 or a power of two.
+		View(const Slot *slots, Size capacity, Size count):
+			slots(slots), capacity(capacity), count(count) {}
+
+		Optional<V> find(const OperationNode &key) const {
+			if (capacity == 0) {
+				return Optional<V>::absent();
+			}
+
+			Size mask = capacity - 1;
+			for (Size h = slot_hash(key) & mask;; h = (h + 1) & mask) {
+				const Slot &slot = slots[h];
+				if (slot.key == key) {
+					return slot.value;
+				} else if (slot.key.left == EMPTY_SLOT) {
+					return Optional<V>::absent();
+				}
+			}
+		}
+
+		Size size() const {
+			return count;
+		}
+
+		/// Number of slots (a power of two).
+		Size slot_count() const {
+			return capacity;
+		}
+
+		/// Calls `f(key, value)` for every entry in the slots `[first, last)`.
+		template<typename F>
+		void for_each(Size first, Size last, F f) const {
+			for (Size i = first; i < last; i++) {
+				if (slots[i].key.left != EMPTY_SLOT) {
+					f(slots[i].key, slots[i].value);
+				}
+			}
+		}
+
+		/// Calls `f(key, value)` for every entry.
+		template<typename F>
+		void for_each(F f) const {
+			for_each(0, capacity, f);
+		}
+	};
+
+protected:
+	Vector<Slot> slots = {};
+	Size count = 0;
+
+public:
+	FlatOperationMap() = default;
+
+	template<typename Map>
+	explicit FlatOperationMap(const Map &map) {
+		Size capacity = 1;
+		while (capacity < map.size() * 2) {
+			capacity <<= 1;
+		}
+
+		slots.assign(capacity, Slot{{EMPTY_SLOT, EMPTY_SLOT}, V{}});
+		Size mask = capacity - 1;
+
+		for (const auto &i : map) {
+			Size h = slot_hash(i.first) & mask;
+			while (slots[h].key.left != EMPTY_SLOT) {
+				h = (h + 1) & mask;
+			}
+			slots[h] = Slot{i.first, i.second};
+			count++;
+		}
+	}
+
+	View view() const {
+		return View(slots.data(), slots.size(), count);
+	}
+
+	Optional<V> find(const OperationNode &key) const {
+		return view().find(key);
+	}
+
+	Size size() const {
+		return count;
+	}
+
+	/// The slot array, whose size is a power of two.
+	const Vector<Slot> &get_slots() const {
+		return slots;
+	}
+};
+
+/**
+ * @brief      Operation performance Statistics.
+ */
+struct OperationPerf {
+	/// Number of direct hits (operation pair in map)
+	size_t hits = 0;
+
+	/// Number of equal hits (both arguments consist of the same set)
+	size_t equal_hits = 0;
+
+	/// Number of subset hits (operation pair not in but resolvable using
+	/// subset relation)
+	size_t subset_hits = 0;
+
+	/// Number of empty hits (operation is optimised because at least one of
+	/// the sets is empty)
+	size_t empty_hits = 0;
+
+	/// Number of cold misses (operation pair not in map, and neither
+	/// resultant set in map. Neither node in lattice exists, nor the edges)
+	size_t cold_misses = 0;
+
+	/// Number of edge misses (operation pair not in map, but resultant set
+	/// in map. Node in lattice exists, but not the edges)
+	size_t edge_misses = 0;
+
+	/**
+	 * @brief      Adds `n` to the counter for `category` (e.g. "hits").
+	 */
+	void add(const String &category, size_t n) {
+		if (category == "hits") {
+			hits += n;
+		} else if (category == "equal_hits") {
+			equal_hits += n;
+		} else if (category == "subset_hits") {
+			subset_hits += n;
+		} else if (category == "empty_hits") {
+			empty_hits += n;
+		} else if (category == "cold_misses") {
+			cold_misses += n;
+		} else if (category == "edge_misses") {
+			edge_misses += n;
+		}
+	}
+
+	String to_string() const {
+		std::stringstream s;
+		s << "      " << "Hits       : " << hits << "\n"
+		  << "      " << "Equal Hits : " << equal_hits << "\n"
+		  << "      " << "Subset Hits: " << subset_hits << "\n"
+		  << "      " << "Empty Hits : " << empty_hits << "\n"
+		  << "      " << "Cold Misses: " << cold_misses << "\n"
+		  << "      " << "Edge Misses: " << edge_misses << "\n";
+		return s.str();
+	}
+};
+
+/**
+ * @def        LHF_PERF_INC(__oper, __category)
+ * @brief      Increments the invocation count of the given category and operator.
+ *             The count is kept in a profiler counter named
+ *             `"<operator>.<category>"`.
+ *
+ * @note       Conditionally enabled if `LHF_ENABLE_PERFORMANCE_METRICS` is set.
+ *
+ * @param      __oper      The operator (e.g. `unions`)
+ * @param      __category  The category (e.g. `hits`)
+ */
+
+#ifdef LHF_ENABLE_PERFORMANCE_METRICS
+#define LHF_PERF_INC(__oper, __category) \
+	(stat.inc_counter(__lhf_profile_key(__LHF_STR(__oper) "." __LHF_STR(__category))))
+#else
+#define LHF_PERF_INC(__oper, __category)
+#endif
+
+template <typename T>
+struct LHFConfig {
+	static constexpr const char* name = "";
+
+	using PropertyT          = T;
+	using PropertyLess       = DefaultLess<PropertyT>;
+	using PropertyHash       = DefaultHash<PropertyT>;
+	using PropertyEqual      = DefaultEqual<PropertyT>;
+	using PropertyPrinter    = DefaultPrinter<PropertyT>;
+
+	static constexpr Size BLOCK_SHIFT = LHF_DEFAULT_BLOCK_SHIFT;
+	static constexpr Size BLOCK_SIZE  = LHF_DEFAULT_BLOCK_SIZE;
+	static constexpr Size BLOCK_MASK  = LHF_DEFAULT_BLOCK_MASK;
+
+	static constexpr Size PARALLEL_MERGE_THRESHOLD = LHF_DEFAULT_PARALLEL_MERGE_THRESHOLD;
+
+	static constexpr Size EVICTION_MEMORY_BUDGET = LHF_DEFAULT_EVICTION_MEMORY_BUDGET;
+
+	static constexpr Size OPERATION_CACHE_CAPACITY = LHF_DEFAULT_OPERATION_CACHE_CAPACITY;
+	static constexpr CachePolicy OPERATION_CACHE_POLICY = CachePolicy::TINYLFU;
+
+	/// Allocator for all sets and internal containers of the LHF, given for
+	/// `std::byte`. An instance can be passed to the constructor.
+	using Allocator = DefaultAllocator;
+};
+
+/**
+ * @brief      Configuration that allocates from a `std::pmr::memory_resource`
+ *             passed to the constructor of the LHF (e.g. a
+ *             `std::pmr::monotonic_buffer_resource`).
+ */
+template <typename T>
+struct PmrLHFConfig : LHFConfig<T> {
+	using Allocator = std::pmr::polymorphic_allocator<std::byte>;
+};
+
+/**
+ * @brief      Configuration that backs large arrays (the set storage and the
+ *             bucket arrays of large hash tables) with transparent huge pages
+ *             (see `HugePageAllocator`).
+ */
+template <typename T>
+struct HugePageLHFConfig : LHFConfig<T> {
+	using Allocator = HugePageAllocator<std::byte>;
+};
+
+/**
+ * @brief      The main LatticeHashForest structure.
+ *             This class can be used as-is with a type or derived for
+ *             additional functionality as needed
+ *
+ *
+ * @tparam     PropertyT      The type of the property.
+ *                            The property type must satisfy the following:
+ *                            * It must be hashable with std::hash
+ *                            * It must be less-than comparable
+ *                            * It can be checked for equality
+ *
+ * @tparam     PropertyLess     Custom less-than comparator (if required)
+ * @tparam     PropertyHash     Custom hasher (if required)
+ * @tparam     PropertyEqual    Custom equality comaparator (if required)
+ * @tparam     PropertyPrinter  PropertyT string representation generator
+ * @tparam     NestingT         Nesting behaviour of the LHF
+ */
+template <
+	typename Config,
+	typename NestingT = NestingNone<typename Config::PropertyT>>
+class LatticeHashForest {
+public:
+	using PropertyT          = typename Config::PropertyT;
+	using PropertyLess       = typename Config::PropertyLess;
+	using PropertyHash       = typename Config::PropertyHash;
+	using PropertyEqual      = typename Config::PropertyEqual;
+	using PropertyPrinter    = typename Config::PropertyPrinter;
+	using Nesting            = NestingT;
+
+	static constexpr const char *name = Config::name;
+	static constexpr Size BLOCK_SIZE = Config::BLOCK_SIZE;
+	static constexpr Size BLOCK_MASK = Config::BLOCK_MASK;
+	static constexpr Size BLOCK_SHIFT = Config::BLOCK_SHIFT;
+	static constexpr Size PARALLEL_MERGE_THRESHOLD = Config::PARALLEL_MERGE_THRESHOLD;
+
+	using Allocator = typename Config::Allocator;
+
+	template<typename T>
+	using AllocatorFor = RebindAllocator<Allocator, T>;
+
+#ifdef LHF_ENABLE_EVICTION
+	static constexpr Size NOT_SPILLED = std::numeric_limits<Size>::max();
+#endif
+
+	/**
+	 * @brief      Index returned by an operation. Being defined inside the
+	 *             class ensures type safety and possible future extensions.
+	 */
+	struct Index {
+		IndexValue value;
+
+		Index(IndexValue idx = EMPTY_SET_VALUE): value(idx) {}
+
+		bool is_empty() const {
+			return value == EMPTY_SET_VALUE;
+		}
+
+		bool operator==(const Index &b) const {
+			return value == b.value;
+		}
+
+		bool operator!=(const Index &b) const {
+			return value != b.value;
+		}
+
+		bool operator<(const Index &b) const {
+			return value < b.value;
+		}
+
+		bool operator>(const Index &b) const {
+			return value > b.value;
+		}
+
+		String to_string() const {
+			return std::to_string(value);
+		}
+
+		friend std::ostream& operator<<(std::ostream& os, const Index& obj) {
+			os << obj.to_string();
+			return os;
+		}
+
+		struct Hash {
+			Size operator()(const Index &idx) const {
+				return DefaultHash<IndexValue>()(idx.value);
+			}
+		};
+	};
+
+	/**
+	 * The canonical element of property sets. Changes based on the nesting
+	 * behaviour supplied.
+	 */
+	using PropertyElement =
+		typename Nesting::template PropertyElement<
+			PropertyLess,
+			PropertyHash,
+			PropertyEqual,
+			PropertyPrinter>;
+
+	/**
+	 * The storage structure for property elements. Currently implemented as
+	 * sorted vectors.
+	 */
+	using PropertySet = std::vector<PropertyElement, AllocatorFor<PropertyElement>>;
+
+#ifdef LHF_ENABLE_EVICTION
+	/// Whether evicted sets can be written to a spill file (see
+	/// `enable_spill()`).
+	static constexpr bool SPILLABLE = std::is_trivially_copyable_v<PropertyElement>;
+#endif
+
+	/// Whether the LHF can be journaled (see `enable_journal()`).
+	static constexpr bool JOURNALABLE = std::is_trivially_copyable_v<PropertyElement>;
+
+	/// Whether snapshots can be delta-encoded (see `SnapshotEncoding`). The
+	/// child indices of nested LHFs are encoded along with the keys, so
+	/// unlike raw snapshots, this does not need trivially copyable elements.
+	static constexpr bool ENCODABLE = std::is_integral_v<PropertyT>;
+
+	using PropertySetHash =
+		SetHash<
+			PropertySet,
+			PropertyElement,
+			typename PropertyElement::Hash>;
+
+	using PropertySetFullEqual =
+		SetEqual<
+			PropertySet,
+			PropertyElement,
+			typename PropertyElement::FullEqual>;
+
+	/**
+	 * The structure responsible for mapping property sets to their respective
+	 * unique indices. When a key-value pair is actually inserted into the map,
+	 * the key is a pointer to a valid storage location held by a member of
+	 * the property set storage vector.
+	 *
+	 * @note The reason the 'key type' of the map is a pointer to a property set
+	 *       is because of several reasons:
+	 *
+	 *       * Allows us to query arbitrary/user created property sets on the
+	 *         map.
+	 *       * Makes it not necessary to actually directly store the property
+	 *         set as a key.
+	 *       * Saves us from having to do some sort of complicated manuever to
+	 *         reserve an index value temporarily and rewrite the hash and
+	 *         equality comparators to retrieve the property sets from the
+	 *         indices instead.
+	 *
+	 *       Careful handling, especially in the case of reallocating structures
+	 *       like vectors is needed so that the address of the data does not
+	 *       change. It must remain static for the duration of the existence of
+	 *       the LHF instance.
+	 */
+#ifdef LHF_ENABLE_TBB
+	using PropertySetMap =
+		MapAdapter<tbb::concurrent_hash_map<
+			const PropertySet *, IndexValue,
+			TBBHashCompare<
+				const PropertySet *,
+				PropertySetHash,
+				PropertySetFullEqual>,
+			AllocatorFor<std::pair<const PropertySet *const, IndexValue>>>>;
+#elif defined(LHF_ENABLE_INCREMENTAL_REHASH)
+	using PropertySetMap =
+		MapAdapter<IncrementalHashMap<
+			const PropertySet *, IndexValue,
+			PropertySetHash,
+			PropertySetFullEqual,
+			AllocatorFor<std::pair<const PropertySet *const, IndexValue>>>>;
+#else
+	using PropertySetMap =
+		MapAdapter<std::unordered_map<
+			const PropertySet *, IndexValue,
+			PropertySetHash,
+			PropertySetFullEqual,
+			AllocatorFor<std::pair<const PropertySet *const, IndexValue>>>>;
+#endif
+
+	using UnaryOperationMap = OperationMap<IndexValue, Allocator>;
+	using BinaryOperationMap = OperationMap<OperationNode, Allocator>;
+	using SubsetMap = InternalMap<OperationNode, SubsetRelation, Allocator>;
+	using RefList = typename Nesting::LHFReferenceList;
+
+protected:
+	RefList reflist;
+
+	Allocator allocator;
+
+#ifdef LHF_ENABLE_PERFORMANCE_METRICS
+	PerformanceStatistics stat;
+#endif
+
+	struct PropertySetHolder {
+		using PtrContainer = AllocatorPointer<PropertySet, Allocator>;
+		using Ptr = typename PtrContainer::pointer;
+
+		mutable PtrContainer ptr;
+
+#ifdef LHF_ENABLE_EVICTION
+		/// The operation that produced the set and its operands, used to
+		/// recompute the set after it has been evicted. `INSERT` marks sets
+		/// that were registered directly and cannot be recomputed.
+		OperationKind origin = OperationKind::INSERT;
+		IndexValue origin_left = EMPTY_SET_VALUE;
+		IndexValue origin_right = EMPTY_SET_VALUE;
+
+		/// Hashes of the contents, kept so that the set can be found again
+		/// while it is evicted.
+		Size hash = 0;
+		Size fingerprint = 0;
+
+		/// Offset of the contents in the spill file, if they were spilled.
+		Size spill_offset = NOT_SPILLED;
+
+		/// Access bit for the CLOCK sweeper.
+		mutable std::atomic<bool> referenced = true;
+#endif
+
+#ifdef LHF_ENABLE_ACCESS_COUNTS
+		/// Number of accesses, used by `reorganize()`.
+		mutable std::atomic<Size> accesses = 0;
+#endif
+
+		PropertySetHolder(PtrContainer &&p): ptr(std::move(p)) {}
+
+#if defined(LHF_ENABLE_EVICTION) || defined(LHF_ENABLE_ACCESS_COUNTS)
+		PropertySetHolder(PropertySetHolder &&h) noexcept:
+			ptr(std::move(h.ptr))
+#ifdef LHF_ENABLE_EVICTION
+			, origin(h.origin),
+			origin_left(h.origin_left),
+			origin_right(h.origin_right),
+			hash(h.hash),
+			fingerprint(h.fingerprint),
+			spill_offset(h.spill_offset),
+			referenced(h.referenced.load(std::memory_order_relaxed))
+#endif
+#ifdef LHF_ENABLE_ACCESS_COUNTS
+			, accesses(h.accesses.load(std::memory_order_relaxed))
+#endif
+			{}
+#endif
+
+		Ptr get() const {
+			return ptr.get();
+		}
+
+		bool is_evicted() const {
+#ifdef LHF_ENABLE_EVICTION
+			return ptr.get() == nullptr;
+#else
+			return false;
+#endif
+		}
+
+#ifdef LHF_ENABLE_EVICTION
+
+		bool is_recomputable() const {
+			return origin != OperationKind::INSERT;
+		}
+
+		bool is_spilled() const {
+			return spill_offset != NOT_SPILLED;
+		}
+
+		/// Approximate number of bytes held by the set.
+		Size payload_bytes() const {
+			if (is_evicted()) {
+				return 0;
+			}
+			return sizeof(PropertySet) + ptr->capacity() * sizeof(PropertyElement);
+		}
+
+		void evict() {
+			__LHF_ASSERT(!is_evicted(),
+				"Tried to evict an already absent property set")
+			ptr.reset();
+		}
+
+		/// All sets of an LHF come from the same allocator, so the deleter
+		/// of `ptr` (which some allocators cannot assign) is kept.
+		void reassign(PtrContainer &&p) {
+			__LHF_ASSERT(is_evicted(),
+				"Tried to reassign when a property set is already present");
+			ptr.reset(p.release());
+		}
+
+#endif
+	};
+
+#if defined(LHF_ENABLE_TBB)
+
+	class PropertySetStorage {
+	protected:
+		/// @note Not marking this as mutable will not allow us to get a
+		///       non-const reference on index-based access. Non-constness
+		//        is important for eviction to work.
+		mutable tbb::concurrent_vector<PropertySetHolder, AllocatorFor<PropertySetHolder>> data;
+
+	public:
+		explicit PropertySetStorage(const Allocator &allocator):
+			data(AllocatorFor<PropertySetHolder>(allocator)) {}
+
+		/**
+		 * @brief      Retuns a mutable reference to the property set holder at
+		 *             a given set index. This is useful for eviction based
+		 *             functions.
+		 *
+		 * @param[in]  idx   Set index
+		 *
+		 * @return     A mutable propety set holder reference.
+		 */
+		PropertySetHolder &at_mutable(const Index &idx) const {
+			return data.at(idx.value);
+		}
+
+		const PropertySetHolder &at(const Index &idx) const {
+			return data.at(idx.value);
+		}
+
+		Index push_back(PropertySetHolder &&p) {
+			auto it = data.push_back(std::move(p));
+			return it - data.begin();
+		}
+
+		void reserve(Size n) {
+			data.reserve(n);
+		}
+
+		void clear() {
+			data.clear();
+		}
+
+		Size size() const {
+			return data.size();
+		}
+
+		Size capacity() const {
+			return data.capacity();
+		}
+	};
+
+#elif defined(LHF_ENABLE_PARALLEL)
+
+	class PropertySetStorage {
+	protected:
+		/// @note Not marking this as mutable will not allow us to get a
+		///       non-const reference on index-based access. Non-constness
+		//        is important for eviction to work.
+		using Block = std::vector<PropertySetHolder, AllocatorFor<PropertySetHolder>>;
+
+		mutable std::vector<Block, AllocatorFor<Block>> data;
+
+		mutable RWMutex mutex;
+		mutable RWMutex realloc_mutex;
+
+		std::atomic<Size> total_elems = 0;
+		std::atomic<Size> block_base = 0;
+
+		void add_block() {
+			Block block(AllocatorFor<PropertySetHolder>(data.get_allocator()));
+			block.reserve(BLOCK_SIZE);
+			data.push_back(std::move(block));
+		}
+
+	public:
+		explicit PropertySetStorage(const Allocator &allocator):
+			data(AllocatorFor<Block>(allocator)) {
+			add_block();
+		}
+
+		/**
+		 * @brief      Retuns a mutable reference to the property set holder at
+		 *             a given set index. This is useful for eviction based
+		 *             functions.
+		 *
+		 * @param[in]  idx   Set index
+		 *
+		 * @return     A mutable propety set holder reference.
+		 */
+		PropertySetHolder &at_mutable(const Index &idx) const {
+			ReadLock m(realloc_mutex);
+			if (idx.value >= block_base) {
+				return data.back().at(idx.value & BLOCK_MASK);
+			} else {
+				return
+					data
+						.at((idx.value & (~BLOCK_MASK)) >> BLOCK_SHIFT)
+						.at(idx.value & BLOCK_MASK);
+			}
+		}
+
+		const PropertySetHolder &at(const Index &idx) const {
+			ReadLock m(realloc_mutex);
+			if (idx.value >= block_base) {
+				return data.back().at(idx.value & BLOCK_MASK);
+			} else {
+				return
+					data
+						.at((idx.value & (~BLOCK_MASK)) >> BLOCK_SHIFT)
+						.at(idx.value & BLOCK_MASK);
+			}
+		}
+
+		/// Blocks are allocated as needed; this only sizes the list of
+		/// blocks.
+		void reserve(Size n) {
+			WriteLock r(realloc_mutex);
+			data.reserve((n + BLOCK_SIZE - 1) / BLOCK_SIZE);
+		}
+
+		Index push_back(PropertySetHolder &&p) {
+			WriteLock m(mutex);
+			__LHF_ASSERT(!data.empty(), "Internal error: no storage blocks avaialable.");
+			if (data.back().size() >= BLOCK_SIZE) {
+				WriteLock r(realloc_mutex);
+				add_block();
+				block_base += BLOCK_SIZE;
+			}
+			data.back().push_back(std::move(p));
+			total_elems++;
+			return Index(total_elems - 1);
+		}
+
+		void clear() {
+			WriteLock m(mutex);
+			data.clear();
+			add_block();
+			total_elems = 0;
+			block_base = 0;
+		}
+
+		Size size() const {
+			return total_elems;
+		}
+
+		Size capacity() const {
+			ReadLock m(realloc_mutex);
+			return data.size() * BLOCK_SIZE;
+		}
+	};
+
+#else
+
+	class PropertySetStorage {
+	protected:
+		/// @note Not marking this as mutable will not allow us to get a
+		///       non-const reference on index-based access. Non-constness
+		//        is important for eviction to work.
+		mutable std::vector<PropertySetHolder, AllocatorFor<PropertySetHolder>> data;
+
+	public:
+		explicit PropertySetStorage(const Allocator &allocator):
+			data(AllocatorFor<PropertySetHolder>(allocator)) {}
+
+		/**
+		 * @brief      Retuns a mutable reference to the property set holder at
+		 *             a given set index. This is useful for eviction based
+		 *             functions.
+		 *
+		 * @param[in]  idx   Set index
+		 *
+		 * @return     A mutable propety set holder reference.
+		 */
+		PropertySetHolder &at_mutable(const Index &idx) const {
+			return data.at(idx.value);
+		}
+
+		const PropertySetHolder &at(const Index &idx) const {
+			return data.at(idx.value);
+		}
+
+		Index push_back(PropertySetHolder &&p) {
+			data.push_back(std::move(p));
+			return data.size() - 1;
+		}
+
+		void reserve(Size n) {
+			data.reserve(n);
+		}
+
+		void clear() {
+			data.clear();
+		}
+
+		Size size() const {
+			return data.size();
+		}
+
+		Size capacity() const {
+			return data.capacity();
+		}
+	};
+
+#endif
+
+	// The property set storage array.
+	PropertySetStorage property_sets{allocator};
+
+	// The property set -> Index in storage array mapping.
+	PropertySetMap property_set_map{allocator};
+
+	BinaryOperationMap unions{allocator};
+	BinaryOperationMap intersections{allocator};
+	BinaryOperationMap differences{allocator};
+
+	SubsetMap subsets{allocator};
+
+#ifdef LHF_ENABLE_TBB
+	// Taken exclusively to take a cut of the sets (see `snapshot_async()`).
+	mutable std::shared_mutex cut_mutex;
+#endif
+
+	// Running totals over the resident sets (see `memory_usage()`).
+	std::atomic<Size> resident_count = 0;
+	std::atomic<Size> element_bytes = 0;
+	std::atomic<Size> slack_bytes = 0;
+
+#ifdef LHF_ENABLE_EVICTION
+	// Byte budget for the resident property sets (0 means unlimited).
+	Size memory_budget = Config::EVICTION_MEMORY_BUDGET;
+
+	std::atomic<Size> resident_bytes = 0;
+	std::atomic<Size> evicted_count = 0;
+	std::atomic<Size> eviction_count = 0;
+	std::atomic<Size> freed_bytes = 0;
+	std::atomic<Size> rematerialization_count = 0;
+
+	// Position of the CLOCK hand in the property set storage.
+	Size clock_hand = EMPTY_SET_VALUE + 1;
+
+	// Content hash -> evicted sets with that hash. Evicted sets are removed
+	// from `property_set_map` as their contents no longer exist.
+	HashMap<Size, Vector<IndexValue>> evicted_sets = {};
+
+	mutable std::recursive_mutex eviction_mutex;
+
+	// Backing file for evicted sets that cannot be recomputed (see
+	// `enable_spill()`).
+	UniquePointer<SpillFile> spill_file = nullptr;
+	std::atomic<Size> spill_read_count = 0;
+
+	// Number of snapshots being written by `snapshot_async()`, which read
+	// the resident sets in place. Sets are not evicted automatically
+	// meanwhile.
+	mutable std::atomic<Size> snapshots_in_flight = 0;
+#endif
+
+	/**
+	 * @brief      Stores index `a` as the subset of index `b` if a < b,
+	 *             else stores index `a` as the superset of index `b`
+	 *
+	 * @param[in]  a     The index of the first set
+	 * @param[in]  b     The index of the second set.
+	 */
+	void store_subset(const Index &a, const Index &b) {
+		LHF_PROPERTY_SET_PAIR_VALID(a, b)
+		LHF_PROPERTY_SET_PAIR_UNEQUAL(a, b)
+		__lhf_calc_functime(stat);
+
+		// We need to maintain the operation pair in index-order here as well.
+		if (a > b) {
+			subsets.insert({{b.value, a.value}, SUPERSET});
+			journal_operation(JournalRecordType::SUBSET, b.value, a.value, SUPERSET);
+		} else {
+			subsets.insert({{a.value, b.value}, SUBSET});
+			journal_operation(JournalRecordType::SUBSET, a.value, b.value, SUBSET);
+		}
+	}
+
+	/// Adds a set that became resident to the running totals of
+	/// `memory_usage()`, or removes it.
+	void account_set(const PropertySet &s, bool resident) {
+		Size elements = s.size() * sizeof(PropertyElement);
+		Size slack = (s.capacity() - s.size()) * sizeof(PropertyElement);
+		if (resident) {
+			resident_count++;
+			element_bytes += elements;
+			slack_bytes += slack;
+		} else {
+			resident_count--;
+			element_bytes -= elements;
+			slack_bytes -= slack;
+		}
+	}
+
+	/**
+	 * @brief      Removes all data from the LHF.
+	 */
+	virtual void clear() {
+		property_sets.clear();
+		property_set_map.clear();
+		unions.clear();
+		intersections.clear();
+		differences.clear();
+		subsets.clear();
+		resident_count = 0;
+		element_bytes = 0;
+		slack_bytes = 0;
+
+#ifdef LHF_ENABLE_EVICTION
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		resident_bytes = 0;
+		evicted_count = 0;
+		clock_hand = EMPTY_SET_VALUE + 1;
+		evicted_sets.clear();
+#endif
+
+		std::lock_guard<std::mutex> g(gc_mutex);
+		gc_roots.clear();
+		collected_sets.clear();
+		gc_result = {};
+	}
+
+	/// Returns an empty set that allocates from the allocator of this LHF.
+	PropertySet make_set() const {
+		return PropertySet(AllocatorFor<PropertyElement>(allocator));
+	}
+
+	/// Returns an element to fill buffers with before raw elements are
+	/// copied over it (see `assign_from_bytes()`).
+	static PropertyElement blank_element() {
+		if constexpr (Nesting::is_nested) {
+			return PropertyElement(PropertyT(), typename Nesting::ChildValueList());
+		} else {
+			return PropertyElement(PropertyT());
+		}
+	}
+
+	/**
+	 * @brief      Allocates a set with the allocator of this LHF, forwarding
+	 *             the arguments to the constructor of `PropertySet` (e.g. a
+	 *             set to copy or move from).
+	 */
+	template<typename... Args>
+	PropertySetHolder make_holder(Args &&... args) const {
+		return PropertySetHolder(allocate_unique<PropertySet>(
+			allocator,
+			std::forward<Args>(args)...,
+			AllocatorFor<PropertyElement>(allocator)));
+	}
+
+	/**
+	 * @brief      Stores a set that is not in `property_set_map`. With
+	 *             eviction enabled, an evicted set with the same contents is
+	 *             brought back instead.
+	 *
+	 * @param      new_set  The new set
+	 * @param[out] cold     Set to `true` if the set was not known before.
+	 *
+	 * @return     Index of the set.
+	 */
+	Index insert_new_set(PropertySetHolder &&new_set, bool &cold) {
+#ifdef LHF_ENABLE_EVICTION
+		if (evicted_count > 0) {
+			Optional<Index> evicted = find_evicted(*new_set.get());
+			if (evicted.is_present()) {
+				LHF_PERF_INC(property_sets, hits);
+				restore(evicted.get(), std::move(*new_set.get()));
+				cold = false;
+				return evicted.get();
+			}
+		}
+#endif
+
+		LHF_PERF_INC(property_sets, cold_misses);
+#ifdef LHF_ENABLE_TBB
+		// concurrent_vector counts sets that are still being constructed,
+		// so a cut (see `snapshot_async()`) waits for them.
+		std::shared_lock<std::shared_mutex> cut(cut_mutex);
+#endif
+		Index ret = property_sets.push_back(std::move(new_set));
+#ifdef LHF_ENABLE_TBB
+		cut.unlock();
+#endif
+		property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
+		account_set(*property_sets.at(ret).get(), true);
+		journal_set(ret, *property_sets.at(ret).get());
+		cold = true;
+
+#ifdef LHF_ENABLE_EVICTION
+		resident_bytes += property_sets.at(ret).payload_bytes();
+		enforce_memory_budget();
+#endif
+
+		return ret;
+	}
+
+	/// Counts an access to a set, if access counting is enabled (see
+	/// `reorganize()`).
+	inline void count_access(const Index &index) const {
+#ifdef LHF_ENABLE_ACCESS_COUNTS
+		property_sets.at(index).accesses.fetch_add(1, std::memory_order_relaxed);
+#else
+		(void) index;
+#endif
+	}
+
+#ifdef LHF_ENABLE_EVICTION
+	/// Secondary hash of the contents of a set. Together with the hash used
+	/// by `property_set_map`, it identifies an evicted set.
+	static Size set_fingerprint(const PropertySet &s) {
+		std::uint64_t h = s.size();
+		for (const PropertyElement &e : s) {
+			std::uint64_t x = typename PropertyElement::Hash()(e) + 0x9e3779b97f4a7c15ULL;
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+			h = (h ^ x ^ (x >> 31)) * 0x100000001b3ULL;
+		}
+		return h;
+	}
+
+	/**
+	 * @brief      Records that `ret` is the result of operation `kind` on `a`
+	 *             and `b`, so that it can be recomputed after eviction. Only
+	 *             operands with smaller indices are recorded, which keeps
+	 *             recomputation from ever depending on the set itself.
+	 */
+	void record_origin(const Index &ret, OperationKind kind, const Index &a, const Index &b) {
+		if (ret < a || ret < b || ret == a || ret == b) {
+			return;
+		}
+
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		PropertySetHolder &h = property_sets.at_mutable(ret);
+		if (!h.is_recomputable()) {
+			h.origin = kind;
+			h.origin_left = a.value;
+			h.origin_right = b.value;
+		}
+	}
+
+	/// Sets the access bit of a set.
+	inline void touch(const Index &index) const {
+		property_sets.at(index).referenced.store(true, std::memory_order_relaxed);
+	}
+
+	/// Returns the evicted set with the contents of `s`, if there is one.
+	Optional<Index> find_evicted(const PropertySet &s) {
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		auto candidates = evicted_sets.find(PropertySetHash()(&s));
+		if (candidates == evicted_sets.end()) {
+			return Optional<Index>::absent();
+		}
+
+		Size fingerprint = set_fingerprint(s);
+		for (IndexValue i : candidates->second) {
+			if (property_sets.at(i).fingerprint == fingerprint) {
+				return Index(i);
+			}
+		}
+
+		return Optional<Index>::absent();
+	}
+
+	/// Frees the contents of a set. The eviction lock must be held.
+	Size evict_unlocked(const Index &index) {
+		PropertySetHolder &h = property_sets.at_mutable(index);
+		const PropertySet &s = *h.get();
+		Size bytes = h.payload_bytes();
+
+		h.hash = PropertySetHash()(&s);
+		h.fingerprint = set_fingerprint(s);
+
+		if constexpr (SPILLABLE) {
+			// The contents never change, so a set is only written once.
+			if (spill_file && !h.is_recomputable() && !h.is_spilled()) {
+				h.spill_offset = spill_file->append(s.data(), s.size());
+			}
+		}
+
+		property_set_map.erase(&s);
+		evicted_sets[h.hash].push_back(index.value);
+		account_set(s, false);
+		h.evict();
+
+		resident_bytes -= bytes;
+		freed_bytes += bytes;
+		eviction_count++;
+		evicted_count++;
+		return bytes;
+	}
+
+	/// Puts back the contents of an evicted set.
+	void restore(const Index &index, PropertySet &&s) {
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		PropertySetHolder &h = property_sets.at_mutable(index);
+		if (!h.is_evicted()) {
+			return;
+		}
+
+		Vector<IndexValue> &candidates = evicted_sets[h.hash];
+		candidates.erase(std::find(candidates.begin(), candidates.end(), index.value));
+		if (candidates.empty()) {
+			evicted_sets.erase(h.hash);
+		}
+
+		h.reassign(std::move(make_holder(std::move(s)).ptr));
+		h.referenced = true;
+		property_set_map.insert(std::make_pair(h.get(), index.value));
+		account_set(*h.get(), true);
+
+		resident_bytes += h.payload_bytes();
+		rematerialization_count++;
+		evicted_count--;
+	}
+
+	/// Recomputes an evicted set from the contents of its operands.
+	PropertySet recompute(
+		const PropertySetHolder &h,
+		const PropertySet &left, const PropertySet &right) {
+
+		switch (h.origin) {
+		case OperationKind::UNION:
+			return compute_union(left, right);
+		case OperationKind::INTERSECTION:
+			return compute_intersection(left, right);
+		case OperationKind::DIFFERENCE:
+			return compute_difference(left, right);
+		default:
+			throw Unreachable();
+		}
+	}
+
+	/**
+	 * @brief      Brings back an evicted set, either from the spill file or by
+	 *             recomputing it from the operation that produced it (evicted
+	 *             operands are brought back first). The chain of evicted
+	 *             operands is walked with an explicit stack, so it may be
+	 *             arbitrarily long.
+	 */
+	void materialize(const Index &index) {
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+
+		// A set is popped once its operands are resident, so each set is
+		// brought back once, after its operands.
+		Vector<IndexValue> stack = {index.value};
+		while (!stack.empty()) {
+			IndexValue i = stack.back();
+			const PropertySetHolder &h = property_sets.at(i);
+			if (!h.is_evicted()) {
+				stack.pop_back();
+				continue;
+			}
+
+			if constexpr (SPILLABLE) {
+				if (h.is_spilled()) {
+					PropertySet s = make_set();
+					spill_file->read(h.spill_offset, s, blank_element());
+					spill_read_count++;
+					restore(i, std::move(s));
+					stack.pop_back();
+					continue;
+				}
+			}
+
+			if (!h.is_recomputable()) {
+				throw AssertError("Tried to access an evicted set that cannot be recomputed");
+			}
+
+			bool ready = true;
+			for (IndexValue operand : {h.origin_left, h.origin_right}) {
+				if (is_evicted(operand)) {
+					stack.push_back(operand);
+					ready = false;
+				}
+			}
+
+			if (ready) {
+				restore(i, recompute(h, get_value(h.origin_left), get_value(h.origin_right)));
+				stack.pop_back();
+			}
+		}
+	}
+
+	/**
+	 * @brief      Returns the contents of a set without bringing it back if
+	 *             it is evicted: a spilled set is read from the spill file
+	 *             into `buffer`, and another evicted set is recomputed into
+	 *             `buffer` from its operands, which are read the same way.
+	 *             The eviction lock must be held while the result is used.
+	 *
+	 *             The evicted sets the result depends on are found with an
+	 *             explicit stack and computed bottom-up. Each of them is
+	 *             computed once, and freed when the last set that uses it has
+	 *             been computed.
+	 */
+	const PropertySet &peek_value(const Index &index, PropertySet &buffer) const {
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		const PropertySetHolder &h = property_sets.at(index);
+		if (!h.is_evicted()) {
+			return *h.get();
+		}
+
+		auto is_spilled = [](const PropertySetHolder &s) {
+			if constexpr (SPILLABLE) {
+				return s.is_spilled();
+			} else {
+				(void) s;
+				return false;
+			}
+		};
+
+		// Depth-first search over the evicted operands. A set is appended to
+		// `order` after its operands, and `uses` counts the sets in `order`
+		// that use it as an operand.
+		Vector<IndexValue> order;
+		HashMap<IndexValue, Size> uses;
+		HashSet<IndexValue> visited;
+		Vector<std::pair<IndexValue, bool>> stack = {{index.value, false}};
+		while (!stack.empty()) {
+			auto [i, expanded] = stack.back();
+			stack.pop_back();
+			if (expanded) {
+				order.push_back(i);
+				continue;
+			} else if (!visited.insert(i).second) {
+				continue;
+			}
+
+			stack.push_back({i, true});
+			const PropertySetHolder &s = property_sets.at(i);
+			if (is_spilled(s)) {
+				continue;
+			} else if (!s.is_recomputable()) {
+				throw AssertError("Tried to access an evicted set that cannot be recomputed");
+			}
+
+			for (IndexValue operand : {s.origin_left, s.origin_right}) {
+				if (is_evicted(operand)) {
+					uses[operand]++;
+					stack.push_back({operand, false});
+				}
+			}
+		}
+
+		HashMap<IndexValue, PropertySet> values;
+		auto operand = [&](IndexValue o) -> const PropertySet & {
+			const PropertySetHolder &s = property_sets.at(o);
+			return s.is_evicted() ? values.at(o) : *s.get();
+		};
+		auto release = [&](IndexValue o) {
+			if (is_evicted(o) && --uses[o] == 0) {
+				values.erase(o);
+			}
+		};
+
+		LatticeHashForest *self = const_cast<LatticeHashForest *>(this);
+		for (IndexValue i : order) {
+			const PropertySetHolder &s = property_sets.at(i);
+			PropertySet &out = i == index.value ?
+				buffer : values.emplace(i, make_set()).first->second;
+
+			if constexpr (SPILLABLE) {
+				if (s.is_spilled()) {
+					spill_file->read(s.spill_offset, out, blank_element());
+					continue;
+				}
+			}
+
+			out = self->recompute(s, operand(s.origin_left), operand(s.origin_right));
+			release(s.origin_left);
+			release(s.origin_right);
+		}
+
+		return buffer;
+	}
+
+	/**
+	 * @brief      Evicts sets until the resident sets fit in the memory
+	 *             budget, using the CLOCK policy: the hand sweeps over the
+	 *             sets, clearing access bits, and evicts sets whose bit is
+	 *             already clear. The hand makes at most two revolutions.
+	 *
+	 *             Only sets that can be recomputed, or spilled to disk (see
+	 *             `enable_spill()`), are evicted automatically.
+	 */
+	void enforce_memory_budget() {
+		if (memory_budget == 0 || resident_bytes <= memory_budget || snapshots_in_flight > 0) {
+			return;
+		}
+
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		Size count = property_sets.size();
+
+		for (Size step = 0;
+		     step < 2 * count && resident_bytes > memory_budget && snapshots_in_flight == 0;
+		     step++) {
+			if (clock_hand >= count) {
+				clock_hand = EMPTY_SET_VALUE + 1;
+			}
+
+			Index index = clock_hand++;
+			const PropertySetHolder &h = property_sets.at(index);
+
+			if (h.is_evicted() || !(h.is_recomputable() || (SPILLABLE && spill_file))) {
+				continue;
+			}
+
+			if (h.referenced.exchange(false, std::memory_order_relaxed)) {
+				continue;
+			}
+
+			evict_unlocked(index);
+		}
+	}
+#endif
+
+public:
+	/**
+	 * @param[in]  reflist    The LHFs nested in this one
+	 * @param[in]  allocator  Allocator for the sets and internal containers
+	 *                        (see `Config::Allocator`)
+	 */
+	explicit LatticeHashForest(RefList reflist = {}, const Allocator &allocator = Allocator()):
+		reflist(reflist), allocator(allocator) {
+		// INSERT EMPTY SET AT INDEX 0
+		register_set({ });
+
+		if (Config::OPERATION_CACHE_CAPACITY > 0) {
+			set_operation_cache_capacity(
+				Config::OPERATION_CACHE_CAPACITY,
+				Config::OPERATION_CACHE_POLICY);
+		}
+	}
+
+	Allocator get_allocator() const {
+		return allocator;
+	}
+
+	/**
+	 * @brief      Pre-sizes the set storage and `property_set_map` for `sets`
+	 *             sets, and each operation cache (and the subset relations)
+	 *             for `operations` entries, so that none of them has to grow
+	 *             while a workload of the expected size runs.
+	 *
+	 * @note       This must not run concurrently with operations.
+	 */
+	void reserve(Size sets, Size operations = 0) {
+		property_sets.reserve(sets);
+		property_set_map.reserve(sets);
+		if (operations > 0) {
+			unions.reserve(operations);
+			intersections.reserve(operations);
+			differences.reserve(operations);
+			subsets.reserve(operations);
+		}
+	}
+
+	/**
+	 * @brief      Limits each of the operation caches (unions, intersections,
+	 *             differences and subset relations) to `capacity` entries.
+	 *             When a cache is full, entries are evicted according to
+	 *             `policy`. An evicted entry only means that the operation is
+	 *             computed again the next time it is requested. 0 removes
+	 *             the limits. The defaults come from
+	 *             `Config::OPERATION_CACHE_CAPACITY` and
+	 *             `Config::OPERATION_CACHE_POLICY`.
+	 *
+	 * @note       This must not run concurrently with operations.
+	 */
+	void set_operation_cache_capacity(Size capacity, CachePolicy policy = CachePolicy::TINYLFU) {
+		unions.set_capacity(capacity, policy);
+		intersections.set_capacity(capacity, policy);
+		differences.set_capacity(capacity, policy);
+		subsets.set_capacity(capacity, policy);
+	}
+
+	/**
+	 * @brief      Returns the occupancy and eviction counters of each
+	 *             operation cache.
+	 */
+	HashMap<String, CacheStats> get_operation_cache_stats() const {
+		return {
+			{"unions", unions.get_cache_stats()},
+			{"intersections", intersections.get_cache_stats()},
+			{"differences", differences.get_cache_stats()},
+			{"subsets", subsets.get_cache_stats()}
+		};
+	}
+
+	/**
+	 * @brief      Memory returned by clearing operation cache entries (see
+	 *             `clear_operation_caches()`). The byte counts are estimates
+	 *             of the map nodes (and bucket arrays) that were freed.
+	 */
+	struct CacheClearResult {
+		Size entries = 0;
+		Size bytes = 0;
+
+		CacheClearResult &operator+=(const CacheClearResult &r) {
+			entries += r.entries;
+			bytes += r.bytes;
+			return *this;
+		}
+
+		String to_string() const {
+			std::stringstream s;
+			s << "    " << "Entries: " << entries << "\n"
+			  << "    " << "Bytes:   " << bytes << "\n";
+			return s.str();
+		}
+	};
+
+protected:
+	template<typename Map>
+	static CacheClearResult release_cache(Map &map) {
+		Size entries = map.size();
+		return {entries, map.release()};
+	}
+
+	/// Erases the entries of a cache whose operands (or result) are marked
+	/// in `doomed`.
+	template<typename Map>
+	static CacheClearResult erase_cache_entries(Map &map, const Vector<bool> &doomed) {
+		using MappedType = typename Map::MappedType;
+
+		auto marked = [&doomed](IndexValue i) {
+			return i < doomed.size() && doomed[i];
+		};
+
+		Size entries = map.erase_if([&marked](const OperationNode &k, const MappedType &v) {
+			if (marked(k.left) || marked(k.right)) {
+				return true;
+			}
+			if constexpr (std::is_same_v<MappedType, IndexValue>) {
+				return marked(v);
+			}
+			return false;
+		});
+
+		return {entries, entries * Map::ENTRY_BYTES};
+	}
+
+public:
+	/**
+	 * @brief      Drops every entry of the operation caches (unions,
+	 *             intersections, differences and subset relations) and frees
+	 *             their bucket arrays. Unlike `clear()`, the sets keep their
+	 *             indices; the dropped operations are simply computed again
+	 *             when they are next requested. Nested LHFs are not affected.
+	 *
+	 * @note       This must not run concurrently with operations.
+	 */
+	CacheClearResult clear_operation_caches() {
+		__lhf_calc_functime(stat);
+		CacheClearResult r;
+		r += release_cache(unions);
+		r += release_cache(intersections);
+		r += release_cache(differences);
+		r += release_cache(subsets);
+		return r;
+	}
+
+	/**
+	 * @brief      Drops every entry of the cache of one operation (see
+	 *             `clear_operation_caches()`).
+	 *
+	 * @param[in]  kind  The operation (`INSERT` is not supported)
+	 */
+	CacheClearResult clear_operation_cache(OperationKind kind) {
+		__lhf_calc_functime(stat);
+		switch (kind) {
+		case OperationKind::UNION:
+			return release_cache(unions);
+		case OperationKind::INTERSECTION:
+			return release_cache(intersections);
+		case OperationKind::DIFFERENCE:
+			return release_cache(differences);
+		default:
+			throw AssertError("Operation does not have a cache");
+		}
+	}
+
+	/**
+	 * @brief      Drops every known subset relation (see
+	 *             `clear_operation_caches()`).
+	 */
+	CacheClearResult clear_subset_cache() {
+		__lhf_calc_functime(stat);
+		return release_cache(subsets);
+	}
+
+	/**
+	 * @brief      Drops the entries of all operation caches that involve any
+	 *             of the given sets, as an operand or as the result. The
+	 *             bucket arrays are kept.
+	 *
+	 * @note       This must not run concurrently with operations.
+	 *
+	 * @param[in]  indices  The sets
+	 */
+	CacheClearResult clear_operation_cache_entries(const Vector<Index> &indices) {
+		__lhf_calc_functime(stat);
+		Vector<bool> doomed(property_sets.size(), false);
+		for (const Index &i : indices) {
+			LHF_PROPERTY_SET_INDEX_VALID(i);
+			doomed[i.value] = true;
+		}
+
+		CacheClearResult r;
+		r += erase_cache_entries(unions, doomed);
+		r += erase_cache_entries(intersections, doomed);
+		r += erase_cache_entries(differences, doomed);
+		r += erase_cache_entries(subsets, doomed);
+		return r;
+	}
+
+	inline bool is_empty(const Index &i) const {
+		return i.is_empty();
+	}
+
+	/**
+	 * @brief      Resets state of the LHF to the default.
+	 */
+	void clear_and_initialize() {
+		clear();
+		register_set({ });
+	}
+
+	/**
+	 * @brief      Returns whether we currently know whether a is a subset or a
+	 *             superset of b.
+	 *
+	 * @param[in]  a     The first set
+	 * @param[in]  b     The second set
+	 *
+	 * @return     Enum value telling if it's a subset, superset or unknown
+	 */
+	SubsetRelation is_subset(const Index &a, const Index &b) const {
+		LHF_PROPERTY_SET_PAIR_VALID(a, b)
+
+		auto i = subsets.find({a.value, b.value});
+
+		if (!i.is_present()) {
+			return UNKNOWN;
+		} else {
+			return i.get();
+		}
+	}
+
+	/**
+	 * @brief         Inserts a (or gets an existing) single-element set into
+	 *                property set storage.
+	 *
+	 * @param[in]  c  The single-element property set.
+	 *
+	 * @return        Index of the newly created/existing set.
+	 *
+	 * @todo          Check whether the cache hit check can be removed.
+	 */
+	Index register_set_single(const PropertyElement &c) {
+		__lhf_calc_functime(stat);
+
+		PropertySetHolder new_set = make_holder(Size(1), c);
+
+		auto result = property_set_map.find(new_set.get());
+
+		if (!result.is_present()) {
+			bool cold;
+			return insert_new_set(std::move(new_set), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			return Index(result.get());
+		}
+	}
+
+	/**
+	 * @brief      Inserts a (or gets an existing) single-element set into
+	 *             the property set storage, and reports whether this set
+	 *             was already  present or not.
+	 *
+	 * @param[in]  c     The single-element property set.
+	 * @param[out] cold  Report if this was a cold miss.
+	 *
+	 * @return     Index of the newly created set.
+	 */
+	Index register_set_single(const PropertyElement &c, bool &cold) {
+		__lhf_calc_functime(stat);
+
+		PropertySetHolder new_set = make_holder(Size(1), c);
+		auto result = property_set_map.find(new_set.get());
+
+		if (!result.is_present()) {
+			return insert_new_set(std::move(new_set), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			cold = false;
+			return Index(result.get());
+		}
+	}
+
+	/**
+	 * Deduplicates and sorts a vector (to function equivalently to a set).
+	 *
+	 * The deduplicate-sort function here is based on a stackoverflow answer
+	 * (chosen for speed metrics): https://stackoverflow.com/a/24477023
+	 *
+	 * Ideally, this shouldn't be used or require being used.
+	 */
+	void prepare_vector_set(PropertySet &c) {
+		std::unordered_set<
+			PropertyElement,
+			typename PropertyElement::Hash,
+			typename PropertyElement::FullEqual> deduplicator;
+
+		for (auto &i : c) {
+			deduplicator.insert(i);
+		}
+
+		c.assign(deduplicator.begin(), deduplicator.end());
+		std::sort(c.begin(), c.end());
+	}
+
+	template <bool disable_integrity_check = false>
+	Index register_set(const PropertySet &c) {
+		__lhf_calc_functime(stat);
+
+		if (!disable_integrity_check) {
+			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+		}
+
+		auto result = property_set_map.find(&c);
+
+		if (!result.is_present()) {
+			bool cold;
+			return insert_new_set(make_holder(c), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			return Index(result.get());
+		}
+	}
+
+	template <bool disable_integrity_check = false>
+	Index register_set(const PropertySet &c, bool &cold) {
+		__lhf_calc_functime(stat);
+
+		if (!disable_integrity_check) {
+			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+		}
+
+		auto result = property_set_map.find(&c);
+
+		if (!result.is_present()) {
+			return insert_new_set(make_holder(c), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			cold = false;
+			return Index(result.get());
+		}
+	}
+
+	template <bool disable_integrity_check = false>
+	Index register_set(PropertySet &&c) {
+		__lhf_calc_functime(stat);
+
+		if (!disable_integrity_check) {
+			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+		}
+
+		auto result = property_set_map.find(&c);
+
+		if (!result.is_present()) {
+			bool cold;
+			return insert_new_set(make_holder(std::move(c)), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			return Index(result.get());
+		}
+	}
+
+	template <bool disable_integrity_check = false>
+	Index register_set(PropertySet &&c, bool &cold) {
+		__lhf_calc_functime(stat);
+
+		if (!disable_integrity_check) {
+			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+		}
+
+		auto result = property_set_map.find(&c);
+
+		if (!result.is_present()) {
+			return insert_new_set(make_holder(std::move(c)), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			cold = false;
+			return Index(result.get());
+		}
+	}
+
+	template<typename Iterator, bool disable_integrity_check = false>
+	Index register_set(Iterator begin, Iterator end) {
+		__lhf_calc_functime(stat);
+
+		PropertySetHolder new_set = make_holder(begin, end);
+
+		if (!disable_integrity_check) {
+			LHF_PROPERTY_SET_INTEGRITY_VALID(*new_set.get());
+		}
+
+		auto result = property_set_map.find(new_set.get());
+
+		if (!result.is_present()) {
+			bool cold;
+			return insert_new_set(std::move(new_set), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			return Index(result.get());
+		}
+	}
+
+	template<typename Iterator, bool disable_integrity_check = false>
+	Index register_set(Iterator begin, Iterator end, bool &cold) {
+		__lhf_calc_functime(stat);
+
+		PropertySetHolder new_set = make_holder(begin, end);
+
+		if (!disable_integrity_check) {
+			LHF_PROPERTY_SET_INTEGRITY_VALID(*new_set.get());
+		}
+
+		auto result = property_set_map.find(new_set.get());
+
+		if (!result.is_present()) {
+			return insert_new_set(std::move(new_set), cold);
+		} else {
+			LHF_PERF_INC(property_sets, hits);
+			cold = false;
+			return Index(result.get());
+		}
+	}
+
+#ifdef LHF_ENABLE_EVICTION
+	/**
+	 * @brief      Eviction statistics (see `get_eviction_stats()`).
+	 */
+	struct EvictionStats {
+		Size memory_budget;
+		Size resident_bytes;
+		Size evicted_sets;
+		Size evictions;
+		Size freed_bytes;
+		Size rematerializations;
+		Size spill_file_bytes;
+		Size spill_reads;
+
+		String to_string() const {
+			std::stringstream s;
+			s << "    " << "Memory Budget:      " << memory_budget << "\n"
+			  << "    " << "Resident Bytes:     " << resident_bytes << "\n"
+			  << "    " << "Evicted Sets:       " << evicted_sets << "\n"
+			  << "    " << "Evictions:          " << evictions << "\n"
+			  << "    " << "Freed Bytes:        " << freed_bytes << "\n"
+			  << "    " << "Rematerializations: " << rematerializations << "\n"
+			  << "    " << "Spill File Bytes:   " << spill_file_bytes << "\n"
+			  << "    " << "Spill Reads:        " << spill_reads << "\n";
+			return s.str();
+		}
+	};
+
+	bool is_evicted(const Index &index) const {
+		return property_sets.at(index.value).is_evicted();
+	}
+
+	/**
+	 * @brief      Frees the contents of a set. Sets that were produced by an
+	 *             operation are recomputed when they are accessed again. Other
+	 *             sets are read back from the spill file if spilling is
+	 *             enabled (see `enable_spill()`), and can otherwise only be
+	 *             brought back by registering them again.
+	 *
+	 * @param[in]  index  The set
+	 */
+	void evict_set(const Index &index) {
+		__LHF_ASSERT(!index.is_empty(),
+			"Tried to evict the empty set");
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		__LHF_ASSERT(!is_evicted(index),
+			"Tried to evict an already absent property set");
+		evict_unlocked(index);
+	}
+
+	/**
+	 * @brief      Sets the memory budget (in bytes) for the resident property
+	 *             sets, and evicts sets if it is exceeded. 0 disables
+	 *             automatic eviction. The default is
+	 *             `Config::EVICTION_MEMORY_BUDGET`.
+	 *
+	 * @note       Automatic eviction assumes that the LHF is not operated on
+	 *             concurrently, as evicting a set invalidates references to
+	 *             it.
+	 */
+	void set_memory_budget(Size bytes) {
+		memory_budget = bytes;
+		enforce_memory_budget();
+	}
+
+	Size get_memory_budget() const {
+		return memory_budget;
+	}
+
+	EvictionStats get_eviction_stats() const {
+		return {
+			memory_budget,
+			resident_bytes,
+			evicted_count,
+			eviction_count,
+			freed_bytes,
+			rematerialization_count,
+			spill_file ? spill_file->size() : 0,
+			spill_read_count
+		};
+	}
+
+	/**
+	 * @brief      Makes evicted sets that cannot be recomputed (such as sets
+	 *             registered directly) get written to an append-only spill
+	 *             file, from which they are read back when accessed. Such sets
+	 *             then also become candidates for automatic eviction.
+	 *
+	 * @note       Requires trivially copyable property elements, so nested
+	 *             LHFs cannot be spilled.
+	 *
+	 * @param[in]  path  Path of the spill file. If empty, an anonymous
+	 *                   temporary file is used.
+	 */
+	void enable_spill(const String &path = "") {
+		static_assert(SPILLABLE,
+			"Spilling requires trivially copyable property elements");
+		std::lock_guard<std::recursive_mutex> l(eviction_mutex);
+		if (spill_file) {
+			throw AssertError("Spilling is already enabled");
+		}
+		spill_file = UniquePointer<SpillFile>(new SpillFile(path));
+	}
+#endif
+
+	/**
+	 * @brief      Result of a garbage collection (see `collect()`).
+	 */
+	struct CollectionResult {
+		Size freed_sets = 0;
+		Size freed_bytes = 0;
+		Size purged_entries = 0;
+
+		/// With compaction, the new index of every old set index, or
+		/// `COLLECTED` for the sets that were collected. Empty otherwise.
+		Vector<IndexValue> remap = {};
+
+		String to_string() const {
+			std::stringstream s;
+			s << "    " << "Freed Sets:     " << freed_sets << "\n"
+			  << "    " << "Freed Bytes:    " << freed_bytes << "\n"
+			  << "    " << "Purged Entries: " << purged_entries << "\n"
+			  << "    " << "Compacted:      " << (remap.empty() ? "no" : "yes") << "\n";
+			return s.str();
+		}
+	};
+
+	/// Marks collected sets in `CollectionResult::remap`.
+	static constexpr IndexValue COLLECTED = std::numeric_limits<IndexValue>::max();
+
+protected:
+	// LHFs of other types call the collector of the LHFs nested in them.
+	template<typename, typename> friend class LatticeHashForest;
+
+	// Reference counts of the sets pinned as roots (see `pin()`).
+	HashMap<IndexValue, Size> gc_roots = {};
+	mutable std::mutex gc_mutex;
+
+	// Reachability marks of the collection in progress.
+	Vector<bool> gc_marks = {};
+
+	// Sets that were collected without compaction. Their indices stay
+	// allocated until the next compaction.
+	Vector<bool> collected_sets = {};
+
+	CollectionResult gc_result = {};
+	Size gc_prepared_epoch = 0;
+	Size gc_swept_epoch = 0;
+	Size reorganized_epoch = 0;
+
+	// Renumbering done by the last compaction or reorganization (see
+	// `renumber_sets()`). Parent LHFs use it to rewrite their elements.
+	// Empty if the indices did not change.
+	Vector<IndexValue> renumbering = {};
+
+	inline bool gc_is_marked(IndexValue i) const {
+		return i < gc_marks.size() && gc_marks[i];
+	}
+
+	/// Marks a set as reachable. Sets registered while marking (such as
+	/// nested sets created by recomputing an evicted set) are covered too.
+	inline void gc_mark(IndexValue i) {
+		if (i >= gc_marks.size()) {
+			gc_marks.resize(i + 1, false);
+		}
+		gc_marks[i] = true;
+	}
+
+	template<typename ChildValues, Size... I>
+	void gc_mark_children(const ChildValues &v, std::index_sequence<I...>) {
+		(std::get<I>(reflist).gc_mark(std::get<I>(v).value), ...);
+	}
+
+	template<typename ChildValues, Size... I>
+	ChildValues translate_children(const ChildValues &v, std::index_sequence<I...>) const {
+		return ChildValues(std::get<I>(reflist).translate(std::get<I>(v).value)...);
+	}
+
+	/// Returns the index that `i` was moved to by the last renumbering.
+	inline IndexValue translate(IndexValue i) const {
+		return renumbering.empty() ? i : renumbering[i];
+	}
+
+	/// Clears the marks of this LHF and of the LHFs nested in it, and marks
+	/// the pinned sets.
+	void gc_prepare(Size epoch) {
+		if (gc_prepared_epoch == epoch) {
+			return;
+		}
+		gc_prepared_epoch = epoch;
+
+		gc_marks.assign(property_sets.size(), false);
+		gc_mark(EMPTY_SET_VALUE);
+		{
+			std::lock_guard<std::mutex> l(gc_mutex);
+			for (const auto &r : gc_roots) {
+				gc_mark(r.first);
+			}
+		}
+
+		if constexpr (Nesting::is_nested) {
+			std::apply([epoch](auto &... child) { (child.gc_prepare(epoch), ...); }, reflist);
+		}
+	}
+
+	/**
+	 * @brief      Marks everything reachable from the marked sets: the
+	 *             operands that evicted sets are recomputed from, and the sets
+	 *             of the nested LHFs that elements refer to. A nested LHF is
+	 *             propagated again by every parent that marks sets in it.
+	 */
+	void gc_propagate() {
+		Size count = property_sets.size();
+
+#ifdef LHF_ENABLE_EVICTION
+		// Operands have smaller indices than the sets computed from them, so
+		// a single downward pass follows chains of origins.
+		for (Size i = count; i-- > EMPTY_SET_VALUE + 1;) {
+			const PropertySetHolder &h = property_sets.at(i);
+			if (gc_is_marked(i) && h.is_recomputable()) {
+				gc_mark(h.origin_left);
+				gc_mark(h.origin_right);
+			}
+		}
+#endif
+
+		if constexpr (Nesting::is_nested) {
+			for (Size i = EMPTY_SET_VALUE + 1; i < count; i++) {
+				if (!gc_is_marked(i)) {
+					continue;
+				}
+
+				// Evicted sets are brought back, since their elements are
+				// needed both here and for compaction.
+				for (const PropertyElement &e : get_value(i)) {
+					gc_mark_children(
+						e.get_value(),
+						std::make_index_sequence<Nesting::num_children>{});
+				}
+			}
+
+			std::apply([](auto &... child) { (child.gc_propagate(), ...); }, reflist);
+		}
+	}
+
+	/**
+	 * @brief      Drops the entries of an operation cache that refer to
+	 *             collected sets, and renumbers the rest with `renumbering`.
+	 *             The operands of commutative operations (and of subset
+	 *             relations) are stored in index order, so they are swapped if
+	 *             the renumbering reversed them.
+	 *
+	 * @return     Number of entries dropped.
+	 */
+	template<typename Map>
+	Size rewrite_operation_map(Map &map, bool commutative) {
+		using MappedType = typename Map::MappedType;
+
+		auto live = [this](IndexValue i) {
+			return i >= collected_sets.size() || !collected_sets[i];
+		};
+
+		Vector<std::pair<OperationNode, MappedType>> kept;
+		Vector<OperationNode> dropped;
+
+		for (const auto &e : map) {
+			bool keep = live(e.first.left) && live(e.first.right);
+			if constexpr (std::is_same_v<MappedType, IndexValue>) {
+				keep = keep && live(e.second);
+			}
+
+			if (keep) {
+				kept.push_back(e);
+			} else {
+				dropped.push_back(e.first);
+			}
+		}
+
+		if (renumbering.empty()) {
+			for (const OperationNode &k : dropped) {
+				map.erase(k);
+			}
+			return dropped.size();
+		}
+
+		map.clear();
+		for (auto &e : kept) {
+			OperationNode key = {translate(e.first.left), translate(e.first.right)};
+			MappedType value = e.second;
+
+			if constexpr (std::is_same_v<MappedType, IndexValue>) {
+				value = translate(value);
+			} else {
+				if (key.left > key.right) {
+					value = value == SUBSET ? SUPERSET : SUBSET;
+				}
+			}
+
+			if (commutative && key.left > key.right) {
+				std::swap(key.left, key.right);
+			}
+
+			map.insert({key, value});
+		}
+
+		return dropped.size();
+	}
+
+	Size rewrite_operation_maps() {
+		return
+			rewrite_operation_map(unions, true) +
+			rewrite_operation_map(intersections, true) +
+			rewrite_operation_map(differences, false) +
+			rewrite_operation_map(subsets, true);
+	}
+
+	/**
+	 * @brief      Moves every set to the index given by `renumbering`
+	 *             (dropping sets mapped to `COLLECTED`). Child indices in the
+	 *             elements of nested LHFs are translated with the
+	 *             renumberings of the children, which must already be done.
+	 *             The operation caches are rewritten separately (see
+	 *             `rewrite_operation_maps()`).
+	 */
+	void renumber_sets() {
+		const Vector<IndexValue> &remap = renumbering;
+		Vector<IndexValue> order(remap.size(), COLLECTED);
+		Size count = 0;
+
+		for (Size i = 0; i < remap.size(); i++) {
+			if (remap[i] != COLLECTED) {
+				order[remap[i]] = i;
+				count++;
+			}
+		}
+		order.resize(count);
+
+#ifdef LHF_ENABLE_EVICTION
+		// A set may only be recomputed from sets with smaller indices (see
+		// `record_origin()`). Sets for which the renumbering breaks this are
+		// brought back and forget their origin.
+		Vector<bool> forget_origin(remap.size(), false);
+		for (IndexValue i : order) {
+			const PropertySetHolder &h = property_sets.at(i);
+			if (h.is_recomputable() &&
+			    (remap[i] < remap[h.origin_left] || remap[i] < remap[h.origin_right])) {
+				materialize(i);
+				forget_origin[i] = true;
+			}
+		}
+#endif
+
+		Vector<PropertySetHolder> kept;
+		kept.reserve(count);
+
+		// The keys of the map are about to be modified.
+		property_set_map.clear();
+
+		for (IndexValue i : order) {
+			PropertySetHolder &h = property_sets.at_mutable(i);
+
+			if constexpr (Nesting::is_nested) {
+				if (h.get()) {
+					for (PropertyElement &e : *h.get()) {
+						e = PropertyElement(
+							e.get_key(),
+							translate_children(
+								e.get_value(),
+								std::make_index_sequence<Nesting::num_children>{}));
+					}
+				}
+			}
+
+#ifdef LHF_ENABLE_EVICTION
+			if (forget_origin[i]) {
+				h.origin = OperationKind::INSERT;
+			} else if (h.is_recomputable()) {
+				h.origin_left = remap[h.origin_left];
+				h.origin_right = remap[h.origin_right];
+			}
+#endif
+
+			kept.push_back(std::move(h));
+		}
+
+		property_sets.clear();
+
+#ifdef LHF_ENABLE_EVICTION
+		evicted_sets.clear();
+		clock_hand = EMPTY_SET_VALUE + 1;
+#endif
+
+		for (PropertySetHolder &h : kept) {
+			Index i = property_sets.push_back(std::move(h));
+			const PropertySetHolder &stored = property_sets.at(i);
+			if (!stored.is_evicted()) {
+				property_set_map.insert(std::make_pair(stored.get(), i.value));
+			}
+#ifdef LHF_ENABLE_EVICTION
+			else {
+				evicted_sets[stored.hash].push_back(i.value);
+			}
+#endif
+		}
+
+		collected_sets.clear();
+
+		std::lock_guard<std::mutex> l(gc_mutex);
+		HashMap<IndexValue, Size> roots;
+		for (const auto &r : gc_roots) {
+			roots[remap[r.first]] = r.second;
+		}
+		gc_roots = std::move(roots);
+	}
+
+	/**
+	 * @brief      Frees the unmarked sets of this LHF, after sweeping the LHFs
+	 *             nested in it (whose remaps are needed to compact this one).
+	 */
+	void gc_sweep(Size epoch, bool compact) {
+		if (gc_swept_epoch == epoch) {
+			return;
+		}
+		gc_swept_epoch = epoch;
+
+		if constexpr (Nesting::is_nested) {
+			std::apply(
+				[epoch, compact](auto &... child) { (child.gc_sweep(epoch, compact), ...); },
+				reflist);
+		}
+
+		LHF_EVICTION(std::lock_guard<std::recursive_mutex> l(eviction_mutex);)
+
+		CollectionResult r;
+		Size count = property_sets.size();
+		collected_sets.resize(count, false);
+
+		for (Size i = EMPTY_SET_VALUE + 1; i < count; i++) {
+			if (gc_is_marked(i) || collected_sets[i]) {
+				continue;
+			}
+
+			PropertySetHolder &h = property_sets.at_mutable(i);
+
+			if (h.get()) {
+				Size bytes = sizeof(PropertySet) + h.get()->capacity() * sizeof(PropertyElement);
+				property_set_map.erase(h.get());
+				account_set(*h.get(), false);
+				h.ptr.reset();
+				r.freed_bytes += bytes;
+				LHF_EVICTION(resident_bytes -= bytes;)
+			}
+#ifdef LHF_ENABLE_EVICTION
+			else {
+				Vector<IndexValue> &candidates = evicted_sets[h.hash];
+				candidates.erase(std::find(candidates.begin(), candidates.end(), i));
+				if (candidates.empty()) {
+					evicted_sets.erase(h.hash);
+				}
+				evicted_count--;
+			}
+
+			h.origin = OperationKind::INSERT;
+			h.spill_offset = NOT_SPILLED;
+#endif
+
+			collected_sets[i] = true;
+			r.freed_sets++;
+		}
+
+		if (compact) {
+			r.remap.assign(count, COLLECTED);
+			IndexValue next = 0;
+			for (Size i = 0; i < count; i++) {
+				if (!collected_sets[i]) {
+					r.remap[i] = next++;
+				}
+			}
+		}
+
+		gc_result = std::move(r);
+		renumbering = gc_result.remap;
+		gc_result.purged_entries = rewrite_operation_maps();
+
+		if (compact) {
+			renumber_sets();
+		}
+
+		gc_marks.clear();
+	}
+
+public:
+	/**
+	 * @brief      Pins a set as a root for garbage collection, so that it and
+	 *             everything it depends on survives `collect()`. Pins are
+	 *             reference counted.
+	 */
+	void pin(const Index &index) {
+		LHF_PROPERTY_SET_INDEX_VALID(index);
+		std::lock_guard<std::mutex> l(gc_mutex);
+		gc_roots[index.value]++;
+	}
+
+	/**
+	 * @brief      Releases a pin taken by `pin()`.
+	 */
+	void unpin(const Index &index) {
+		std::lock_guard<std::mutex> l(gc_mutex);
+		auto i = gc_roots.find(index.value);
+		if (i == gc_roots.end()) {
+			throw AssertError("Tried to unpin a set that is not pinned");
+		}
+		if (--i->second == 0) {
+			gc_roots.erase(i);
+		}
+	}
+
+	bool is_pinned(const Index &index) const {
+		std::lock_guard<std::mutex> l(gc_mutex);
+		return gc_roots.count(index.value) > 0;
+	}
+
+	/**
+	 * @brief      Returns whether a set was collected by `collect()` without
+	 *             compaction. Its index must not be used anymore.
+	 */
+	bool is_collected(const Index &index) const {
+		return index.value < collected_sets.size() && collected_sets[index.value];
+	}
+
+	/**
+	 * @brief      Frees the sets that are not reachable from the pinned sets
+	 *             (see `pin()`), and drops the cached operations that refer to
+	 *             them. The empty set is always reachable. With eviction
+	 *             enabled, the operands that a reachable evicted set would be
+	 *             recomputed from are reachable too.
+	 *
+	 *             Nested LHFs in the reference list are collected as well:
+	 *             their sets are reachable if they are pinned or referred to
+	 *             by a reachable set of a parent. Collect through the outermost
+	 *             LHF; collecting a nested LHF on its own only keeps its own
+	 *             pinned sets.
+	 *
+	 *             Without compaction, collected sets leave holes in the index
+	 *             space (see `is_collected()`). With compaction, the surviving
+	 *             sets are renumbered densely in their original order, and
+	 *             every index held outside the LHF must be translated with the
+	 *             returned remap. The remaps of nested LHFs are available from
+	 *             their `get_last_collection()`.
+	 *
+	 * @note       This must not run concurrently with any other operation
+	 *             on the LHF or the LHFs nested in it.
+	 *
+	 * @param[in]  compact  Whether to compact the LHFs afterwards.
+	 *
+	 * @return     What was collected in this LHF.
+	 */
+	CollectionResult collect(bool compact = false) {
+		__lhf_calc_functime(stat);
+		Size epoch = ++gc_epoch_counter;
+		gc_prepare(epoch);
+		gc_propagate();
+		gc_sweep(epoch, compact);
+		return gc_result;
+	}
+
+	/**
+	 * @brief      Returns the result of the last collection of this LHF,
+	 *             including collections done through a parent LHF.
+	 */
+	const CollectionResult &get_last_collection() const {
+		return gc_result;
+	}
+
+protected:
+	/**
+	 * @brief      Computes the renumbering used by `reorganize()`. Sets are
+	 *             ordered by how hot they are: their access count (with
+	 *             `LHF_ENABLE_ACCESS_COUNTS`), then the number of cached
+	 *             operations they take part in. Each set is followed by the
+	 *             sets it was operated on with, hottest first, so that pairs
+	 *             of operands end up close together.
+	 */
+	Vector<IndexValue> locality_order() const {
+		Size count = property_sets.size();
+		Vector<Size> heat(count, 0);
+		Vector<Size> degree(count, 0);
+		Vector<Vector<IndexValue>> partners(count);
+
+		auto visit = [&](const BinaryOperationMap &map) {
+			for (const auto &e : map) {
+				degree[e.first.left]++;
+				degree[e.first.right]++;
+				degree[e.second]++;
+				partners[e.first.left].push_back(e.first.right);
+				partners[e.first.right].push_back(e.first.left);
+			}
+		};
+
+		visit(unions);
+		visit(intersections);
+		visit(differences);
+
+#ifdef LHF_ENABLE_ACCESS_COUNTS
+		for (Size i = 0; i < count; i++) {
+			heat[i] = property_sets.at(i).accesses.load(std::memory_order_relaxed);
+		}
+#endif
+
+		auto hotter = [&](IndexValue a, IndexValue b) {
+			if (heat[a] != heat[b]) {
+				return heat[a] > heat[b];
+			} else if (degree[a] != degree[b]) {
+				return degree[a] > degree[b];
+			}
+			return a < b;
+		};
+
+		Vector<IndexValue> sets;
+		for (Size i = EMPTY_SET_VALUE + 1; i < count; i++) {
+			if (!is_collected(i)) {
+				sets.push_back(i);
+			}
+		}
+		std::sort(sets.begin(), sets.end(), hotter);
+
+		Vector<IndexValue> remap(count, COLLECTED);
+		IndexValue next = EMPTY_SET_VALUE;
+		remap[EMPTY_SET_VALUE] = next++;
+
+		for (IndexValue i : sets) {
+			if (remap[i] != COLLECTED) {
+				continue;
+			}
+			remap[i] = next++;
+
+			Vector<IndexValue> &p = partners[i];
+			std::sort(p.begin(), p.end(), hotter);
+			for (IndexValue j : p) {
+				if (remap[j] == COLLECTED && !is_collected(j)) {
+					remap[j] = next++;
+				}
+			}
+		}
+
+		return remap;
+	}
+
+	/// Reorganizes the LHFs nested in this one, then this one.
+	void reorganize_sets(Size epoch) {
+		if (reorganized_epoch == epoch) {
+			return;
+		}
+		reorganized_epoch = epoch;
+
+		LHF_EVICTION(std::lock_guard<std::recursive_mutex> l(eviction_mutex);)
+
+		if constexpr (Nesting::is_nested) {
+#ifdef LHF_ENABLE_EVICTION
+			// Evicted sets are recomputed through the nested LHFs, which is
+			// only possible before those are renumbered.
+			for (Size i = EMPTY_SET_VALUE + 1; i < property_sets.size(); i++) {
+				if (!is_collected(i)) {
+					materialize(i);
+				}
+			}
+#endif
+			std::apply([epoch](auto &... child) { (child.reorganize_sets(epoch), ...); }, reflist);
+		}
+
+		renumbering = locality_order();
+		rewrite_operation_maps();
+		renumber_sets();
+
+#ifdef LHF_ENABLE_ACCESS_COUNTS
+		// Decay the counts, so that later reorganizations follow changes in
+		// the access pattern.
+		for (Size i = 0; i < property_sets.size(); i++) {
+			std::atomic<Size> &c = property_sets.at(i).accesses;
+			c.store(c.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+		}
+#endif
+	}
+
+public:
+	/**
+	 * @brief      Renumbers the sets for locality, so that hot sets are
+	 *             stored contiguously and sets that are operated on together
+	 *             are close to each other (see `locality_order()`). The
+	 *             storage, operation caches, pins and the child indices of
+	 *             nested elements are rewritten consistently. Nested LHFs are
+	 *             reorganized too, and their renumberings are available from
+	 *             their `get_last_renumbering()`. Sets collected without
+	 *             compaction are dropped. The empty set stays at index 0.
+	 *
+	 *             Meant to be run offline or between phases of an analysis.
+	 *             Every index held outside the LHF must be translated with
+	 *             the returned renumbering.
+	 *
+	 * @note       This must not run concurrently with any other operation
+	 *             on the LHF or the LHFs nested in it.
+	 *
+	 * @return     The new index of every old set index (`COLLECTED` for
+	 *             collected sets).
+	 */
+	Vector<IndexValue> reorganize() {
+		__lhf_calc_functime(stat);
+		reorganize_sets(++gc_epoch_counter);
+		return renumbering;
+	}
+
+	/**
+	 * @brief      Returns the renumbering done by the last compacting
+	 *             collection or reorganization of this LHF (including those
+	 *             done through a parent LHF). Empty if the last collection
+	 *             did not compact.
+	 */
+	const Vector<IndexValue> &get_last_renumbering() const {
+		return renumbering;
+	}
+
+	/**
+	 * @brief      Gets the actual property set specified by index.
+	 *             With eviction enabled, an evicted set is recomputed first,
+	 *             and the reference stays valid until the next set is
+	 *             registered.
+	 *
+	 * @param[in]  index  The index
+	 *
+	 * @return     The property set.
+	 */
+	inline const PropertySet &get_value(const Index &index) const {
+		LHF_PROPERTY_SET_INDEX_VALID(index);
+		__LHF_ASSERT(!is_collected(index), "Tried to access a collected set");
+		count_access(index);
+#ifdef LHF_ENABLE_EVICTION
+		const PropertySetHolder &h = property_sets.at(index.value);
+		h.referenced.store(true, std::memory_order_relaxed);
+		if (h.is_evicted()) {
+			const_cast<LatticeHashForest *>(this)->materialize(index);
+		}
+		return *h.get();
+#else
+		return *property_sets.at(index.value).get();
+#endif
+	}
+
+	/**
+	 * @brief      Returns the total number of property sets currently in the
+	 *             LHF.
+	 *
+	 * @return     The count.
+	 */
+	inline Size property_set_count() const {
+		return property_sets.size();
+	}
+
+	/**
+	 * @brief      Returns an estimate of the memory used by this LHF, broken
+	 *             down by structure, with the usage of the LHFs nested in it
+	 *             as children. It is read from running counters and the sizes
+	 *             of the maps, without walking the sets, so it is cheap
+	 *             enough to poll. An LHF nested in several places is counted
+	 *             for each of them.
+	 */
+	MemoryUsage memory_usage() const {
+		MemoryUsage ret;
+		ret.name = name;
+		ret.sets = property_sets.size();
+		ret.element_bytes = element_bytes;
+		ret.slack_bytes = slack_bytes;
+		ret.holder_bytes =
+			property_sets.capacity() * sizeof(PropertySetHolder) +
+			resident_count * sizeof(PropertySet);
+		ret.property_set_map = property_set_map.memory();
+		ret.unions = unions.memory();
+		ret.intersections = intersections.memory();
+		ret.differences = differences.memory();
+		ret.subsets = subsets.memory();
+
+		if constexpr (Nesting::is_nested) {
+			std::apply(
+				[&ret](const auto &... child) { (ret.children.push_back(child.memory_usage()), ...); },
+				reflist);
+		}
+
+		return ret;
+	}
+
+	/**
+	 * @brief      Returns the size of the set at `index`
+	 *
+	 * @param[in]  index  The index
+	 *
+	 * @return     size of the set.
+	 */
+	inline Size size_of(const Index &index) const {
+		if (index == EMPTY_SET_VALUE) {
+			return 0;
+		} else {
+			return get_value(index).size();
+		}
+	}
+
+	/**
+	 * @brief      Less than comparator for operations. You MUST use this
+	 *             instead of directly using anything else like "<"
+	 *
+	 * @param[in]  a     LHS Property
+	 * @param[in]  b     RHS Property
+	 *
+	 * @return     Result of doing a < b according to provided semantics.
+	 */
+	static inline bool less(const PropertyElement &a, const PropertyElement &b) {
+		return a < b;
+	}
+
+	static inline bool less_key(const PropertyElement &a, const PropertyT &b) {
+		return PropertyLess()(a.get_key(), b);
+	}
+
+	static inline bool less_key(const PropertyElement &a, const PropertyElement &b) {
+		return PropertyLess()(a.get_key(), b.get_key());
+	}
+
+	/**
+	 * @brief      Equality comparator for operations. You MUST use this
+	 *             instead of directly using anything else like "<"
+	 *
+	 * @param[in]  a     LHS Property
+	 * @param[in]  b     RHS Property
+	 *
+	 * @return     Result of doing a == b according to provided semantics.
+	 */
+	static inline bool equal(const PropertyElement &a, const PropertyElement &b) {
+		return a == b;
+	}
+
+	static inline bool equal_key(const PropertyElement &a, const PropertyT &b) {
+		return PropertyEqual()(a.get_key(), b);
+	}
+
+	static inline bool equal_key(const PropertyElement &a, const PropertyElement &b) {
+		return PropertyEqual()(a.get_key(), b.get_key());
+	}
+
+	/**
+	 * @brief      Finds a property element in the set based on the key
+	 *             provided.
+	 *
+	 * @param[in]  index  Set Index
+	 * @param[in]  p      Key
+	 *
+	 * @return     An optional that contains a property element if the key was
+	 *             found.
+	 */
+	inline OptionalRef<PropertyElement> find_key(const Index &index, const PropertyT &p) const {
+		if (is_empty(index)) {
+			return OptionalRef<PropertyElement>::absent();
+		}
+
+		const PropertySet &s = get_value(index);
+		return find_key_in(s.data(), s.size(), p);
+	}
+
+	/**
+	 * @brief      Determines whether the property set at `index` contains the
+	 *             element `prop` or not.
+	 *
+	 * @param[in]  index  The index
+	 * @param[in]  prop   The property
+	 *
+	 * @return     `true` if `prop` is in `index`, false otherwise.
+	 */
+	inline bool contains(const Index &index, const PropertyElement &prop) const {
+		if (is_empty(index)) {
+			return false;
+		}
+
+		const PropertySet &s = get_value(index);
+		return find_key_in(s.data(), s.size(), prop).is_present();
+	}
+
+	/**
+	 * @brief      Finds the property element with the key `p` in the sorted
+	 *             array of property elements `[s, s + size)`.
+	 *
+	 * @param[in]  s     The first element
+	 * @param[in]  size  The number of elements
+	 * @param[in]  p     Key (or an element with the key)
+	 *
+	 * @return     An optional that contains a property element if the key was
+	 *             found.
+	 */
+	template<typename Key>
+	static OptionalRef<PropertyElement> find_key_in(
+		const PropertyElement *s, Size size, const Key &p) {
+
+		if (size <= LHF_SORTED_VECTOR_BINARY_SEARCH_THRESHOLD) {
+			for (Size i = 0; i < size; i++) {
+				if (equal_key(s[i], p)) {
+					return OptionalRef<PropertyElement>(s[i]);
+				}
+			}
+		} else {
+			// Binary search implementation
+			std::int64_t low = 0;
+			std::int64_t high = size - 1;
+
+			while (low <= high) {
+				std::int64_t mid = low + (high - low) / 2;
+
+				if (equal_key(s[mid], p)) {
+					return OptionalRef<PropertyElement>(s[mid]);
+				} else if (less_key(s[mid], p)) {
+					low = mid + 1;
+				} else {
+					high = mid - 1;
+				}
+			}
+		}
+
+		return OptionalRef<PropertyElement>::absent();
+	}
+
+	/**
+	 * @brief      Union kernel. Merges the sorted ranges
+	 *             `[cursor_1, cursor_end_1)` and `[cursor_2, cursor_end_2)`
+	 *             into `new_set`.
+	 *
+	 * @note       The union implementation here is adapted from the example
+	 *             suggested implementation provided of std::set_union from
+	 *             cppreference.com
+	 */
+	template<typename Iterator>
+	void union_merge(
+		Iterator cursor_1, const Iterator cursor_end_1,
+		Iterator cursor_2, const Iterator cursor_end_2,
+		PropertySet &new_set) {
+		while (cursor_1 != cursor_end_1) {
+			if (cursor_2 == cursor_end_2) {
+				LHF_PUSH_RANGE(new_set, cursor_1, cursor_end_1);
+				break;
+			}
+
+			if (less(*cursor_2, *cursor_1)) {
+				LHF_PUSH_ONE(new_set, *cursor_2);
+				cursor_2++;
+			} else {
+				if (!(less(*cursor_1, *cursor_2))) {
+					if constexpr (Nesting::is_nested) {
+						PropertyElement new_elem =
+							LHF_PERFORM_BINARY_NESTED_OPERATION(
+								set_union, reflist, *cursor_1, *cursor_2);
+						LHF_PUSH_ONE(new_set, new_elem);
+					} else {
+						LHF_PUSH_ONE(new_set, *cursor_1);
+					}
+					cursor_2++;
+				} else {
+					LHF_PUSH_ONE(new_set, *cursor_1);
+				}
+				cursor_1++;
+			}
+		}
+
+		LHF_PUSH_RANGE(new_set, cursor_2, cursor_end_2);
+	}
+
+	/**
+	 * @brief      Difference kernel. Writes the elements of the sorted range
+	 *             `[cursor_1, cursor_end_1)` that are not in the sorted range
+	 *             `[cursor_2, cursor_end_2)` to `new_set`.
+	 *
+	 * @note       The difference implementation here is adapted from the
+	 *             example suggested implementation provided of
+	 *             std::set_difference from cppreference.com
+	 */
+	template<typename Iterator>
+	void difference_merge(
+		Iterator cursor_1, const Iterator cursor_end_1,
+		Iterator cursor_2, const Iterator cursor_end_2,
+		PropertySet &new_set) {
+		while (cursor_1 != cursor_end_1) {
+			if (cursor_2 == cursor_end_2) {
+				LHF_PUSH_RANGE(new_set, cursor_1, cursor_end_1);
+				break;
+			}
+
+			if (less(*cursor_1, *cursor_2)) {
+				LHF_PUSH_ONE(new_set, *cursor_1);
+				cursor_1++;
+			} else {
+				if (!(less(*cursor_2, *cursor_1))) {
+					if constexpr (Nesting::is_nested) {
+						PropertyElement new_elem =
+							LHF_PERFORM_BINARY_NESTED_OPERATION(
+								set_difference, reflist, *cursor_1, *cursor_2);
+						LHF_PUSH_ONE(new_set, new_elem);
+					}
+					cursor_1++;
+				}
+				cursor_2++;
+			}
+		}
+	}
+
+	/**
+	 * @brief      Intersection kernel. Writes the elements common to the
+	 *             sorted ranges `[cursor_1, cursor_end_1)` and
+	 *             `[cursor_2, cursor_end_2)` to `new_set`.
+	 *
+	 * @note       The intersection implementation here is adapted from the
+	 *             example suggested implementation provided for
+	 *             std::set_intersection from cppreference.com
+	 */
+	template<typename Iterator>
+	void intersection_merge(
+		Iterator cursor_1, const Iterator cursor_end_1,
+		Iterator cursor_2, const Iterator cursor_end_2,
+		PropertySet &new_set) {
+		while (cursor_1 != cursor_end_1 && cursor_2 != cursor_end_2) {
+			if (less(*cursor_1,*cursor_2)) {
+				cursor_1++;
+			} else {
+				if (!(less(*cursor_2, *cursor_1))) {
+					if constexpr (Nesting::is_nested) {
+						PropertyElement new_elem =
+							LHF_PERFORM_BINARY_NESTED_OPERATION(
+								set_intersection, reflist, *cursor_1, *cursor_2);
+						LHF_PUSH_ONE(new_set, new_elem);
+					} else {
+						LHF_PUSH_ONE(new_set, *cursor_1);
+					}
+					cursor_1++;
+				}
+				cursor_2++;
+			}
+		}
+	}
+
+	/**
+	 * @brief      Runs a merge kernel over two property sets. In parallel
+	 *             builds, if the operands together have at least
+	 *             `Config::PARALLEL_MERGE_THRESHOLD` elements, both operands
+	 *             are split at matching splitter keys (found by binary search)
+	 *             and the partitions are merged in parallel and concatenated.
+	 *
+	 *             Splitting by key keeps the elements with equal keys in the
+	 *             same partition, so every kernel can be partitioned this way.
+	 *             For nested LHFs, this also dispatches the per-element
+	 *             operations on the children in parallel.
+	 *
+	 * @param[in]  first   The first operand
+	 * @param[in]  second  The second operand
+	 * @param[in]  merge   The kernel (e.g. `union_merge`)
+	 *
+	 * @return     The merged set.
+	 */
+	template<typename Merge>
+	PropertySet partitioned_merge(
+		const PropertySet &first,
+		const PropertySet &second,
+		Merge merge) {
+		PropertySet new_set = make_set();
+
+#if defined(LHF_ENABLE_PARALLEL) || defined(LHF_ENABLE_TBB)
+		const Size total = first.size() + second.size();
+		const Size parts = std::min(parallel_concurrency(), total / LHF_PARALLEL_MERGE_MIN_PARTITION);
+
+		if (total >= PARALLEL_MERGE_THRESHOLD && parts > 1) {
+			using Iterator = typename PropertySet::const_iterator;
+			const PropertySet &pivot = first.size() >= second.size() ? first : second;
+			auto key_less = [](const PropertyElement &a, const PropertyElement &b) {
+				return less(a, b);
+			};
+
+			Vector<Iterator> split_1 = {first.begin()};
+			Vector<Iterator> split_2 = {second.begin()};
+
+			for (Size p = 1; p < parts; p++) {
+				const PropertyElement &key = pivot[p * pivot.size() / parts];
+				split_1.push_back(std::lower_bound(split_1.back(), first.end(), key, key_less));
+				split_2.push_back(std::lower_bound(split_2.back(), second.end(), key, key_less));
+			}
+
+			split_1.push_back(first.end());
+			split_2.push_back(second.end());
+
+			Vector<PropertySet> results(parts);
+			TaskGroup group;
+
+			for (Size p = 0; p < parts; p++) {
+				group.run([&, p]() {
+					merge(split_1[p], split_1[p + 1], split_2[p], split_2[p + 1], results[p]);
+				});
+			}
+
+			group.wait();
+
+			Size result_size = 0;
+			for (const PropertySet &r : results) {
+				result_size += r.size();
+			}
+
+			new_set.reserve(result_size);
+			for (PropertySet &r : results) {
+				LHF_PUSH_RANGE(new_set,
+					std::make_move_iterator(r.begin()),
+					std::make_move_iterator(r.end()));
+			}
+
+			return new_set;
+		}
+#endif
+
+		merge(first.begin(), first.end(), second.begin(), second.end(), new_set);
+		return new_set;
+	}
+
+	/// Computes the union of two property sets (without any caching).
+	PropertySet compute_union(const PropertySet &first, const PropertySet &second) {
+		return partitioned_merge(first, second, [this](auto &&...args) {
+			union_merge(std::forward<decltype(args)>(args)...);
+		});
+	}
+
+	/// Computes the difference of two property sets (without any caching).
+	PropertySet compute_difference(const PropertySet &first, const PropertySet &second) {
+		return partitioned_merge(first, second, [this](auto &&...args) {
+			difference_merge(std::forward<decltype(args)>(args)...);
+		});
+	}
+
+	/// Computes the intersection of two property sets (without any caching).
+	PropertySet compute_intersection(const PropertySet &first, const PropertySet &second) {
+		return partitioned_merge(first, second, [this](auto &&...args) {
+			intersection_merge(std::forward<decltype(args)>(args)...);
+		});
+	}
+
+	/**
+	 * @brief      Calculates, or returns a cached result of the union
+	 *             of `a` and `b`
+	 *
+	 * @param[in]  a     The first set
+	 * @param[in]  b     The second set
+	 *
+	 * @return     Index of the new property set.
+	 */
+	LHF_BINARY_NESTED_OPERATION(set_union)
+	Index set_union(const Index &_a, const Index &_b) {
+		LHF_PROPERTY_SET_PAIR_VALID(_a, _b);
+		__lhf_calc_functime(stat);
+
+		if (_a == _b) {
+			LHF_PERF_INC(unions, equal_hits);
+			return Index(_a);
+		}
+
+		if (is_empty(_a)) {
+			LHF_PERF_INC(unions, empty_hits);
+			return Index(_b);
+		} else if (is_empty(_b)) {
+			LHF_PERF_INC(unions,empty_hits);
+			return Index(_a);
+		}
+
+		const Index &a = std::min(_a, _b);
+		const Index &b = std::max(_a, _b);
+
+		SubsetRelation r = is_subset(a, b);
+
+		if (r == SUBSET) {
+			LHF_PERF_INC(unions, subset_hits);
+			return Index(b);
+		} else if (r == SUPERSET) {
+			LHF_PERF_INC(unions, subset_hits);
+			return Index(a);
+		}
+
+		count_access(a);
+		count_access(b);
+
+		auto result = unions.find({a.value, b.value});
+
+		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
+			PropertySet new_set = compute_union(get_value(a), get_value(b));
+
+			bool cold = false;
+			Index ret;
+
+			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
+				ret = result.get();
+				restore(ret, std::move(new_set));
+			} else) {
+				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
+
+				unions.insert({{a.value, b.value}, ret.value});
+				journal_operation(JournalRecordType::UNION, a.value, b.value, ret.value);
+				LHF_EVICTION(record_origin(ret, OperationKind::UNION, a, b);)
+
+				if (ret == a) {
+					store_subset(b, ret);
+				} else if (ret == b) {
+					store_subset(a, ret);
+				} else {
+					store_subset(a, ret);
+					store_subset(b, ret);
+				}
+			}
+
+			if (cold) {
+				LHF_PERF_INC(unions, cold_misses);
+			} else {
+				LHF_PERF_INC(unions, edge_misses);
+			}
+
+			return Index(ret);
+		} else {
+			LHF_PERF_INC(unions, hits);
+			LHF_EVICTION(touch(result.get());)
+			return Index(result.get());
+		}
+	}
+
+	/**
+	 * @brief      Inserts a single element from a given set (and returns the
+	 *             index of the set). This is a wrapper over the union
+	 *             operation.
+	 *
+	 * @param[in]  a     The set to insert the element to
+	 * @param[in]  b     The element to be inserted.
+	 *
+	 * @return     Index of the new PropertySet.
+	 */
+	Index set_insert_single(const Index &a, const PropertyElement &b) {
+		return set_union(a, register_set_single(b));
+	}
+
+	/**
+	 * @brief      Calculates, or returns a cached result of the difference
+	 *             of `a` from `b`
+	 *
+	 * @param[in]  a     The first set (what to subtract from)
+	 * @param[in]  b     The second set (what will be subtracted)
+	 *
+	 * @return     Index of the new PropertySet.
+	 */
+	LHF_BINARY_NESTED_OPERATION(set_difference)
+	Index set_difference(const Index &a, const Index &b) {
+		LHF_PROPERTY_SET_PAIR_VALID(a, b);
+		__lhf_calc_functime(stat);
+
+		if (a == b) {
+			LHF_PERF_INC(differences, equal_hits);
+			return Index(EMPTY_SET_VALUE);
+		}
+
+		if (is_empty(a)) {
+			LHF_PERF_INC(differences, empty_hits);
+			return Index(EMPTY_SET_VALUE);
+		} else if (is_empty(b)) {
+			LHF_PERF_INC(differences, empty_hits);
+			return Index(a);
+		}
+
+		count_access(a);
+		count_access(b);
+
+		auto result = differences.find({a.value, b.value});
+
+		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
+			PropertySet new_set = compute_difference(get_value(a), get_value(b));
+
+			bool cold = false;
+			Index ret;
+
+			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
+				ret = result.get();
+				restore(ret, std::move(new_set));
+			} else) {
+				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
+				differences.insert({{a.value, b.value}, ret.value});
+				journal_operation(JournalRecordType::DIFFERENCE, a.value, b.value, ret.value);
+				LHF_EVICTION(record_origin(ret, OperationKind::DIFFERENCE, a, b);)
+
+				if (ret != a) {
+					store_subset(ret, a);
+				} else {
+					intersections.insert({
+						{
+							std::min(a.value, b.value),
+							std::max(a.value, b.value)
+						}, EMPTY_SET_VALUE});
+					journal_operation(
+						JournalRecordType::INTERSECTION,
+						std::min(a.value, b.value),
+						std::max(a.value, b.value), EMPTY_SET_VALUE);
+				}
+			}
+
+			if (cold) {
+				LHF_PERF_INC(differences, cold_misses);
+			} else {
+				LHF_PERF_INC(differences, edge_misses);
+			}
+
+			return Index(ret);
+		} else {
+			LHF_PERF_INC(differences, hits);
+			LHF_EVICTION(touch(result.get());)
+			return Index(result.get());
+		}
+	}
+
+	/**
+	 * @brief      Removes a single element from a given set (and returns the
+	 *             index of the set). This is a wrapper over the diffrerence
+	 *             operation.
+	 *
+	 * @param[in]  a     The set to remove the element from
+	 * @param[in]  b     The element to be removed
+	 *
+	 * @return     Index of the new PropertySet.
+	 */
+	Index set_remove_single(const Index &a, const PropertyElement &b) {
+		return set_difference(a, register_set_single(b));
+	}
+
+	/**
+	 * @brief      Removes a single element from a given set if the "key"
+	 *             element matches.
+	 *
+	 * @param[in]  a     The set to remove the element from
+	 * @param[in]  p     The key of the element with that is to be removed
+	 *
+	 * @return     Index of the new PropertySet.
+	 */
+	Index set_remove_single_key(const Index &a, const PropertyT &p) {
+		PropertySet new_set = make_set();
+		const PropertySet &first = get_value(a);
+
+		auto cursor_1 = first.begin();
+		const auto &cursor_end_1 = first.end();
+
+		for (;cursor_1 != cursor_end_1; cursor_1++) {
+			if (!PropertyEqual()(cursor_1->get_key(), p)) {
+				LHF_PUSH_ONE(new_set, *cursor_1);
+			}
+		}
+		return register_set<true>(std::move(new_set));
+	}
+
+	/**
+	 * @brief      Calculates, or returns a cached result of the intersection
+	 *             of `a` and `b`
+	 *
+	 * @param[in]  a     The first set
+	 * @param[in]  b     The second set
+	 *
+	 * @return     Index of the new property set.
+	 */
+	LHF_BINARY_NESTED_OPERATION(set_intersection)
+	Index set_intersection(const Index &_a, const Index &_b) {
+		LHF_PROPERTY_SET_PAIR_VALID(_a, _b);
+		__lhf_calc_functime(stat);
+
+		if (_a == _b) {
+			LHF_PERF_INC(intersections, equal_hits);
+			return Index(_a);
+		}
+
+		if (is_empty(_a) || is_empty(_b)) {
+			LHF_PERF_INC(intersections, empty_hits);
+			return Index(EMPTY_SET_VALUE);
+		}
+
+		const Index &a = std::min(_a, _b);
+		const Index &b = std::max(_a, _b);
+
+		SubsetRelation r = is_subset(a, b);
+
+		if (r == SUBSET) {
+			LHF_PERF_INC(intersections, subset_hits);
+			return Index(a);
+		} else if (r == SUPERSET) {
+			LHF_PERF_INC(intersections, subset_hits);
+			return Index(b);
+		}
+
+		count_access(a);
+		count_access(b);
+
+		auto result = intersections.find({a.value, b.value});
+
+		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
+			PropertySet new_set = compute_intersection(get_value(a), get_value(b));
+
+			bool cold = false;
+			Index ret;
+
+			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
+				ret = result.get();
+				restore(ret, std::move(new_set));
+			} else){
+				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
+				intersections.insert({{a.value, b.value}, ret.value});
+				journal_operation(JournalRecordType::INTERSECTION, a.value, b.value, ret.value);
+				LHF_EVICTION(record_origin(ret, OperationKind::INTERSECTION, a, b);)
+
+				if (ret != a) {
+					store_subset(ret, a);
+				} else if (ret != b) {
+					store_subset(ret, b);
+				} else {
+					store_subset(ret, a);
+					store_subset(ret, b);
+				}
+			}
+
+			if (cold) {
+				LHF_PERF_INC(intersections, cold_misses);
+			} else {
+				LHF_PERF_INC(intersections, edge_misses);
+			}
+			return Index(ret);
+		}
+
+		LHF_PERF_INC(intersections, hits);
+		LHF_EVICTION(touch(result.get());)
+		return Index(result.get());
+	}
+
+
+	/**
+	 * @brief      Filters a set based on a criterion function.
+	 *             This is supposed to be an abstract filtering mechanism that
+	 *             derived classes will use to implement caching on a filter
+	 *             operation rather than letting them implement their own.
+	 *
+	 * @param[in]  s            The set to filter
+	 * @param[in]  filter_func  The filter function (can be a lambda)
+	 * @param      cache        The cache to use (possibly defined by the user)
+	 *
+	 * @todo Implement sort bound optimization
+	 * @todo Implement bounding as a seperate function instead
+	 *
+	 * @return     Index of the filtered set.
+	 */
+	Index set_filter(
+		Index s,
+		std::function<bool(const PropertyElement &)> filter_func,
+		UnaryOperationMap &cache) {
+		LHF_PROPERTY_SET_INDEX_VALID(s);
+		__lhf_calc_functime(stat);
+
+		if (is_empty(s)) {
+			return s;
+		}
+
+		auto result = cache.find(s.value);
+
+		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
+			PropertySet new_set = make_set();
+			for (const PropertyElement &value : get_value(s)) {
+				if (filter_func(value)) {
+					LHF_PUSH_ONE(new_set, value);
+				}
+			}
+
+			bool cold = false;
+			Index ret;
+
+			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
+				ret = result.get();
+				restore(ret, std::move(new_set));
+			} else) {
+				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
+				cache.insert(std::make_pair(s.value, ret.value));
+			}
 
-	static constexpr const char *name = Config::name;
-	static constexpr Size BLOCK_SIZE = Config::BLOCK_SIZE;
-	static constexpr Size BLOCK_MASK = Config::BLOCK_MASK;
-	static constexpr Size BLOCK_SHIFT = Config::BLOCK_SHIFT;
+			if (cold) {
+				LHF_PERF_INC(filter, cold_misses);
+			} else {
+				LHF_PERF_INC(filter, edge_misses);
+			}
+
+			return Index(ret);
+		} else {
+			LHF_PERF_INC(filter, hits);
+			LHF_EVICTION(touch(result.get());)
+			return Index(result.get());
+		}
+	}
 
 	/**
-	 * @brief      Index returned by an operation. Being defined inside the
-	 *             class ensures type safety and possible future extensions.
+	 * @brief      Operand of a request in an operation batch. It is either an
+	 *             existing set index, or the result of an earlier request in
+	 *             the same batch.
 	 */
-	struct Index {
+	struct BatchOperand {
 		IndexValue value;
+		bool is_result;
 
-		Index(IndexValue idx = EMPTY_SET_VALUE): value(idx) {}
+		BatchOperand(const Index &idx): value(idx.value), is_result(false) {}
 
-		bool is_empty() const {
-			return value == EMPTY_SET_VALUE;
+		/**
+		 * @brief      Refers to the result of request number `request` of
+		 *             the batch. The request must come earlier in the batch.
+		 */
+		static BatchOperand result_of(Size request) {
+			BatchOperand ret = Index(request);
+			ret.is_result = true;
+			return ret;
 		}
 
-		bool operator==(const Index &b) const {
-			return value == b.value;
+		bool operator==(const BatchOperand &b) const {
+			return value == b.value && is_result == b.is_result;
 		}
 
-		bool operator!=(const Index &b) const {
-			return value != b.value;
+		bool operator<(const BatchOperand &b) const {
+			return std::make_pair(is_result, value) <
+			       std::make_pair(b.is_result, b.value);
 		}
+	};
 
-		bool operator<(const Index &b) const {
-			return value < b.value;
-		}
+	/**
+	 * @brief      A request in an operation batch. See `execute_batch`.
+	 */
+	struct BatchRequest {
+		OperationKind kind;
+		BatchOperand left;
+		BatchOperand right;
 
-		bool operator>(const Index &b) const {
-			return value > b.value;
+		/// Element to insert for `OperationKind::INSERT` requests.
+		std::optional<PropertyElement> element = std::nullopt;
+
+		static BatchRequest set_union(const BatchOperand &a, const BatchOperand &b) {
+			return {OperationKind::UNION, a, b};
 		}
 
-		String to_string() const {
-			return std::to_string(value);
+		static BatchRequest set_intersection(const BatchOperand &a, const BatchOperand &b) {
+			return {OperationKind::INTERSECTION, a, b};
 		}
 
-		friend std::ostream& operator<<(std::ostream& os, const Index& obj) {
-			os << obj.to_string();
-			return os;
+		static BatchRequest set_difference(const BatchOperand &a, const BatchOperand &b) {
+			return {OperationKind::DIFFERENCE, a, b};
 		}
 
-		struct Hash {
-			Size operator()(const Index &idx) const {
-				return DefaultHash<IndexValue>()(idx.value);
-			}
-		};
+		static BatchRequest set_insert_single(const BatchOperand &a, const PropertyElement &e) {
+			return {OperationKind::INSERT, a, Index(), e};
+		}
 	};
 
 	/**
-	 * The canonical element of property sets. Changes based on the nesting
-	 * behaviour supplied.
+	 * @brief      Returns the result of an operation if it can be answered
+	 *             without computing anything: the trivial cases, known subset
+	 *             relations and the operation caches. Performance counters are
+	 *             not updated.
+	 *
+	 * @param[in]  kind  The operation (`INSERT` is not supported)
+	 * @param[in]  a     The first set
+	 * @param[in]  b     The second set
+	 *
+	 * @return     The result if it is already known.
 	 */
-	using PropertyElement =
-		typename Nesting::template PropertyElement<
-			PropertyLess,
-			PropertyHash,
-			PropertyEqual,
-			PropertyPrinter>;
+	Optional<Index> find_cached_operation(OperationKind kind, const Index &a, const Index &b) const {
+		LHF_PROPERTY_SET_PAIR_VALID(a, b);
+
+		Optional<Index> result = lookup_operation(*this, kind, a, b);
+
+		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
+			return Optional<Index>::absent();
+		}
+
+		return result;
+	}
 
+protected:
 	/**
-	 * The storage structure for property elements. Currently implemented as
-	 * sorted vectors.
+	 * @brief      Implements `find_cached_operation` for both the LHF and its
+	 *             frozen form (see `Frozen`), which name their caches alike.
 	 */
-	using PropertySet = std::vector<PropertyElement>;
+	template<typename Forest>
+	static Optional<Index> lookup_operation(
+		const Forest &f, OperationKind kind, const Index &a, const Index &b) {
+
+		const Index &lo = std::min(a, b);
+		const Index &hi = std::max(a, b);
+		OperationNode node = {lo.value, hi.value};
+		auto probe = [&node](const auto &cache) -> Optional<Index> {
+			auto result = cache.find(node);
+			if (!result.is_present()) {
+				return Optional<Index>::absent();
+			}
+			return Index(result.get());
+		};
 
-	using PropertySetHash =
-		SetHash<
-			PropertySet,
-			PropertyElement,
-			typename PropertyElement::Hash>;
+		switch (kind) {
+		case OperationKind::UNION: {
+			if (a == b || b.is_empty()) {
+				return a;
+			} else if (a.is_empty()) {
+				return b;
+			}
 
-	using PropertySetFullEqual =
-		SetEqual<
-			PropertySet,
-			PropertyElement,
-			typename PropertyElement::FullEqual>;
+			SubsetRelation r = f.is_subset(lo, hi);
+			if (r != UNKNOWN) {
+				return r == SUBSET ? hi : lo;
+			}
+
+			return probe(f.unions);
+		}
+
+		case OperationKind::INTERSECTION: {
+			if (a == b) {
+				return a;
+			} else if (a.is_empty() || b.is_empty()) {
+				return Index(EMPTY_SET_VALUE);
+			}
+
+			SubsetRelation r = f.is_subset(lo, hi);
+			if (r != UNKNOWN) {
+				return r == SUBSET ? lo : hi;
+			}
+
+			return probe(f.intersections);
+		}
+
+		case OperationKind::DIFFERENCE: {
+			if (a == b || a.is_empty()) {
+				return Index(EMPTY_SET_VALUE);
+			} else if (b.is_empty()) {
+				return a;
+			}
 
+			node = {a.value, b.value};
+			return probe(f.differences);
+		}
+
+		default:
+			throw AssertError("Operation cannot be looked up in a cache");
+		}
+	}
+
+public:
 	/**
-	 * The structure responsible for mapping property sets to their respective
-	 * unique indices. When a key-value pair is actually inserted into the map,
-	 * the key is a pointer to a valid storage location held by a member of
-	 * the property set storage vector.
+	 * @brief      Executes a batch of operations and returns the result of
+	 *             each request, in order.
 	 *
-	 * @note The reason the 'key type' of the map is a pointer to a property set
-	 *       is because of several reasons:
+	 *             Requests may use the results of earlier requests as
+	 *             operands (see `BatchOperand::result_of`), which makes the
+	 *             batch a DAG of operations. Identical requests in the batch
+	 *             are computed once, requests that can be answered from the
+	 *             caches are resolved inline on the dispatching thread, and
+	 *             the rest are scheduled on the task scheduler as soon as
+	 *             their operands are available (see `TaskGroup`).
 	 *
-	 *       * Allows us to query arbitrary/user created property sets on the
-	 *         map.
-	 *       * Makes it not necessary to actually directly store the property
-	 *         set as a key.
-	 *       * Saves us from having to do some sort of complicated manuever to
-	 *         reserve an index value temporarily and rewrite the hash and
-	 *         equality comparators to retrieve the property sets from the
-	 *         indices instead.
+	 * @note       Without `LHF_ENABLE_PARALLEL` or `LHF_ENABLE_TBB`, the
+	 *             batch is executed sequentially on the calling thread.
 	 *
-	 *       Careful handling, especially in the case of reallocating structures
-	 *       like vectors is needed so that the address of the data does not
-	 *       change. It must remain static for the duration of the existence of
-	 *       the LHF instance.
+	 * @param[in]  batch  The requests.
+	 *
+	 * @return     Indices of the results of each request.
 	 */
-#ifdef LHF_ENABLE_TBB
-	using PropertySetMap =
-		MapAdapter<tbb::concurrent_hash_map<
-			const PropertySet *, IndexValue,
-			TBBHashCompare<
-				const PropertySet *,
-				PropertySetHash,
-				PropertySetFullEqual>>>;
-#else
-	using PropertySetMap =
-		MapAdapter<std::unordered_map<
-			const PropertySet *, IndexValue,
-			PropertySetHash,
-			PropertySetFullEqual>>;
-#endif
+	Vector<Index> execute_batch(const Vector<BatchRequest> &batch) {
+		__lhf_calc_functime(stat);
 
-	using UnaryOperationMap = OperationMap<IndexValue>;
-	using BinaryOperationMap = OperationMap<OperationNode>;
-	using RefList = typename Nesting::LHFReferenceList;
+		struct Key {
+			OperationKind kind;
+			BatchOperand left;
+			BatchOperand right;
 
-protected:
-	RefList reflist;
+			bool operator==(const Key &k) const {
+				return kind == k.kind && left == k.left && right == k.right;
+			}
 
-#ifdef LHF_ENABLE_PERFORMANCE_METRICS
-	PerformanceStatistics stat;
-	HashMap<String, OperationPerf> perf;
-#endif
+			struct Hash {
+				Size operator()(const Key &k) const {
+					Size ret = compose_hash(0, static_cast<int>(k.kind));
+					ret = compose_hash(ret, k.left.value);
+					ret = compose_hash(ret, k.left.is_result);
+					ret = compose_hash(ret, k.right.value);
+					return compose_hash(ret, k.right.is_result);
+				}
+			};
+		};
 
-	struct PropertySetHolder {
-		using PtrContainer = UniquePointer<PropertySet>;
-		using Ptr = typename PtrContainer::pointer;
+		const Size n = batch.size();
 
-		mutable PtrContainer ptr;
+		// Each request is lowered to a canonical node: insertions become
+		// unions, commutative operands are ordered, and references to
+		// duplicate requests are redirected to the first occurrence.
+		Vector<Key> nodes;
+		Vector<Size> canonical(n);
+		HashMap<Key, Size, typename Key::Hash> seen;
 
-		PropertySetHolder(Ptr &&p): ptr(p) {}
+		nodes.reserve(n);
 
-		Ptr get() const {
-			return ptr.get();
-		}
+		auto resolve = [&](const BatchOperand &o, Size i) {
+			if (!o.is_result) {
+				LHF_PROPERTY_SET_INDEX_VALID(Index(o.value));
+				return o;
+			} else if (o.value >= i) {
+				throw AssertError("Batch request " + std::to_string(i) +
+					" refers to a request that does not precede it");
+			}
+			return BatchOperand::result_of(canonical[o.value]);
+		};
 
-		bool is_evicted() const {
-#ifdef LHF_ENABLE_EVICTION
-			return ptr.get() == nullptr;
-#else
-			return false;
-#endif
-		}
+		for (Size i = 0; i < n; i++) {
+			const BatchRequest &r = batch[i];
+			Key k = {r.kind, resolve(r.left, i), r.right};
 
-#ifdef LHF_ENABLE_EVICTION
+			if (r.kind == OperationKind::INSERT) {
+				k.kind = OperationKind::UNION;
+				k.right = register_set_single(r.element.value());
+			} else {
+				k.right = resolve(r.right, i);
+			}
 
-		void evict() {
-			__LHF_ASSERT(is_present(),
-				"Tried to evict an already absent property set")
-			ptr.release();
-		}
+			if (k.kind != OperationKind::DIFFERENCE && k.right < k.left) {
+				std::swap(k.left, k.right);
+			}
 
-		void reassign(Ptr &&p) {
-			__LHF_ASSERT(!is_present(),
-				"Tried to reassign when a property set is already present");
-			ptr.reset(p);
-		}
+			auto it = seen.find(k);
+			if (it != seen.end()) {
+				canonical[i] = it->second;
+			} else {
+				canonical[i] = i;
+				seen.insert({k, i});
+			}
 
-		void swap(PropertySetHolder &p) {
-			__LHF_ASSERT(!is_present(),
-				"Tried to reassign when a property set is already present");
-			__LHF_ASSERT(p.is_present(),
-				"Attempted to swap to a null pointer");
-			ptr.swap(p.ptr);
+			nodes.push_back(k);
 		}
 
-#endif
-	};
-
-#if defined(LHF_ENABLE_TBB)
+		Vector<Vector<Size>> dependents(n);
+		Vector<std::atomic<Size>> waiting(n);
+		Vector<IndexValue> results(n, EMPTY_SET_VALUE);
+		Vector<Size> ready;
 
-	class PropertySetStorage {
-	protected:
-		/// @note Not marking this as mutable will not allow us to get a
-		///       non-const reference on index-based access. Non-constness
-		//        is important for eviction to work.
-		mutable tbb::concurrent_vector<PropertySetHolder> data = {};
+		for (Size i = 0; i < n; i++) {
+			waiting[i] = 0;
+			if (canonical[i] != i) {
+				continue;
+			}
 
-	public:
-		/**
-		 * @brief      Retuns a mutable reference to the property set holder at
-		 *             a given set index. This is useful for eviction based
-		 *             functions.
-		 *
-		 * @param[in]  idx   Set index
-		 *
-		 * @return     A mutable propety set holder reference.
-		 */
-		PropertySetHolder &at_mutable(const Index &idx) const {
-			return data.at(idx.value);
-		}
+			for (const BatchOperand *o : {&nodes[i].left, &nodes[i].right}) {
+				if (o->is_result) {
+					dependents[o->value].push_back(i);
+					waiting[i]++;
+				}
+			}
 
-		const PropertySetHolder &at(const Index &idx) const {
-			return data.at(idx.value);
+			if (waiting[i] == 0) {
+				ready.push_back(i);
+			}
 		}
 
-		Index push_back(PropertySetHolder &&p) {
-			auto it = data.push_back(std::move(p));
-			return it - data.begin();
-		}
+		auto operand = [&](const BatchOperand &o) {
+			return o.is_result ? Index(results[o.value]) : Index(o.value);
+		};
 
-		void clear() {
-			data.clear();
-		}
+		auto release = [&](Size i, Vector<Size> &next) {
+			for (Size j : dependents[i]) {
+				if (waiting[j].fetch_sub(1) == 1) {
+					next.push_back(j);
+				}
+			}
+		};
 
-		Size size() const {
-			return data.size();
-		}
+		TaskGroup group;
+		std::function<void(Vector<Size> &)> dispatch;
 
+		dispatch = [&](Vector<Size> &queue) {
+			while (!queue.empty()) {
+				Size i = queue.back();
+				queue.pop_back();
 
-	};
+				const Key &k = nodes[i];
+				Optional<Index> hit =
+					find_cached_operation(k.kind, operand(k.left), operand(k.right));
 
-#elif defined(LHF_ENABLE_PARALLEL)
+				if (hit.is_present()) {
+					results[i] = hit.get().value;
+					release(i, queue);
+					continue;
+				}
 
-	class PropertySetStorage {
-	protected:
-		/// @note Not marking this as mutable will not allow us to get a
-		///       non-const reference on index-based access. Non-constness
-		//        is important for eviction to work.
-		mutable Vector<Vector<PropertySetHolder>> data = {};
+				group.run([&, i]() {
+					const Key &k = nodes[i];
+					Index a = operand(k.left);
+					Index b = operand(k.right);
+
+					switch (k.kind) {
+					case OperationKind::UNION:
+						results[i] = set_union(a, b).value;
+						break;
+					case OperationKind::INTERSECTION:
+						results[i] = set_intersection(a, b).value;
+						break;
+					case OperationKind::DIFFERENCE:
+						results[i] = set_difference(a, b).value;
+						break;
+					default:
+						throw Unreachable();
+					}
 
-		mutable RWMutex mutex;
-		mutable RWMutex realloc_mutex;
+					Vector<Size> next;
+					release(i, next);
+					dispatch(next);
+				});
+			}
+		};
 
-		std::atomic<Size> total_elems = 0;
-		std::atomic<Size> block_base = 0;
+		dispatch(ready);
+		group.wait();
 
-	public:
-		PropertySetStorage() {
-			data.push_back({});
-			data.back().reserve(BLOCK_SIZE);
+		Vector<Index> ret;
+		ret.reserve(n);
+		for (Size i = 0; i < n; i++) {
+			ret.push_back(Index(results[canonical[i]]));
 		}
 
+		return ret;
+	}
+
+	/**
+	 * @brief      An immutable, self-contained copy of an LHF (see `freeze()`).
+	 *
+	 *             The property sets are compacted into one contiguous array of
+	 *             elements, and the operation caches and subset relations are
+	 *             rebuilt as flat hash tables (see `FlatOperationMap`). Nothing
+	 *             is ever modified after construction, so none of the read
+	 *             paths take locks, and any number of threads may query the
+	 *             same instance concurrently.
+	 *
+	 * @note       Indices of nested child LHFs stored in the elements refer
+	 *             to the child LHFs themselves, which can be frozen separately.
+	 */
+	class Frozen {
+	public:
 		/**
-		 * @brief      Retuns a mutable reference to the property set holder at
-		 *             a given set index. This is useful for eviction based
-		 *             functions.
-		 *
-		 * @param[in]  idx   Set index
-		 *
-		 * @return     A mutable propety set holder reference.
+		 * @brief      A read-only view of a frozen property set. Elements are
+		 *             sorted, as in `PropertySet`.
 		 */
-		PropertySetHolder &at_mutable(const Index &idx) const {
-			ReadLock m(realloc_mutex);
-			if (idx.value >= block_base) {
-				return data.back().at(idx.value & BLOCK_MASK);
-			} else {
-				return
-					data
-						.at((idx.value & (~BLOCK_MASK)) >> BLOCK_SHIFT)
-						.at(idx.value & BLOCK_MASK);
+		struct SetView {
+			const PropertyElement *first = nullptr;
+			const PropertyElement *last = nullptr;
+
+			const PropertyElement *begin() const {
+				return first;
+			}
+
+			const PropertyElement *end() const {
+				return last;
 			}
-		}
 
-		const PropertySetHolder &at(const Index &idx) const {
-			ReadLock m(realloc_mutex);
-			if (idx.value >= block_base) {
-				return data.back().at(idx.value & BLOCK_MASK);
-			} else {
-				return
-					data
-						.at((idx.value & (~BLOCK_MASK)) >> BLOCK_SHIFT)
-						.at(idx.value & BLOCK_MASK);
+			Size size() const {
+				return last - first;
 			}
-		}
 
-		Index push_back(PropertySetHolder &&p) {
-			WriteLock m(mutex);
-			__LHF_ASSERT(!data.empty(), "Internal error: no storage blocks avaialable.");
-			if (data.back().size() >= BLOCK_SIZE) {
-				WriteLock r(realloc_mutex);
-				data.push_back({});
-				data.back().reserve(BLOCK_SIZE);
-				block_base += BLOCK_SIZE;
+			bool empty() const {
+				return first == last;
 			}
-			data.back().push_back(std::move(p));
-			total_elems++;
-			return Index(total_elems - 1);
-		}
 
-		void clear() {
-			WriteLock m(mutex);
-			data.clear();
-			data.push_back({});
-			total_elems = 0;
-			block_base = 0;
-		}
+			const PropertyElement &operator[](Size i) const {
+				return first[i];
+			}
+		};
 
-		Size size() const {
-			return total_elems;
-		}
-	};
+	protected:
+		friend class LatticeHashForest;
 
-#else
+		Vector<PropertyElement> elements = {};
 
-	class PropertySetStorage {
-	protected:
-		/// @note Not marking this as mutable will not allow us to get a
-		///       non-const reference on index-based access. Non-constness
-		//        is important for eviction to work.
-		mutable Vector<PropertySetHolder> data = {};
+		// Set i is [elements[offsets[i]], elements[offsets[i + 1]]).
+		Vector<Size> offsets = {};
+
+		FlatOperationMap<IndexValue> unions = {};
+		FlatOperationMap<IndexValue> intersections = {};
+		FlatOperationMap<IndexValue> differences = {};
+		FlatOperationMap<SubsetRelation> subsets = {};
 
 	public:
 		/**
-		 * @brief      Retuns a mutable reference to the property set holder at
-		 *             a given set index. This is useful for eviction based
-		 *             functions.
-		 *
-		 * @param[in]  idx   Set index
-		 *
-		 * @return     A mutable propety set holder reference.
+		 * @brief      Returns the number of property sets.
 		 */
-		PropertySetHolder &at_mutable(const Index &idx) const {
-			return data.at(idx.value);
+		inline Size property_set_count() const {
+			return offsets.size() - 1;
 		}
 
-		const PropertySetHolder &at(const Index &idx) const {
-			return data.at(idx.value);
+		/**
+		 * @brief      Gets the property set specified by index.
+		 */
+		inline SetView get_value(const Index &index) const {
+			__LHF_ASSERT(index.value < property_set_count(),
+				"Set index out of range");
+			return SetView{
+				elements.data() + offsets[index.value],
+				elements.data() + offsets[index.value + 1]};
 		}
 
-		Index push_back(PropertySetHolder &&p) {
-			data.push_back(std::move(p));
-			return data.size() - 1;
+		inline Size size_of(const Index &index) const {
+			return offsets[index.value + 1] - offsets[index.value];
 		}
 
-		void clear() {
-			data.clear();
+		/**
+		 * @brief      Finds a property element in the set based on the key
+		 *             provided.
+		 */
+		inline OptionalRef<PropertyElement> find_key(const Index &index, const PropertyT &p) const {
+			SetView s = get_value(index);
+			return find_key_in(s.begin(), s.size(), p);
 		}
 
-		Size size() const {
-			return data.size();
+		/**
+		 * @brief      Determines whether the property set at `index` contains
+		 *             the element `prop` or not.
+		 */
+		inline bool contains(const Index &index, const PropertyElement &prop) const {
+			SetView s = get_value(index);
+			return find_key_in(s.begin(), s.size(), prop).is_present();
 		}
-	};
-
-#endif
-
-	// The property set storage array.
-	PropertySetStorage property_sets = {};
-
-	// The property set -> Index in storage array mapping.
-	PropertySetMap property_set_map = {};
 
-	BinaryOperationMap unions = {};
-	BinaryOperationMap intersections = {};
-	BinaryOperationMap differences = {};
+		/**
+		 * @brief      Returns whether a is known to be a subset or a superset
+		 *             of b.
+		 */
+		SubsetRelation is_subset(const Index &a, const Index &b) const {
+			auto i = subsets.find({a.value, b.value});
+			return i.is_present() ? i.get() : UNKNOWN;
+		}
 
-	InternalMap<OperationNode, SubsetRelation> subsets = {};
+		/**
+		 * @brief      Returns the result of an operation if it was known when
+		 *             the LHF was frozen (see
+		 *             `LatticeHashForest::find_cached_operation`).
+		 */
+		Optional<Index> find_cached_operation(OperationKind kind, const Index &a, const Index &b) const {
+			return lookup_operation(*this, kind, a, b);
+		}
+	};
 
 	/**
-	 * @brief      Stores index `a` as the subset of index `b` if a < b,
-	 *             else stores index `a` as the superset of index `b`
+	 * @brief      Produces an immutable copy of the current state of the LHF
+	 *             for lock-free concurrent querying (see `Frozen`).
 	 *
-	 * @param[in]  a     The index of the first set
-	 * @param[in]  b     The index of the second set.
+	 * @note       Evicted sets are recomputed (see `materialize()`). This must
+	 *             not run concurrently with operations that modify
+	 *             the LHF.
+	 *
+	 * @return     The frozen LHF.
 	 */
-	void store_subset(const Index &a, const Index &b) {
-		LHF_PROPERTY_SET_PAIR_VALID(a, b)
-		LHF_PROPERTY_SET_PAIR_UNEQUAL(a, b)
+	Frozen freeze() const {
 		__lhf_calc_functime(stat);
 
-		// We need to maintain the operation pair in index-order here as well.
-		if (a > b) {
-			subsets.insert({{b.value, a.value}, SUPERSET});
-		} else {
-			subsets.insert({{a.value, b.value}, SUBSET});
-		}
-	}
+		Frozen f;
+		Size count = property_sets.size();
+		Size total = 0;
 
-	/**
-	 * @brief      Removes all data from the LHF.
-	 */
-	virtual void clear() {
-		property_sets.clear();
-		property_set_map.clear();
-		unions.clear();
-		intersections.clear();
-		differences.clear();
-		subsets.clear();
-	}
+		// Collected sets are frozen as empty sets.
+		for (Size i = 0; i < count; i++) {
+			if (!is_collected(i)) {
+				total += get_value(i).size();
+			}
+		}
 
-public:
-	explicit LatticeHashForest(RefList reflist = {}): reflist(reflist) {
-		// INSERT EMPTY SET AT INDEX 0
-		register_set({ });
-	}
+		f.elements.reserve(total);
+		f.offsets.reserve(count + 1);
+		for (Size i = 0; i < count; i++) {
+			f.offsets.push_back(f.elements.size());
+			if (!is_collected(i)) {
+				const PropertySet &s = get_value(i);
+				f.elements.insert(f.elements.end(), s.begin(), s.end());
+			}
+		}
+		f.offsets.push_back(f.elements.size());
 
-	inline bool is_empty(const Index &i) const {
-		return i.is_empty();
-	}
+		f.unions = FlatOperationMap<IndexValue>(unions);
+		f.intersections = FlatOperationMap<IndexValue>(intersections);
+		f.differences = FlatOperationMap<IndexValue>(differences);
+		f.subsets = FlatOperationMap<SubsetRelation>(subsets);
 
-	/**
-	 * @brief      Resets state of the LHF to the default.
-	 */
-	void clear_and_initialize() {
-		clear();
-		register_set({ });
+		return f;
 	}
 
 	/**
-	 * @brief      Returns whether we currently know whether a is a subset or a
-	 *             superset of b.
+	 * @brief      Writes a binary snapshot of the LHF to `path`, which can be
+	 *             mapped into memory and queried without loading it (see
+	 *             `MappedSnapshot`). The sets are written one by one, so apart
+	 *             from the output buffer, only the set offsets and the hash
+	 *             table images are held in memory.
 	 *
-	 * @param[in]  a     The first set
-	 * @param[in]  b     The second set
+	 *             With `SnapshotEncoding::DELTA`, sets of integral keys are
+	 *             delta-encoded and the operation caches are stored as sorted,
+	 *             delta-encoded entries. This makes the snapshot much smaller,
+	 *             but it is decoded into memory when it is opened.
 	 *
-	 * @return     Enum value telling if it's a subset, superset or unknown
+	 * @note       Raw snapshots need trivially copyable property elements,
+	 *             which the elements of nested LHFs are not, so nested LHFs
+	 *             can only be written with `SnapshotEncoding::DELTA`. Indices
+	 *             of nested child LHFs are stored as they are, so the child
+	 *             LHFs need snapshots of their own. Evicted sets are recomputed
+	 *             (see `materialize()`) and collected sets are written as empty
+	 *             sets. This must not run concurrently with operations that
+	 *             modify the LHF.
+	 *
+	 * @param[in]  path      The path
+	 * @param[in]  encoding  The encoding of the sets and caches
+	 * @param[in]  tag       Stored in the header (see `warm_start()`)
 	 */
-	SubsetRelation is_subset(const Index &a, const Index &b) const {
-		LHF_PROPERTY_SET_PAIR_VALID(a, b)
+	void write_snapshot(
+		const String &path,
+		SnapshotEncoding encoding = SnapshotEncoding::RAW,
+		std::uint64_t tag = 0) const {
+		__lhf_calc_functime(stat);
 
-		auto i = subsets.find({a.value, b.value});
+		using SetView = typename Frozen::SetView;
+		auto set_at = [this](Size i, SetView &out) {
+			if (is_collected(i)) {
+				return false;
+			}
+			const PropertySet &set = get_value(i);
+			out = SetView{set.data(), set.data() + set.size()};
+			return true;
+		};
 
-		if (!i.is_present()) {
-			return UNKNOWN;
-		} else {
-			return i.get();
-		}
+		write_snapshot_file(
+			path, property_sets.size(), set_at,
+			unions, intersections, differences, subsets, encoding, tag);
 	}
 
 	/**
-	 * @brief         Inserts a (or gets an existing) single-element set into
-	 *                property set storage.
+	 * @brief      Writes a snapshot of the LHF (see `write_snapshot()`) on a
+	 *             background thread, while other threads keep registering
+	 *             sets and running operations.
 	 *
-	 * @param[in]  c  The single-element property set.
+	 *             The snapshot holds a cut of the LHF: the sets that exist
+	 *             when this is called, and the cache entries among them.
+	 *             Sets are immutable and indices are only appended, so the
+	 *             cut is the number of sets (the high-water index), which is
+	 *             all that is taken on the calling thread. The background
+	 *             thread reads the sets in place and copies the cache entries
+	 *             of each map, which briefly blocks insertions into it. The
+	 *             snapshot is written to a temporary file, which replaces
+	 *             `path` when it is complete.
 	 *
-	 * @return        Index of the newly created/existing set.
+	 *             Without `LHF_ENABLE_PARALLEL` or `LHF_ENABLE_TBB`, the
+	 *             containers cannot be read while the calling thread keeps
+	 *             using the LHF, so the set pointers and the cache entries
+	 *             are taken on the calling thread.
 	 *
-	 * @todo          Check whether the cache hit check can be removed.
+	 * @note       With `LHF_ENABLE_EVICTION`, sets are not evicted
+	 *             automatically until the snapshot is written. Evicted sets
+	 *             are read from the spill file or recomputed into a buffer
+	 *             (see `peek_value()`), without bringing them back.
+	 *             `collect()`, `reorganize()`, `clear()` and `evict_set()`
+	 *             free sets, so they must not run, and the LHF must not be
+	 *             destroyed, until the snapshot is written.
+	 *
+	 * @return     A future that becomes ready when the snapshot is written,
+	 *             with the number of sets it holds.
 	 */
-	Index register_set_single(const PropertyElement &c) {
+	std::future<Size> snapshot_async(
+		const String &path,
+		SnapshotEncoding encoding = SnapshotEncoding::RAW,
+		std::uint64_t tag = 0) const {
+
 		__lhf_calc_functime(stat);
 
-		PropertySetHolder new_set = PropertySetHolder(new PropertySet{c});
+		struct Cut {
+			Size count = 0;
+			Vector<std::pair<OperationNode, IndexValue>> unions, intersections, differences;
+			Vector<std::pair<OperationNode, SubsetRelation>> subsets;
+#if !defined(LHF_ENABLE_PARALLEL) && !defined(LHF_ENABLE_TBB)
+			Vector<const PropertySet *> sets;
+			LHF_EVICTION(std::deque<PropertySet> evicted;)
+#endif
+#ifdef LHF_ENABLE_EVICTION
+			std::atomic<Size> *in_flight = nullptr;
 
-		auto result = property_set_map.find(new_set.get());
+			~Cut() {
+				if (in_flight) {
+					(*in_flight)--;
+				}
+			}
+#endif
+		};
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+		auto cut = std::make_shared<Cut>();
+#ifdef LHF_ENABLE_EVICTION
+		snapshots_in_flight++;
+		cut->in_flight = &snapshots_in_flight;
+#endif
+		{
+#ifdef LHF_ENABLE_TBB
+			std::lock_guard<std::shared_mutex> l(cut_mutex);
+#endif
+			cut->count = property_sets.size();
+		}
 
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
+		auto take_entries = [this, cut]() {
+			auto copy = [count = cut->count](const auto &map, auto &entries) {
+				map.for_each([count, &entries](const OperationNode &k, auto v) {
+					if (k.left < count && k.right < count &&
+					    (std::is_same_v<decltype(v), SubsetRelation> || IndexValue(v) < count)) {
+						entries.push_back({k, v});
+					}
+				});
+			};
 
-			return ret;
-		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).swap(new_set);
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			return Index(result.get());
+			copy(unions, cut->unions);
+			copy(intersections, cut->intersections);
+			copy(differences, cut->differences);
+			copy(subsets, cut->subsets);
+		};
+
+		using SetView = typename Frozen::SetView;
+		auto write = [cut, path, encoding, tag](auto set_at) {
+			write_file_atomically(path, [&](const String &temporary) {
+				write_snapshot_file(
+					temporary, cut->count, set_at,
+					cut->unions, cut->intersections, cut->differences, cut->subsets,
+					encoding, tag);
+			});
+			return cut->count;
+		};
+
+#if !defined(LHF_ENABLE_PARALLEL) && !defined(LHF_ENABLE_TBB)
+		cut->sets.resize(cut->count, nullptr);
+		for (Size i = 0; i < cut->count; i++) {
+			if (is_collected(i)) {
+				continue;
+			}
+#ifdef LHF_ENABLE_EVICTION
+			if (is_evicted(i)) {
+				cut->evicted.push_back(make_set());
+				cut->sets[i] = &peek_value(i, cut->evicted.back());
+				continue;
+			}
+#endif
+			cut->sets[i] = property_sets.at(i).get();
 		}
+		take_entries();
+
+		return std::async(std::launch::async, [cut, write]() {
+			return write([&cut](Size i, SetView &out) {
+				const PropertySet *set = cut->sets[i];
+				if (set == nullptr) {
+					return false;
+				}
+				out = SetView{set->data(), set->data() + set->size()};
+				return true;
+			});
+		});
+#else
+		return std::async(std::launch::async, [this, take_entries, write]() {
+			take_entries();
+
+			LHF_EVICTION(PropertySet buffer = make_set();)
+			return write([&](Size i, SetView &out) {
+				if (is_collected(i)) {
+					return false;
+				}
+#ifdef LHF_ENABLE_EVICTION
+				// Resident sets are not evicted while the snapshot is
+				// written, and an evicted set is read into the buffer.
+				const PropertySet &set = peek_value(i, buffer);
+#else
+				const PropertySet &set = *property_sets.at(i).get();
+#endif
+				out = SetView{set.data(), set.data() + set.size()};
+				return true;
+			});
+		});
+#endif
 	}
 
 	/**
-	 * @brief      Inserts a (or gets an existing) single-element set into
-	 *             the property set storage, and reports whether this set
-	 *             was already  present or not.
-	 *
-	 * @param[in]  c     The single-element property set.
-	 * @param[out] cold  Report if this was a cold miss.
+	 * @brief      Returns a fingerprint of the configuration of the LHF: the
+	 *             type of the property elements, which covers the key type,
+	 *             the nesting behaviour and the comparison and hash functions,
+	 *             and their layout. Snapshots record it, and are only opened
+	 *             by LHFs with the same fingerprint.
 	 *
-	 * @return     Index of the newly created set.
+	 * @note       The fingerprint is derived from `typeid` names, so it is
+	 *             only stable for builds with the same compiler.
 	 */
-	Index register_set_single(const PropertyElement &c, bool &cold) {
-		__lhf_calc_functime(stat);
-
-		PropertySetHolder new_set = PropertySetHolder(new PropertySet{c});
-		auto result = property_set_map.find(new_set.get());
-
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+	static std::uint64_t config_fingerprint() {
+		static const std::uint64_t fingerprint = [] {
+			const char *name = typeid(PropertyElement).name();
+			const std::uint64_t layout[] = {
+				sizeof(PropertyElement), alignof(PropertyElement), Nesting::num_children};
+
+			SnapshotChecksum c;
+			c.update(name, std::strlen(name));
+			c.update(layout, sizeof(layout));
+			return c.finish();
+		}();
+		return fingerprint;
+	}
 
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
+protected:
+	/// Number of slots of the set table of a snapshot of `count` sets.
+	static Size set_table_capacity(Size count) {
+		Size capacity = 1;
+		while (capacity < count * 2) {
+			capacity <<= 1;
+		}
+		return capacity;
+	}
 
-			cold = true;
-			return ret;
+	/// Adds set `i`, whose contents have the hash `hash`, to the set table of
+	/// a snapshot (see `SnapshotSection::SET_TABLE`).
+	static void add_to_set_table(Vector<IndexValue> &table, IndexValue i, Size hash) {
+		constexpr IndexValue EMPTY_SLOT = std::numeric_limits<IndexValue>::max();
+		Size mask = table.size() - 1;
+		Size h = hash & mask;
+		while (table[h] != EMPTY_SLOT) {
+			h = (h + 1) & mask;
 		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).swap(new_set);
-			cold = false;
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			cold = false;
-			return Index(result.get());
+		table[h] = i;
+	}
+
+	/**
+	 * @brief      Calls `write(temporary)` to write a file next to `path`,
+	 *             then renames it over `path`, so that `path` is either the
+	 *             old or the complete new file.
+	 */
+	template<typename Writer>
+	static void write_file_atomically(const String &path, Writer write) {
+		String temporary = path + ".tmp";
+		write(temporary);
+		if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+			throw SnapshotError("Could not replace the snapshot '" + path + "'");
 		}
 	}
 
 	/**
-	 * Deduplicates and sorts a vector (to function equivalently to a set).
-	 *
-	 * The deduplicate-sort function here is based on a stackoverflow answer
-	 * (chosen for speed metrics): https://stackoverflow.com/a/24477023
-	 *
-	 * Ideally, this shouldn't be used or require being used.
+	 * @brief      Writes a snapshot of `count` sets. `set_at(i, view)` stores
+	 *             the elements of set `i` in `view` and returns `false` if the
+	 *             set was collected. The operation maps can be any maps from
+	 *             `OperationNode` to the result.
 	 */
-	void prepare_vector_set(PropertySet &c) {
-		std::unordered_set<
-			PropertyElement,
-			typename PropertyElement::Hash,
-			typename PropertyElement::FullEqual> deduplicator;
+	template<typename SetAt, typename U, typename I, typename D, typename S>
+	static void write_snapshot_file(
+		const String &path, Size count, SetAt set_at,
+		const U &unions, const I &intersections,
+		const D &differences, const S &subsets,
+		SnapshotEncoding encoding = SnapshotEncoding::RAW,
+		std::uint64_t tag = 0) {
+
+		if (encoding == SnapshotEncoding::RAW && !std::is_trivially_copyable_v<PropertyElement>) {
+			throw SnapshotError(
+				"Only trivially copyable property elements can be written to a raw snapshot");
+		} else if (encoding != SnapshotEncoding::RAW && !ENCODABLE) {
+			throw SnapshotError("Only sets of integral keys can be delta-encoded");
+		}
 
-		for (auto &i : c) {
-			deduplicator.insert(i);
+		SnapshotWriter w(path);
+
+		if (encoding == SnapshotEncoding::RAW) {
+			if constexpr (std::is_trivially_copyable_v<PropertyElement>) {
+				write_raw_sections(w, count, set_at, unions, intersections, differences, subsets);
+			}
+		} else if constexpr (ENCODABLE) {
+			write_encoded_sections(w, count, set_at, unions, intersections, differences, subsets);
 		}
 
-		c.assign(deduplicator.begin(), deduplicator.end());
-		std::sort(c.begin(), c.end());
+		w.finish(sizeof(PropertyElement), alignof(PropertyElement),
+		         Nesting::num_children, count, encoding, config_fingerprint(), tag);
 	}
 
-	template <bool disable_integrity_check = false>
-	Index register_set(const PropertySet &c) {
-		__lhf_calc_functime(stat);
+	template<typename SetAt, typename U, typename I, typename D, typename S>
+	static void write_raw_sections(
+		SnapshotWriter &w, Size count, SetAt set_at,
+		const U &unions, const I &intersections,
+		const D &differences, const S &subsets) {
+
+		using Section = SnapshotSection;
+		constexpr IndexValue EMPTY_SLOT = std::numeric_limits<IndexValue>::max();
+
+		Vector<std::uint64_t> offsets;
+		offsets.reserve(count + 1);
+		Vector<IndexValue> set_table(set_table_capacity(count), EMPTY_SLOT);
+
+		w.begin(Section::ELEMENTS);
+		Size total = 0;
+		Size resident = 0;
+		typename Frozen::SetView set;
+		for (Size i = 0; i < count; i++) {
+			offsets.push_back(total);
+			if (!set_at(i, set)) {
+				continue;
+			}
 
-		if (!disable_integrity_check) {
-			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+			w.write(set.begin(), set.size());
+			total += set.size();
+			add_to_set_table(set_table, i, PropertySetHash()(set.begin(), set.end()));
+			resident++;
 		}
+		offsets.push_back(total);
+		w.end(total);
 
-		auto result = property_set_map.find(&c);
+		w.begin(Section::OFFSETS);
+		w.write(offsets.data(), offsets.size());
+		w.end(offsets.size());
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+		w.begin(Section::SET_TABLE);
+		w.write(set_table.data(), set_table.size());
+		w.end(resident);
 
-			PropertySetHolder new_set(new PropertySet(c));
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
-			return ret;
-		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).reassign(new PropertySet(c));
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			return Index(result.get());
-		}
+		auto write_map = [&w](Section section, const auto &flat) {
+			w.begin(section);
+			w.write(flat.get_slots().data(), flat.get_slots().size());
+			w.end(flat.size());
+		};
+
+		write_map(Section::UNIONS, FlatOperationMap<IndexValue>(unions));
+		write_map(Section::INTERSECTIONS, FlatOperationMap<IndexValue>(intersections));
+		write_map(Section::DIFFERENCES, FlatOperationMap<IndexValue>(differences));
+		write_map(Section::SUBSETS, FlatOperationMap<SubsetRelation>(subsets));
 	}
 
-	template <bool disable_integrity_check = false>
-	Index register_set(const PropertySet &c, bool &cold) {
-		__lhf_calc_functime(stat);
+	/**
+	 * @brief      Writes the sections of a `SnapshotEncoding::DELTA`
+	 *             snapshot. `ELEMENTS` holds the encoded sets one after
+	 *             another. In nested LHFs, the keys of each set are followed
+	 *             by its child indices, one column per child LHF, encoded as
+	 *             a single StreamVByte sequence. `OFFSETS` holds the encoded
+	 *             set sizes, and the operation
+	 *             caches hold their entries sorted by operands, each as the
+	 *             words `(left - previous left, right or right - previous
+	 *             right, result)`. The set table is left empty, as it is
+	 *             rebuilt when the snapshot is opened.
+	 */
+	template<typename SetAt, typename U, typename I, typename D, typename S>
+	static void write_encoded_sections(
+		SnapshotWriter &w, Size count, SetAt set_at,
+		const U &unions, const I &intersections,
+		const D &differences, const S &subsets) {
+
+		using Section = SnapshotSection;
+		using Codec = SetCodec<PropertyT>;
+
+		Vector<std::uint64_t> sizes;
+		sizes.reserve(count);
+		Vector<PropertyT> keys;
+		Vector<typename Codec::Word> words;
+		Vector<std::uint64_t> children;
+		Vector<std::uint8_t> buffer;
+
+		w.begin(Section::ELEMENTS);
+		Size total = 0;
+		typename Frozen::SetView set;
+		for (Size i = 0; i < count; i++) {
+			if (!set_at(i, set)) {
+				sizes.push_back(0);
+				continue;
+			}
+
+			keys.clear();
+			for (const PropertyElement &e : set) {
+				keys.push_back(e.get_key());
+			}
 
-		if (!disable_integrity_check) {
-			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+			buffer.clear();
+			Codec::encode(keys.data(), keys.size(), words, buffer);
+
+			if constexpr (Nesting::is_nested) {
+				Size n = set.size();
+				children.resize(n * Nesting::num_children);
+				for (Size j = 0; j < n; j++) {
+					Size c = 0;
+					std::apply([&](const auto &... child) {
+						((children[(c++) * n + j] = child.value), ...);
+					}, set[j].get_value());
+				}
+				StreamVByte<std::uint64_t>::encode(children.data(), children.size(), buffer);
+			}
+
+			w.write(buffer.data(), buffer.size());
+			sizes.push_back(set.size());
+			total += set.size();
 		}
+		w.end(total);
 
-		auto result = property_set_map.find(&c);
+		buffer.clear();
+		StreamVByte<std::uint64_t>::encode(sizes.data(), sizes.size(), buffer);
+		w.begin(Section::OFFSETS);
+		w.write(buffer.data(), buffer.size());
+		w.end(count);
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+		w.begin(Section::SET_TABLE);
+		w.end(0);
 
-			PropertySetHolder new_set(new PropertySet(c));
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
+		write_encoded_map(w, Section::UNIONS, unions);
+		write_encoded_map(w, Section::INTERSECTIONS, intersections);
+		write_encoded_map(w, Section::DIFFERENCES, differences);
+		write_encoded_map(w, Section::SUBSETS, subsets);
+	}
 
-			cold = true;
-			return ret;
+	template<typename Map>
+	static void write_encoded_map(SnapshotWriter &w, SnapshotSection section, const Map &map) {
+		Vector<std::pair<OperationNode, std::uint64_t>> entries;
+		for (const auto &i : map) {
+			entries.push_back({i.first, std::uint64_t(i.second)});
 		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).reassign(new PropertySet(c));
-			cold = false;
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			cold = false;
-			return Index(result.get());
+
+		std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+			return a.first.left != b.first.left ?
+				a.first.left < b.first.left :
+				a.first.right < b.first.right;
+		});
+
+		Vector<std::uint64_t> words;
+		words.reserve(entries.size() * 3);
+		IndexValue left = 0;
+		IndexValue right = 0;
+		for (const auto &e : entries) {
+			words.push_back(e.first.left - left);
+			words.push_back(e.first.left == left ? e.first.right - right : e.first.right);
+			words.push_back(e.second);
+			left = e.first.left;
+			right = e.first.right;
 		}
+
+		Vector<std::uint8_t> buffer;
+		StreamVByte<std::uint64_t>::encode(words.data(), words.size(), buffer);
+		w.begin(section);
+		w.write(buffer.data(), buffer.size());
+		w.end(entries.size());
 	}
 
-	template <bool disable_integrity_check = false>
-	Index register_set(PropertySet &&c) {
-		__lhf_calc_functime(stat);
+public:
+	/**
+	 * @brief      A snapshot written by `write_snapshot()`, mapped read-only
+	 *             into memory. Opening it takes constant time: only the header
+	 *             is read and checked, and the sets and hash tables are served
+	 *             directly from the mapping, so pages are read from the file
+	 *             as they are accessed. It offers the queries of `Frozen`, and
+	 *             `find_set()`, and can be used from any number of threads.
+	 */
+	class MappedSnapshot {
+	public:
+		using SetView = typename Frozen::SetView;
 
-		if (!disable_integrity_check) {
-			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+	protected:
+		friend class LatticeHashForest;
+
+		SnapshotMapping file;
+
+		const std::uint64_t *offsets = nullptr;
+		const PropertyElement *elements = nullptr;
+		Size set_count = 0;
+
+		const IndexValue *set_table = nullptr;
+		Size set_table_mask = 0;
+
+		typename FlatOperationMap<IndexValue>::View unions = {};
+		typename FlatOperationMap<IndexValue>::View intersections = {};
+		typename FlatOperationMap<IndexValue>::View differences = {};
+		typename FlatOperationMap<SubsetRelation>::View subsets = {};
+
+		// Contents of delta-encoded snapshots, which are decoded when the
+		// snapshot is opened.
+		Vector<std::uint64_t> decoded_offsets = {};
+		Vector<PropertyElement> decoded_elements = {};
+		Vector<IndexValue> decoded_set_table = {};
+		FlatOperationMap<IndexValue> decoded_unions = {};
+		FlatOperationMap<IndexValue> decoded_intersections = {};
+		FlatOperationMap<IndexValue> decoded_differences = {};
+		FlatOperationMap<SubsetRelation> decoded_subsets = {};
+
+		template<typename V>
+		typename FlatOperationMap<V>::View map_view(SnapshotSection section) {
+			using Slot = typename FlatOperationMap<V>::Slot;
+			Size capacity = file.template capacity<Slot>(section);
+			if ((capacity & (capacity - 1)) != 0 || file.count(section) > capacity / 2) {
+				throw SnapshotError("The snapshot is truncated or corrupt");
+			}
+
+			const Slot *slots = file.template section<Slot>(section);
+			return typename FlatOperationMap<V>::View(slots, capacity, file.count(section));
 		}
 
-		auto result = property_set_map.find(&c);
+		/// Returns the bytes of a section of a delta-encoded snapshot, after
+		/// checking that they hold an encoded sequence of `n` words.
+		template<typename Codec>
+		std::pair<const std::uint8_t *, const std::uint8_t *>
+		encoded_section(SnapshotSection section, Size n) const {
+			const std::uint8_t *first = file.template section<std::uint8_t>(section);
+			Size bytes = file.template capacity<std::uint8_t>(section);
+			if (n > bytes * 4 || Codec::encoded_size(first, n) > bytes) {
+				throw SnapshotError("The snapshot is truncated or corrupt");
+			}
+			return {first, first + bytes};
+		}
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+		/**
+		 * @brief      Decodes a delta-encoded snapshot (see
+		 *             `write_encoded_sections()`). The sets are decoded in
+		 *             parallel (see `parallel_for()`).
+		 */
+		void decode() {
+			using Section = SnapshotSection;
+			using Codec = SetCodec<PropertyT>;
+			using Sizes = StreamVByte<std::uint64_t>;
+			using Children = StreamVByte<std::uint64_t>;
+			constexpr IndexValue EMPTY_SLOT = std::numeric_limits<IndexValue>::max();
+
+			auto [sizes_begin, sizes_end] = encoded_section<Sizes>(Section::OFFSETS, set_count);
+			Vector<std::uint64_t> sizes(set_count);
+			Sizes::decode(sizes_begin, set_count, sizes.data(), sizes_end);
+
+			// Offsets of the sets in the elements and in the encoded section.
+			const std::uint8_t *in = file.template section<std::uint8_t>(Section::ELEMENTS);
+			const std::uint8_t *end = in + file.template capacity<std::uint8_t>(Section::ELEMENTS);
+			Vector<Size> positions(set_count);
+			decoded_offsets.resize(set_count + 1);
+
+			// Checks that an encoded sequence of `n` values starts at
+			// `position`, and returns its size in bytes.
+			auto sequence_size = [&](auto codec, Size position, Size n) {
+				using SequenceCodec = decltype(codec);
+				Size bytes = end - in - position;
+				if (n > bytes * 4 || SequenceCodec::encoded_size(in + position, n) > bytes) {
+					throw SnapshotError("The snapshot is truncated or corrupt");
+				}
+				return SequenceCodec::encoded_size(in + position, n);
+			};
+
+			Size total = 0;
+			Size position = 0;
+			for (Size i = 0; i < set_count; i++) {
+				if (sizes[i] > Size(end - in)) {
+					throw SnapshotError("The snapshot is truncated or corrupt");
+				}
 
-			PropertySetHolder new_set(new PropertySet(std::move(c)));
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
-			return ret;
-		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).reassign(new PropertySet(c));
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			return Index(result.get());
-		}
-	}
+				positions[i] = position;
+				decoded_offsets[i] = total;
+				position += sequence_size(typename Codec::Codec(), position, sizes[i]);
+				if constexpr (Nesting::is_nested) {
+					position += sequence_size(
+						Children(), position, sizes[i] * Nesting::num_children);
+				}
+				total += sizes[i];
+			}
+			decoded_offsets[set_count] = total;
 
-	template <bool disable_integrity_check = false>
-	Index register_set(PropertySet &&c, bool &cold) {
-		__lhf_calc_functime(stat);
+			if (set_count == 0 || total != file.count(Section::ELEMENTS)) {
+				throw SnapshotError("The snapshot is truncated or corrupt");
+			}
 
-		if (!disable_integrity_check) {
-			LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+			decoded_elements.resize(total, blank_element());
+			parallel_for(set_count, LHF_SNAPSHOT_LOAD_GRAIN, [&](Size first, Size last) {
+				Vector<typename Codec::Word> words;
+				if constexpr (Nesting::is_nested) {
+					Vector<PropertyT> keys;
+					Vector<std::uint64_t> children;
+					for (Size i = first; i < last; i++) {
+						Size n = sizes[i];
+						keys.resize(n);
+						children.resize(n * Nesting::num_children);
+						const std::uint8_t *next = Codec::decode(
+							in + positions[i], n, keys.data(), words, end);
+						Children::decode(next, children.size(), children.data(), end);
+
+						PropertyElement *out = decoded_elements.data() + decoded_offsets[i];
+						for (Size j = 0; j < n; j++) {
+							Size c = 0;
+							typename Nesting::ChildValueList value;
+							std::apply([&](auto &... child) {
+								((child = children[(c++) * n + j]), ...);
+							}, value);
+							out[j] = PropertyElement(keys[j], value);
+						}
+					}
+				} else {
+					for (Size i = first; i < last; i++) {
+						Codec::decode(
+							in + positions[i], sizes[i],
+							decoded_elements.data() + decoded_offsets[i], words, end);
+					}
+				}
+			});
+
+			offsets = decoded_offsets.data();
+			elements = decoded_elements.data();
+
+			// The sets are hashed in parallel, but the table is filled in
+			// order, so that it is the same as the table of a raw snapshot.
+			Vector<Size> hashes(set_count);
+			parallel_for(set_count, LHF_SNAPSHOT_LOAD_GRAIN, [&](Size first, Size last) {
+				for (Size i = first; i < last; i++) {
+					SetView s = get_value(i);
+					hashes[i] = PropertySetHash()(s.begin(), s.end());
+				}
+			});
+
+			decoded_set_table.assign(set_table_capacity(set_count), EMPTY_SLOT);
+			for (Size i = 0; i < set_count; i++) {
+				if (i == EMPTY_SET_VALUE || sizes[i] > 0) {
+					add_to_set_table(decoded_set_table, i, hashes[i]);
+				}
+			}
+			set_table = decoded_set_table.data();
+			set_table_mask = decoded_set_table.size() - 1;
+
+			decoded_unions = decode_map<IndexValue>(Section::UNIONS);
+			decoded_intersections = decode_map<IndexValue>(Section::INTERSECTIONS);
+			decoded_differences = decode_map<IndexValue>(Section::DIFFERENCES);
+			decoded_subsets = decode_map<SubsetRelation>(Section::SUBSETS);
+			unions = decoded_unions.view();
+			intersections = decoded_intersections.view();
+			differences = decoded_differences.view();
+			subsets = decoded_subsets.view();
 		}
 
-		auto result = property_set_map.find(&c);
+		template<typename V>
+		FlatOperationMap<V> decode_map(SnapshotSection section) const {
+			using Words = StreamVByte<std::uint64_t>;
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+			Size count = file.count(section);
+			if (count > file.template capacity<std::uint8_t>(section)) {
+				throw SnapshotError("The snapshot is truncated or corrupt");
+			}
 
-			PropertySetHolder new_set(new PropertySet(std::move(c)));
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
+			auto [in, end] = encoded_section<Words>(section, count * 3);
+			Vector<std::uint64_t> words(count * 3);
+			Words::decode(in, words.size(), words.data(), end);
+
+			Vector<std::pair<OperationNode, V>> entries;
+			entries.reserve(count);
+			IndexValue left = 0;
+			IndexValue right = 0;
+			for (Size k = 0; k < count; k++) {
+				const std::uint64_t *w = &words[k * 3];
+				left += w[0];
+				right = w[0] == 0 ? right + w[1] : w[1];
+				entries.push_back({{left, right}, V(w[2])});
+			}
 
-			cold = true;
-			return ret;
-		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).reassign(new PropertySet(c));
-			cold = false;
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			cold = false;
-			return Index(result.get());
+			return FlatOperationMap<V>(entries);
 		}
-	}
 
-	template<typename Iterator, bool disable_integrity_check = false>
-	Index register_set(Iterator begin, Iterator end) {
-		__lhf_calc_functime(stat);
+	public:
+		/**
+		 * @brief      Maps the snapshot at `path`. Throws `SnapshotError` if
+		 *             it cannot be read or was written for another element
+		 *             type.
+		 */
+		explicit MappedSnapshot(const String &path):
+			file(path, sizeof(PropertyElement), alignof(PropertyElement),
+			     Nesting::num_children, config_fingerprint()) {
 
-		PropertySetHolder new_set(new PropertySet(begin, end));
+			using Section = SnapshotSection;
+			set_count = file.set_count();
 
-		if (!disable_integrity_check) {
-			LHF_PROPERTY_SET_INTEGRITY_VALID(*new_set.get());
-		}
+			if (file.encoding() == SnapshotEncoding::DELTA) {
+				if constexpr (ENCODABLE) {
+					decode();
+					return;
+				} else {
+					throw SnapshotError("The snapshot was written for a different element type");
+				}
+			}
 
-		auto result = property_set_map.find(new_set.get());
+			// Raw snapshots are only written for trivially copyable elements.
+			if (!std::is_trivially_copyable_v<PropertyElement>) {
+				throw SnapshotError("The snapshot was written for a different element type");
+			}
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+			offsets = file.template section<std::uint64_t>(Section::OFFSETS);
+			elements = file.template section<PropertyElement>(Section::ELEMENTS);
+			set_table = file.template section<IndexValue>(Section::SET_TABLE);
 
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
-			return ret;
+			Size capacity = file.template capacity<IndexValue>(Section::SET_TABLE);
+			if (file.template capacity<std::uint64_t>(Section::OFFSETS) != set_count + 1 ||
+			    offsets[set_count] != file.template capacity<PropertyElement>(Section::ELEMENTS) ||
+			    capacity == 0 || (capacity & (capacity - 1)) != 0) {
+				throw SnapshotError("The snapshot is truncated or corrupt");
+			}
+			set_table_mask = capacity - 1;
+
+			unions = map_view<IndexValue>(Section::UNIONS);
+			intersections = map_view<IndexValue>(Section::INTERSECTIONS);
+			differences = map_view<IndexValue>(Section::DIFFERENCES);
+			subsets = map_view<SubsetRelation>(Section::SUBSETS);
 		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).reassign(std::move(new_set));
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			return Index(result.get());
+
+		/**
+		 * @brief      Returns the number of property sets.
+		 */
+		inline Size property_set_count() const {
+			return set_count;
 		}
-	}
 
-	template<typename Iterator, bool disable_integrity_check = false>
-	Index register_set(Iterator begin, Iterator end, bool &cold) {
-		__lhf_calc_functime(stat);
+		/**
+		 * @brief      Gets the property set specified by index.
+		 */
+		inline SetView get_value(const Index &index) const {
+			__LHF_ASSERT(index.value < property_set_count(),
+				"Set index out of range");
+			return SetView{
+				elements + offsets[index.value],
+				elements + offsets[index.value + 1]};
+		}
 
-		PropertySetHolder new_set(new PropertySet(begin, end));
+		inline Size size_of(const Index &index) const {
+			return offsets[index.value + 1] - offsets[index.value];
+		}
 
-		if (!disable_integrity_check) {
-			LHF_PROPERTY_SET_INTEGRITY_VALID(*new_set.get());
+		/**
+		 * @brief      Finds a property element in the set based on the key
+		 *             provided.
+		 */
+		inline OptionalRef<PropertyElement> find_key(const Index &index, const PropertyT &p) const {
+			SetView s = get_value(index);
+			return find_key_in(s.begin(), s.size(), p);
 		}
 
-		auto result = property_set_map.find(new_set.get());
+		/**
+		 * @brief      Determines whether the property set at `index` contains
+		 *             the element `prop` or not.
+		 */
+		inline bool contains(const Index &index, const PropertyElement &prop) const {
+			SetView s = get_value(index);
+			return find_key_in(s.begin(), s.size(), prop).is_present();
+		}
 
-		if (!result.is_present()) {
-			LHF_PERF_INC(property_sets, cold_misses);
+		/**
+		 * @brief      Finds the index of a set through the set table, like
+		 *             `register_set()` would without inserting anything.
+		 *
+		 * @param[in]  set   The set, sorted as `register_set()` sorts it
+		 *
+		 * @return     The index if the set is in the snapshot.
+		 */
+		Optional<Index> find_set(const PropertySet &set) const {
+			constexpr IndexValue EMPTY_SLOT = std::numeric_limits<IndexValue>::max();
+			typename PropertyElement::FullEqual eq;
+
+			Size h = PropertySetHash()(set.begin(), set.end()) & set_table_mask;
+			for (;; h = (h + 1) & set_table_mask) {
+				IndexValue i = set_table[h];
+				if (i == EMPTY_SLOT) {
+					return Optional<Index>::absent();
+				}
 
-			Index ret = property_sets.push_back(std::move(new_set));
-			property_set_map.insert(std::make_pair(property_sets.at(ret).get(), ret.value));
-			cold = true;
-			return ret;
+				SetView s = get_value(i);
+				if (s.size() == set.size() &&
+				    std::equal(s.begin(), s.end(), set.begin(), eq)) {
+					return Index(i);
+				}
+			}
 		}
-		LHF_EVICTION(else if (is_evicted(result.get())) {
-			property_sets.at_mutable(result.get()).reassign(std::move(new_set));
-			cold = false;
-			return Index(result.get());
-		})
-		else {
-			LHF_PERF_INC(property_sets, hits);
-			cold = false;
-			return Index(result.get());
+
+		/**
+		 * @brief      Returns whether a is known to be a subset or a superset
+		 *             of b.
+		 */
+		SubsetRelation is_subset(const Index &a, const Index &b) const {
+			auto i = subsets.find({a.value, b.value});
+			return i.is_present() ? i.get() : UNKNOWN;
 		}
-	}
 
-#ifdef LHF_ENABLE_EVICTION
-	bool is_evicted(const Index &index) const {
-		return property_sets.at(index.value).is_evicted();
-	}
-#endif
+		/**
+		 * @brief      Returns the result of an operation if it was known when
+		 *             the snapshot was written (see
+		 *             `LatticeHashForest::find_cached_operation`).
+		 */
+		Optional<Index> find_cached_operation(OperationKind kind, const Index &a, const Index &b) const {
+			return lookup_operation(*this, kind, a, b);
+		}
 
-#ifdef LHF_ENABLE_EVICTION
-	void evict_set(const Index &index) {
-		__LHF_ASSERT(!index.is_empty(),
-			"Tried to evict the empty set");
-		property_sets.at_mutable(index.value).evict();
-	}
-#endif
+		/**
+		 * @brief      Checks the checksums of the snapshot, which reads the
+		 *             whole file (see `SnapshotMapping::verify()`).
+		 *
+		 * @exception  SnapshotError  If the snapshot is corrupt.
+		 */
+		void verify() const {
+			file.verify();
+		}
 
-	/**
-	 * @brief      Gets the actual property set specified by index.
-	 *
-	 * @param[in]  index  The index
-	 *
-	 * @return     The property set.
-	 */
-	inline const PropertySet &get_value(const Index &index) const {
-		LHF_PROPERTY_SET_INDEX_VALID(index);
-#if defined(LHF_DEBUG) && defined(LHF_ENABLE_EVICTION)
-		__LHF_ASSERT(!is_evicted(index),
-			"Tried to access an evicted set");
-#endif
-		return *property_sets.at(index.value).get();
-	}
+		/**
+		 * @brief      Returns the size of the snapshot in bytes.
+		 */
+		Size file_size() const {
+			return file.size();
+		}
 
-	/**
-	 * @brief      Returns the total number of property sets currently in the
-	 *             LHF.
-	 *
-	 * @return     The count.
-	 */
-	inline Size property_set_count() const {
-		return property_sets.size();
-	}
+		SnapshotEncoding get_encoding() const {
+			return file.encoding();
+		}
 
-	/**
-	 * @brief      Returns the size of the set at `index`
-	 *
-	 * @param[in]  index  The index
-	 *
-	 * @return     size of the set.
-	 */
-	inline Size size_of(const Index &index) const {
-		if (index == EMPTY_SET_VALUE) {
-			return 0;
-		} else {
-			return get_value(index).size();
+		/**
+		 * @brief      Returns the tag the snapshot was written with.
+		 */
+		std::uint64_t get_tag() const {
+			return file.tag();
 		}
-	}
+	};
 
-	/**
-	 * @brief      Less than comparator for operations. You MUST use this
-	 *             instead of directly using anything else like "<"
-	 *
-	 * @param[in]  a     LHS Property
-	 * @param[in]  b     RHS Property
-	 *
-	 * @return     Result of doing a < b according to provided semantics.
-	 */
-	static inline bool less(const PropertyElement &a, const PropertyElement &b) {
-		return a < b;
+protected:
+	// Write-ahead journal of new sets and cache entries (see
+	// `enable_journal()`).
+	UniquePointer<JournalWriter> journal = nullptr;
+	bool journal_operations = false;
+
+	/// Appends a new set to the journal, if journaling is enabled.
+	void journal_set(const Index &index, const PropertySet &set) {
+		if constexpr (JOURNALABLE) {
+			if (journal) {
+				journal->append(
+					JournalRecordType::SET, index.value, set.size(), 0,
+					set.data(), set.size());
+			}
+		} else {
+			(void) index;
+			(void) set;
+		}
 	}
 
-	static inline bool less_key(const PropertyElement &a, const PropertyT &b) {
-		return PropertyLess()(a.get_key(), b);
+	/// Appends a new cache entry to the journal, if journaling of
+	/// operations is enabled.
+	void journal_operation(JournalRecordType type, IndexValue a, IndexValue b, IndexValue result) {
+		if (journal && journal_operations) {
+			journal->append(type, a, b, result);
+		}
 	}
 
-	static inline bool less_key(const PropertyElement &a, const PropertyElement &b) {
-		return PropertyLess()(a.get_key(), b.get_key());
+	/// Calls `f(first, last)` to insert entries `[0, n)` into the hash
+	/// tables. The tables lock every insertion in parallel builds, so they
+	/// are only filled in parallel by TBB, whose tables are concurrent.
+	template<typename F>
+	static void fill_tables(Size n, F f) {
+#ifdef LHF_ENABLE_TBB
+		parallel_for(n, LHF_SNAPSHOT_LOAD_GRAIN, f);
+#else
+		f(Size(0), n);
+#endif
 	}
 
+public:
 	/**
-	 * @brief      Equality comparator for operations. You MUST use this
-	 *             instead of directly using anything else like "<"
-	 *
-	 * @param[in]  a     LHS Property
-	 * @param[in]  b     RHS Property
-	 *
-	 * @return     Result of doing a == b according to provided semantics.
+	 * @brief      Result of replaying a journal (see `replay_journal()`).
 	 */
-	static inline bool equal(const PropertyElement &a, const PropertyElement &b) {
-		return a == b;
-	}
+	struct JournalReplayResult {
+		/// Number of sets registered.
+		Size sets = 0;
 
-	static inline bool equal_key(const PropertyElement &a, const PropertyT &b) {
-		return PropertyEqual()(a.get_key(), b);
-	}
+		/// Number of cache entries restored.
+		Size operations = 0;
 
-	static inline bool equal_key(const PropertyElement &a, const PropertyElement &b) {
-		return PropertyEqual()(a.get_key(), b.get_key());
-	}
+		/// Number of records that were dropped because they follow a set
+		/// missing from the journal, or mention such a set.
+		Size discarded = 0;
+
+		/// Whether the journal ended with an incomplete or corrupt record,
+		/// as left behind by a crash.
+		bool torn = false;
+
+		String to_string() const {
+			std::stringstream s;
+			s << "    " << "Sets:       " << sets << "\n"
+			  << "    " << "Operations: " << operations << "\n"
+			  << "    " << "Discarded:  " << discarded << "\n"
+			  << "    " << "Torn:       " << (torn ? "yes" : "no") << "\n";
+			return s.str();
+		}
+	};
 
+protected:
 	/**
-	 * @brief      Finds a property element in the set based on the key
-	 *             provided.
+	 * @brief      Reads the records of a journal that starts at set `next`.
+	 *             Sets are passed to `on_set(index, set)` in index order, and
+	 *             cache entries are collected in `operations`.
 	 *
-	 * @param[in]  index  Set Index
-	 * @param[in]  p      Key
-	 *
-	 * @return     An optional that contains a property element if the key was
-	 *             found.
+	 * @note       In parallel builds, sets may be journaled out of index
+	 *             order, so sets are held back until the sets before them
+	 *             have been read. Sets after a gap (which a crash can leave)
+	 *             are discarded.
 	 */
-	inline OptionalRef<PropertyElement> find_key(const Index &index, const PropertyT &p) const {
-		if (is_empty(index)) {
-			return OptionalRef<PropertyElement>::absent();
-		}
-
-		const PropertySet &s = get_value(index);
-
-		if (s.size() <= LHF_SORTED_VECTOR_BINARY_SEARCH_THRESHOLD) {
-			for (const PropertyElement &i : s) {
-				if (equal_key(i, p)) {
-					return OptionalRef<PropertyElement>(i);
-				}
-			}
-		} else {
-			// Binary search implementation
-			long int low = 0;
-			long int high = s.size() - 1;
+	template<typename SetT, typename OnSet>
+	static void read_journal(
+		JournalReader &reader, Size next, const SetT &empty, OnSet on_set,
+		Vector<JournalRecord> &operations, JournalReplayResult &result) {
+
+		OrderedMap<IndexValue, SetT> pending;
+		JournalRecord record;
+		SetT elements = empty;
+
+		while (reader.next(record, elements, blank_element())) {
+			if (record.type != JournalRecordType::SET) {
+				operations.push_back(record);
+				continue;
+			} else if (record.a < next || pending.count(record.a) > 0) {
+				result.discarded++;
+				continue;
+			}
 
-			while (low <= high) {
-				long int mid = low + (high - low) / 2;
+			pending.emplace(record.a, std::move(elements));
+			elements = empty;
 
-				if (equal_key(s[mid], p)) {
-					return OptionalRef<PropertyElement>(s[mid]);
-				} else if (less_key(s[mid], p)) {
-					low = mid + 1;
-				} else {
-					high = mid - 1;
-				}
+			while (!pending.empty() && pending.begin()->first == next) {
+				on_set(next, std::move(pending.begin()->second));
+				pending.erase(pending.begin());
+				result.sets++;
+				next++;
 			}
 		}
 
-		return OptionalRef<PropertyElement>::absent();
+		result.discarded += pending.size();
+		result.torn = reader.is_torn();
+	}
+
+	/// Opens a journal written by an LHF of this type.
+	static UniquePointer<JournalReader> open_journal(const String &path) {
+		return std::make_unique<JournalReader>(
+			path, sizeof(PropertyElement), alignof(PropertyElement),
+			Nesting::num_children);
 	}
 
+public:
 	/**
-	 * @brief      Determines whether the property set at `index` contains the
-	 *             element `prop` or not.
+	 * @brief      Starts a write-ahead journal at `path`. Every set that is
+	 *             registered from now on is appended to it, and with
+	 *             `operations`, so is every new operation cache entry and
+	 *             subset relation. Records are buffered (see
+	 *             `LHF_JOURNAL_BUFFER_SIZE`) until the buffer is full or
+	 *             `sync_journal()` is called.
 	 *
-	 * @param[in]  index  The index
-	 * @param[in]  prop   The property
+	 *             The journal records the changes since it was started, so it
+	 *             is replayed on top of a snapshot of the LHF from that point
+	 *             (see `checkpoint()` and `replay_journal()`).
 	 *
-	 * @return     `true` if `prop` is in `index`, false otherwise.
+	 * @note       Requires trivially copyable property elements. This must
+	 *             not run concurrently with other operations. Journals do not
+	 *             record `collect()` and `reorganize()`, so a checkpoint
+	 *             should follow these.
 	 */
-	inline bool contains(const Index &index, const PropertyElement &prop) const {
-		if (is_empty(index)) {
-			return false;
+	void enable_journal(const String &path, bool operations = false) {
+		static_assert(JOURNALABLE,
+			"Journaling requires trivially copyable property elements");
+
+		if (journal) {
+			throw AssertError("Journaling is already enabled");
 		}
 
-		const PropertySet &s = get_value(index);
+		journal = std::make_unique<JournalWriter>(path, make_journal_header(
+			sizeof(PropertyElement), alignof(PropertyElement),
+			Nesting::num_children, property_sets.size()));
+		journal_operations = operations;
+	}
 
-		if (s.size() <= LHF_SORTED_VECTOR_BINARY_SEARCH_THRESHOLD) {
-			for (PropertyElement i : s) {
-				if (equal_key(i, prop)) {
-					return true;
-				}
-			}
-		} else {
-			// Binary search implementation
-			std::int64_t low = 0;
-			std::int64_t high = s.size() - 1;
+	/**
+	 * @brief      Writes the buffered records to the journal and waits until
+	 *             they are on stable storage.
+	 */
+	void sync_journal() {
+		if (journal) {
+			journal->flush(true);
+		}
+	}
 
-			while (low <= high) {
-				long int mid = low + (high - low) / 2;
-				if (equal_key(s[mid], prop)) {
-					return true;
-				} else if (less_key(s[mid], prop)) {
-					low = mid + 1;
-				} else {
-					high = mid - 1;
-				}
-			}
+	/**
+	 * @brief      Syncs and closes the journal.
+	 */
+	void disable_journal() {
+		if (journal) {
+			journal->flush(true);
+			journal.reset();
 		}
+	}
 
-		return false;
+	bool is_journal_enabled() const {
+		return journal != nullptr;
 	}
 
 	/**
-	 * @brief      Calculates, or returns a cached result of the union
-	 *             of `a` and `b`
+	 * @brief      Writes a snapshot to `snapshot_path` (replacing the previous
+	 *             one atomically) and starts a new journal at `journal_path`.
+	 *             After a crash, the LHF is restored with
+	 *             `load_snapshot(snapshot_path)` followed by
+	 *             `replay_journal(journal_path)`.
 	 *
-	 * @param[in]  a     The first set
-	 * @param[in]  b     The second set
+	 * @note       If a crash happens between writing the snapshot and
+	 *             starting the new journal, the old journal is left behind,
+	 *             and `replay_journal()` rejects it, as it starts at an
+	 *             earlier set. The snapshot alone is then complete.
+	 */
+	void checkpoint(const String &snapshot_path, const String &journal_path) {
+		bool operations = journal_operations;
+		disable_journal();
+
+		write_file_atomically(snapshot_path, [this](const String &temporary) {
+			write_snapshot(temporary);
+		});
+
+		enable_journal(journal_path, operations);
+	}
+
+	/**
+	 * @brief      Replaces the contents of the LHF with those of a snapshot
+	 *             written by `write_snapshot()`. The sets keep their indices.
 	 *
-	 * @return     Index of the new property set.
+	 *             The checksums of the snapshot are verified first, after
+	 *             which its contents are trusted: sets are stored without the
+	 *             integrity check and lookups of `register_set()`, and the
+	 *             hash tables are sized once and filled in a single pass. Set
+	 *             contents are decoded in parallel (see `parallel_for()`),
+	 *             and with `LHF_ENABLE_TBB`, the hash tables are filled in
+	 *             parallel as well.
+	 *
+	 * @note       Snapshots of LHFs with collected sets cannot be loaded, as
+	 *             their indices cannot be reproduced. Compact the LHF first
+	 *             (see `collect()`). This must not run concurrently with other
+	 *             operations.
+	 *
+	 * @exception  SnapshotError  If the snapshot is invalid or corrupt.
 	 */
-	LHF_BINARY_NESTED_OPERATION(set_union)
-	Index set_union(const Index &_a, const Index &_b) {
-		LHF_PROPERTY_SET_PAIR_VALID(_a, _b);
+	void load_snapshot(const String &path) {
 		__lhf_calc_functime(stat);
 
-		if (_a == _b) {
-			LHF_PERF_INC(unions, equal_hits);
-			return Index(_a);
-		}
-
-		if (is_empty(_a)) {
-			LHF_PERF_INC(unions, empty_hits);
-			return Index(_b);
-		} else if (is_empty(_b)) {
-			LHF_PERF_INC(unions,empty_hits);
-			return Index(_a);
+		if (journal) {
+			throw AssertError("Journaling must be disabled while loading a snapshot");
 		}
 
-		const Index &a = std::min(_a, _b);
-		const Index &b = std::max(_a, _b);
-
-		SubsetRelation r = is_subset(a, b);
+		MappedSnapshot m(path);
+		m.verify();
 
-		if (r == SUBSET) {
-			LHF_PERF_INC(unions, subset_hits);
-			return Index(b);
-		} else if (r == SUPERSET) {
-			LHF_PERF_INC(unions, subset_hits);
-			return Index(a);
+		Size count = m.property_set_count();
+		if (count == 0 || !m.get_value(EMPTY_SET_VALUE).empty()) {
+			throw SnapshotError("The snapshot is truncated or corrupt");
 		}
 
-		auto result = unions.find({a.value, b.value});
+		Vector<std::optional<PropertySetHolder>> holders(count);
+		std::atomic<bool> collected = false;
 
-		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
-			PropertySet new_set;
-			const PropertySet &first = get_value(a);
-			const PropertySet &second = get_value(b);
-
-			// The union implementation here is adapted from the example
-			// suggested implementation provided of std::set_union from
-			// cppreference.com
-			auto cursor_1 = first.begin();
-			const auto &cursor_end_1 = first.end();
-			auto cursor_2 = second.begin();
-			const auto &cursor_end_2 = second.end();
-
-			while (cursor_1 != cursor_end_1) {
-				if (cursor_2 == cursor_end_2) {
-					LHF_PUSH_RANGE(new_set, cursor_1, cursor_end_1);
-					break;
+		parallel_for(count, LHF_SNAPSHOT_LOAD_GRAIN, [&](Size first, Size last) {
+			for (Size i = first; i < last; i++) {
+				auto view = m.get_value(i);
+				if (i != EMPTY_SET_VALUE && view.empty()) {
+					collected = true;
+					return;
 				}
 
-				if (less(*cursor_2, *cursor_1)) {
-					LHF_PUSH_ONE(new_set, *cursor_2);
-					cursor_2++;
-				} else {
-					if (!(less(*cursor_1, *cursor_2))) {
-						if constexpr (Nesting::is_nested) {
-							PropertyElement new_elem =
-								LHF_PERFORM_BINARY_NESTED_OPERATION(
-									set_union, reflist, *cursor_1, *cursor_2);
-							LHF_PUSH_ONE(new_set, new_elem);
-						} else {
-							LHF_PUSH_ONE(new_set, *cursor_1);
-						}
-						cursor_2++;
-					} else {
-						LHF_PUSH_ONE(new_set, *cursor_1);
-					}
-					cursor_1++;
-				}
+				PropertySet set = make_set();
+				set.assign(view.begin(), view.end());
+				holders[i].emplace(make_holder(std::move(set)));
 			}
+		});
 
-			LHF_PUSH_RANGE(new_set, cursor_2, cursor_end_2);
-
-			bool cold = false;
-			Index ret;
-
-			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
-				ret = result.get();
-				property_sets.at_mutable(ret).reassign(new PropertySet(std::move(new_set)));
-			} else) {
-				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
+		if (collected) {
+			throw SnapshotError(
+				"The snapshot contains collected sets and cannot be loaded");
+		}
 
-				unions.insert({{a.value, b.value}, ret.value});
+		clear();
+		reserve(count, std::max({
+			m.unions.size(), m.intersections.size(),
+			m.differences.size(), m.subsets.size()}));
+
+		for (Size i = 0; i < count; i++) {
+			Index index = property_sets.push_back(std::move(*holders[i]));
+			account_set(*property_sets.at(index).get(), true);
+			LHF_EVICTION(resident_bytes += property_sets.at(index).payload_bytes();)
+		}
+		holders.clear();
+		holders.shrink_to_fit();
 
-				if (ret == a) {
-					store_subset(b, ret);
-				} else if (ret == b) {
-					store_subset(a, ret);
-				} else {
-					store_subset(a, ret);
-					store_subset(b, ret);
-				}
+		fill_tables(count, [this](Size first, Size last) {
+			for (Size i = first; i < last; i++) {
+				property_set_map.insert(std::make_pair(property_sets.at(i).get(), IndexValue(i)));
 			}
+		});
+
+		auto fill_map = [](auto &map, const auto &view) {
+			fill_tables(view.slot_count(), [&map, &view](Size first, Size last) {
+				view.for_each(first, last, [&map](const OperationNode &k, auto v) {
+					map.insert({k, v});
+				});
+			});
+		};
 
-			if (cold) {
-				LHF_PERF_INC(unions, cold_misses);
-			} else {
-				LHF_PERF_INC(unions, edge_misses);
-			}
+		fill_map(unions, m.unions);
+		fill_map(intersections, m.intersections);
+		fill_map(differences, m.differences);
+		fill_map(subsets, m.subsets);
 
-			return Index(ret);
-		} else {
-			LHF_PERF_INC(unions, hits);
-			return Index(result.get());
-		}
+		LHF_EVICTION(enforce_memory_budget();)
 	}
 
 	/**
-	 * @brief      Inserts a single element from a given set (and returns the
-	 *             index of the set). This is a wrapper over the union
-	 *             operation.
-	 *
-	 * @param[in]  a     The set to insert the element to
-	 * @param[in]  b     The element to be inserted.
+	 * @brief      Saves the sets and operation caches of the LHF to `path` for
+	 *             `warm_start()`, replacing the previous file atomically.
 	 *
-	 * @return     Index of the new PropertySet.
+	 * @param[in]  path  The path
+	 * @param[in]  tag   Identifies the inputs the LHF was built from (e.g. a
+	 *                   hash of the analyzed program). A later `warm_start()`
+	 *                   only uses the file if it is given the same tag.
 	 */
-	Index set_insert_single(const Index &a, const PropertyElement &b) {
-		return set_union(a, register_set_single(b));
+	void save_warm_start(const String &path, std::uint64_t tag = 0) const {
+		write_file_atomically(path, [this, tag](const String &temporary) {
+			write_snapshot(temporary, SnapshotEncoding::RAW, tag);
+		});
 	}
 
 	/**
-	 * @brief      Calculates, or returns a cached result of the difference
-	 *             of `a` from `b`
+	 * @brief      Loads the sets and operation caches saved by
+	 *             `save_warm_start()` in an earlier run, so that repeating
+	 *             the same work is answered from the caches. The header is
+	 *             checked first (see `check_snapshot_header()`): a file that
+	 *             is missing, was written by an LHF with a different
+	 *             configuration (see `config_fingerprint()`) or has a
+	 *             different tag is rejected without reading the rest of it.
 	 *
-	 * @param[in]  a     The first set (what to subtract from)
-	 * @param[in]  b     The second set (what will be subtracted)
+	 *             The sets are loaded in the order of their indices (see
+	 *             `load_snapshot()`), also in parallel builds, so every set
+	 *             keeps the index it had when it was saved, and registering
+	 *             it again returns that index.
 	 *
-	 * @return     Index of the new PropertySet.
+	 * @note       This replaces the contents of the LHF, so it should be
+	 *             called before any sets are registered.
+	 *
+	 * @return     Whether the file was loaded. If not, the LHF is unchanged.
 	 */
-	LHF_BINARY_NESTED_OPERATION(set_difference)
-	Index set_difference(const Index &a, const Index &b) {
-		LHF_PROPERTY_SET_PAIR_VALID(a, b);
+	bool warm_start(const String &path, std::uint64_t tag = 0) {
 		__lhf_calc_functime(stat);
 
-		if (a == b) {
-			LHF_PERF_INC(differences, equal_hits);
-			return Index(EMPTY_SET_VALUE);
-		}
+		try {
+			SnapshotHeader h;
+			Size length = read_snapshot_header(path, h);
+			check_snapshot_header(
+				h, length, path, sizeof(PropertyElement), alignof(PropertyElement),
+				Nesting::num_children, config_fingerprint());
+			if (h.tag != tag) {
+				return false;
+			}
 
-		if (is_empty(a)) {
-			LHF_PERF_INC(differences, empty_hits);
-			return Index(EMPTY_SET_VALUE);
-		} else if (is_empty(b)) {
-			LHF_PERF_INC(differences, empty_hits);
-			return Index(a);
+			load_snapshot(path);
+			return true;
+		} catch (const SnapshotError &) {
+			return false;
 		}
+	}
 
-		auto result = differences.find({a.value, b.value});
-
-		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
-			PropertySet new_set;
-			const PropertySet &first = get_value(a);
-			const PropertySet &second = get_value(b);
-
-			// The difference implementation here is adapted from the example
-			// suggested implementation provided of std::set_difference from
-			// cppreference.com
-			auto cursor_1 = first.begin();
-			const auto &cursor_end_1 = first.end();
-			auto cursor_2 = second.begin();
-			const auto &cursor_end_2 = second.end();
-
-			while (cursor_1 != cursor_end_1) {
-				if (cursor_2 == cursor_end_2) {
-					LHF_PUSH_RANGE(new_set, cursor_1, cursor_end_1);
-					break;
-				}
+protected:
+	using ChildRemaps = std::array<Vector<IndexValue>, Nesting::num_children>;
 
-				if (less(*cursor_1, *cursor_2)) {
-					LHF_PUSH_ONE(new_set, *cursor_1);
-					cursor_1++;
-				} else {
-					if (!(less(*cursor_2, *cursor_1))) {
-						if constexpr (Nesting::is_nested) {
-							PropertyElement new_elem =
-								LHF_PERFORM_BINARY_NESTED_OPERATION(
-									set_difference, reflist, *cursor_1, *cursor_2);
-							LHF_PUSH_ONE(new_set, new_elem);
-						}
-						cursor_1++;
-					}
-					cursor_2++;
+	/**
+	 * @brief      Merges the LHFs nested in `other` into the ones nested in
+	 *             this LHF (see `merge_from()`). A child that both LHFs share
+	 *             is left alone, and its remap stays empty, which stands for
+	 *             the identity. A pair of children that appears more than
+	 *             once in the reference lists is merged once.
+	 */
+	template<Size... I>
+	ChildRemaps merge_children(const LatticeHashForest &other, std::index_sequence<I...>) {
+		ChildRemaps remaps;
+		std::array<std::pair<const void *, const void *>, Nesting::num_children> pairs = {
+			std::make_pair(
+				static_cast<const void *>(&std::get<I>(reflist)),
+				static_cast<const void *>(&std::get<I>(other.reflist)))...};
+
+		auto merge = [&remaps, &pairs](Size i, auto &mine, const auto &theirs) {
+			if (pairs[i].first == pairs[i].second) {
+				return;
+			}
+			for (Size j = 0; j < i; j++) {
+				if (pairs[j] == pairs[i]) {
+					remaps[i] = remaps[j];
+					return;
 				}
 			}
+			remaps[i] = mine.merge_from(theirs);
+		};
 
-			bool cold = false;
-			Index ret;
+		(merge(I, std::get<I>(reflist), std::get<I>(other.reflist)), ...);
+		return remaps;
+	}
 
-			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
-				ret = result.get();
-				property_sets.at_mutable(ret).reassign(new PropertySet(std::move(new_set)));
-			} else) {
-				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
-				differences.insert({{a.value, b.value}, ret.value});
+	/// Translates the child indices of an element with `remaps` (see
+	/// `merge_children()`). `collected` is set if one of them was collected.
+	template<typename ChildValues, Size... I>
+	static ChildValues remap_children(
+		const ChildValues &v, const ChildRemaps &remaps, bool &collected,
+		std::index_sequence<I...>) {
 
-				if (ret != a) {
-					store_subset(ret, a);
+		auto remap = [&collected](const Vector<IndexValue> &r, IndexValue i) {
+			IndexValue ret = r.empty() ? i : r[i];
+			collected = collected || ret == COLLECTED;
+			return ret;
+		};
+		return ChildValues(remap(remaps[I], std::get<I>(v).value)...);
+	}
+
+	/**
+	 * @brief      Inserts the entries of `theirs`, a cache of another LHF,
+	 *             into `map`, with their indices translated by `remap` and
+	 *             the operands put back in the order `map` keeps them in.
+	 *             Entries that refer to a set that was not merged are dropped.
+	 */
+	template<typename Map>
+	void import_entries(
+		Map &map, const Map &theirs, const Vector<IndexValue> &remap,
+		JournalRecordType type) {
+
+		using Value = typename Map::MappedType;
+
+		Vector<std::pair<OperationNode, Value>> entries;
+		theirs.for_each([&entries](const OperationNode &k, const Value &v) {
+			entries.push_back({k, v});
+		});
+
+		fill_tables(entries.size(), [&](Size first, Size last) {
+			for (Size i = first; i < last; i++) {
+				IndexValue a = remap[entries[i].first.left];
+				IndexValue b = remap[entries[i].first.right];
+				Value v = entries[i].second;
+
+				if constexpr (std::is_same_v<Value, SubsetRelation>) {
+					if (a > b) {
+						std::swap(a, b);
+						v = v == SUBSET ? SUPERSET : SUBSET;
+					}
 				} else {
-					intersections.insert({
-						{
-							std::min(a.value, b.value),
-							std::max(a.value, b.value)
-						}, EMPTY_SET_VALUE});
+					v = remap[v];
+					if (v == COLLECTED) {
+						continue;
+					}
+					// Only differences are not commutative.
+					if (type != JournalRecordType::DIFFERENCE && a > b) {
+						std::swap(a, b);
+					}
 				}
-			}
 
-			if (cold) {
-				LHF_PERF_INC(differences, cold_misses);
-			} else {
-				LHF_PERF_INC(differences, edge_misses);
-			}
+				if (a == COLLECTED || b == COLLECTED) {
+					continue;
+				}
 
-			return Index(ret);
-		} else {
-			LHF_PERF_INC(differences, hits);
-			return Index(result.get());
-		}
+				map.insert({{a, b}, v});
+				journal_operation(type, a, b, IndexValue(v));
+			}
+		});
 	}
 
+public:
 	/**
-	 * @brief      Removes a single element from a given set (and returns the
-	 *             index of the set). This is a wrapper over the diffrerence
-	 *             operation.
+	 * @brief      Merges `other`, an LHF of the same type that was built
+	 *             independently (e.g. by another worker), into this one: its
+	 *             sets are interned here, and its cached unions,
+	 *             intersections, differences and subset relations are
+	 *             translated to the indices of this LHF and imported, so
+	 *             that the operations `other` has computed are cache hits.
 	 *
-	 * @param[in]  a     The set to remove the element from
-	 * @param[in]  b     The element to be removed
+	 *             The sets of `other` are looked up here in parallel (see
+	 *             `parallel_for()`). They are already sorted and unique, so
+	 *             the ones that are new are appended in a single pass, after
+	 *             reserving space for all of them, and without the integrity
+	 *             check or a lookup. On a single thread, the lookups and the
+	 *             appends are done in one pass instead, so that each new set
+	 *             is indexed while it is still in the cache. With nesting,
+	 *             the LHFs nested in
+	 *             `other` are merged into the ones nested in this LHF first
+	 *             (see `get_reflist()`), and the child indices of the
+	 *             elements are translated. Children that both LHFs share are
+	 *             left as they are.
 	 *
-	 * @return     Index of the new PropertySet.
-	 */
-	Index set_remove_single(const Index &a, const PropertyElement &b) {
-		return set_difference(a, register_set_single(b));
-	}
-
-	/**
-	 * @brief      Removes a single element from a given set if the "key"
-	 *             element matches.
+	 * @note       Neither LHF may be modified while this runs. With
+	 *             eviction enabled, sets of `other` that are evicted here
+	 *             are not brought back.
 	 *
-	 * @param[in]  a     The set to remove the element from
-	 * @param[in]  p     The key of the element with that is to be removed
+	 * @param[in]  other  The LHF to merge into this one.
 	 *
-	 * @return     Index of the new PropertySet.
+	 * @return     The index in this LHF of every set of `other`, by its index
+	 *             in `other`. Sets collected in `other` map to `COLLECTED`.
 	 */
-	Index set_remove_single_key(const Index &a, const PropertyT &p) {
-		PropertySet new_set;
-		const PropertySet &first = get_value(a);
+	Vector<IndexValue> merge_from(const LatticeHashForest &other) {
+		__lhf_calc_functime(stat);
+
+		Size count = other.property_sets.size();
+		Vector<IndexValue> remap(count, COLLECTED);
+
+		if (&other == this) {
+			for (Size i = 0; i < count; i++) {
+				if (!is_collected(i)) {
+					remap[i] = i;
+				}
+			}
+			return remap;
+		}
+
+		ChildRemaps children;
+		if constexpr (Nesting::is_nested) {
+			children = merge_children(other, std::make_index_sequence<Nesting::num_children>{});
+		}
+
+		Size operations = std::max({
+			unions.size() + other.unions.size(),
+			intersections.size() + other.intersections.size(),
+			differences.size() + other.differences.size(),
+			subsets.size() + other.subsets.size()});
+
+		// Returns a copy of set `i` of `other`, with its child indices
+		// translated, if this LHF does not have it yet, and otherwise stores
+		// the index it has here in `remap`.
+		auto look_up = [&](Size i) -> std::optional<PropertySetHolder> {
+			if (other.is_collected(i)) {
+				return std::nullopt;
+			}
+
+			const PropertySet &set = other.get_value(i);
+			PropertySet translated = make_set();
+
+			if constexpr (Nesting::is_nested) {
+				// Elements are ordered by their keys alone, so the
+				// translated set is still sorted.
+				translated.reserve(set.size());
+				bool collected = false;
+				for (const PropertyElement &e : set) {
+					translated.push_back(PropertyElement(
+						e.get_key(),
+						remap_children(
+							e.get_value(), children, collected,
+							std::make_index_sequence<Nesting::num_children>{})));
+				}
+				if (collected) {
+					return std::nullopt;
+				}
+			}
+
+			const PropertySet &contents = Nesting::is_nested ? translated : set;
+			Optional<IndexValue> existing = property_set_map.find(&contents);
+			if (existing.is_present()) {
+				remap[i] = existing.get();
+				return std::nullopt;
+			}
+
+#ifdef LHF_ENABLE_EVICTION
+			if (evicted_count > 0) {
+				Optional<Index> evicted = find_evicted(contents);
+				if (evicted.is_present()) {
+					remap[i] = evicted.get().value;
+					return std::nullopt;
+				}
+			}
+#endif
+
+			if constexpr (Nesting::is_nested) {
+				return make_holder(std::move(translated));
+			} else {
+				return make_holder(set);
+			}
+		};
+
+		// The sets of `other` are sorted and unique, and so are their
+		// translations, so the new ones are appended without lookups, in
+		// the order of their indices in `other`. The running totals (see
+		// `account_set()`) are updated once, at the end.
+		Size added = 0;
+		Size elements = 0;
+		Size slack = 0;
+		auto append = [&](Size i, PropertySetHolder &&holder) {
+			Index index = property_sets.push_back(std::move(holder));
+			remap[i] = index.value;
+			const PropertySet &set = *property_sets.at(index).get();
+			added++;
+			elements += set.size() * sizeof(PropertyElement);
+			slack += (set.capacity() - set.size()) * sizeof(PropertyElement);
+			journal_set(index, set);
+			LHF_EVICTION(resident_bytes += property_sets.at(index).payload_bytes();)
+			return index;
+		};
+
+		// concurrent_vector counts sets that are still being constructed, so
+		// a cut (see `snapshot_async()`) waits for the appends.
+		auto append_all = [&](auto f) {
+#ifdef LHF_ENABLE_TBB
+			std::shared_lock<std::shared_mutex> cut(cut_mutex);
+#endif
+			f();
+		};
 
-		auto cursor_1 = first.begin();
-		const auto &cursor_end_1 = first.end();
+		if (parallel_concurrency() > 1) {
+			// Look the sets up in parallel and collect the new ones by chunk
+			// of indices. They are appended once space is reserved for
+			// exactly them, and `fill_tables()` indexes them.
+			Vector<Vector<std::pair<IndexValue, PropertySetHolder>>> fresh(
+				(count + LHF_MERGE_GRAIN - 1) / LHF_MERGE_GRAIN);
+
+			parallel_for(count, LHF_MERGE_GRAIN, [&](Size first, Size last) {
+				auto &chunk = fresh[first / LHF_MERGE_GRAIN];
+				for (Size i = first; i < last; i++) {
+					std::optional<PropertySetHolder> holder = look_up(i);
+					if (holder.has_value()) {
+						chunk.emplace_back(i, std::move(*holder));
+					}
+				}
+			});
 
-		for (;cursor_1 != cursor_end_1; cursor_1++) {
-			if (!PropertyEqual()(cursor_1->get_key(), p)) {
-				LHF_PUSH_ONE(new_set, *cursor_1);
+			Size total = 0;
+			for (const auto &chunk : fresh) {
+				total += chunk.size();
 			}
+
+			Size base = property_sets.size();
+			reserve(base + total, operations);
+			append_all([&]() {
+				for (auto &chunk : fresh) {
+					for (auto &[i, holder] : chunk) {
+						append(i, std::move(holder));
+					}
+				}
+			});
+			fresh.clear();
+			fresh.shrink_to_fit();
+
+			fill_tables(added, [this, base](Size first, Size last) {
+				for (Size i = base + first; i < base + last; i++) {
+					property_set_map.insert(
+						std::make_pair(property_sets.at(i).get(), IndexValue(i)));
+				}
+			});
+		} else {
+			// On a single thread, a new set is appended and indexed right
+			// after it is looked up, while it is still in the cache.
+			reserve(property_sets.size() + count, operations);
+			append_all([&]() {
+				for (Size i = 0; i < count; i++) {
+					std::optional<PropertySetHolder> holder = look_up(i);
+					if (holder.has_value()) {
+						Index index = append(i, std::move(*holder));
+						property_set_map.insert(
+							std::make_pair(property_sets.at(index).get(), index.value));
+					}
+				}
+			});
 		}
-		return register_set<true>(std::move(new_set));
+
+		resident_count += added;
+		element_bytes += elements;
+		slack_bytes += slack;
+
+		import_entries(unions, other.unions, remap, JournalRecordType::UNION);
+		import_entries(intersections, other.intersections, remap, JournalRecordType::INTERSECTION);
+		import_entries(differences, other.differences, remap, JournalRecordType::DIFFERENCE);
+		import_entries(subsets, other.subsets, remap, JournalRecordType::SUBSET);
+
+		LHF_EVICTION(enforce_memory_budget();)
+		return remap;
 	}
 
 	/**
-	 * @brief      Calculates, or returns a cached result of the intersection
-	 *             of `a` and `b`
-	 *
-	 * @param[in]  a     The first set
-	 * @param[in]  b     The second set
+	 * @brief      Replays a journal written by `enable_journal()` into the
+	 *             LHF, which must be in the state the journal was started in
+	 *             (e.g. just after `load_snapshot()`).
 	 *
-	 * @return     Index of the new property set.
+	 * @return     What was replayed.
 	 */
-	LHF_BINARY_NESTED_OPERATION(set_intersection)
-	Index set_intersection(const Index &_a, const Index &_b) {
-		LHF_PROPERTY_SET_PAIR_VALID(_a, _b);
+	JournalReplayResult replay_journal(const String &path) {
 		__lhf_calc_functime(stat);
 
-		if (_a == _b) {
-			LHF_PERF_INC(intersections, equal_hits);
-			return Index(_a);
-		}
-
-		if (is_empty(_a) || is_empty(_b)) {
-			LHF_PERF_INC(intersections, empty_hits);
-			return Index(EMPTY_SET_VALUE);
+		if (journal) {
+			throw AssertError("Journaling must be disabled while replaying a journal");
 		}
 
-		const Index &a = std::min(_a, _b);
-		const Index &b = std::max(_a, _b);
-
-		SubsetRelation r = is_subset(a, b);
-
-		if (r == SUBSET) {
-			LHF_PERF_INC(intersections, subset_hits);
-			return Index(a);
-		} else if (r == SUPERSET) {
-			LHF_PERF_INC(intersections, subset_hits);
-			return Index(b);
+		auto reader = open_journal(path);
+		if (reader->get_header().base_count != property_sets.size()) {
+			throw JournalError(
+				"The journal starts at set " +
+				std::to_string(reader->get_header().base_count) +
+				", but the LHF has " + std::to_string(property_sets.size()) + " sets");
 		}
 
-		auto result = intersections.find({a.value, b.value});
-
-		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
-			PropertySet new_set;
-			const PropertySet &first = get_value(a);
-			const PropertySet &second = get_value(b);
-
-			// The intersection implementation here is adapted from the example
-			// suggested implementation provided for std::set_intersection from
-			// cppreference.com
-			auto cursor_1 = first.begin();
-			const auto &cursor_end_1 = first.end();
-			auto cursor_2 = second.begin();
-			const auto &cursor_end_2 = second.end();
-
-			while (cursor_1 != cursor_end_1 && cursor_2 != cursor_end_2)
-			{
-				if (less(*cursor_1,*cursor_2)) {
-					cursor_1++;
-				} else {
-					if (!(less(*cursor_2, *cursor_1))) {
-						if constexpr (Nesting::is_nested) {
-							PropertyElement new_elem =
-								LHF_PERFORM_BINARY_NESTED_OPERATION(set_intersection, reflist, *cursor_1, *cursor_2);
-							LHF_PUSH_ONE(new_set, new_elem);
-						} else {
-							LHF_PUSH_ONE(new_set, *cursor_1);
-						}
-						cursor_1++;
-					}
-					cursor_2++;
-				}
-			}
-
-			bool cold = false;
-			Index ret;
-
-			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
-				ret = result.get();
-				property_sets.at_mutable(ret).reassign(new PropertySet(std::move(new_set)));
-			} else){
-				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
-				intersections.insert({{a.value, b.value}, ret.value});
+		JournalReplayResult result;
+		Vector<JournalRecord> operations;
 
-				if (ret != a) {
-					store_subset(ret, a);
-				} else if (ret != b) {
-					store_subset(ret, b);
-				} else {
-					store_subset(ret, a);
-					store_subset(ret, b);
+		read_journal(*reader, property_sets.size(), make_set(),
+			[this](IndexValue index, PropertySet &&set) {
+				if (register_set<true>(std::move(set)).value != index) {
+					throw JournalError("The journal does not belong to this LHF");
 				}
+			}, operations, result);
+
+		Size count = property_sets.size();
+		for (const JournalRecord &r : operations) {
+			if (r.a >= count || r.b >= count ||
+			    (r.type != JournalRecordType::SUBSET && r.c >= count)) {
+				result.discarded++;
+				continue;
 			}
 
-			if (cold) {
-				LHF_PERF_INC(intersections, cold_misses);
-			} else {
-				LHF_PERF_INC(intersections, edge_misses);
+			switch (r.type) {
+			case JournalRecordType::UNION:
+				unions.insert({{r.a, r.b}, r.c});
+				break;
+			case JournalRecordType::INTERSECTION:
+				intersections.insert({{r.a, r.b}, r.c});
+				break;
+			case JournalRecordType::DIFFERENCE:
+				differences.insert({{r.a, r.b}, r.c});
+				break;
+			default:
+				subsets.insert({{r.a, r.b}, SubsetRelation(r.c)});
+				break;
 			}
-			return Index(ret);
+			result.operations++;
 		}
 
-		LHF_PERF_INC(intersections, hits);
-		return Index(result.get());
+		return result;
 	}
 
-
 	/**
-	 * @brief      Filters a set based on a criterion function.
-	 *             This is supposed to be an abstract filtering mechanism that
-	 *             derived classes will use to implement caching on a filter
-	 *             operation rather than letting them implement their own.
-	 *
-	 * @param[in]  s            The set to filter
-	 * @param[in]  filter_func  The filter function (can be a lambda)
-	 * @param      cache        The cache to use (possibly defined by the user)
+	 * @brief      Folds a journal into the snapshot it was started from and
+	 *             writes the result to `output_path` as a new snapshot,
+	 *             without an LHF. The journal may still be appended to: only
+	 *             the records written so far are folded in.
 	 *
-	 * @todo Implement sort bound optimization
-	 * @todo Implement bounding as a seperate function instead
+	 *             Together with `checkpoint()`, this allows compacting in the
+	 *             background: start a new journal, and fold the old one into
+	 *             the snapshot with `compact_journal_async()`.
 	 *
-	 * @return     Index of the filtered set.
+	 * @note       The operation caches of the snapshot are held in memory
+	 *             while the new snapshot is written.
 	 */
-	Index set_filter(
-		Index s,
-		std::function<bool(const PropertyElement &)> filter_func,
-		UnaryOperationMap &cache) {
-		LHF_PROPERTY_SET_INDEX_VALID(s);
-		__lhf_calc_functime(stat);
-
-		if (is_empty(s)) {
-			return s;
+	static void compact_journal(
+		const String &snapshot_path,
+		const String &journal_path,
+		const String &output_path) {
+
+		using SetView = typename Frozen::SetView;
+		using Elements = Vector<PropertyElement>;
+
+		MappedSnapshot base(snapshot_path);
+		auto reader = open_journal(journal_path);
+		Size count = base.property_set_count();
+
+		if (reader->get_header().base_count != count) {
+			throw JournalError(
+				"The journal starts at set " +
+				std::to_string(reader->get_header().base_count) +
+				", but the snapshot has " + std::to_string(count) + " sets");
 		}
 
-		auto result = cache.find(s.value);
-
-		if (!result.is_present() LHF_EVICTION(|| is_evicted(result.get()))) {
-			PropertySet new_set;
-			for (const PropertyElement &value : get_value(s)) {
-				if (filter_func(value)) {
-					LHF_PUSH_ONE(new_set, value);
-				}
+		JournalReplayResult result;
+		Vector<JournalRecord> operations;
+		Vector<Elements> added;
+
+		read_journal(*reader, count, Elements(),
+			[&added](IndexValue, Elements &&set) {
+				added.push_back(std::move(set));
+			}, operations, result);
+
+		HashMap<OperationNode, IndexValue> u, i, d;
+		HashMap<OperationNode, SubsetRelation> sub;
+		base.unions.for_each([&u](const OperationNode &k, IndexValue v) { u.insert({k, v}); });
+		base.intersections.for_each([&i](const OperationNode &k, IndexValue v) { i.insert({k, v}); });
+		base.differences.for_each([&d](const OperationNode &k, IndexValue v) { d.insert({k, v}); });
+		base.subsets.for_each([&sub](const OperationNode &k, SubsetRelation v) { sub.insert({k, v}); });
+
+		Size total = count + added.size();
+		for (const JournalRecord &r : operations) {
+			if (r.a >= total || r.b >= total ||
+			    (r.type != JournalRecordType::SUBSET && r.c >= total)) {
+				continue;
 			}
 
-			bool cold;
-			Index ret;
-
-			LHF_EVICTION(if (result.is_present() && is_evicted(result.get())) {
-				ret = result.get();
-				property_sets.at_mutable(ret).reassign(new PropertySet(std::move(new_set)));
-			} else) {
-				ret = LHF_REGISTER_SET_INTERNAL(std::move(new_set), cold);
-				cache.insert(std::make_pair(s.value, ret.value));
+			OperationNode k = {r.a, r.b};
+			switch (r.type) {
+			case JournalRecordType::UNION:
+				u.insert({k, r.c});
+				break;
+			case JournalRecordType::INTERSECTION:
+				i.insert({k, r.c});
+				break;
+			case JournalRecordType::DIFFERENCE:
+				d.insert({k, r.c});
+				break;
+			default:
+				sub.insert({k, SubsetRelation(r.c)});
+				break;
 			}
+		}
 
-			if (cold) {
-				LHF_PERF_INC(filter, cold_misses);
-			} else {
-				LHF_PERF_INC(filter, edge_misses);
+		auto set_at = [&](Size k, SetView &out) {
+			if (k < count) {
+				out = base.get_value(k);
+				return k == EMPTY_SET_VALUE || !out.empty();
 			}
+			const Elements &s = added[k - count];
+			out = SetView{s.data(), s.data() + s.size()};
+			return true;
+		};
 
-			return Index(ret);
-		} else {
-			LHF_PERF_INC(filter, hits);
-			return Index(result.get());
-		}
+		write_file_atomically(output_path, [&](const String &temporary) {
+			write_snapshot_file(
+				temporary, total, set_at, u, i, d, sub,
+				base.get_encoding(), base.get_tag());
+		});
+	}
+
+	/**
+	 * @brief      Runs `compact_journal()` on a background thread.
+	 */
+	static std::future<void> compact_journal_async(
+		const String &snapshot_path,
+		const String &journal_path,
+		const String &output_path) {
+
+		return std::async(std::launch::async, compact_journal,
+			snapshot_path, journal_path, output_path);
 	}
 
 	/**
@@ -2297,6 +7062,10 @@ public:
 
 #ifdef LHF_ENABLE_SERIALIZATION
 
+	/// Clears the LHF before loading it.
+	template<typename, typename>
+	friend struct slz::LHFStreamLoader;
+
 	const RefList &get_reflist() const {
 		return reflist;
 	}
@@ -2318,17 +7087,85 @@ public:
 		slz::binary_operation_map_from_json(subsets, obj["subsets"]);
 	}
 
+	/**
+	 * @brief      Streaming counterpart of `operations_to_json`.
+	 */
+	virtual void operations_to_json_stream(std::ostream &os) const {
+		os << "{\"unions\":";
+		slz::binary_operation_map_to_stream(os, unions);
+		os << ",\"intersections\":";
+		slz::binary_operation_map_to_stream(os, intersections);
+		os << ",\"differences\":";
+		slz::binary_operation_map_to_stream(os, differences);
+		os << ",\"subsets\":";
+		slz::binary_operation_map_to_stream(os, subsets);
+		os << '}';
+	}
+
+	/**
+	 * @brief      Inserts a single entry of the operation map named `name`
+	 *             (as in `operations_to_json`). Used by `slz::lhf_from_stream`.
+	 *             Entries of unknown maps are ignored.
+	 */
+	virtual void operation_from_json(const String &name, const slz::JSON &entry) {
+		if (name == "unions") {
+			slz::binary_operation_entry_from_json(unions, entry);
+		} else if (name == "intersections") {
+			slz::binary_operation_entry_from_json(intersections, entry);
+		} else if (name == "differences") {
+			slz::binary_operation_entry_from_json(differences, entry);
+		} else if (name == "subsets") {
+			slz::binary_operation_entry_from_json(subsets, entry);
+		}
+	}
+
+protected:
+	/**
+	 * @brief      Returns the set at `index` for serialization. An evicted
+	 *             set is read into `buffer` (see `peek_value()`) without
+	 *             bringing it back, so the eviction lock must be held while
+	 *             the result is used. Collected sets cannot be serialized, as
+	 *             their indices cannot be reproduced when the sets are
+	 *             registered again.
+	 */
+	const PropertySet &serialized_value(Size index, PropertySet &buffer) const {
+		if (is_collected(index)) {
+			throw slz::SerializationError(
+				"LHFs with collected sets cannot be serialized");
+		}
+#ifdef LHF_ENABLE_EVICTION
+		return peek_value(index, buffer);
+#else
+		(void) buffer;
+		return *property_sets.at(index).get();
+#endif
+	}
+
+public:
+	/**
+	 * @note       Evicted sets are read from the spill file or recomputed
+	 *             into a buffer (see `peek_value()`), without bringing them
+	 *             back. LHFs with collected sets cannot be serialized and
+	 *             throw `slz::SerializationError`, as their indices cannot
+	 *             be reproduced. Compact the LHF first (see `collect()`).
+	 */
 	template<typename Serializer =
 		slz::DefaultValueSerializer<PropertyT>>
 	slz::JSON to_json(Serializer &s) const {
 		slz::JSON ret = slz::JSON::object();
 
+		LHF_EVICTION(std::lock_guard<std::recursive_mutex> l(eviction_mutex);)
+		PropertySet buffer = make_set();
+		auto set_at = [this, &buffer](Size i) -> const PropertySet & {
+			return serialized_value(i, buffer);
+		};
+
 		if constexpr (Nesting::is_nested) {
 			ret["property_sets"] =
-				slz::storage_array_to_json_nested(property_sets, s);
+				slz::storage_array_to_json_nested(property_sets.size(), set_at, s);
 		} else {
 			ret["property_sets"] =
-				slz::storage_array_to_json(property_sets, s);
+				slz::storage_array_to_json(property_sets.size(), set_at, s);
 		}
 
 		ret["operations"] = operations_to_json();
@@ -2343,6 +7180,46 @@ public:
 		return to_json(s);
 	}
 
+	/**
+	 * @brief      Writes the representation returned by `to_json` to `os`
+	 *             without building it in memory. Evicted and collected sets
+	 *             are handled as in `to_json`; a collected set is detected
+	 *             before anything is written.
+	 */
+	template<typename Serializer =
+		slz::DefaultValueSerializer<PropertyT>>
+	void to_json_stream(std::ostream &os, Serializer &s) const {
+		for (Size i = 0; i < collected_sets.size(); i++) {
+			if (collected_sets[i]) {
+				throw slz::SerializationError(
+					"LHFs with collected sets cannot be serialized");
+			}
+		}
+
+		LHF_EVICTION(std::lock_guard<std::recursive_mutex> l(eviction_mutex);)
+		PropertySet buffer = make_set();
+		auto set_at = [this, &buffer](Size i) -> const PropertySet & {
+			return serialized_value(i, buffer);
+		};
+
+		os << "{\"property_sets\":";
+		if constexpr (Nesting::is_nested) {
+			slz::storage_array_to_stream_nested(os, property_sets.size(), set_at, s);
+		} else {
+			slz::storage_array_to_stream(os, property_sets.size(), set_at, s);
+		}
+		os << ",\"operations\":";
+		operations_to_json_stream(os);
+		os << '}';
+	}
+
+	template<typename Serializer =
+		slz::DefaultValueSerializer<PropertyT>>
+	void to_json_stream(std::ostream &os) const {
+		auto s = Serializer();
+		to_json_stream(os, s);
+	}
+
 	template<typename Serializer =
 		slz::DefaultValueSerializer<PropertyT>>
 	void load_from_json(const slz::JSON &obj, Serializer &s) {
@@ -2362,6 +7239,149 @@ public:
 		load_from_json(obj, s);
 	}
 
+	/**
+	 * @brief      Adds the contents of the LHF to a bundle as the LHF at
+	 *             `path` (see `slz::lhf_to_bundle`). Every distinct key is
+	 *             serialized once and interned in the dictionary of the
+	 *             bundle, which is shared by all LHFs written to it.
+	 *
+	 * @note       LHFs with collected sets cannot be written, as their
+	 *             indices cannot be reproduced. Compact the LHF first (see
+	 *             `collect()`).
+	 */
+	template<typename Serializer =
+		slz::DefaultValueSerializer<PropertyT>>
+	void to_bundle(slz::BundleWriter &w, const String &path, Serializer &s) const {
+		HashMap<PropertyT, std::uint64_t, PropertyHash, PropertyEqual> ids;
+		Vector<std::uint64_t> words = {property_sets.size()};
+
+		for (Size i = 0; i < property_sets.size(); i++) {
+			if (is_collected(i)) {
+				throw slz::SerializationError(
+					"LHFs with collected sets cannot be written to a bundle");
+			}
+
+			const PropertySet &set = get_value(i);
+			words.push_back(set.size());
+			for (const PropertyElement &e : set) {
+				auto k = ids.find(e.get_key());
+				if (k == ids.end()) {
+					k = ids.insert({e.get_key(), w.intern(s.save(e.get_key()).dump())}).first;
+				}
+				words.push_back(k->second);
+
+				if constexpr (Nesting::is_nested) {
+					std::apply([&words](const auto &... child) {
+						(words.push_back(child.value), ...);
+					}, e.get_value());
+				}
+			}
+		}
+
+		auto add_map = [&words](const auto &map) {
+			words.push_back(map.size());
+			for (auto &i : map) {
+				words.insert(words.end(), {
+					i.first.left, i.first.right, std::uint64_t(i.second)});
+			}
+		};
+
+		add_map(unions);
+		add_map(intersections);
+		add_map(differences);
+		add_map(subsets);
+
+		w.add(path, words);
+	}
+
+	template<typename Serializer =
+		slz::DefaultValueSerializer<PropertyT>>
+	void to_bundle(slz::BundleWriter &w, const String &path) const {
+		auto s = Serializer();
+		to_bundle(w, path, s);
+	}
+
+	/**
+	 * @brief      Replaces the contents of the LHF with those of the LHF at
+	 *             `path` in a bundle. Only the contents of this LHF and the
+	 *             keys they refer to are read.
+	 */
+	template<typename Serializer =
+		slz::DefaultValueSerializer<PropertyT>>
+	void load_from_bundle(slz::BundleReader &r, const String &path, Serializer &s) {
+		Vector<std::uint64_t> words = r.contents(path);
+		Size position = 0;
+		auto next = [&]() {
+			if (position == words.size()) {
+				throw slz::SerializationError("The bundle is truncated or corrupt");
+			}
+			return words[position++];
+		};
+
+		clear();
+
+		// Keys are converted once per LHF.
+		Vector<std::optional<PropertyT>> keys(r.key_count());
+		Size count = next();
+		for (Size i = 0; i < count; i++) {
+			PropertySet data = make_set();
+			for (Size n = next(); n > 0; n--) {
+				std::uint64_t id = next();
+				if (id >= keys.size()) {
+					throw slz::SerializationError("The bundle is truncated or corrupt");
+				} else if (!keys[id]) {
+					keys[id] = s.load(r.key(id));
+				}
+
+				if constexpr (Nesting::is_nested) {
+					std::array<std::uint64_t, Nesting::num_children> children;
+					for (std::uint64_t &c : children) {
+						c = next();
+					}
+					data.push_back(PropertyElement(*keys[id], std::apply([](auto... c) {
+						return typename Nesting::ChildValueList{c...};
+					}, children)));
+				} else {
+					data.push_back(PropertyElement(*keys[id]));
+				}
+			}
+
+			if (register_set(std::move(data)).value != i) {
+				throw slz::SerializationError("The bundle is truncated or corrupt");
+			}
+		}
+
+		auto load_map = [&](auto &map, auto value) {
+			using Value = decltype(value);
+			for (Size n = next(); n > 0; n--) {
+				IndexValue a = next();
+				IndexValue b = next();
+				std::uint64_t c = next();
+				if (a >= count || b >= count ||
+				    (std::is_same_v<Value, IndexValue> && c >= count)) {
+					throw slz::SerializationError("The bundle is truncated or corrupt");
+				}
+				map.insert({{a, b}, Value(c)});
+			}
+		};
+
+		load_map(unions, IndexValue());
+		load_map(intersections, IndexValue());
+		load_map(differences, IndexValue());
+		load_map(subsets, SubsetRelation());
+
+		if (position != words.size()) {
+			throw slz::SerializationError("The bundle is truncated or corrupt");
+		}
+	}
+
+	template<typename Serializer =
+		slz::DefaultValueSerializer<PropertyT>>
+	void load_from_bundle(slz::BundleReader &r, const String &path) {
+		auto s = Serializer();
+		load_from_bundle(r, path, s);
+	}
+
 #endif
 
 	/**
@@ -2392,8 +7412,14 @@ public:
 
 		s << "    " << "PropertySets: " << "(Count: " << property_sets.size() << ")\n";
 		for (size_t i = 0; i < property_sets.size(); i++) {
-			s << "      "
-				<< i << " : " << property_set_to_string(*property_sets.at(i).get()) << "\n";
+			s << "      " << i << " : ";
+			if (is_collected(i)) {
+				s << "(collected)\n";
+			} else if (property_sets.at(i).is_evicted()) {
+				s << "(evicted)\n";
+			} else {
+				s << property_set_to_string(*property_sets.at(i).get()) << "\n";
+			}
 		}
 		s << "}\n";
 
@@ -2416,13 +7442,37 @@ public:
 	String dump_perf() const {
 		std::stringstream s;
 		s << "Performance Profile: \n";
-		for (auto &p : perf) {
+		for (auto &p : get_perf()) {
 			s << p.first << "\n"
 			  << p.second.to_string() << "\n";
 		}
-		s << stat.dump();
+		s << "Operation Caches:\n";
+		for (auto &c : get_operation_cache_stats()) {
+			s << "  " << c.first << "\n" << c.second.to_string();
+		}
+		s << stat.dump(false);
+#ifdef LHF_ENABLE_EVICTION
+		s << "Eviction:\n" << get_eviction_stats().to_string();
+#endif
 		return s.str();
 	}
+
+	/**
+	 * @brief      Aggregates the operation counters of all threads.
+	 * @note       Conditionally enabled if `LHF_ENABLE_PERFORMANCE_METRICS` is
+	 *             set.
+	 * @return     Performance statistics for each operation.
+	 */
+	HashMap<String, OperationPerf> get_perf() const {
+		HashMap<String, OperationPerf> ret;
+		for (auto &c : stat.get_counters()) {
+			Size sep = c.first.find('.');
+			if (sep != String::npos) {
+				ret[c.first.substr(0, sep)].add(c.first.substr(sep + 1), c.second);
+			}
+		}
+		return ret;
+	}
 #endif
 
 }; // END LatticeHashForest
@@ -2454,12 +7504,15 @@ public:
  * @tparam     PropertyLess     Custom less-than comparator (if required)
  * @tparam     PropertyEqual    Custom equality comaparator (if required)
  * @tparam     PropertyPrinter  PropertyT string representation generator
+ * @tparam     Allocator        Allocator for the values and internal
+ *                              containers (see `LHFConfig::Allocator`)
  */
 template <
 	typename PropertyT,
 	typename PropertyHash = DefaultHash<PropertyT>,
 	typename PropertyEqual = DefaultEqual<PropertyT>,
-	typename PropertyPrinter = DefaultPrinter<PropertyT>>
+	typename PropertyPrinter = DefaultPrinter<PropertyT>,
+	typename Allocator = DefaultAllocator>
 struct Deduplicator {
 	/**
 	 * @brief      Index returned by the class. Being defined inside the
@@ -2522,13 +7575,23 @@ struct Deduplicator {
 		std::unordered_map<
 			PropertyT *, IndexValue,
 			PropertyPtrHash,
-			PropertyPtrEqual>;
+			PropertyPtrEqual,
+			RebindAllocator<Allocator, std::pair<PropertyT *const, IndexValue>>>;
+
+	using PropertyPointer = AllocatorPointer<PropertyT, Allocator>;
+
+	Allocator allocator;
 
 	// The property storage array.
-	Vector<UniquePointer<PropertyT>> property_list = {};
+	std::vector<PropertyPointer, RebindAllocator<Allocator, PropertyPointer>> property_list;
 
 	// The property -> Index in storage array mapping.
-	PropertyMap property_map = {};
+	PropertyMap property_map;
+
+	explicit Deduplicator(const Allocator &allocator = Allocator()):
+		allocator(allocator),
+		property_list(RebindAllocator<Allocator, PropertyPointer>(allocator)),
+		property_map(RebindAllocator<Allocator, std::pair<PropertyT *const, IndexValue>>(allocator)) {}
 
 	/**
 	 * @brief         Inserts a (or gets an existing) element into property
@@ -2544,9 +7607,7 @@ struct Deduplicator {
 		auto cursor = property_map.find(&c);
 
 		if (cursor == property_map.end()) {
-			UniquePointer<PropertyT> new_value =
-				UniquePointer<PropertyT>(new PropertyT(c));
-			property_list.push_back(std::move(new_value));
+			property_list.push_back(allocate_unique<PropertyT>(allocator, c));
 			IndexValue ret = property_list.size() - 1;
 			property_map.insert(std::make_pair(property_list[ret].get(), ret));
 			return Index(ret);
@@ -2558,9 +7619,7 @@ struct Deduplicator {
 		auto cursor = property_map.find(&c);
 
 		if (cursor == property_map.end()) {
-			UniquePointer<PropertyT> new_value =
-				UniquePointer<PropertyT>(new PropertyT(std::move(c)));
-			property_list.push_back(std::move(new_value));
+			property_list.push_back(allocate_unique<PropertyT>(allocator, std::move(c)));
 			IndexValue ret = property_list.size() - 1;
 			property_map.insert(std::make_pair(property_list[ret].get(), ret));
 			return Index(ret);
@@ -2570,23 +7629,15 @@ struct Deduplicator {
 
 	/**
 	* This transfers ownership over to the deduplicator. DO NOT free or use the
-	* supplied pointer after this.
+	* supplied pointer after this. The pointer must come from `new`; its
+	* value is moved into storage from the allocator of the deduplicator.
 	*
 	* Ideally, this function should not be used at all, and is present only
 	* as a workaround for integration into existing systems.
 	*/
 	Index register_ptr(PropertyT *c) {
-		auto cursor = property_map.find(c);
-
-		if (cursor == property_map.end()) {
-			UniquePointer<PropertyT> new_value = UniquePointer<PropertyT>(c);
-			property_list.push_back(std::move(new_value));
-			IndexValue ret = property_list.size() - 1;
-			property_map.insert(std::make_pair(property_list[ret].get(), ret));
-			return Index(ret);
-		}
-		delete c;
-		return Index(cursor->second);
+		UniquePointer<PropertyT> owned(c);
+		return register_value(std::move(*owned));
 	}
 
 	Size get_property_count() const {
@@ -0,0 +1,453 @@
+/**
+ * @file lhf_bundle.hpp
+ * @brief A binary format for a whole family of nested LHFs, with the keys of
+ *        all LHFs stored once in a shared dictionary.
+ */
+
+#ifndef LHF_BUNDLE_HPP
+#define LHF_BUNDLE_HPP
+
+#include "lhf_common.hpp"
+#include "lhf_codec.hpp"
+#include "lhf_serialization.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+namespace lhf {
+
+namespace slz {
+
+/// Version of the bundle format. Bundles of other versions are rejected.
+static constexpr std::uint32_t BUNDLE_FORMAT_VERSION = 1;
+
+static constexpr std::uint32_t BUNDLE_BYTE_ORDER_MARK = 0x01020304;
+
+static constexpr char BUNDLE_MAGIC[8] = {'L', 'H', 'F', 'B', 'N', 'D', 'L', '\0'};
+
+/**
+ * @brief      The header at the start of a bundle.
+ *
+ *             A bundle consists of the header, the dictionary, the contents
+ *             of every LHF and the directory:
+ *
+ *             - The dictionary holds the serialized keys (JSON text, see
+ *               `ValueSerializer`) of all LHFs of the family, each distinct
+ *               key once: `key_count + 1` offsets, followed by the text of
+ *               the keys.
+ *             - The contents of an LHF are a sequence of words, encoded with
+ *               `StreamVByte`: the number of sets, then for every set its
+ *               size and, for every element, the dictionary index of its key
+ *               and its child indices, and finally the unions,
+ *               intersections, differences and subsets, each as a count
+ *               followed by `(left, right, value)` triples.
+ *             - The directory lists every LHF as its path (as in
+ *               `lhf_to_json`), followed by the offset, size in bytes and
+ *               number of words of its contents.
+ */
+struct BundleHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint64_t key_count;
+	std::uint64_t dictionary_offset;
+	std::uint64_t dictionary_bytes;
+	std::uint64_t forest_count;
+	std::uint64_t directory_offset;
+	std::uint64_t directory_bytes;
+};
+
+/**
+ * @brief      Collects the dictionary and the contents of the LHFs of a
+ *             bundle, and writes them to a file.
+ */
+class BundleWriter {
+protected:
+	struct Forest {
+		String path;
+		Vector<std::uint8_t> contents;
+		std::uint64_t words;
+	};
+
+	HashMap<String, std::uint64_t> ids;
+	Vector<const String *> keys;
+	Vector<Forest> forests;
+
+	static void put(std::FILE *file, const void *data, Size bytes) {
+		if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes) {
+			std::fclose(file);
+			throw SerializationError("Could not write to the bundle");
+		}
+	}
+
+public:
+	/**
+	 * @brief      Returns the dictionary index of a serialized key, adding it
+	 *             to the dictionary if it is new.
+	 */
+	std::uint64_t intern(String &&text) {
+		auto [i, inserted] = ids.insert({std::move(text), keys.size()});
+		if (inserted) {
+			keys.push_back(&i->first);
+		}
+		return i->second;
+	}
+
+	/**
+	 * @brief      Adds the contents of the LHF at `path` (see `BundleHeader`).
+	 */
+	void add(const String &path, const Vector<std::uint64_t> &words) {
+		Forest f = {path, {}, words.size()};
+		StreamVByte<std::uint64_t>::encode(words.data(), words.size(), f.contents);
+		forests.push_back(std::move(f));
+	}
+
+	/**
+	 * @brief      Returns the number of distinct keys added so far.
+	 */
+	Size key_count() const {
+		return keys.size();
+	}
+
+	/**
+	 * @brief      Writes the bundle to `file_path`.
+	 */
+	void write(const String &file_path) const {
+		std::FILE *file = std::fopen(file_path.c_str(), "wb");
+		if (file == nullptr) {
+			throw SerializationError("Could not create the bundle '" + file_path + "'");
+		}
+
+		BundleHeader h = {};
+		std::memcpy(h.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+		h.version = BUNDLE_FORMAT_VERSION;
+		h.byte_order = BUNDLE_BYTE_ORDER_MARK;
+		h.key_count = keys.size();
+		h.forest_count = forests.size();
+
+		Vector<std::uint64_t> offsets = {0};
+		for (const String *k : keys) {
+			offsets.push_back(offsets.back() + k->size());
+		}
+		h.dictionary_offset = sizeof(h);
+		h.dictionary_bytes = offsets.size() * sizeof(std::uint64_t) + offsets.back();
+
+		Vector<std::uint64_t> directory;
+		Vector<char> paths;
+		std::uint64_t position = h.dictionary_offset + h.dictionary_bytes;
+		for (const Forest &f : forests) {
+			directory.insert(directory.end(), {
+				f.path.size(), position, f.contents.size(), f.words});
+			paths.insert(paths.end(), f.path.begin(), f.path.end());
+			position += f.contents.size();
+		}
+		h.directory_offset = position;
+		h.directory_bytes = directory.size() * sizeof(std::uint64_t) + paths.size();
+
+		put(file, &h, sizeof(h));
+		put(file, offsets.data(), offsets.size() * sizeof(std::uint64_t));
+		for (const String *k : keys) {
+			put(file, k->data(), k->size());
+		}
+		for (const Forest &f : forests) {
+			put(file, f.contents.data(), f.contents.size());
+		}
+		put(file, directory.data(), directory.size() * sizeof(std::uint64_t));
+		put(file, paths.data(), paths.size());
+
+		if (std::fclose(file) != 0) {
+			throw SerializationError("Could not write to the bundle");
+		}
+	}
+};
+
+/**
+ * @brief      Reads a bundle. Opening it reads the header, the directory and
+ *             the dictionary offsets. The contents of an LHF are only read
+ *             when it is loaded, and of the dictionary, only the keys it
+ *             refers to are parsed.
+ */
+class BundleReader {
+protected:
+	struct Forest {
+		std::uint64_t offset;
+		std::uint64_t bytes;
+		std::uint64_t words;
+	};
+
+	std::FILE *file = nullptr;
+	String file_path;
+	BundleHeader header = {};
+	Size length = 0;
+	Vector<std::uint64_t> key_offsets;
+	HashMap<String, Forest> forests;
+	Vector<String> paths;
+
+	// Keys parsed so far, by dictionary index.
+	Vector<std::optional<JSON>> parsed;
+
+	[[noreturn]] void corrupt() const {
+		throw SerializationError("The bundle '" + file_path + "' is truncated or corrupt");
+	}
+
+	void read(std::uint64_t offset, void *data, Size bytes) const {
+		if (offset > length || bytes > length - offset) {
+			corrupt();
+		}
+		if (bytes > 0 &&
+		    (std::fseek(file, long(offset), SEEK_SET) != 0 ||
+		     std::fread(data, 1, bytes, file) != bytes)) {
+			corrupt();
+		}
+	}
+
+	void open() {
+		if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+		    std::memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+			throw SerializationError("'" + file_path + "' is not a bundle");
+		} else if (header.version != BUNDLE_FORMAT_VERSION) {
+			throw SerializationError(
+				"Unsupported bundle version " + std::to_string(header.version) +
+				" (expected " + std::to_string(BUNDLE_FORMAT_VERSION) + ")");
+		} else if (header.byte_order != BUNDLE_BYTE_ORDER_MARK) {
+			throw SerializationError("The bundle was written on an incompatible platform");
+		}
+
+		std::fseek(file, 0, SEEK_END);
+		length = std::ftell(file);
+
+		// Guards the allocations below against corrupt counts.
+		if (header.key_count >= length / sizeof(std::uint64_t) ||
+		    header.forest_count >= length / (4 * sizeof(std::uint64_t))) {
+			corrupt();
+		}
+
+		key_offsets.resize(header.key_count + 1);
+		Size offset_bytes = key_offsets.size() * sizeof(std::uint64_t);
+		if (header.dictionary_bytes < offset_bytes) {
+			corrupt();
+		}
+		read(header.dictionary_offset, key_offsets.data(), offset_bytes);
+		if (key_offsets[0] != 0 ||
+		    key_offsets.back() != header.dictionary_bytes - offset_bytes) {
+			corrupt();
+		}
+		for (Size i = 0; i < header.key_count; i++) {
+			if (key_offsets[i] > key_offsets[i + 1]) {
+				corrupt();
+			}
+		}
+		parsed.resize(header.key_count);
+
+		Vector<std::uint64_t> directory(4 * header.forest_count);
+		Size directory_words = directory.size() * sizeof(std::uint64_t);
+		if (header.directory_bytes < directory_words) {
+			corrupt();
+		}
+		String names(header.directory_bytes - directory_words, '\0');
+		read(header.directory_offset, directory.data(), directory_words);
+		read(header.directory_offset + directory_words, names.data(), names.size());
+
+		Size name = 0;
+		for (Size i = 0; i < header.forest_count; i++) {
+			const std::uint64_t *d = &directory[4 * i];
+			if (d[0] > names.size() - name || d[1] > length || d[2] > length - d[1]) {
+				corrupt();
+			}
+			paths.push_back(names.substr(name, d[0]));
+			forests[paths.back()] = {d[1], d[2], d[3]};
+			name += d[0];
+		}
+	}
+
+public:
+	/**
+	 * @brief      Opens the bundle at `file_path`.
+	 *
+	 * @exception  SerializationError  If it is not a valid bundle.
+	 */
+	explicit BundleReader(const String &file_path): file_path(file_path) {
+		file = std::fopen(file_path.c_str(), "rb");
+		if (file == nullptr) {
+			throw SerializationError("Could not open the bundle '" + file_path + "'");
+		}
+
+		try {
+			open();
+		} catch (...) {
+			std::fclose(file);
+			throw;
+		}
+	}
+
+	BundleReader(const BundleReader &) = delete;
+	BundleReader &operator=(const BundleReader &) = delete;
+
+	~BundleReader() {
+		std::fclose(file);
+	}
+
+	/**
+	 * @brief      Returns the paths of the LHFs in the bundle, in the order
+	 *             they were written (the root first).
+	 */
+	const Vector<String> &get_paths() const {
+		return paths;
+	}
+
+	bool contains(const String &path) const {
+		return forests.count(path) > 0;
+	}
+
+	/**
+	 * @brief      Returns the number of keys in the dictionary.
+	 */
+	Size key_count() const {
+		return header.key_count;
+	}
+
+	/**
+	 * @brief      Reads and decodes the contents of the LHF at `path` (see
+	 *             `BundleHeader`).
+	 */
+	Vector<std::uint64_t> contents(const String &path) const {
+		auto i = forests.find(path);
+		if (i == forests.end()) {
+			throw SerializationError("The bundle has no LHF at '" + path + "'");
+		}
+
+		const Forest &f = i->second;
+		if (f.words > f.bytes * 4) {
+			corrupt();
+		}
+
+		// Padded, as decoding reads whole words past the last value.
+		Vector<std::uint8_t> bytes(f.bytes + 16);
+		read(f.offset, bytes.data(), f.bytes);
+		using Codec = StreamVByte<std::uint64_t>;
+		if (Codec::encoded_size(bytes.data(), f.words) > f.bytes) {
+			corrupt();
+		}
+
+		Vector<std::uint64_t> words(f.words);
+		Codec::decode(bytes.data(), f.words, words.data(), bytes.data() + bytes.size());
+		return words;
+	}
+
+	/**
+	 * @brief      Returns the key with dictionary index `id`, parsing it the
+	 *             first time it is requested.
+	 */
+	const JSON &key(std::uint64_t id) {
+		if (id >= parsed.size()) {
+			corrupt();
+		}
+
+		if (!parsed[id]) {
+			String text(key_offsets[id + 1] - key_offsets[id], '\0');
+			read(header.dictionary_offset + key_offsets.size() * sizeof(std::uint64_t) +
+			     key_offsets[id], text.data(), text.size());
+			parsed[id] = JSON::parse(text, nullptr, false);
+			if (parsed[id]->is_discarded()) {
+				corrupt();
+			}
+		}
+		return *parsed[id];
+	}
+
+	/**
+	 * @brief      Loads the LHF at `path` into `lhf`, without reading the
+	 *             other LHFs of the bundle. Child indices are loaded as they
+	 *             are, so the child LHFs should be loaded from the same bundle.
+	 */
+	template<typename LHFT>
+	void load(const String &path, LHFT &lhf) {
+		lhf.load_from_bundle(*this, path);
+	}
+};
+
+template<typename LHFT>
+void lhf_to_bundle_internal(
+	BundleWriter &w, LHFT &root,
+	HashSet<void *> &visited, String &path) {
+
+	if (visited.count(&root) > 0) {
+		return;
+	} else {
+		visited.insert(&root);
+	}
+
+	root.to_bundle(w, path);
+
+	std::apply([&](auto&... child_refs) {
+		[[maybe_unused]] Size i = 0;
+		([&](auto& child) {
+			String current_path = path + std::to_string(i++) + "/";
+			lhf_to_bundle_internal(w, child, visited, current_path);
+		}(child_refs), ...);
+	}, root.get_reflist());
+}
+
+/**
+ * @brief      Writes an LHF and its referenced child LHFs to a bundle at
+ *             `file_path`. The LHFs are identified by the same paths as in
+ *             `lhf_to_json`, and every distinct key of all LHFs is
+ *             serialized once, into the shared dictionary of the bundle.
+ *
+ * @param      root       The LHF object to serialize.
+ * @param[in]  file_path  The file path
+ */
+template<typename LHFT>
+void lhf_to_bundle(LHFT &root, const String &file_path) {
+	HashSet<void *> visited = {};
+	String path = "/";
+	BundleWriter w;
+	lhf_to_bundle_internal(w, root, visited, path);
+	w.write(file_path);
+}
+
+template<typename LHFT>
+void lhf_from_bundle_internal(
+	BundleReader &r, LHFT &root,
+	HashSet<void *> &visited, String &path) {
+
+	if (visited.count(&root) > 0) {
+		return;
+	} else {
+		visited.insert(&root);
+	}
+
+	r.load(path, root);
+
+	std::apply([&](auto&... child_refs) {
+		[[maybe_unused]] Size i = 0;
+		([&](auto& child) {
+			String current_path = path + std::to_string(i++) + "/";
+			lhf_from_bundle_internal(r, child, visited, current_path);
+		}(child_refs), ...);
+	}, root.get_reflist());
+}
+
+/**
+ * @brief      Loads an LHF and its referenced child LHFs from a bundle
+ *             written by `lhf_to_bundle`. To load a single LHF, use
+ *             `BundleReader::load()`.
+ *
+ * @param      root       The LHF object to load data into.
+ * @param[in]  file_path  The file path
+ */
+template<typename LHFT>
+void lhf_from_bundle(LHFT &root, const String &file_path) {
+	HashSet<void *> visited = {};
+	String path = "/";
+	BundleReader r(file_path);
+	lhf_from_bundle_internal(r, root, visited, path);
+}
+
+}; // END namespace slz
+
+}; // END namespace lhf
+
+#endif
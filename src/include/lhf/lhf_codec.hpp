@@ -0,0 +1,308 @@
+/**
+ * @file lhf_codec.hpp
+ * @brief StreamVByte-style encoding of integer sequences, used by compact
+ *        snapshots.
+ */
+
+#ifndef LHF_CODEC_HPP
+#define LHF_CODEC_HPP
+
+#include "lhf_common.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// The vector decoder is compiled in if SSSE3 is enabled (1), or, with GCC and
+// Clang on x86, compiled for SSSE3 separately and chosen at runtime (2).
+#if defined(__SSSE3__)
+#define LHF_CODEC_SSSE3 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LHF_CODEC_SSSE3 2
+#endif
+
+#ifdef LHF_CODEC_SSSE3
+#include <immintrin.h>
+#endif
+
+namespace lhf {
+
+/**
+ * @brief      Encodes sequences of unsigned integers in the StreamVByte
+ *             layout: a 2-bit length code per value, packed four to a
+ *             control byte, followed by the values themselves with leading
+ *             zero bytes dropped (least significant byte first). As the
+ *             lengths of four values are known from a single control byte,
+ *             decoding needs no branches per value, and on CPUs with SSSE3,
+ *             32-bit values are decoded four at a time with a byte shuffle.
+ *
+ *             Sorted sequences are delta-encoded first (see `SetCodec`), so
+ *             most values fit in a single byte.
+ *
+ * @tparam     U     `std::uint32_t` (values take 1 to 4 bytes) or
+ *                   `std::uint64_t` (values take 1, 2, 4 or 8 bytes).
+ */
+template<typename U>
+struct StreamVByte {
+	static_assert(std::is_same_v<U, std::uint32_t> || std::is_same_v<U, std::uint64_t>,
+		"StreamVByte encodes 32-bit or 64-bit unsigned integers");
+
+	/// Number of bytes a value with length code `code` takes.
+	static constexpr Size length(unsigned code) {
+		return sizeof(U) == 4 ? code + 1 : Size(1) << code;
+	}
+
+	static unsigned code_of(U v) {
+		if constexpr (sizeof(U) == 4) {
+			return v < (U(1) << 8) ? 0 : v < (U(1) << 16) ? 1 : v < (U(1) << 24) ? 2 : 3;
+		} else {
+			return v < (U(1) << 8) ? 0 : v < (U(1) << 16) ? 1 : v < (U(1) << 32) ? 2 : 3;
+		}
+	}
+
+	/// Number of control bytes of a sequence of `n` values.
+	static constexpr Size control_bytes(Size n) {
+		return (n + 3) / 4;
+	}
+
+	/**
+	 * @brief      Appends the encoding of `[values, values + n)` to `out`.
+	 */
+	template<typename Allocator>
+	static void encode(const U *values, Size n, std::vector<std::uint8_t, Allocator> &out) {
+		Size control = out.size();
+		out.resize(control + control_bytes(n), 0);
+
+		for (Size i = 0; i < n; i++) {
+			unsigned code = code_of(values[i]);
+			out[control + i / 4] |= code << (2 * (i % 4));
+			for (Size b = 0; b < length(code); b++) {
+				out.push_back(std::uint8_t(values[i] >> (8 * b)));
+			}
+		}
+	}
+
+	/**
+	 * @brief      Returns the size in bytes of an encoded sequence of `n`
+	 *             values (control bytes included).
+	 */
+	static Size encoded_size(const std::uint8_t *in, Size n) {
+		const Tables &t = tables();
+		Size bytes = control_bytes(n);
+		for (Size i = 0; i < n / 4; i++) {
+			bytes += t.sums[in[i]];
+		}
+		for (Size i = n / 4 * 4; i < n; i++) {
+			bytes += length((in[i / 4] >> (2 * (i % 4))) & 3);
+		}
+		return bytes;
+	}
+
+	/**
+	 * @brief      Decodes a sequence of `n` values into `out`.
+	 *
+	 * @param[in]  in     The encoded sequence
+	 * @param[in]  n      Number of values
+	 * @param      out    Room for `n` values
+	 * @param[in]  limit  End of the readable memory after `in`. The vector
+	 *                    path reads up to 16 bytes at a time, so it is only
+	 *                    taken while that many bytes are readable.
+	 *
+	 * @return     Pointer past the last byte of the sequence.
+	 */
+	static const std::uint8_t *decode(
+		const std::uint8_t *in, Size n, U *out, const std::uint8_t *limit) {
+
+		const Tables &t = tables();
+		const std::uint8_t *control = in;
+		const std::uint8_t *data = in + control_bytes(n);
+		Size i = 0;
+
+#ifdef LHF_CODEC_SSSE3
+		if constexpr (sizeof(U) == 4) {
+			if (has_ssse3()) {
+				i = decode_quads(control, data, n, out, limit, t);
+			}
+		}
+#endif
+
+		for (; i < n; i++) {
+			unsigned code = (control[i / 4] >> (2 * (i % 4))) & 3;
+			Size len = length(code);
+			U v = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			// Load a whole word and mask off the bytes of the next values.
+			if (Size(limit - data) >= sizeof(U)) {
+				std::memcpy(&v, data, sizeof(U));
+				v &= t.masks[code];
+			} else
+#endif
+			{
+				for (Size b = 0; b < len; b++) {
+					v |= U(data[b]) << (8 * b);
+				}
+			}
+			out[i] = v;
+			data += len;
+		}
+
+		(void) limit;
+		return data;
+	}
+
+protected:
+	struct Tables {
+		/// Total data bytes of the four values of a control byte.
+		std::uint8_t sums[256];
+
+		/// `_mm_shuffle_epi8` masks that spread the data bytes of a control
+		/// byte into four 32-bit lanes (only used for 32-bit values).
+		std::uint8_t shuffle[256][16];
+
+		/// Masks of the bytes of a value with each length code.
+		U masks[4];
+
+		Tables() {
+			for (unsigned code = 0; code < 4; code++) {
+				masks[code] = length(code) == sizeof(U) ?
+					~U(0) : (U(1) << (8 * length(code))) - 1;
+			}
+
+			for (unsigned c = 0; c < 256; c++) {
+				Size position = 0;
+				for (unsigned lane = 0; lane < 4; lane++) {
+					Size len = length((c >> (2 * lane)) & 3);
+					for (Size b = 0; b < 4; b++) {
+						shuffle[c][lane * 4 + b] =
+							b < len && sizeof(U) == 4 ? std::uint8_t(position + b) : 0x80;
+					}
+					position += len;
+				}
+				sums[c] = std::uint8_t(position);
+			}
+		}
+	};
+
+	static const Tables &tables() {
+		static const Tables t;
+		return t;
+	}
+
+#ifdef LHF_CODEC_SSSE3
+	static bool has_ssse3() {
+#if LHF_CODEC_SSSE3 == 1
+		return true;
+#else
+		static const bool supported = __builtin_cpu_supports("ssse3");
+		return supported;
+#endif
+	}
+
+	/// Decodes groups of four 32-bit values while 16 bytes can be read, and
+	/// returns the number of values decoded.
+#if LHF_CODEC_SSSE3 == 2
+	__attribute__((target("ssse3")))
+#endif
+	static Size decode_quads(
+		const std::uint8_t *control, const std::uint8_t *&data,
+		Size n, U *out, const std::uint8_t *limit, const Tables &t) {
+
+		Size i = 0;
+		for (; i + 4 <= n && limit - data >= 16; i += 4) {
+			std::uint8_t c = control[i / 4];
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+			v = _mm_shuffle_epi8(v, _mm_loadu_si128(
+				reinterpret_cast<const __m128i *>(t.shuffle[c])));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+			data += t.sums[c];
+		}
+		return i;
+	}
+#endif
+};
+
+/**
+ * @brief      Delta encoding of sorted sets of integral keys. The first key
+ *             is stored zigzag-encoded (so that small negative keys stay
+ *             small), and every further key as its distance from the
+ *             previous one. The resulting words are encoded with
+ *             `StreamVByte`.
+ *
+ * @tparam     T     The (integral) key type.
+ */
+template<typename T>
+struct SetCodec {
+	static_assert(std::is_integral_v<T>, "Only integral keys can be delta-encoded");
+
+	using Word = std::conditional_t<sizeof(T) <= 4, std::uint32_t, std::uint64_t>;
+	using Codec = StreamVByte<Word>;
+
+	static Word zigzag(T v) {
+		if constexpr (std::is_signed_v<T>) {
+			std::int64_t x = v;
+			return Word((std::uint64_t(x) << 1) ^ std::uint64_t(x >> 63));
+		} else {
+			return Word(v);
+		}
+	}
+
+	static T unzigzag(Word w) {
+		if constexpr (std::is_signed_v<T>) {
+			return T(std::int64_t((std::uint64_t(w) >> 1) ^ (~(std::uint64_t(w) & 1) + 1)));
+		} else {
+			return T(w);
+		}
+	}
+
+	/**
+	 * @brief      Appends the encoding of the strictly increasing keys
+	 *             `[keys, keys + n)` to `out`. `words` is scratch space.
+	 */
+	template<typename Allocator>
+	static void encode(
+		const T *keys, Size n,
+		Vector<Word> &words,
+		std::vector<std::uint8_t, Allocator> &out) {
+
+		words.resize(n);
+		for (Size i = 0; i < n; i++) {
+			words[i] = i == 0 ?
+				zigzag(keys[0]) :
+				Word(std::uint64_t(keys[i]) - std::uint64_t(keys[i - 1]));
+		}
+		Codec::encode(words.data(), n, out);
+	}
+
+	/**
+	 * @brief      Decodes `n` keys into `out` (see `StreamVByte::decode()`).
+	 *             `words` is scratch space.
+	 *
+	 * @tparam     Out   `T`, or a type constructible from it (such as the
+	 *                   property elements of an LHF).
+	 */
+	template<typename Out>
+	static const std::uint8_t *decode(
+		const std::uint8_t *in, Size n, Out *out,
+		Vector<Word> &words, const std::uint8_t *limit) {
+
+		if (n == 0) {
+			return in;
+		}
+
+		words.resize(n);
+		const std::uint8_t *end = Codec::decode(in, n, words.data(), limit);
+
+		T previous = unzigzag(words[0]);
+		out[0] = Out(previous);
+		for (Size i = 1; i < n; i++) {
+			previous = T(std::uint64_t(previous) + words[i]);
+			out[i] = Out(previous);
+		}
+
+		return end;
+	}
+};
+
+}; // END namespace lhf
+
+#endif
@@ -7,8 +7,10 @@
 #define LHF_CONFIG_HPP
 
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
@@ -32,10 +34,6 @@
 #include <tbb/concurrent_vector.h>
 #endif
 
-#ifdef LHF_ENABLE_SERIALIZATION
-#include "lhf_serialization.hpp"
-#endif
-
 #define LHF_VERSION_MAJOR "0"
 #define LHF_VERSION_MINOR "6"
 #define LHF_VERSION_PATCH "0"
@@ -46,6 +44,45 @@
 #define LHF_DEFAULT_BLOCK_SIZE (1 << LHF_DEFAULT_BLOCK_SHIFT)
 #define LHF_DEFAULT_BLOCK_MASK (LHF_DEFAULT_BLOCK_SIZE - 1)
 #define LHF_DISABLE_INTERNAL_INTEGRITY_CHECK true
+#define LHF_DEFAULT_PARALLEL_MERGE_THRESHOLD (1 << 16)
+#define LHF_PARALLEL_MERGE_MIN_PARTITION (1 << 12)
+
+// Default memory budget (in bytes) for the resident property sets when
+// eviction is enabled. 0 means unlimited (only manual eviction).
+#define LHF_DEFAULT_EVICTION_MEMORY_BUDGET 0
+
+// Default capacity of each operation cache. 0 means unbounded.
+#define LHF_DEFAULT_OPERATION_CACHE_CAPACITY 0
+
+// Number of entries of the old table that `IncrementalHashMap` migrates on
+// every write (at least 2).
+#ifndef LHF_INCREMENTAL_REHASH_STEP
+#define LHF_INCREMENTAL_REHASH_STEP 4
+#endif
+
+// Size of the buffer in which `JournalWriter` collects records before writing
+// them to the journal.
+#ifndef LHF_JOURNAL_BUFFER_SIZE
+#define LHF_JOURNAL_BUFFER_SIZE (1 << 20)
+#endif
+
+// Number of sets (and hash table entries) per task when a snapshot is loaded
+// with `load_snapshot()`.
+#ifndef LHF_SNAPSHOT_LOAD_GRAIN
+#define LHF_SNAPSHOT_LOAD_GRAIN (1 << 12)
+#endif
+
+// Number of sets per task when the sets of another LHF are registered by
+// `merge_from()`.
+#ifndef LHF_MERGE_GRAIN
+#define LHF_MERGE_GRAIN (1 << 10)
+#endif
+
+// Allocations of at least this many bytes made by `HugePageAllocator` are
+// backed by transparent huge pages.
+#ifndef LHF_HUGE_PAGE_THRESHOLD
+#define LHF_HUGE_PAGE_THRESHOLD (1 << 21)
+#endif
 
 namespace lhf {
 
@@ -77,11 +114,62 @@ using IndexValue = Size;
 template<typename T>
 using UniquePointer = std::unique_ptr<T>;
 
+/**
+ * @brief      The default allocator of LHF (see `LHFConfig::Allocator`).
+ *             Allocators are given for `std::byte` and rebound to the types
+ *             that are actually allocated.
+ */
+using DefaultAllocator = std::allocator<std::byte>;
+
+template<typename Allocator, typename T>
+using RebindAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+/**
+ * @brief      Deletes objects created by `allocate_unique()` through the
+ *             allocator they were allocated with. It derives from the
+ *             allocator, so stateless allocators add no space to the pointer.
+ */
+template<typename T, typename Allocator>
+struct AllocatorDeleter : RebindAllocator<Allocator, T> {
+	using ObjectAllocator = RebindAllocator<Allocator, T>;
+
+	AllocatorDeleter() = default;
+	AllocatorDeleter(const Allocator &allocator): ObjectAllocator(allocator) {}
+
+	void operator()(T *p) {
+		p->~T();
+		std::allocator_traits<ObjectAllocator>::deallocate(*this, p, 1);
+	}
+};
+
+template<typename T, typename Allocator>
+using AllocatorPointer = std::unique_ptr<T, AllocatorDeleter<T, Allocator>>;
+
+/**
+ * @brief      Creates an object with memory from `allocator`. The arguments
+ *             are passed to the constructor as they are, so allocator-aware
+ *             types must be given their allocator explicitly.
+ */
+template<typename T, typename Allocator, typename... Args>
+AllocatorPointer<T, Allocator> allocate_unique(const Allocator &allocator, Args &&... args) {
+	using Traits = std::allocator_traits<RebindAllocator<Allocator, T>>;
+	AllocatorDeleter<T, Allocator> deleter(allocator);
+	T *p = Traits::allocate(deleter, 1);
+	try {
+		::new (static_cast<void *>(p)) T(std::forward<Args>(args)...);
+	} catch (...) {
+		Traits::deallocate(deleter, p, 1);
+		throw;
+	}
+	return AllocatorPointer<T, Allocator>(p, deleter);
+}
+
 template<typename T>
 using Vector = std::vector<T>;
 
-template<typename K, typename V>
-using HashMap = std::unordered_map<K, V>;
+template<typename K, typename V,
+         typename Hash = std::hash<K>, typename Equal = std::equal_to<K>>
+using HashMap = std::unordered_map<K, V, Hash, Equal>;
 
 template<typename K, typename V>
 using OrderedMap = std::map<K, V>;
@@ -110,6 +198,24 @@ struct DefaultPrinter {
 	}
 };
 
+/**
+ * @brief      Replaces the contents of `out` with `count` elements copied
+ *             from the raw bytes at `bytes`. `T` need not be
+ *             default-constructible, so the elements are first constructed
+ *             as copies of `blank` and then overwritten.
+ */
+template<typename T, typename Allocator>
+void assign_from_bytes(
+	std::vector<T, Allocator> &out, const std::byte *bytes, Size count, const T &blank) {
+	static_assert(std::is_trivially_copyable_v<T>,
+		"Only trivially copyable elements can be copied from bytes");
+
+	out.assign(count, blank);
+	if (count > 0) {
+		std::memcpy(static_cast<void *>(out.data()), bytes, count * sizeof(T));
+	}
+}
+
 /**
  * @brief      Thrown if an Optional is accessed when the value is absent.
  */
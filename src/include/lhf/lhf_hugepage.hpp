@@ -0,0 +1,176 @@
+/**
+ * @file lhf_hugepage.hpp
+ * @brief Allocation of large arrays backed by transparent huge pages.
+ */
+
+#ifndef LHF_HUGEPAGE_HPP
+#define LHF_HUGEPAGE_HPP
+
+#include "lhf_common.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace lhf {
+
+/// Size of a huge page (2MB on x86-64 and most AArch64 configurations).
+static constexpr Size HUGE_PAGE_SIZE = Size(1) << 21;
+
+/**
+ * @brief      Counters of the memory mapped by `HugePageAllocator` (see
+ *             `get_huge_page_stats()`).
+ */
+struct HugePageStats {
+	/// Bytes currently mapped for huge pages.
+	Size mapped_bytes = 0;
+
+	/// Number of mappings made so far.
+	Size mappings = 0;
+
+	/// Number of mappings for which the kernel refused huge pages (e.g.
+	/// because transparent huge pages are disabled). These are still usable,
+	/// with normal pages.
+	Size advise_failures = 0;
+
+	String to_string() const {
+		std::stringstream s;
+		s << "    " << "Mapped Bytes:    " << mapped_bytes << "\n"
+		  << "    " << "Mappings:        " << mappings << "\n"
+		  << "    " << "Advise Failures: " << advise_failures << "\n";
+		return s.str();
+	}
+};
+
+inline std::atomic<Size> huge_page_mapped_bytes = 0;
+inline std::atomic<Size> huge_page_mappings = 0;
+inline std::atomic<Size> huge_page_advise_failures = 0;
+
+inline HugePageStats get_huge_page_stats() {
+	return {huge_page_mapped_bytes, huge_page_mappings, huge_page_advise_failures};
+}
+
+/// Whether allocations of `bytes` are mapped to huge pages.
+inline bool uses_huge_pages(Size bytes) {
+#ifdef __linux__
+	return bytes >= LHF_HUGE_PAGE_THRESHOLD;
+#else
+	(void) bytes;
+	return false;
+#endif
+}
+
+/// Rounds `bytes` up to a whole number of huge pages.
+inline Size huge_page_round_up(Size bytes) {
+	return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+#ifdef __linux__
+
+/**
+ * @brief      Maps anonymous memory aligned to `HUGE_PAGE_SIZE` and asks the
+ *             kernel to back it with transparent huge pages. An extra huge
+ *             page is mapped to align the region and the excess is unmapped.
+ *
+ * @param[in]  bytes  A multiple of `HUGE_PAGE_SIZE`
+ */
+inline void *map_huge_pages(Size bytes) {
+	Size length = bytes + HUGE_PAGE_SIZE;
+	void *region = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+	                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+
+	char *start = static_cast<char *>(region);
+	char *aligned = reinterpret_cast<char *>(
+		(reinterpret_cast<std::uintptr_t>(start) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+
+	if (aligned > start) {
+		munmap(start, aligned - start);
+	}
+	if (aligned + bytes < start + length) {
+		munmap(aligned + bytes, start + length - (aligned + bytes));
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (madvise(aligned, bytes, MADV_HUGEPAGE) != 0) {
+		huge_page_advise_failures++;
+	}
+#else
+	huge_page_advise_failures++;
+#endif
+
+	huge_page_mapped_bytes += bytes;
+	huge_page_mappings++;
+	return aligned;
+}
+
+inline void unmap_huge_pages(void *p, Size bytes) {
+	munmap(p, bytes);
+	huge_page_mapped_bytes -= bytes;
+}
+
+#endif
+
+/**
+ * @brief      A stateless allocator that maps allocations of at least
+ *             `LHF_HUGE_PAGE_THRESHOLD` bytes (such as the set storage array
+ *             and the bucket arrays of large hash tables) to 2MB-aligned
+ *             regions backed by transparent huge pages, which reduces TLB
+ *             misses on random accesses. Smaller allocations, and all
+ *             allocations on platforms other than Linux, use `std::allocator`.
+ *             If transparent huge pages are unavailable, the regions are
+ *             backed by normal pages.
+ *
+ * @tparam     T     The value type.
+ */
+template<typename T>
+struct HugePageAllocator {
+	using value_type = T;
+	using is_always_equal = std::true_type;
+
+	HugePageAllocator() = default;
+
+	template<typename U>
+	HugePageAllocator(const HugePageAllocator<U> &) {}
+
+	T *allocate(Size n) {
+		Size bytes = n * sizeof(T);
+#ifdef __linux__
+		if (uses_huge_pages(bytes)) {
+			return static_cast<T *>(map_huge_pages(huge_page_round_up(bytes)));
+		}
+#endif
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T *p, Size n) {
+		Size bytes = n * sizeof(T);
+#ifdef __linux__
+		if (uses_huge_pages(bytes)) {
+			unmap_huge_pages(p, huge_page_round_up(bytes));
+			return;
+		}
+#endif
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template<typename U>
+	bool operator==(const HugePageAllocator<U> &) const {
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const HugePageAllocator<U> &) const {
+		return false;
+	}
+};
+
+} // END namespace lhf
+
+#endif
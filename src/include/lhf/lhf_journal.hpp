@@ -0,0 +1,357 @@
+/**
+ * @file lhf_journal.hpp
+ * @brief An append-only write-ahead journal of the changes made to an LHF.
+ */
+
+#ifndef LHF_JOURNAL_HPP
+#define LHF_JOURNAL_HPP
+
+#include "lhf_common.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace lhf {
+
+/**
+ * @brief      Thrown if the journal cannot be written or read, or does not
+ *             belong to the LHF it is replayed into.
+ */
+struct JournalError : public std::runtime_error {
+	JournalError(const std::string &message):
+		std::runtime_error(message.c_str()) {}
+};
+
+/// Version of the journal format. Journals of other versions are rejected.
+static constexpr std::uint32_t JOURNAL_FORMAT_VERSION = 1;
+
+static constexpr std::uint32_t JOURNAL_BYTE_ORDER_MARK = 0x01020304;
+
+static constexpr char JOURNAL_MAGIC[8] = {'L', 'H', 'F', 'J', 'R', 'N', 'L', '\0'};
+
+/**
+ * @brief      The kinds of records in a journal.
+ */
+enum class JournalRecordType : std::uint32_t {
+	/// A new set. `a` is its index and `b` the number of elements, which
+	/// follow the record.
+	SET = 1,
+	/// An operation cache entry. `a` and `b` are the operands and `c` the
+	/// result (or the `SubsetRelation` for `SUBSET`).
+	UNION,
+	INTERSECTION,
+	DIFFERENCE,
+	SUBSET
+};
+
+/**
+ * @brief      The header at the start of a journal.
+ */
+struct JournalHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint64_t index_size;
+	std::uint64_t element_size;
+	std::uint64_t element_align;
+	std::uint64_t num_children;
+
+	/// Number of sets the LHF had when the journal was started. The first
+	/// set in the journal has this index.
+	std::uint64_t base_count;
+};
+
+inline JournalHeader make_journal_header(
+	Size element_size, Size element_align, Size num_children, Size base_count) {
+
+	JournalHeader h = {};
+	std::memcpy(h.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	h.version = JOURNAL_FORMAT_VERSION;
+	h.byte_order = JOURNAL_BYTE_ORDER_MARK;
+	h.index_size = sizeof(IndexValue);
+	h.element_size = element_size;
+	h.element_align = element_align;
+	h.num_children = num_children;
+	h.base_count = base_count;
+	return h;
+}
+
+/**
+ * @brief      A journal record, followed by the elements for `SET` records.
+ */
+struct JournalRecord {
+	JournalRecordType type;
+
+	/// Checksum of the other fields and the elements. A record with a wrong
+	/// checksum (e.g. one that was only partially written before a crash)
+	/// ends the journal.
+	std::uint32_t checksum;
+
+	std::uint64_t a;
+	std::uint64_t b;
+	std::uint64_t c;
+};
+
+static_assert(std::is_trivially_copyable_v<JournalHeader>);
+static_assert(std::is_trivially_copyable_v<JournalRecord>);
+
+/// FNV-1a over a record and its payload.
+inline std::uint32_t journal_checksum(const JournalRecord &r, const void *payload, Size bytes) {
+	std::uint32_t h = 2166136261u;
+	auto mix = [&h](const void *data, Size n) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (Size i = 0; i < n; i++) {
+			h = (h ^ p[i]) * 16777619u;
+		}
+	};
+
+	mix(&r.type, sizeof(r.type));
+	mix(&r.a, sizeof(r.a));
+	mix(&r.b, sizeof(r.b));
+	mix(&r.c, sizeof(r.c));
+	mix(payload, bytes);
+	return h;
+}
+
+/**
+ * @brief      Appends records to a journal. Records are collected in a buffer
+ *             of `LHF_JOURNAL_BUFFER_SIZE` bytes and written when it is full
+ *             or on `flush()`, so a crash loses at most the records since the
+ *             last flush. Appending is synchronized.
+ */
+class JournalWriter {
+protected:
+	std::FILE *file = nullptr;
+	Vector<char> buffer;
+	Size used = 0;
+	Size record_count = 0;
+	std::mutex mutex;
+
+	void write_out() {
+		if (used > 0 && std::fwrite(buffer.data(), 1, used, file) != used) {
+			throw JournalError("Could not write to the journal");
+		}
+		used = 0;
+	}
+
+	void put(const void *data, Size bytes) {
+		if (used + bytes > buffer.size()) {
+			write_out();
+		}
+
+		if (bytes > buffer.size()) {
+			if (std::fwrite(data, 1, bytes, file) != bytes) {
+				throw JournalError("Could not write to the journal");
+			}
+		} else {
+			std::memcpy(buffer.data() + used, data, bytes);
+			used += bytes;
+		}
+	}
+
+public:
+	/**
+	 * @brief      Creates (or truncates) the journal at `path` and writes its
+	 *             header.
+	 */
+	JournalWriter(const String &path, const JournalHeader &header):
+		buffer(LHF_JOURNAL_BUFFER_SIZE) {
+
+		file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			throw JournalError("Could not create the journal '" + path + "'");
+		}
+		put(&header, sizeof(header));
+		flush(false);
+	}
+
+	JournalWriter(const JournalWriter &) = delete;
+	JournalWriter &operator=(const JournalWriter &) = delete;
+
+	~JournalWriter() {
+		try {
+			flush(false);
+		} catch (...) {
+		}
+		std::fclose(file);
+	}
+
+	/**
+	 * @brief      Appends a record with the elements `[data, data + count)`
+	 *             (none, for operation records).
+	 */
+	template<typename T = char>
+	void append(JournalRecordType type, std::uint64_t a, std::uint64_t b,
+	            std::uint64_t c, const T *data = nullptr, Size count = 0) {
+		static_assert(std::is_trivially_copyable_v<T>,
+			"Only trivially copyable elements can be journaled");
+
+		JournalRecord r = {type, 0, a, b, c};
+		r.checksum = journal_checksum(r, data, count * sizeof(T));
+
+		std::lock_guard<std::mutex> l(mutex);
+		put(&r, sizeof(r));
+		put(data, count * sizeof(T));
+		record_count++;
+	}
+
+	/**
+	 * @brief      Writes the buffered records to the file. With `sync`, also
+	 *             waits until they are on stable storage.
+	 */
+	void flush(bool sync = true) {
+		std::lock_guard<std::mutex> l(mutex);
+		write_out();
+		if (std::fflush(file) != 0) {
+			throw JournalError("Could not write to the journal");
+		}
+#if defined(__unix__) || defined(__APPLE__)
+		if (sync && fsync(fileno(file)) != 0) {
+			throw JournalError("Could not sync the journal");
+		}
+#else
+		(void) sync;
+#endif
+	}
+
+	/**
+	 * @brief      Returns the number of records appended so far.
+	 */
+	Size size() const {
+		return record_count;
+	}
+};
+
+/**
+ * @brief      Reads the records of a journal in order. Reading stops at the
+ *             end of the file or at the first incomplete or corrupt record,
+ *             which is what a crash while appending leaves behind.
+ */
+class JournalReader {
+protected:
+	std::FILE *file = nullptr;
+	JournalHeader header = {};
+	bool torn = false;
+
+	/// Size of the file, which bounds the elements a record can have.
+	Size file_size = 0;
+
+public:
+	/**
+	 * @brief      Opens the journal at `path` and checks that it was written
+	 *             for elements of the given layout.
+	 */
+	JournalReader(
+		const String &path, Size element_size,
+		Size element_align, Size num_children) {
+
+		file = std::fopen(path.c_str(), "rb");
+		if (file == nullptr) {
+			throw JournalError("Could not open the journal '" + path + "'");
+		}
+
+		if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+		    std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+			std::fclose(file);
+			throw JournalError("'" + path + "' is not a journal");
+		} else if (header.version != JOURNAL_FORMAT_VERSION) {
+			std::fclose(file);
+			throw JournalError(
+				"Unsupported journal version " + std::to_string(header.version) +
+				" (expected " + std::to_string(JOURNAL_FORMAT_VERSION) + ")");
+		} else if (header.byte_order != JOURNAL_BYTE_ORDER_MARK ||
+		           header.index_size != sizeof(IndexValue) ||
+		           header.element_size != element_size ||
+		           header.element_align != element_align ||
+		           header.num_children != num_children) {
+			std::fclose(file);
+			throw JournalError("The journal was written for a different element type");
+		}
+
+		long position = std::ftell(file);
+		std::fseek(file, 0, SEEK_END);
+		file_size = std::ftell(file);
+		std::fseek(file, position, SEEK_SET);
+	}
+
+	JournalReader(const JournalReader &) = delete;
+	JournalReader &operator=(const JournalReader &) = delete;
+
+	~JournalReader() {
+		std::fclose(file);
+	}
+
+	const JournalHeader &get_header() const {
+		return header;
+	}
+
+	/**
+	 * @brief      Reads the next record. The elements of `SET` records are
+	 *             read into `elements`, which are filled with `blank` before
+	 *             the record is copied over them (see `assign_from_bytes()`).
+	 *
+	 * @return     `false` at the end of the journal.
+	 */
+	template<typename T, typename Allocator>
+	bool next(JournalRecord &r, std::vector<T, Allocator> &elements, const T &blank) {
+		static_assert(std::is_trivially_copyable_v<T>,
+			"Only trivially copyable elements can be journaled");
+
+		elements.clear();
+		if (torn) {
+			return false;
+		}
+
+		Size read = std::fread(&r, 1, sizeof(r), file);
+		if (read != sizeof(r)) {
+			// A partial record header was left by an interrupted append.
+			torn = read > 0;
+			return false;
+		}
+
+		if (r.type == JournalRecordType::SET) {
+			Vector<std::byte> buffer;
+
+			// A corrupt count must not turn into a huge allocation, so
+			// the elements have to fit in the rest of the file.
+			Size remaining = file_size - Size(std::ftell(file));
+			if (r.b > remaining / sizeof(T)) {
+				torn = true;
+				return false;
+			}
+			buffer.resize(r.b * sizeof(T));
+			if (std::fread(buffer.data(), sizeof(T), r.b, file) != r.b ||
+			    journal_checksum(r, buffer.data(), r.b * sizeof(T)) != r.checksum) {
+				torn = true;
+				return false;
+			}
+			assign_from_bytes(elements, buffer.data(), r.b, blank);
+		} else if (r.type < JournalRecordType::SET ||
+		           r.type > JournalRecordType::SUBSET ||
+		           journal_checksum(r, nullptr, 0) != r.checksum) {
+			torn = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief      Whether reading stopped at an incomplete or corrupt record
+	 *             rather than at the end of the file.
+	 */
+	bool is_torn() const {
+		return torn;
+	}
+};
+
+}; // END namespace lhf
+
+#endif
@@ -0,0 +1,350 @@
+/**
+ * @file lhf_parallel.hpp
+ * @brief Task scheduling primitives used by the parallel facilities of LHF.
+ */
+
+#ifndef LHF_PARALLEL_HPP
+#define LHF_PARALLEL_HPP
+
+#include "lhf_common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace lhf {
+
+/**
+ * @brief      A work-stealing thread pool.
+ *
+ *             Every worker owns a deque of tasks. A worker pushes tasks it
+ *             spawns onto the back of its own deque and pops from the back
+ *             (LIFO, for locality), and when it runs dry it steals from the
+ *             front of the other workers' deques. Tasks submitted from outside
+ *             the pool are distributed round-robin.
+ *
+ * @note       The deques are guarded by per-worker mutexes rather than being
+ *             lock-free. The critical sections are a handful of instructions,
+ *             and contention is limited to stealing.
+ */
+class ThreadPool {
+public:
+	using Task = std::function<void()>;
+
+protected:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	Vector<UniquePointer<Worker>> workers;
+	Vector<std::thread> threads;
+
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+
+	std::atomic<Size> pending = 0;
+	std::atomic<Size> next_worker = 0;
+	std::atomic<bool> stopping = false;
+
+	/// The pool the current thread is a worker of (if any).
+	static inline thread_local ThreadPool *current_pool = nullptr;
+
+	/// The worker index of the current thread in `current_pool`.
+	static inline thread_local Size current_worker = 0;
+
+	bool pop_own(Size self, Task &task) {
+		Worker &w = *workers[self];
+		std::lock_guard<std::mutex> m(w.mutex);
+		if (w.tasks.empty()) {
+			return false;
+		}
+		task = std::move(w.tasks.back());
+		w.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(Size self, Task &task) {
+		for (Size i = 1; i <= workers.size(); i++) {
+			Worker &w = *workers[(self + i) % workers.size()];
+			std::lock_guard<std::mutex> m(w.mutex);
+			if (!w.tasks.empty()) {
+				task = std::move(w.tasks.front());
+				w.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void worker_loop(Size self) {
+		current_pool = this;
+		current_worker = self;
+
+		while (!stopping) {
+			if (run_one()) {
+				continue;
+			}
+
+			std::unique_lock<std::mutex> m(sleep_mutex);
+			sleep_cv.wait(m, [this]() {
+				return pending > 0 || stopping;
+			});
+		}
+	}
+
+public:
+	explicit ThreadPool(Size num_threads = std::thread::hardware_concurrency()) {
+		if (num_threads == 0) {
+			num_threads = 1;
+		}
+
+		for (Size i = 0; i < num_threads; i++) {
+			workers.push_back(UniquePointer<Worker>(new Worker()));
+		}
+
+		for (Size i = 0; i < num_threads; i++) {
+			threads.emplace_back([this, i]() { worker_loop(i); });
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> m(sleep_mutex);
+			stopping = true;
+		}
+		sleep_cv.notify_all();
+		for (std::thread &t : threads) {
+			t.join();
+		}
+	}
+
+	/**
+	 * @brief      Returns the number of worker threads in the pool.
+	 */
+	Size size() const {
+		return workers.size();
+	}
+
+	/**
+	 * @brief      Returns whether the calling thread is a worker of this pool.
+	 */
+	bool in_pool() const {
+		return current_pool == this;
+	}
+
+	/**
+	 * @brief      Submits a task to the pool. Tasks submitted by a worker are
+	 *             placed on that worker's own deque.
+	 *
+	 * @param[in]  task  The task.
+	 */
+	void submit(Task &&task) {
+		Size target = in_pool() ?
+			current_worker :
+			next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+		{
+			Worker &w = *workers[target];
+			std::lock_guard<std::mutex> m(w.mutex);
+			// Counted under the deque's mutex, so that a thief cannot run the
+			// task and decrement `pending` before it is incremented.
+			pending++;
+			w.tasks.push_back(std::move(task));
+		}
+
+		// A worker checks `pending` under `sleep_mutex` before blocking, so
+		// taking it here ensures the notification is not lost in between.
+		{
+			std::lock_guard<std::mutex> m(sleep_mutex);
+		}
+		sleep_cv.notify_one();
+	}
+
+	/**
+	 * @brief      Runs one pending task on the calling thread, if there is
+	 *             any. Threads outside the pool only steal.
+	 *
+	 * @return     `true` if a task was run.
+	 */
+	bool run_one() {
+		Task task;
+		Size self = in_pool() ? current_worker : 0;
+
+		if ((in_pool() && pop_own(self, task)) || steal(self, task)) {
+			pending--;
+			task();
+			return true;
+		}
+
+		return false;
+	}
+};
+
+/**
+ * @brief      Returns the process-wide thread pool used by LHF, sized to the
+ *             hardware concurrency. It is created on first use.
+ */
+inline ThreadPool &default_thread_pool() {
+	static ThreadPool pool;
+	return pool;
+}
+
+/**
+ * @brief      Returns the number of tasks that the active scheduler can run
+ *             concurrently (see `TaskGroup`).
+ */
+inline Size parallel_concurrency() {
+#if defined(LHF_ENABLE_TBB)
+	return tbb::this_task_arena::max_concurrency();
+#elif defined(LHF_ENABLE_PARALLEL)
+	return default_thread_pool().size();
+#else
+	return 1;
+#endif
+}
+
+/**
+ * @def        TaskGroup
+ * @brief      A group of tasks that can be waited upon together. This
+ *             preprocessor if-ladder selects the scheduler backing the group:
+ *
+ *             * `LHF_ENABLE_TBB`: `tbb::task_group` (TBB's own work-stealing
+ *               scheduler).
+ *             * `LHF_ENABLE_PARALLEL`: the built-in `ThreadPool`.
+ *             * Otherwise: tasks are queued and run on the waiting thread.
+ *
+ *             Exceptions thrown by tasks are rethrown by `wait()`.
+ */
+
+#if defined(LHF_ENABLE_TBB)
+
+class TaskGroup {
+	tbb::task_group group;
+
+public:
+	template<typename F>
+	void run(F &&f) {
+		group.run(std::forward<F>(f));
+	}
+
+	void wait() {
+		group.wait();
+	}
+};
+
+#elif defined(LHF_ENABLE_PARALLEL)
+
+class TaskGroup {
+	ThreadPool &pool;
+	std::atomic<Size> outstanding = 0;
+	std::mutex error_mutex;
+	std::exception_ptr error = nullptr;
+
+public:
+	explicit TaskGroup(ThreadPool &pool = default_thread_pool()): pool(pool) {}
+
+	~TaskGroup() {
+		// Tasks hold a reference to the group, so it must not die before
+		// they do.
+		while (outstanding > 0) {
+			if (!pool.run_one()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	template<typename F>
+	void run(F &&f) {
+		outstanding++;
+		pool.submit([this, f = std::forward<F>(f)]() mutable {
+			try {
+				f();
+			} catch (...) {
+				std::lock_guard<std::mutex> m(error_mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+			outstanding--;
+		});
+	}
+
+	/**
+	 * @brief      Waits for all tasks in the group. The waiting thread helps
+	 *             run pending tasks instead of blocking, which keeps nested
+	 *             waits from deadlocking the pool.
+	 */
+	void wait() {
+		while (outstanding > 0) {
+			if (!pool.run_one()) {
+				std::this_thread::yield();
+			}
+		}
+
+		if (error) {
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+};
+
+#else
+
+class TaskGroup {
+	std::deque<std::function<void()>> tasks;
+
+public:
+	template<typename F>
+	void run(F &&f) {
+		tasks.push_back(std::forward<F>(f));
+	}
+
+	void wait() {
+		while (!tasks.empty()) {
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			task();
+		}
+	}
+};
+
+#endif
+
+/**
+ * @brief      Splits `[0, n)` into consecutive ranges of `grain` indices and
+ *             calls `f(first, last)` for each of them as a task of a
+ *             `TaskGroup`. Exceptions thrown by `f` are rethrown.
+ */
+template<typename F>
+void parallel_for(Size n, Size grain, F f) {
+	if (grain == 0) {
+		grain = 1;
+	}
+
+	if (n <= grain) {
+		if (n > 0) {
+			f(Size(0), n);
+		}
+		return;
+	}
+
+	TaskGroup group;
+	for (Size first = 0; first < n; first += grain) {
+		Size last = std::min(n, first + grain);
+		group.run([&f, first, last]() { f(first, last); });
+	}
+	group.wait();
+}
+
+}; // END namespace lhf
+
+#endif
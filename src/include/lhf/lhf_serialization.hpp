@@ -75,6 +75,27 @@ JSON binary_operation_map_to_json(const MapT &map) {
 	return ret;
 }
 
+/**
+ * @brief      Inserts a single entry (`[[left, right], value]`) of the JSON
+ *             representation of an OperationNode -> integer map.
+ *
+ * @param[in]  map    a BinaryOperationMap or analogue.
+ * @param[in]  tuple  The JSON entry.
+ */
+template<typename MapT>
+void binary_operation_entry_from_json(MapT &map, const JSON &tuple) {
+	if (!tuple.is_array() || !(tuple.size() == 2)) {
+		throw SerializationError("Expected array of size 2 (root[*])");
+	} else if (!tuple[0].is_array() || !(tuple[0].size() == 2)) {
+		throw SerializationError("Expected array of size 2 (root[*][0])");
+	} else if (!tuple[0][0].is_number_integer() || !tuple[0][1].is_number_integer()) {
+		throw SerializationError("Expected array of size 2 (root[*][0][0,1])");
+	} else if (!tuple[1].is_number_integer()) {
+		throw SerializationError("Expected array of size 2 (root[*][1])");
+	}
+	map.insert({{tuple[0][0], tuple[0][1]}, tuple[1]});
+}
+
 /**
  * @brief      Inserts data from the JSON representation to the equivalent C++
  *             data strucure for the OperationNode -> integer map.
@@ -92,16 +113,7 @@ void binary_operation_map_from_json(MapT &map, const JSON &obj) {
 	}
 
 	for (auto &tuple : obj) {
-		if (!tuple.is_array() || !(tuple.size() == 2)) {
-			throw SerializationError("Expected array of size 2 (root[*])");
-		} else if (!tuple[0].is_array() || !(tuple[0].size() == 2)) {
-			throw SerializationError("Expected array of size 2 (root[*][0])");
-		} else if (!tuple[0][0].is_number_integer() || !tuple[0][1].is_number_integer()) {
-			throw SerializationError("Expected array of size 2 (root[*][0][0,1])");
-		} else if (!tuple[1].is_number_integer()) {
-			throw SerializationError("Expected array of size 2 (root[*][1])");
-		}
-		map.insert({{tuple[0][0], tuple[0][1]}, tuple[1]});
+		binary_operation_entry_from_json(map, tuple);
 	}
 }
 
@@ -150,17 +162,19 @@ void unary_operation_map_from_json(MapT &map, const JSON &obj) {
 /**
  * @brief      Converts a storage array to its JSON representation.
  *
- * @param[in]  store       A PropertySetStorage or an analogue.
+ * @param[in]  count       The number of sets.
+ * @param[in]  set_at      Returns the set at an index. The set only needs to
+ *                         stay valid until the next call.
  * @param      serializer  A serializer structure.
  *
  * @return     The JSON representation.
  */
-template<typename StoreT, typename Serializer>
-JSON storage_array_to_json(const StoreT &store, Serializer &serializer) {
+template<typename SetAt, typename Serializer>
+JSON storage_array_to_json(Size count, SetAt set_at, Serializer &serializer) {
 	JSON ret = JSON::array();
-	for (Size set_index = 0; set_index < store.size(); set_index++) {
+	for (Size set_index = 0; set_index < count; set_index++) {
 		JSON set_arr = JSON::array();
-		for (auto &elem : *store.at(set_index).get()) {
+		for (auto &elem : set_at(set_index)) {
 			set_arr.push_back(serializer.save(elem.get_key()));
 		}
 		ret.push_back(set_arr);
@@ -187,7 +201,7 @@ void register_storage_from_json(LHFT &lhf, const JSON &obj, Serializer &serializ
 	}
 
 	for (Size set_index = 0; set_index < obj.size(); set_index++) {
-		Vector<PropertyElement> data;
+		typename LHFT::PropertySet data;
 		if (!obj[set_index].is_array()) {
 			throw SerializationError("Expected array (root[*])");
 		}
@@ -201,19 +215,21 @@ void register_storage_from_json(LHFT &lhf, const JSON &obj, Serializer &serializ
 /**
  * @brief      Converts an LHF storage array to JSON in the nested case.
  *
- * @param[in]  store       A PropertySetStorage object or analogue.
+ * @param[in]  count       The number of sets.
+ * @param[in]  set_at      Returns the set at an index (see
+ *                         `storage_array_to_json`).
  * @param[in]  serializer  A Serializer object.
  *
  * @return     The JSON Representation
  */
-template<typename Serializer, typename StoreT>
-JSON storage_array_to_json_nested(const StoreT &store, Serializer &serializer) {
+template<typename Serializer, typename SetAt>
+JSON storage_array_to_json_nested(Size count, SetAt set_at, Serializer &serializer) {
 	JSON ret = JSON::array();
 
-	for (Size set_index = 0; set_index < store.size(); set_index++) {
+	for (Size set_index = 0; set_index < count; set_index++) {
 		JSON set_arr = JSON::array();
 
-		for (auto &elem : *store.at(set_index).get()) {
+		for (auto &elem : set_at(set_index)) {
 			JSON child_arr = JSON::array();
 
 			std::apply([&child_arr](const auto&... args) {
@@ -264,7 +280,7 @@ void register_storage_from_json_nested(LHFT &lhf, const JSON &obj, Serializer &s
 	}
 
 	for (Size set_index = 0; set_index < obj.size(); set_index++) {
-		Vector<PropertyElement> data;
+		typename LHFT::PropertySet data;
 		if (!obj[set_index].is_array()) {
 			throw SerializationError("Expected array (root[*])");
 		}
@@ -376,6 +392,472 @@ void lhf_from_json(LHFT &root, const JSON &obj) {
 	lhf_from_json_internal(root, obj, visited, path);
 }
 
+/**
+ * @brief      Streaming counterpart of `binary_operation_map_to_json`. Writes
+ *             the JSON representation of the map to `os` entry by entry.
+ *
+ * @param      os    The output stream.
+ * @param[in]  map   a BinaryOperationMap or analogue.
+ */
+template<typename MapT>
+void binary_operation_map_to_stream(std::ostream &os, const MapT &map) {
+	bool first = true;
+	os << '[';
+	for (auto &i : map) {
+		os << (first ? "" : ",")
+		   << "[[" << i.first.left << ',' << i.first.right << "],"
+		   << JSON(i.second) << ']';
+		first = false;
+	}
+	os << ']';
+}
+
+/**
+ * @brief      Streaming counterpart of `storage_array_to_json`. Only one
+ *             element is converted to JSON at a time.
+ *
+ * @param      os          The output stream.
+ * @param[in]  count       The number of sets.
+ * @param[in]  set_at      Returns the set at an index (see
+ *                         `storage_array_to_json`).
+ * @param      serializer  A serializer structure.
+ */
+template<typename SetAt, typename Serializer>
+void storage_array_to_stream(std::ostream &os, Size count, SetAt set_at, Serializer &serializer) {
+	os << '[';
+	for (Size set_index = 0; set_index < count; set_index++) {
+		bool first = true;
+		os << (set_index == 0 ? "[" : ",[");
+		for (auto &elem : set_at(set_index)) {
+			os << (first ? "" : ",") << serializer.save(elem.get_key());
+			first = false;
+		}
+		os << ']';
+	}
+	os << ']';
+}
+
+/**
+ * @brief      Streaming counterpart of `storage_array_to_json_nested`.
+ *
+ * @param      os          The output stream.
+ * @param[in]  count       The number of sets.
+ * @param[in]  set_at      Returns the set at an index (see
+ *                         `storage_array_to_json`).
+ * @param[in]  serializer  A Serializer object.
+ */
+template<typename Serializer, typename SetAt>
+void storage_array_to_stream_nested(std::ostream &os, Size count, SetAt set_at, Serializer &serializer) {
+	os << '[';
+	for (Size set_index = 0; set_index < count; set_index++) {
+		bool first = true;
+		os << (set_index == 0 ? "[" : ",[");
+		for (auto &elem : set_at(set_index)) {
+			os << (first ? "[" : ",[") << serializer.save(elem.get_key()) << ",[";
+			std::apply([&os](const auto&... args) {
+				Size i = 0;
+				((os << (i++ == 0 ? "" : ",") << args.value), ...);
+			}, elem.get_value());
+			os << "]]";
+			first = false;
+		}
+		os << ']';
+	}
+	os << ']';
+}
+
+template<typename LHFT>
+void lhf_to_stream_internal(
+	std::ostream &os, LHFT &root,
+	HashSet<void *> &visited, String &path) {
+
+	if (visited.count(&root) > 0) {
+		return;
+	} else {
+		visited.insert(&root);
+	}
+
+	os << ',' << JSON(path) << ':';
+	root.to_json_stream(os);
+
+	std::apply([&](auto&... child_refs) {
+		[[maybe_unused]] Size i = 0;
+		([&](auto& child) {
+			String current_path = path + std::to_string(i++) + "/";
+			lhf_to_stream_internal(os, child, visited, current_path);
+		}(child_refs), ...);
+	}, root.get_reflist());
+}
+
+/**
+ * @brief      Streaming counterpart of `lhf_to_json`. Writes the same
+ *             representation to `os` without building it in memory first:
+ *             apart from the buffers of the stream, only one element or
+ *             operation entry is held as JSON at a time.
+ *
+ * @param      os    The output stream.
+ * @param      root  The LHF object to serialize.
+ */
+template<typename LHFT>
+void lhf_to_stream(std::ostream &os, LHFT &root) {
+	HashSet<void *> visited = {};
+	String path = "/";
+	os << "{\"lhf_version\":" << JSON(LHF_VERSION_STRING);
+	lhf_to_stream_internal(os, root, visited, path);
+	os << '}';
+}
+
+/**
+ * @brief      Receives the contents of one LHF from `StreamReader`.
+ */
+struct StreamLoader {
+	/// Called when the object of the LHF starts.
+	virtual void begin() = 0;
+
+	/// Called for every element (as JSON) of the current set.
+	virtual void element(const JSON &obj) = 0;
+
+	/// Called at the end of every set.
+	virtual void end_set() = 0;
+
+	/// Called for every entry of the operation map named `name`.
+	virtual void operation(const String &name, const JSON &entry) = 0;
+
+	virtual ~StreamLoader() = default;
+};
+
+/**
+ * @brief      Loads an LHF through `register_set`, one set at a time.
+ */
+template<typename LHFT, typename Serializer = DefaultValueSerializer<typename LHFT::PropertyT>>
+struct LHFStreamLoader : StreamLoader {
+	using PropertyElement = typename LHFT::PropertyElement;
+
+	LHFT &lhf;
+	Serializer serializer = {};
+	typename LHFT::PropertySet data = {};
+
+	LHFStreamLoader(LHFT &lhf): lhf(lhf) {}
+
+	void begin() override {
+		lhf.clear();
+	}
+
+	void element(const JSON &obj) override {
+		if constexpr (LHFT::Nesting::is_nested) {
+			using ChildValueList = typename LHFT::Nesting::ChildValueList;
+			constexpr const Size num_children = LHFT::Nesting::num_children;
+
+			if (!obj.is_array() || obj.size() != 2) {
+				throw SerializationError("Expected array of size 2 (root[*][*])");
+			} else if (!obj[1].is_array() || obj[1].size() != num_children) {
+				throw SerializationError(
+					"Expected array of size " + std::to_string(num_children) +
+					" (root[*][1])");
+			}
+			auto cvl = json_list_to_tuple<ChildValueList>(obj[1]);
+			data.push_back(PropertyElement(serializer.load(obj[0]), cvl));
+		} else {
+			data.push_back(PropertyElement(serializer.load(obj)));
+		}
+	}
+
+	void end_set() override {
+		lhf.register_set(std::move(data));
+		data = typename LHFT::PropertySet();
+	}
+
+	void operation(const String &name, const JSON &entry) override {
+		lhf.operation_from_json(name, entry);
+	}
+};
+
+/**
+ * @brief      SAX handler that parses the representation written by
+ *             `lhf_to_json` or `lhf_to_stream` and passes it to the
+ *             `StreamLoader` of each LHF as it is read. Only a single element
+ *             or operation entry is materialized as JSON at a time.
+ */
+class StreamReader : public nlohmann::json_sax<JSON> {
+protected:
+	enum class Scope {
+		ROOT,
+		FOREST,
+		SETS,
+		SET,
+		OPERATIONS,
+		OPERATION_LIST,
+		CAPTURE,
+		SKIP
+	};
+
+	const HashMap<String, StreamLoader *> &loaders;
+	HashSet<String> seen = {};
+	Vector<Scope> scopes = {};
+	StreamLoader *forest = nullptr;
+	String last_key = {};
+	String operation = {};
+
+	// The element or entry being materialized.
+	JSON captured = {};
+	Vector<JSON *> capture_stack = {};
+	String capture_key = {};
+
+	void deliver(const JSON &obj) {
+		if (scopes.back() == Scope::SET) {
+			forest->element(obj);
+		} else {
+			forest->operation(operation, obj);
+		}
+	}
+
+	JSON *capture_insert(JSON &&obj) {
+		JSON &top = *capture_stack.back();
+		if (top.is_array()) {
+			top.push_back(std::move(obj));
+			return &top.back();
+		}
+		return &(top[capture_key] = std::move(obj));
+	}
+
+	bool value(JSON &&obj) {
+		if (scopes.empty()) {
+			throw SerializationError("Expected object (root)");
+		}
+
+		switch (scopes.back()) {
+		case Scope::SET:
+		case Scope::OPERATION_LIST:
+			deliver(obj);
+			break;
+		case Scope::CAPTURE:
+			capture_insert(std::move(obj));
+			break;
+		case Scope::SETS:
+			throw SerializationError("Expected array (root[*])");
+		default:
+			break;
+		}
+		return true;
+	}
+
+	bool begin_container(bool is_array) {
+		JSON empty = is_array ? JSON::array() : JSON::object();
+
+		if (scopes.empty()) {
+			if (is_array) {
+				throw SerializationError("Expected object (root)");
+			}
+			scopes.push_back(Scope::ROOT);
+			return true;
+		}
+
+		switch (scopes.back()) {
+		case Scope::ROOT: {
+			auto i = loaders.find(last_key);
+			if (i == loaders.end() || is_array) {
+				scopes.push_back(Scope::SKIP);
+			} else {
+				forest = i->second;
+				seen.insert(last_key);
+				forest->begin();
+				scopes.push_back(Scope::FOREST);
+			}
+			break;
+		}
+
+		case Scope::FOREST:
+			if (last_key == "property_sets") {
+				if (!is_array) {
+					throw SerializationError("Expected array (root)");
+				}
+				scopes.push_back(Scope::SETS);
+			} else if (last_key == "operations") {
+				if (is_array) {
+					throw SerializationError("Expected object (operations)");
+				}
+				scopes.push_back(Scope::OPERATIONS);
+			} else {
+				scopes.push_back(Scope::SKIP);
+			}
+			break;
+
+		case Scope::SETS:
+			if (!is_array) {
+				throw SerializationError("Expected array (root[*])");
+			}
+			scopes.push_back(Scope::SET);
+			break;
+
+		case Scope::OPERATIONS:
+			if (!is_array) {
+				throw SerializationError("Expected array (root)");
+			}
+			operation = last_key;
+			scopes.push_back(Scope::OPERATION_LIST);
+			break;
+
+		case Scope::SET:
+		case Scope::OPERATION_LIST:
+			captured = std::move(empty);
+			capture_stack = {&captured};
+			scopes.push_back(Scope::CAPTURE);
+			break;
+
+		case Scope::CAPTURE:
+			capture_stack.push_back(capture_insert(std::move(empty)));
+			scopes.push_back(Scope::CAPTURE);
+			break;
+
+		case Scope::SKIP:
+			scopes.push_back(Scope::SKIP);
+			break;
+		}
+
+		return true;
+	}
+
+	bool end_container() {
+		Scope scope = scopes.back();
+		scopes.pop_back();
+
+		if (scope == Scope::CAPTURE) {
+			capture_stack.pop_back();
+			if (capture_stack.empty()) {
+				deliver(captured);
+				captured = JSON();
+			}
+		} else if (scope == Scope::SET) {
+			forest->end_set();
+		} else if (scope == Scope::FOREST) {
+			forest = nullptr;
+		}
+
+		return true;
+	}
+
+public:
+	StreamReader(const HashMap<String, StreamLoader *> &loaders): loaders(loaders) {}
+
+	/// Paths of the LHFs found in the input.
+	const HashSet<String> &get_seen() const {
+		return seen;
+	}
+
+	bool null() override {
+		return value(JSON(nullptr));
+	}
+
+	bool boolean(bool val) override {
+		return value(JSON(val));
+	}
+
+	bool number_integer(number_integer_t val) override {
+		return value(JSON(val));
+	}
+
+	bool number_unsigned(number_unsigned_t val) override {
+		return value(JSON(val));
+	}
+
+	bool number_float(number_float_t val, const string_t &) override {
+		return value(JSON(val));
+	}
+
+	bool string(string_t &val) override {
+		return value(JSON(val));
+	}
+
+	bool binary(binary_t &val) override {
+		return value(JSON(val));
+	}
+
+	bool start_object(std::size_t) override {
+		return begin_container(false);
+	}
+
+	bool key(string_t &val) override {
+		if (!scopes.empty() && scopes.back() == Scope::CAPTURE) {
+			capture_key = val;
+		} else {
+			last_key = val;
+		}
+		return true;
+	}
+
+	bool end_object() override {
+		return end_container();
+	}
+
+	bool start_array(std::size_t) override {
+		return begin_container(true);
+	}
+
+	bool end_array() override {
+		return end_container();
+	}
+
+	bool parse_error(std::size_t, const std::string &,
+	                 const nlohmann::detail::exception &ex) override {
+		throw SerializationError(ex.what());
+	}
+};
+
+template<typename LHFT>
+void lhf_stream_loaders_internal(
+	LHFT &root, HashSet<void *> &visited, String &path,
+	Vector<UniquePointer<StreamLoader>> &loaders,
+	HashMap<String, StreamLoader *> &paths) {
+
+	if (visited.count(&root) > 0) {
+		return;
+	} else {
+		visited.insert(&root);
+	}
+
+	loaders.push_back(std::make_unique<LHFStreamLoader<LHFT>>(root));
+	paths[path] = loaders.back().get();
+
+	std::apply([&](auto&... child_refs) {
+		[[maybe_unused]] Size i = 0;
+		([&](auto& child) {
+			String current_path = path + std::to_string(i++) + "/";
+			lhf_stream_loaders_internal(child, visited, current_path, loaders, paths);
+		}(child_refs), ...);
+	}, root.get_reflist());
+}
+
+/**
+ * @brief      Streaming counterpart of `lhf_from_json`. Parses the
+ *             representation from `is` and registers the sets of each LHF
+ *             as they are read, without building a JSON object for the whole
+ *             input.
+ *
+ * @param      root    The LHF object to load data into.
+ * @param      is      The input stream.
+ * @param[in]  format  `nlohmann::json::input_format_t::json` or `bson`.
+ */
+template<typename LHFT>
+void lhf_from_stream(
+	LHFT &root, std::istream &is,
+	JSON::input_format_t format = JSON::input_format_t::json) {
+
+	HashSet<void *> visited = {};
+	String path = "/";
+	Vector<UniquePointer<StreamLoader>> loaders;
+	HashMap<String, StreamLoader *> paths;
+	lhf_stream_loaders_internal(root, visited, path, loaders, paths);
+
+	StreamReader reader(paths);
+	JSON::sax_parse(is, &reader, format);
+
+	for (auto &i : paths) {
+		if (reader.get_seen().count(i.first) == 0) {
+			throw SerializationError("Missing LHF '" + i.first + "'");
+		}
+	}
+}
+
 /**
  * @brief      Returns a string representation of the supplied JSON object.
  *
@@ -444,7 +926,14 @@ inline JSON load_bson_file(const String &file_path) {
 
 template<typename LHFT>
 bool save(const LHFT &lhf, const String &file_path) {
-	return json_to_file(lhf_to_json(lhf), file_path);
+	std::ofstream f(file_path);
+
+	if (!f.is_open()) {
+		return false;
+	}
+
+	lhf_to_stream(f, lhf);
+	return bool(f);
 }
 
 template<typename LHFT>
@@ -454,12 +943,24 @@ bool save_bson(const LHFT &lhf, const String &file_path) {
 
 template<typename LHFT>
 void load(LHFT &lhf, const String &file_path) {
-	lhf_from_json(lhf, load_json_file(file_path));
+	std::ifstream f(file_path);
+
+	if (!f.is_open()) {
+		throw SerializationError("Could not open '" + file_path + "'");
+	}
+
+	lhf_from_stream(lhf, f);
 }
 
 template<typename LHFT>
 void load_bson(LHFT &lhf, const String &file_path) {
-	lhf_from_json(lhf, load_bson_file(file_path));
+	std::ifstream f(file_path, std::ios::in | std::ios::binary);
+
+	if (!f.is_open()) {
+		throw SerializationError("Could not open '" + file_path + "'");
+	}
+
+	lhf_from_stream(lhf, f, JSON::input_format_t::bson);
 }
 
 }; // END namespace slz
@@ -0,0 +1,768 @@
+/**
+ * @file lhf_shared.hpp
+ * @brief An LHF whose sets and operation caches live in a POSIX shared memory
+ *        segment, so that processes on one machine intern into the same
+ *        forest and share cache hits.
+ */
+
+#ifndef LHF_SHARED_HPP
+#define LHF_SHARED_HPP
+
+#include "lhf.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lhf {
+
+/**
+ * @brief      Thrown if a shared memory segment cannot be created or opened,
+ *             is not a shared LHF of the expected configuration, or is full.
+ */
+struct SharedMemoryError : public std::runtime_error {
+	SharedMemoryError(const std::string &message):
+		std::runtime_error(message.c_str()) {}
+};
+
+/// Version of the segment layout. Segments of other versions are rejected.
+static constexpr std::uint32_t SHARED_FOREST_VERSION = 3;
+
+/**
+ * @brief      Capacities of a shared LHF. The segment is sized for them when
+ *             it is created and does not grow.
+ */
+struct SharedForestLimits {
+	/// Maximum number of sets (at most 2^32 - 2).
+	Size max_sets = Size(1) << 20;
+
+	/// Bytes for the contents of the sets.
+	Size arena_bytes = Size(1) << 28;
+
+	/// Number of entries of each operation cache. An entry that does not
+	/// find a free slot close to its hash is not cached.
+	Size operation_slots = Size(1) << 20;
+};
+
+/**
+ * @brief      Position of an object in a shared segment, relative to the
+ *             start of the segment. Each process maps the segment at a
+ *             different address, so the segment holds no pointers.
+ */
+template<typename T>
+struct SharedOffset {
+	std::uint64_t value = 0;
+
+	T *in(std::byte *base) const {
+		return reinterpret_cast<T *>(base + value);
+	}
+};
+
+/**
+ * @brief      Counters of a shared LHF, summed over all processes using it
+ *             (see `SharedLatticeHashForest::get_stats()`).
+ */
+struct SharedForestStats {
+	Size sets = 0;
+	Size arena_bytes_used = 0;
+	Size set_hits = 0;
+	Size operation_hits = 0;
+	Size operation_misses = 0;
+
+	String to_string() const {
+		std::stringstream s;
+		s << "    " << "Sets:             " << sets << "\n"
+		  << "    " << "Arena Bytes Used: " << arena_bytes_used << "\n"
+		  << "    " << "Set Hits:         " << set_hits << "\n"
+		  << "    " << "Operation Hits:   " << operation_hits << "\n"
+		  << "    " << "Operation Misses: " << operation_misses << "\n";
+		return s.str();
+	}
+};
+
+/**
+ * @brief      An LHF of flat sets that lives in a POSIX shared memory
+ *             segment (see `shm_open()`), so that several processes on one
+ *             machine register sets into, and run operations on, the same
+ *             forest. A set registered by one process has the same index in
+ *             every other, and an operation computed by one process is a
+ *             cache hit for the others.
+ *
+ *             Everything is stored in the segment, addressed by offsets (see
+ *             `SharedOffset`), and synchronized with lock-free atomics, which
+ *             work across processes:
+ *             * The contents of the sets are bump-allocated from an arena,
+ *               and a directory maps indices to them.
+ *             * Sets are interned in an open addressing hash table. A
+ *               process claims an empty slot by a compare-and-swap, stores
+ *               the set, and publishes its index in the slot. Processes that
+ *               probe the slot meanwhile wait for the index.
+ *             * The operation caches and subset relations are open
+ *               addressing tables of (operands, result) pairs. Entries are
+ *               only added, by a compare-and-swap of their key.
+ *
+ *             The segment has fixed capacities (see `SharedForestLimits`).
+ *             Sets are never removed, so there is no eviction or garbage
+ *             collection.
+ *
+ * @note       A process that dies while storing a set leaves its slot
+ *             claimed, and processes that look up the same set wait forever.
+ *             The segment outlives the processes until it is removed (see
+ *             `remove()`).
+ *
+ * @tparam     Config  The configuration (see `LHFConfig`). Its elements must
+ *                     be trivially copyable, as they are shared as bytes.
+ */
+template<typename Config>
+class SharedLatticeHashForest {
+public:
+	using LHF = LatticeHashForest<Config>;
+	using PropertyElement = typename LHF::PropertyElement;
+	using PropertySet = typename LHF::PropertySet;
+	using SetView = typename LHF::Frozen::SetView;
+
+	static_assert(std::is_trivially_copyable_v<PropertyElement>,
+		"Only trivially copyable elements can be shared");
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+		"Sharing an LHF between processes requires lock-free 64-bit atomics");
+
+	/**
+	 * @brief      Index of a set, the same in every process using the
+	 *             segment.
+	 */
+	struct Index {
+		IndexValue value;
+
+		Index(IndexValue idx = EMPTY_SET_VALUE): value(idx) {}
+
+		bool is_empty() const {
+			return value == EMPTY_SET_VALUE;
+		}
+
+		bool operator==(const Index &b) const {
+			return value == b.value;
+		}
+
+		bool operator!=(const Index &b) const {
+			return value != b.value;
+		}
+
+		bool operator<(const Index &b) const {
+			return value < b.value;
+		}
+
+		bool operator>(const Index &b) const {
+			return value > b.value;
+		}
+	};
+
+protected:
+	using Word = std::atomic<std::uint64_t>;
+
+	/// Marks a slot of the set table whose set is being stored.
+	static constexpr std::uint64_t PENDING = std::numeric_limits<std::uint64_t>::max();
+
+	/// Number of slots an operation cache entry is looked for in.
+	static constexpr Size MAX_PROBES = 64;
+
+	enum Table { UNIONS, INTERSECTIONS, DIFFERENCES, SUBSETS, NUM_TABLES };
+
+	struct OperationSlot {
+		/// The operands (see `operation_key()`), or 0 if the slot is free.
+		Word key;
+
+		/// The result plus one, or 0 until it is written.
+		Word value;
+	};
+
+	/// A set in the arena, followed by its elements.
+	struct SetRecord {
+		std::uint64_t size;
+		std::uint64_t hash;
+
+		const PropertyElement *elements() const {
+			return reinterpret_cast<const PropertyElement *>(this + 1);
+		}
+	};
+
+	static constexpr Size RECORD_ALIGN = std::max(alignof(SetRecord), alignof(PropertyElement));
+
+	struct Header {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t element_size;
+		std::uint64_t element_align;
+		std::uint64_t fingerprint;
+		std::uint64_t total_bytes;
+
+		std::uint64_t max_sets;
+		std::uint64_t set_slots;
+		std::uint64_t operation_slots;
+		std::uint64_t arena_bytes;
+
+		SharedOffset<Word> directory;
+		SharedOffset<Word> sets;
+		SharedOffset<OperationSlot> operations[NUM_TABLES];
+		SharedOffset<std::byte> arena;
+
+		Word arena_used;
+		Word set_count;
+		Word set_hits;
+		Word operation_hits;
+		Word operation_misses;
+
+		/// Set when the segment is initialized.
+		std::atomic<std::uint32_t> ready;
+	};
+
+	static constexpr char MAGIC[8] = {'L', 'H', 'F', 'S', 'H', 'A', 'R', 'E'};
+
+	String name;
+	std::byte *base = nullptr;
+	Size length = 0;
+
+	Header &header() const {
+		return *reinterpret_cast<Header *>(base);
+	}
+
+	Word *directory() const {
+		return header().directory.in(base);
+	}
+
+	Word *set_table() const {
+		return header().sets.in(base);
+	}
+
+	OperationSlot *operation_table(Table t) const {
+		return header().operations[t].in(base);
+	}
+
+	static Size align_up(Size n, Size alignment) {
+		return (n + alignment - 1) / alignment * alignment;
+	}
+
+	static Size power_of_two_at_least(Size n) {
+		Size p = 1;
+		while (p < n) {
+			p <<= 1;
+		}
+		return p;
+	}
+
+	void map(int fd, Size bytes) {
+		void *region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (region == MAP_FAILED) {
+			throw SharedMemoryError("Could not map the shared LHF '" + name + "'");
+		}
+		base = static_cast<std::byte *>(region);
+		length = bytes;
+	}
+
+	void unmap() {
+		if (base != nullptr) {
+			munmap(base, length);
+		}
+		base = nullptr;
+		length = 0;
+	}
+
+	explicit SharedLatticeHashForest(const String &name): name(name) {}
+
+	/// Returns the record of a set, waiting for the process storing it to
+	/// publish it if it has been counted but not yet written.
+	const SetRecord &record(IndexValue i) const {
+		std::uint64_t entry = directory()[i].load(std::memory_order_acquire);
+		while (entry == 0) {
+			std::this_thread::yield();
+			entry = directory()[i].load(std::memory_order_acquire);
+		}
+		return *reinterpret_cast<const SetRecord *>(header().arena.in(base) + entry - 1);
+	}
+
+	/// Copies a set into the arena and gives it the next index.
+	IndexValue store_set(const PropertyElement *elements, Size size, Size hash) {
+		Header &h = header();
+
+		Size bytes = align_up(sizeof(SetRecord) + size * sizeof(PropertyElement), RECORD_ALIGN);
+		Size offset = h.arena_used.fetch_add(bytes);
+		if (offset + bytes > h.arena_bytes) {
+			throw SharedMemoryError("The arena of the shared LHF '" + name + "' is full");
+		}
+
+		IndexValue index = h.set_count.fetch_add(1);
+		if (index >= h.max_sets) {
+			throw SharedMemoryError("The shared LHF '" + name + "' holds its maximum number of sets");
+		}
+
+		SetRecord *r = reinterpret_cast<SetRecord *>(h.arena.in(base) + offset);
+		r->size = size;
+		r->hash = hash;
+		if (size > 0) {
+			std::memcpy(reinterpret_cast<std::byte *>(r + 1), elements, size * sizeof(PropertyElement));
+		}
+
+		// Stored plus one, so that 0 marks an entry that is not written yet.
+		directory()[index].store(offset + 1, std::memory_order_release);
+		return index;
+	}
+
+	/**
+	 * @brief      Returns the index of the set `[elements, elements + size)`,
+	 *             storing it if no process has stored it yet.
+	 */
+	IndexValue intern(const PropertyElement *elements, Size size) {
+		Size hash = SetHash<PropertySet, PropertyElement, typename PropertyElement::Hash>()(
+			elements, elements + size);
+
+		Word *table = set_table();
+		Size mask = header().set_slots - 1;
+
+		for (Size i = hash & mask, probes = 0; probes <= mask; ) {
+			std::uint64_t slot = table[i].load(std::memory_order_acquire);
+
+			if (slot == 0) {
+				if (table[i].compare_exchange_strong(slot, PENDING, std::memory_order_acq_rel)) {
+					IndexValue index;
+					try {
+						index = store_set(elements, size, hash);
+					} catch (...) {
+						// Processes waiting for the slot look at it again.
+						table[i].store(0, std::memory_order_release);
+						throw;
+					}
+					table[i].store(index + 1, std::memory_order_release);
+					return index;
+				}
+			}
+
+			while (slot == PENDING) {
+				std::this_thread::yield();
+				slot = table[i].load(std::memory_order_acquire);
+			}
+
+			if (slot == 0) {
+				// The set that was being stored here could not be stored.
+				continue;
+			}
+
+			const SetRecord &r = record(slot - 1);
+			if (r.hash == hash && r.size == size &&
+			    std::equal(elements, elements + size, r.elements(),
+			               typename PropertyElement::FullEqual())) {
+				header().set_hits.fetch_add(1, std::memory_order_relaxed);
+				return slot - 1;
+			}
+
+			i = (i + 1) & mask;
+			probes++;
+		}
+
+		throw SharedMemoryError("The set table of the shared LHF '" + name + "' is full");
+	}
+
+	/// Packs a pair of operands into a nonzero key.
+	static std::uint64_t operation_key(IndexValue a, IndexValue b) {
+		return ((std::uint64_t(a) << 32) | std::uint64_t(b)) + 1;
+	}
+
+	Optional<std::uint64_t> find_operation(Table t, IndexValue a, IndexValue b) const {
+		OperationSlot *table = operation_table(t);
+		Size mask = header().operation_slots - 1;
+		std::uint64_t key = operation_key(a, b);
+
+		Size i = compose_hash(a, b) & mask;
+		for (Size probes = 0; probes < MAX_PROBES; probes++, i = (i + 1) & mask) {
+			std::uint64_t k = table[i].key.load(std::memory_order_acquire);
+			if (k == 0) {
+				break;
+			}
+			if (k == key) {
+				std::uint64_t v = table[i].value.load(std::memory_order_acquire);
+				if (v == 0) {
+					break;
+				}
+				return v - 1;
+			}
+		}
+
+		return Optional<std::uint64_t>::absent();
+	}
+
+	void store_operation(Table t, IndexValue a, IndexValue b, std::uint64_t result) {
+		OperationSlot *table = operation_table(t);
+		Size mask = header().operation_slots - 1;
+		std::uint64_t key = operation_key(a, b);
+
+		Size i = compose_hash(a, b) & mask;
+		for (Size probes = 0; probes < MAX_PROBES; probes++, i = (i + 1) & mask) {
+			std::uint64_t k = table[i].key.load(std::memory_order_acquire);
+			if (k == 0 &&
+			    table[i].key.compare_exchange_strong(k, key, std::memory_order_acq_rel)) {
+				table[i].value.store(result + 1, std::memory_order_release);
+				return;
+			}
+			if (k == key) {
+				// Another process has computed the same result.
+				return;
+			}
+		}
+	}
+
+	/// Stores that `a` is a subset of `b`, in index order (see
+	/// `LatticeHashForest::store_subset()`).
+	void store_subset(const Index &a, const Index &b) {
+		if (a > b) {
+			store_operation(SUBSETS, b.value, a.value, SUPERSET);
+		} else {
+			store_operation(SUBSETS, a.value, b.value, SUBSET);
+		}
+	}
+
+	Optional<Index> cached(Table t, IndexValue a, IndexValue b) {
+		Optional<std::uint64_t> r = find_operation(t, a, b);
+		if (r.is_present()) {
+			header().operation_hits.fetch_add(1, std::memory_order_relaxed);
+			return Index(r.get());
+		}
+		header().operation_misses.fetch_add(1, std::memory_order_relaxed);
+		return Optional<Index>::absent();
+	}
+
+	void check_index(const Index &index) const {
+		if (index.value >= property_set_count()) {
+			throw AssertError("Out of bounds access to the shared LHF");
+		}
+	}
+
+public:
+	SharedLatticeHashForest(const SharedLatticeHashForest &) = delete;
+	SharedLatticeHashForest &operator=(const SharedLatticeHashForest &) = delete;
+
+	SharedLatticeHashForest(SharedLatticeHashForest &&b):
+		name(std::move(b.name)), base(b.base), length(b.length) {
+		b.base = nullptr;
+		b.length = 0;
+	}
+
+	SharedLatticeHashForest &operator=(SharedLatticeHashForest &&b) {
+		if (this != &b) {
+			unmap();
+			name = std::move(b.name);
+			base = b.base;
+			length = b.length;
+			b.base = nullptr;
+			b.length = 0;
+		}
+		return *this;
+	}
+
+	~SharedLatticeHashForest() {
+		unmap();
+	}
+
+	/**
+	 * @brief      Creates the shared memory segment `name` (e.g.
+	 *             `"/analysis"`, see `shm_open()`) and an empty LHF in it.
+	 *
+	 * @exception  SharedMemoryError  If the segment exists already or cannot
+	 *                                be created.
+	 */
+	static SharedLatticeHashForest create(
+		const String &name, const SharedForestLimits &limits = {}) {
+
+		if (limits.max_sets == 0 || limits.max_sets >= std::numeric_limits<std::uint32_t>::max() ||
+		    limits.operation_slots == 0) {
+			throw SharedMemoryError("Invalid limits for the shared LHF '" + name + "'");
+		}
+
+		SharedLatticeHashForest f(name);
+
+		// The set table is kept at most half full.
+		Size set_slots = power_of_two_at_least(2 * limits.max_sets);
+		Size operation_slots = power_of_two_at_least(limits.operation_slots);
+
+		Size offset = align_up(sizeof(Header), alignof(Word));
+		Size directory = offset;
+		offset += limits.max_sets * sizeof(Word);
+		Size sets = offset;
+		offset += set_slots * sizeof(Word);
+		Size operations[NUM_TABLES];
+		for (Size t = 0; t < NUM_TABLES; t++) {
+			operations[t] = offset;
+			offset += operation_slots * sizeof(OperationSlot);
+		}
+		offset = align_up(offset, RECORD_ALIGN);
+		Size arena = offset;
+		Size total = offset + limits.arena_bytes;
+
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0) {
+			throw SharedMemoryError("Could not create the shared LHF '" + name + "'");
+		}
+		if (ftruncate(fd, total) != 0) {
+			::close(fd);
+			shm_unlink(name.c_str());
+			throw SharedMemoryError("Could not size the shared LHF '" + name + "'");
+		}
+
+		try {
+			f.map(fd, total);
+		} catch (...) {
+			shm_unlink(name.c_str());
+			throw;
+		}
+
+		// The new segment is zero-filled, which is a valid state for the
+		// atomics and empty tables.
+		Header &h = f.header();
+		std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+		h.version = SHARED_FOREST_VERSION;
+		h.element_size = sizeof(PropertyElement);
+		h.element_align = alignof(PropertyElement);
+		h.fingerprint = LHF::config_fingerprint();
+		h.total_bytes = total;
+		h.max_sets = limits.max_sets;
+		h.set_slots = set_slots;
+		h.operation_slots = operation_slots;
+		h.arena_bytes = limits.arena_bytes;
+		h.directory.value = directory;
+		h.sets.value = sets;
+		for (Size t = 0; t < NUM_TABLES; t++) {
+			h.operations[t].value = operations[t];
+		}
+		h.arena.value = arena;
+
+		// The empty set always has index 0.
+		f.intern(nullptr, 0);
+
+		h.ready.store(1, std::memory_order_release);
+		return f;
+	}
+
+	/**
+	 * @brief      Opens the shared LHF in the segment `name`, which another
+	 *             process has created with `create()`.
+	 *
+	 * @exception  SharedMemoryError  If the segment does not exist, is not
+	 *                                initialized yet, or holds an LHF of
+	 *                                another configuration.
+	 */
+	static SharedLatticeHashForest open(const String &name) {
+		SharedLatticeHashForest f(name);
+
+		int fd = shm_open(name.c_str(), O_RDWR, 0600);
+		if (fd < 0) {
+			throw SharedMemoryError("Could not open the shared LHF '" + name + "'");
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || Size(st.st_size) < sizeof(Header)) {
+			::close(fd);
+			throw SharedMemoryError("'" + name + "' is not a shared LHF");
+		}
+		f.map(fd, st.st_size);
+
+		const Header &h = f.header();
+		if (h.ready.load(std::memory_order_acquire) != 1) {
+			throw SharedMemoryError("The shared LHF '" + name + "' is not initialized");
+		}
+		if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		    h.version != SHARED_FOREST_VERSION ||
+		    h.total_bytes != f.length) {
+			throw SharedMemoryError("'" + name + "' is not a shared LHF");
+		}
+		if (h.element_size != sizeof(PropertyElement) ||
+		    h.element_align != alignof(PropertyElement) ||
+		    h.fingerprint != LHF::config_fingerprint()) {
+			throw SharedMemoryError(
+				"The shared LHF '" + name + "' was created for another configuration");
+		}
+
+		return f;
+	}
+
+	/**
+	 * @brief      Removes the segment `name`. Processes that have it open keep
+	 *             using it until they close it.
+	 */
+	static void remove(const String &name) {
+		shm_unlink(name.c_str());
+	}
+
+	const String &get_name() const {
+		return name;
+	}
+
+	/**
+	 * @brief      Returns the number of sets. Sets that another process is
+	 *             storing may be counted before their indices are returned;
+	 *             reading such a set waits until it is written.
+	 */
+	Size property_set_count() const {
+		return std::min<Size>(
+			header().set_count.load(std::memory_order_acquire), header().max_sets);
+	}
+
+	SharedForestStats get_stats() const {
+		const Header &h = header();
+		return {
+			property_set_count(),
+			std::min<Size>(h.arena_used.load(), h.arena_bytes),
+			h.set_hits.load(),
+			h.operation_hits.load(),
+			h.operation_misses.load()};
+	}
+
+	/**
+	 * @brief      Returns the elements of a set. They stay valid as long as
+	 *             this object does.
+	 */
+	SetView get_value(const Index &index) const {
+		check_index(index);
+		const SetRecord &r = record(index.value);
+		return SetView{r.elements(), r.elements() + r.size};
+	}
+
+	/**
+	 * @brief      Inserts a (or gets an existing) set, which must be sorted
+	 *             and free of duplicates (see `LatticeHashForest::register_set()`).
+	 */
+	Index register_set(const PropertySet &c) {
+		LHF_PROPERTY_SET_INTEGRITY_VALID(c);
+		return intern(c.data(), c.size());
+	}
+
+	Index register_set_single(const PropertyElement &c) {
+		return intern(&c, 1);
+	}
+
+	/**
+	 * @brief      Returns whether `a` is known to be a subset (or superset) of
+	 *             `b`, with `a` < `b` (see `LatticeHashForest::is_subset()`).
+	 */
+	SubsetRelation is_subset(const Index &a, const Index &b) const {
+		Optional<std::uint64_t> r = find_operation(SUBSETS, a.value, b.value);
+		return r.is_present() ? SubsetRelation(r.get()) : UNKNOWN;
+	}
+
+	Index set_union(const Index &_a, const Index &_b) {
+		check_index(_a);
+		check_index(_b);
+
+		if (_a == _b || _b.is_empty()) {
+			return _a;
+		} else if (_a.is_empty()) {
+			return _b;
+		}
+
+		const Index &a = std::min(_a, _b);
+		const Index &b = std::max(_a, _b);
+
+		SubsetRelation r = is_subset(a, b);
+		if (r != UNKNOWN) {
+			return r == SUBSET ? b : a;
+		}
+
+		Optional<Index> hit = cached(UNIONS, a.value, b.value);
+		if (hit.is_present()) {
+			return hit.get();
+		}
+
+		SetView x = get_value(a), y = get_value(b);
+		PropertySet s;
+		s.reserve(x.size() + y.size());
+		std::set_union(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(s));
+
+		Index ret = intern(s.data(), s.size());
+		store_operation(UNIONS, a.value, b.value, ret.value);
+		if (ret == a) {
+			store_subset(b, a);
+		} else if (ret == b) {
+			store_subset(a, b);
+		}
+		return ret;
+	}
+
+	Index set_intersection(const Index &_a, const Index &_b) {
+		check_index(_a);
+		check_index(_b);
+
+		if (_a == _b) {
+			return _a;
+		} else if (_a.is_empty() || _b.is_empty()) {
+			return Index(EMPTY_SET_VALUE);
+		}
+
+		const Index &a = std::min(_a, _b);
+		const Index &b = std::max(_a, _b);
+
+		SubsetRelation r = is_subset(a, b);
+		if (r != UNKNOWN) {
+			return r == SUBSET ? a : b;
+		}
+
+		Optional<Index> hit = cached(INTERSECTIONS, a.value, b.value);
+		if (hit.is_present()) {
+			return hit.get();
+		}
+
+		SetView x = get_value(a), y = get_value(b);
+		PropertySet s;
+		s.reserve(std::min(x.size(), y.size()));
+		std::set_intersection(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(s));
+
+		Index ret = intern(s.data(), s.size());
+		store_operation(INTERSECTIONS, a.value, b.value, ret.value);
+		if (ret == a) {
+			store_subset(a, b);
+		} else if (ret == b) {
+			store_subset(b, a);
+		}
+		return ret;
+	}
+
+	Index set_difference(const Index &a, const Index &b) {
+		check_index(a);
+		check_index(b);
+
+		if (a == b || a.is_empty()) {
+			return Index(EMPTY_SET_VALUE);
+		} else if (b.is_empty()) {
+			return a;
+		}
+
+		Optional<Index> hit = cached(DIFFERENCES, a.value, b.value);
+		if (hit.is_present()) {
+			return hit.get();
+		}
+
+		SetView x = get_value(a), y = get_value(b);
+		PropertySet s;
+		s.reserve(x.size());
+		std::set_difference(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(s));
+
+		Index ret = intern(s.data(), s.size());
+		store_operation(DIFFERENCES, a.value, b.value, ret.value);
+		if (ret != a) {
+			if (!ret.is_empty()) {
+				store_subset(ret, a);
+			}
+		} else {
+			store_operation(INTERSECTIONS, std::min(a.value, b.value), std::max(a.value, b.value), EMPTY_SET_VALUE);
+		}
+		return ret;
+	}
+};
+
+}; // END namespace lhf
+
+#endif
@@ -0,0 +1,656 @@
+/**
+ * @file lhf_snapshot.hpp
+ * @brief Building blocks for binary snapshots of LHFs that can be mapped into
+ *        memory and queried in place.
+ */
+
+#ifndef LHF_SNAPSHOT_HPP
+#define LHF_SNAPSHOT_HPP
+
+#include "lhf_common.hpp"
+#include "lhf_parallel.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LHF_SNAPSHOT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lhf {
+
+/**
+ * @brief      Thrown if a snapshot cannot be written or read, or if the file
+ *             is not a valid snapshot for the LHF that opens it.
+ */
+struct SnapshotError : public std::runtime_error {
+	SnapshotError(const std::string &message):
+		std::runtime_error(message.c_str()) {}
+};
+
+/// Version of the snapshot format. Snapshots of other versions are rejected.
+static constexpr std::uint32_t SNAPSHOT_FORMAT_VERSION = 4;
+
+/// Written in the native byte order, so that snapshots written on a machine
+/// with the other byte order are rejected.
+static constexpr std::uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+/// Every section starts at a multiple of this, which is also the largest
+/// alignment an element may require.
+static constexpr Size SNAPSHOT_ALIGNMENT = 64;
+
+static constexpr char SNAPSHOT_MAGIC[8] = {'L', 'H', 'F', 'S', 'N', 'A', 'P', '\0'};
+
+/// Sections are checksummed in blocks of this many bytes, which are verified
+/// in parallel.
+static constexpr Size SNAPSHOT_CHECKSUM_BLOCK = Size(1) << 20;
+
+/**
+ * @brief      The sections of a snapshot.
+ */
+enum class SnapshotSection : std::uint32_t {
+	/// Set i is `[elements[offsets[i]], elements[offsets[i + 1]])`.
+	OFFSETS,
+	/// The elements of all sets, stored contiguously.
+	ELEMENTS,
+	/// Open-addressing table from set contents to set indices (the image of
+	/// `property_set_map`).
+	SET_TABLE,
+	/// Slots of the flat operation caches (see `FlatOperationMap`).
+	UNIONS,
+	INTERSECTIONS,
+	DIFFERENCES,
+	SUBSETS,
+	COUNT
+};
+
+/**
+ * @brief      How the sets and operation caches of a snapshot are stored.
+ */
+enum class SnapshotEncoding : std::uint64_t {
+	/// Fixed-layout sections that are queried in place.
+	RAW,
+	/// Sets of integral keys are delta-encoded, the child indices of nested
+	/// LHFs are stored in StreamVByte columns after the keys, and the
+	/// operation caches are stored as sorted, delta-encoded entries (see
+	/// `SetCodec`). The snapshot is decoded into memory when it is opened.
+	DELTA
+};
+
+/**
+ * @brief      Location of a section in the file.
+ */
+struct SnapshotSectionEntry {
+	std::uint64_t offset;
+	std::uint64_t bytes;
+	std::uint64_t count;
+
+	/// See `SnapshotChecksum`.
+	std::uint64_t checksum;
+};
+
+/**
+ * @brief      The fixed-size header at the start of a snapshot. All values
+ *             are in the native byte order and layout, so a snapshot can only
+ *             be opened by a build with the same element type and word size.
+ */
+struct SnapshotHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint64_t index_size;
+	std::uint64_t element_size;
+	std::uint64_t element_align;
+	std::uint64_t num_children;
+	std::uint64_t set_count;
+	SnapshotEncoding encoding;
+
+	/// Fingerprint of the configuration of the LHF that wrote the snapshot
+	/// (see `LatticeHashForest::config_fingerprint()`).
+	std::uint64_t fingerprint;
+
+	/// Chosen by the writer, e.g. a hash of the inputs of an analysis (see
+	/// `LatticeHashForest::warm_start()`).
+	std::uint64_t tag;
+
+	SnapshotSectionEntry sections[Size(SnapshotSection::COUNT)];
+
+	/// Checksum of the header up to this field.
+	std::uint64_t header_checksum;
+};
+
+static_assert(std::is_trivially_copyable_v<SnapshotHeader>);
+
+/**
+ * @brief      Checksum of a section. The section is split into blocks of
+ *             `SNAPSHOT_CHECKSUM_BLOCK` bytes, each block is hashed as a
+ *             sequence of 64-bit words (the last one padded with zeros), and
+ *             the block hashes, mixed with their block numbers, are summed.
+ *             Blocks can therefore be hashed independently, and the checksum
+ *             can be computed while the section is written.
+ */
+class SnapshotChecksum {
+protected:
+	static constexpr std::uint64_t SEED = 0xcbf29ce484222325ULL;
+	static constexpr std::uint64_t PRIME = 0x100000001b3ULL;
+
+	std::uint64_t sum = 0;
+	std::uint64_t hash = SEED;
+	Size block = 0;
+	Size in_block = 0;
+	unsigned char carry[8] = {};
+	Size carried = 0;
+
+	static std::uint64_t mix(std::uint64_t h) {
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+		return h;
+	}
+
+	static std::uint64_t finish_block(std::uint64_t hash, Size block) {
+		return mix(hash ^ mix(block + 1));
+	}
+
+	void word(std::uint64_t w) {
+		hash = (hash ^ w) * PRIME;
+		in_block += sizeof(w);
+		if (in_block == SNAPSHOT_CHECKSUM_BLOCK) {
+			sum += finish_block(hash, block);
+			hash = SEED;
+			in_block = 0;
+			block++;
+		}
+	}
+
+public:
+	/**
+	 * @brief      Returns the term that block number `block`, which holds
+	 *             `[data, data + bytes)`, contributes to the checksum.
+	 */
+	static std::uint64_t block_term(const std::byte *data, Size bytes, Size block) {
+		std::uint64_t h = SEED;
+		Size i = 0;
+		for (; i + 8 <= bytes; i += 8) {
+			std::uint64_t w;
+			std::memcpy(&w, data + i, 8);
+			h = (h ^ w) * PRIME;
+		}
+		if (i < bytes) {
+			std::uint64_t w = 0;
+			std::memcpy(&w, data + i, bytes - i);
+			h = (h ^ w) * PRIME;
+		}
+		return bytes > 0 ? finish_block(h, block) : 0;
+	}
+
+	void update(const void *data, Size bytes) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+
+		if (carried > 0) {
+			Size n = std::min<Size>(sizeof(carry) - carried, bytes);
+			std::memcpy(carry + carried, p, n);
+			carried += n;
+			p += n;
+			bytes -= n;
+			if (carried < sizeof(carry)) {
+				return;
+			}
+
+			std::uint64_t w;
+			std::memcpy(&w, carry, sizeof(w));
+			carried = 0;
+			word(w);
+		}
+
+		for (; bytes >= 8; p += 8, bytes -= 8) {
+			std::uint64_t w;
+			std::memcpy(&w, p, 8);
+			word(w);
+		}
+
+		std::memcpy(carry, p, bytes);
+		carried = bytes;
+	}
+
+	std::uint64_t finish() {
+		if (carried > 0) {
+			std::uint64_t w = 0;
+			std::memcpy(&w, carry, carried);
+			hash = (hash ^ w) * PRIME;
+			in_block += carried;
+			carried = 0;
+		}
+		if (in_block > 0) {
+			sum += finish_block(hash, block);
+			hash = SEED;
+			in_block = 0;
+			block++;
+		}
+		return sum;
+	}
+};
+
+/// Checksum of the header fields before `header_checksum`.
+inline std::uint64_t snapshot_header_checksum(const SnapshotHeader &h) {
+	SnapshotChecksum c;
+	c.update(&h, offsetof(SnapshotHeader, header_checksum));
+	return c.finish();
+}
+
+/**
+ * @brief      Reads the header of the snapshot at `path` without reading the
+ *             rest of the file.
+ *
+ * @return     The size of the file.
+ *
+ * @exception  SnapshotError  If the file cannot be read or is too small.
+ */
+inline Size read_snapshot_header(const String &path, SnapshotHeader &h) {
+	std::FILE *file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		throw SnapshotError("Could not open the snapshot '" + path + "'");
+	}
+
+	bool ok = std::fread(&h, sizeof(h), 1, file) == 1 && std::fseek(file, 0, SEEK_END) == 0;
+	long length = ok ? std::ftell(file) : -1;
+	std::fclose(file);
+	if (length < 0) {
+		throw SnapshotError("'" + path + "' is too small to be a snapshot");
+	}
+	return Size(length);
+}
+
+/**
+ * @brief      Checks that `h` is the header of a snapshot of `length` bytes
+ *             that was written for elements of the given layout, by an LHF
+ *             with the given configuration fingerprint. Only the header is
+ *             read, so mismatched snapshots are rejected cheaply.
+ *
+ * @exception  SnapshotError  If it is not.
+ */
+inline void check_snapshot_header(
+	const SnapshotHeader &h, Size length, const String &path,
+	Size element_size, Size element_align, Size num_children,
+	std::uint64_t fingerprint) {
+
+	if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+		throw SnapshotError("'" + path + "' is not a snapshot");
+	} else if (h.version != SNAPSHOT_FORMAT_VERSION) {
+		throw SnapshotError(
+			"Unsupported snapshot version " + std::to_string(h.version) +
+			" (expected " + std::to_string(SNAPSHOT_FORMAT_VERSION) + ")");
+	} else if (h.byte_order != SNAPSHOT_BYTE_ORDER_MARK ||
+	           h.index_size != sizeof(IndexValue)) {
+		throw SnapshotError("The snapshot was written on an incompatible platform");
+	} else if (h.element_size != element_size ||
+	           h.element_align != element_align ||
+	           h.num_children != num_children) {
+		throw SnapshotError("The snapshot was written for a different element type");
+	} else if (h.fingerprint != fingerprint) {
+		throw SnapshotError("The snapshot was written for a different LHF configuration");
+	} else if (h.encoding > SnapshotEncoding::DELTA) {
+		throw SnapshotError("Unsupported snapshot encoding");
+	}
+
+	if (h.header_checksum != snapshot_header_checksum(h)) {
+		throw SnapshotError("The snapshot header is corrupt");
+	}
+
+	for (const SnapshotSectionEntry &s : h.sections) {
+		if (s.offset % SNAPSHOT_ALIGNMENT != 0 ||
+		    s.offset > length || s.bytes > length - s.offset) {
+			throw SnapshotError("The snapshot is truncated or corrupt");
+		}
+	}
+}
+
+/**
+ * @brief      Writes a snapshot section by section. The header is written
+ *             last, so a snapshot that was not finished has no valid magic
+ *             and is never opened.
+ */
+class SnapshotWriter {
+protected:
+	std::FILE *file = nullptr;
+	Vector<char> buffer;
+	SnapshotHeader header = {};
+	Size position = 0;
+	SnapshotSection current = SnapshotSection::COUNT;
+	SnapshotChecksum checksum;
+
+	void put(const void *data, Size bytes) {
+		if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes) {
+			throw SnapshotError("Could not write to the snapshot");
+		}
+		position += bytes;
+	}
+
+public:
+	explicit SnapshotWriter(const String &path): buffer(Size(1) << 20) {
+		file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			throw SnapshotError("Could not create the snapshot '" + path + "'");
+		}
+		std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+		// Placeholder, overwritten by finish().
+		SnapshotHeader empty = {};
+		put(&empty, sizeof(empty));
+	}
+
+	SnapshotWriter(const SnapshotWriter &) = delete;
+	SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+	~SnapshotWriter() {
+		if (file != nullptr) {
+			std::fclose(file);
+		}
+	}
+
+	/**
+	 * @brief      Starts a section at the next aligned offset.
+	 */
+	void begin(SnapshotSection section) {
+		static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+		put(zeros, (SNAPSHOT_ALIGNMENT - position % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT);
+		current = section;
+		checksum = SnapshotChecksum();
+		header.sections[Size(section)].offset = position;
+	}
+
+	/**
+	 * @brief      Appends `count` values to the current section.
+	 */
+	template<typename T>
+	void write(const T *data, Size count) {
+		static_assert(std::is_trivially_copyable_v<T>,
+			"Only trivially copyable values can be written to a snapshot");
+		put(data, count * sizeof(T));
+		checksum.update(data, count * sizeof(T));
+	}
+
+	/**
+	 * @brief      Ends the current section, which holds `count` values (or
+	 *             `count` entries, if it is a hash table).
+	 */
+	void end(Size count) {
+		SnapshotSectionEntry &entry = header.sections[Size(current)];
+		entry.bytes = position - entry.offset;
+		entry.count = count;
+		entry.checksum = checksum.finish();
+		current = SnapshotSection::COUNT;
+	}
+
+	/**
+	 * @brief      Writes the header and closes the file.
+	 *
+	 * @param[in]  element_size   `sizeof` the property elements
+	 * @param[in]  element_align  `alignof` the property elements
+	 * @param[in]  num_children   Number of nested children of an element
+	 * @param[in]  set_count      Number of sets
+	 * @param[in]  encoding       Encoding of the sections
+	 * @param[in]  fingerprint    Fingerprint of the configuration of the LHF
+	 * @param[in]  tag            Tag chosen by the writer
+	 */
+	void finish(
+		Size element_size, Size element_align, Size num_children, Size set_count,
+		SnapshotEncoding encoding = SnapshotEncoding::RAW,
+		std::uint64_t fingerprint = 0, std::uint64_t tag = 0) {
+		std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		header.version = SNAPSHOT_FORMAT_VERSION;
+		header.byte_order = SNAPSHOT_BYTE_ORDER_MARK;
+		header.index_size = sizeof(IndexValue);
+		header.element_size = element_size;
+		header.element_align = element_align;
+		header.num_children = num_children;
+		header.set_count = set_count;
+		header.encoding = encoding;
+		header.fingerprint = fingerprint;
+		header.tag = tag;
+		header.header_checksum = snapshot_header_checksum(header);
+
+		if (std::fflush(file) != 0 ||
+		    std::fseek(file, 0, SEEK_SET) != 0 ||
+		    std::fwrite(&header, sizeof(header), 1, file) != 1) {
+			throw SnapshotError("Could not write the snapshot header");
+		}
+
+		std::FILE *f = file;
+		file = nullptr;
+		if (std::fclose(f) != 0) {
+			throw SnapshotError("Could not close the snapshot");
+		}
+	}
+};
+
+/**
+ * @brief      A snapshot mapped read-only into memory. Opening it only reads
+ *             and checks the header, the contents are paged in as they are
+ *             accessed. On platforms without `mmap`, the file is read into
+ *             memory instead.
+ */
+class SnapshotMapping {
+protected:
+	const std::byte *data = nullptr;
+	Size length = 0;
+#ifndef LHF_SNAPSHOT_MMAP
+	Vector<std::byte> contents;
+#endif
+
+	const SnapshotHeader &header() const {
+		return *reinterpret_cast<const SnapshotHeader *>(data);
+	}
+
+	void unmap() {
+#ifdef LHF_SNAPSHOT_MMAP
+		if (data != nullptr) {
+			munmap(const_cast<std::byte *>(data), length);
+		}
+#endif
+		data = nullptr;
+		length = 0;
+	}
+
+	void load(const String &path) {
+#ifdef LHF_SNAPSHOT_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw SnapshotError("Could not open the snapshot '" + path + "'");
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			throw SnapshotError("Could not read the size of the snapshot '" + path + "'");
+		}
+		length = st.st_size;
+
+		if (length < sizeof(SnapshotHeader)) {
+			::close(fd);
+			throw SnapshotError("'" + path + "' is too small to be a snapshot");
+		}
+
+		void *region = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (region == MAP_FAILED) {
+			throw SnapshotError("Could not map the snapshot '" + path + "'");
+		}
+		data = static_cast<const std::byte *>(region);
+#else
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if (file == nullptr) {
+			throw SnapshotError("Could not open the snapshot '" + path + "'");
+		}
+		std::fseek(file, 0, SEEK_END);
+		length = std::ftell(file);
+		std::fseek(file, 0, SEEK_SET);
+		contents.resize(length);
+		bool ok = std::fread(contents.data(), 1, length, file) == length;
+		std::fclose(file);
+		if (!ok || length < sizeof(SnapshotHeader)) {
+			throw SnapshotError("Could not read the snapshot '" + path + "'");
+		}
+		data = contents.data();
+#endif
+	}
+
+public:
+	SnapshotMapping() = default;
+
+	/**
+	 * @brief      Maps the snapshot at `path` and checks that it was written
+	 *             for elements of the given layout and an LHF with the given
+	 *             configuration fingerprint (see `check_snapshot_header()`).
+	 */
+	SnapshotMapping(
+		const String &path, Size element_size,
+		Size element_align, Size num_children,
+		std::uint64_t fingerprint) {
+
+		load(path);
+
+		try {
+			check_snapshot_header(
+				header(), length, path,
+				element_size, element_align, num_children, fingerprint);
+		} catch (...) {
+			unmap();
+			throw;
+		}
+	}
+
+	SnapshotMapping(const SnapshotMapping &) = delete;
+	SnapshotMapping &operator=(const SnapshotMapping &) = delete;
+
+	SnapshotMapping(SnapshotMapping &&m) noexcept {
+		*this = std::move(m);
+	}
+
+	SnapshotMapping &operator=(SnapshotMapping &&m) noexcept {
+		if (this != &m) {
+			unmap();
+#ifndef LHF_SNAPSHOT_MMAP
+			contents = std::move(m.contents);
+#endif
+			data = m.data;
+			length = m.length;
+			m.data = nullptr;
+			m.length = 0;
+		}
+		return *this;
+	}
+
+	~SnapshotMapping() {
+		unmap();
+	}
+
+	Size set_count() const {
+		return header().set_count;
+	}
+
+	SnapshotEncoding encoding() const {
+		return header().encoding;
+	}
+
+	std::uint64_t tag() const {
+		return header().tag;
+	}
+
+	/**
+	 * @brief      Returns the number of values in a section, or the number of
+	 *             entries if the section is a hash table.
+	 */
+	Size count(SnapshotSection section) const {
+		return header().sections[Size(section)].count;
+	}
+
+	/**
+	 * @brief      Returns the number of values of type T that fit in a
+	 *             section (the number of slots of a hash table).
+	 */
+	template<typename T>
+	Size capacity(SnapshotSection section) const {
+		return header().sections[Size(section)].bytes / sizeof(T);
+	}
+
+	/**
+	 * @brief      Returns the values of a section, after checking that the
+	 *             section holds a whole number of values of type T.
+	 */
+	template<typename T>
+	const T *section(SnapshotSection section) const {
+		static_assert(alignof(T) <= SNAPSHOT_ALIGNMENT);
+		const SnapshotSectionEntry &s = header().sections[Size(section)];
+		if (s.bytes % sizeof(T) != 0) {
+			throw SnapshotError("The snapshot is truncated or corrupt");
+		}
+		return reinterpret_cast<const T *>(data + s.offset);
+	}
+
+	/**
+	 * @brief      Checks the checksums of all sections, which reads the whole
+	 *             file. The blocks are hashed in parallel (see
+	 *             `parallel_for()`).
+	 *
+	 * @exception  SnapshotError  If a section does not match its checksum.
+	 */
+	void verify() const {
+		struct Block {
+			Size section;
+			Size number;
+		};
+
+		Vector<Block> blocks;
+		for (Size s = 0; s < Size(SnapshotSection::COUNT); s++) {
+			Size bytes = header().sections[s].bytes;
+			for (Size b = 0; b * SNAPSHOT_CHECKSUM_BLOCK < bytes; b++) {
+				blocks.push_back({s, b});
+			}
+		}
+
+		Vector<std::uint64_t> terms(blocks.size());
+		parallel_for(blocks.size(), 1, [&](Size first, Size last) {
+			for (Size i = first; i < last; i++) {
+				const SnapshotSectionEntry &s = header().sections[blocks[i].section];
+				Size start = blocks[i].number * SNAPSHOT_CHECKSUM_BLOCK;
+				terms[i] = SnapshotChecksum::block_term(
+					data + s.offset + start,
+					std::min<Size>(SNAPSHOT_CHECKSUM_BLOCK, s.bytes - start),
+					blocks[i].number);
+			}
+		});
+
+		std::uint64_t sums[Size(SnapshotSection::COUNT)] = {};
+		for (Size i = 0; i < blocks.size(); i++) {
+			sums[blocks[i].section] += terms[i];
+		}
+
+		for (Size s = 0; s < Size(SnapshotSection::COUNT); s++) {
+			if (sums[s] != header().sections[s].checksum) {
+				throw SnapshotError("The snapshot is corrupt (checksum mismatch)");
+			}
+		}
+	}
+
+	/**
+	 * @brief      Returns the size of the file in bytes.
+	 */
+	Size size() const {
+		return length;
+	}
+};
+
+}; // END namespace lhf
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file lhf_spill.hpp
+ * @brief Disk storage for the contents of evicted property sets.
+ */
+
+#ifndef LHF_SPILL_HPP
+#define LHF_SPILL_HPP
+
+#include "lhf_common.hpp"
+
+#include <cstdio>
+#include <type_traits>
+
+namespace lhf {
+
+/**
+ * @brief      Thrown if the spill file cannot be created, written or read.
+ */
+struct SpillError : public std::runtime_error {
+	SpillError(const std::string &message):
+		std::runtime_error(message.c_str()) {}
+};
+
+/**
+ * @brief      An append-only file holding the contents of evicted property
+ *             sets. Records are never modified or removed, as the contents
+ *             of a set never change.
+ *
+ *             A record is the number of elements followed by the raw bytes
+ *             of the elements, so only trivially copyable elements can be
+ *             spilled.
+ *
+ * @note       This is not synchronized. The LHF only accesses it under its
+ *             eviction lock.
+ */
+class SpillFile {
+protected:
+	std::FILE *file = nullptr;
+	Size end = 0;
+
+	void seek(Size offset) const {
+		if (std::fseek(file, offset, SEEK_SET) != 0) {
+			throw SpillError("Could not seek in the spill file");
+		}
+	}
+
+public:
+	/**
+	 * @brief      Creates the spill file.
+	 *
+	 * @param[in]  path  Path of the file. If empty, an anonymous temporary
+	 *                   file is used, which is deleted when it is closed.
+	 */
+	explicit SpillFile(const String &path = "") {
+		file = path.empty() ? std::tmpfile() : std::fopen(path.c_str(), "w+b");
+		if (file == nullptr) {
+			throw SpillError("Could not create the spill file '" + path + "'");
+		}
+	}
+
+	SpillFile(const SpillFile &) = delete;
+	SpillFile &operator=(const SpillFile &) = delete;
+
+	~SpillFile() {
+		std::fclose(file);
+	}
+
+	/**
+	 * @brief      Appends the elements `[data, data + count)` as a record.
+	 *
+	 * @return     Offset of the record.
+	 */
+	template<typename T>
+	Size append(const T *data, Size count) {
+		static_assert(std::is_trivially_copyable_v<T>,
+			"Only trivially copyable elements can be spilled");
+
+		Size offset = end;
+		seek(offset);
+
+		if (std::fwrite(&count, sizeof(count), 1, file) != 1 ||
+		    std::fwrite(data, sizeof(T), count, file) != count) {
+			throw SpillError("Could not write to the spill file");
+		}
+
+		end += sizeof(count) + count * sizeof(T);
+		return offset;
+	}
+
+	/**
+	 * @brief      Reads the record at `offset` into `out`. `blank` is any
+	 *             element, which `out` is filled with before the record is
+	 *             copied over it (see `assign_from_bytes()`).
+	 */
+	template<typename T, typename Allocator>
+	void read(Size offset, std::vector<T, Allocator> &out, const T &blank) const {
+		static_assert(std::is_trivially_copyable_v<T>,
+			"Only trivially copyable elements can be spilled");
+
+		Size count = 0;
+		seek(offset);
+
+		if (offset > end || end - offset < sizeof(count) ||
+		    std::fread(&count, sizeof(count), 1, file) != 1) {
+			throw SpillError("Could not read from the spill file");
+		}
+
+		// A corrupt count must not turn into a huge allocation, so the
+		// elements have to fit in the rest of the file.
+		if (count > (end - offset - sizeof(count)) / sizeof(T)) {
+			throw SpillError("The spill file is corrupt");
+		}
+
+		Vector<std::byte> buffer(count * sizeof(T));
+
+		if (std::fread(buffer.data(), sizeof(T), count, file) != count) {
+			throw SpillError("Could not read from the spill file");
+		}
+
+		assign_from_bytes(out, buffer.data(), count, blank);
+	}
+
+	/**
+	 * @brief      Returns the size of the file in bytes.
+	 */
+	Size size() const {
+		return end;
+	}
+};
+
+}; // END namespace lhf
+
+#endif
@@ -6,114 +6,427 @@
 #ifndef LHF_PROFILING_H
 #define LHF_PROFILING_H
 
-#include <cassert>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
+
+#if defined(LHF_PROFILER_USE_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define LHF_PROFILER_RDTSC_AVAILABLE
+#endif
+
+/// Maximum number of distinct timer and counter keys in a process.
+#ifndef LHF_PROFILER_MAX_KEYS
+#define LHF_PROFILER_MAX_KEYS 256
+#endif
+
+/// Timers only measure one in every `LHF_PROFILER_SAMPLING_RATE` calls (on
+/// average) per call site. The default of 1 times every call.
+#ifndef LHF_PROFILER_SAMPLING_RATE
+#define LHF_PROFILER_SAMPLING_RATE 1
+#endif
+
+static_assert(LHF_PROFILER_SAMPLING_RATE >= 1,
+	"LHF_PROFILER_SAMPLING_RATE must be at least 1");
 
 namespace lhf {
 
+/**
+ * @brief      Integer identifier of an interned timer or counter name.
+ */
+using ProfileKey = std::uint32_t;
+
+/**
+ * @brief      Process-wide registry of profiling key names. A name is
+ *             interned once per call site (see `__lhf_profile_key`), so that
+ *             the instrumented code paths only deal with integer keys.
+ */
+struct ProfileKeyRegistry {
+	/**
+	 * @brief      Returns the key for `name`, registering it if needed. This
+	 *             takes a lock and must be kept out of hot paths.
+	 */
+	static ProfileKey intern(const std::string &name) {
+		std::lock_guard<std::mutex> m(mutex());
+		std::vector<std::string> &n = names();
+
+		for (ProfileKey i = 0; i < n.size(); i++) {
+			if (n[i] == name) {
+				return i;
+			}
+		}
+
+		if (n.size() >= LHF_PROFILER_MAX_KEYS) {
+			throw std::length_error(
+				"Too many profiling keys. Increase LHF_PROFILER_MAX_KEYS.");
+		}
+
+		n.push_back(name);
+		return n.size() - 1;
+	}
+
+	/// Returns the name of a key.
+	static std::string name(ProfileKey key) {
+		std::lock_guard<std::mutex> m(mutex());
+		return names().at(key);
+	}
+
+	/// Returns the number of keys registered so far.
+	static ProfileKey count() {
+		std::lock_guard<std::mutex> m(mutex());
+		return names().size();
+	}
+
+private:
+	static std::mutex &mutex() {
+		static std::mutex m;
+		return m;
+	}
+
+	static std::vector<std::string> &names() {
+		static std::vector<std::string> n;
+		return n;
+	}
+};
+
+/**
+ * @def        __lhf_profile_key(__name)
+ * @brief      Interns `__name` once for the call site and evaluates to its
+ *             `ProfileKey`.
+ *
+ * @param      __name  The name (evaluated only on the first execution)
+ */
+#define __lhf_profile_key(__name) \
+	([](const char *__key_name) { \
+		static const ::lhf::ProfileKey __key = \
+			::lhf::ProfileKeyRegistry::intern(__key_name); \
+		return __key; \
+	}(__name))
+
+/**
+ * @brief      The clock used for timing. This is `steady_clock`, or the time
+ *             stamp counter when `LHF_PROFILER_USE_RDTSC` is set on x86.
+ *             Ticks are only converted to time when statistics are dumped.
+ */
+struct ProfileClock {
+	using Ticks = std::uint64_t;
+
+	static inline Ticks now() {
+#ifdef LHF_PROFILER_RDTSC_AVAILABLE
+		return __rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	/// Returns the number of milliseconds per tick.
+	static long double ms_per_tick() {
+#ifdef LHF_PROFILER_RDTSC_AVAILABLE
+		// Calibrated once against steady_clock.
+		static const long double ratio = []() {
+			using namespace std::chrono;
+			auto t1 = steady_clock::now();
+			Ticks r1 = __rdtsc();
+			std::this_thread::sleep_for(milliseconds(10));
+			auto t2 = steady_clock::now();
+			Ticks r2 = __rdtsc();
+			return duration<long double, std::milli>(t2 - t1).count() / (r2 - r1);
+		}();
+		return ratio;
+#else
+		using Period = std::chrono::steady_clock::period;
+		return 1000.0L * Period::num / Period::den;
+#endif
+	}
+};
+
+/**
+ * @brief      Decides which calls of an instrumented call site are timed when
+ *             sampling is enabled (`LHF_PROFILER_SAMPLING_RATE` > 1).
+ *
+ *             Each call site keeps a thread-local countdown. When it runs
+ *             out, the call is timed and the countdown is reset to a random
+ *             interval averaging `LHF_PROFILER_SAMPLING_RATE`, so that the
+ *             samples do not alias with periodic call patterns.
+ */
+struct ProfileSampler {
+	static constexpr std::uint32_t rate = LHF_PROFILER_SAMPLING_RATE;
+
+	static inline bool sample(std::uint32_t &countdown) {
+		if constexpr (rate == 1) {
+			return true;
+		} else {
+			if (--countdown > 0) {
+				return false;
+			}
+			countdown = next_interval();
+			return true;
+		}
+	}
+
+	/// Returns a random interval in [1, 2 * rate - 1] (xorshift64).
+	static std::uint32_t next_interval() {
+		thread_local std::uint64_t state =
+			0x9e3779b97f4a7c15ULL ^
+			std::hash<std::thread::id>()(std::this_thread::get_id());
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return 1 + state % (2 * rate - 1);
+	}
+};
+
+/**
+ * @def        __lhf_profile_sample()
+ * @brief      Evaluates to whether the current execution of the call site
+ *             should be timed (see `ProfileSampler`).
+ */
+#define __lhf_profile_sample() \
+	([]() { \
+		static thread_local std::uint32_t __countdown = 1; \
+		return ::lhf::ProfileSampler::sample(__countdown); \
+	}())
+
 /**
  * @brief      Utility class for enabling code-based profiling.
+ *
+ *             Every thread that records statistics in an instance gets its
+ *             own slot of counter and timer arrays indexed by `ProfileKey`.
+ *             A slot is only written by its owning thread, so recording does
+ *             not take any locks; a lock is only taken the first time a thread
+ *             touches an instance, and when dumping. Slots are aggregated only
+ *             at dump time.
  */
 struct PerformanceStatistics {
-	using Count = uint64_t;
+	using Count = std::uint64_t;
 	using String = std::string;
-	using TimePoint = std::chrono::steady_clock::time_point;
+	using Ticks = ProfileClock::Ticks;
+	using ThreadID = std::thread::id;
 	template <typename K, typename V> using Map = std::map<K, V>;
 
-	using Mutex = std::mutex;
-	using WriteLock = std::lock_guard<std::mutex>;
-	using ThreadID = std::thread::id;
+	/**
+	 * @brief      Statistics recorded by a single thread.
+	 */
+	struct ThreadStatistics {
+		ThreadID thread;
+		std::atomic<Count> counters[LHF_PROFILER_MAX_KEYS] = {};
+		std::atomic<Ticks> timer_ticks[LHF_PROFILER_MAX_KEYS] = {};
+		std::atomic<Count> timer_calls[LHF_PROFILER_MAX_KEYS] = {};
+		std::atomic<Count> timer_samples[LHF_PROFILER_MAX_KEYS] = {};
+		Ticks timer_starts[LHF_PROFILER_MAX_KEYS] = {};
+
+		ThreadStatistics(ThreadID thread): thread(thread) {}
+
+		/// Single-writer increment. No read-modify-write is needed.
+		template<typename T>
+		static inline void add(std::atomic<T> &v, T n) {
+			v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+	};
 
-	std::mutex mutex;
+protected:
+	/// Distinguishes instances for the thread-local slot lookup. Unlike the
+	/// address, it is never reused.
+	const std::uint64_t serial = next_serial()++;
 
-	struct Duration {
-		bool started = false;
-		TimePoint t1;
-		TimePoint t2;
-		long double duration = 0;
+	mutable std::mutex mutex;
+	mutable std::vector<std::unique_ptr<ThreadStatistics>> slots;
 
-		long double get_curr_duration_ms() {
-			using namespace std::chrono;
-			return (duration_cast<microseconds>(t2.time_since_epoch()).count() -
-					duration_cast<microseconds>(t1.time_since_epoch()).count()) /
-				    1000.0;
+	static std::atomic<std::uint64_t> &next_serial() {
+		static std::atomic<std::uint64_t> s = 0;
+		return s;
+	}
+
+	/// Number of instances whose slots each thread remembers in
+	/// `register_thread()`.
+	static constexpr std::size_t SLOT_CACHE_SIZE = 8;
+
+	/**
+	 * @brief      Returns the slot of the calling thread, creating it if the
+	 *             thread has none. Each thread remembers its slots in a small
+	 *             cache indexed by serial, so that threads outliving many
+	 *             instances do not accumulate entries. As serials are never
+	 *             reused, an entry of a destroyed instance is never matched.
+	 */
+	ThreadStatistics &register_thread() const {
+		struct CachedSlot {
+			std::uint64_t serial = ~std::uint64_t(0);
+			ThreadStatistics *slot = nullptr;
+		};
+
+		thread_local CachedSlot cache[SLOT_CACHE_SIZE];
+
+		CachedSlot &c = cache[serial % SLOT_CACHE_SIZE];
+		if (c.serial == serial) {
+			return *c.slot;
 		}
 
-		long double get_cumul_duration_ms() { return duration; }
-	};
+		std::lock_guard<std::mutex> m(mutex);
+		ThreadID id = std::this_thread::get_id();
 
-	Map<String, Count> counters;
-	Map<ThreadID, Map<String, Duration>> timers;
+		// The slot may have been evicted from the cache by another instance.
+		ThreadStatistics *slot = nullptr;
+		for (const std::unique_ptr<ThreadStatistics> &s : slots) {
+			if (s->thread == id) {
+				slot = s.get();
+				break;
+			}
+		}
 
-	// Timer Functions
+		if (slot == nullptr) {
+			slots.push_back(std::unique_ptr<ThreadStatistics>(new ThreadStatistics(id)));
+			slot = slots.back().get();
+		}
 
-	static inline const ThreadID currthread() {
-		return std::this_thread::get_id();
+		c.serial = serial;
+		c.slot = slot;
+		return *slot;
 	}
 
-	Duration &get_timer(const String &s) {
-		if (timers.count(std::this_thread::get_id()) == 0) {
-			timers[std::this_thread::get_id()] = {};
+public:
+	PerformanceStatistics() = default;
+	PerformanceStatistics(const PerformanceStatistics &) = delete;
+	PerformanceStatistics &operator=(const PerformanceStatistics &) = delete;
+
+	/**
+	 * @brief      Returns the statistics slot of the calling thread.
+	 */
+	inline ThreadStatistics &local() const {
+		thread_local std::uint64_t cached_serial = ~std::uint64_t(0);
+		thread_local ThreadStatistics *cached_slot = nullptr;
+
+		if (cached_serial != serial) {
+			cached_slot = &register_thread();
+			cached_serial = serial;
 		}
 
-		if (timers[std::this_thread::get_id()].count(s) == 0) {
-			timers[std::this_thread::get_id()][s] = Duration{};
-		}
+		return *cached_slot;
+	}
+
+	// Timer Functions
+
+	/// Adds a measured duration to a timer.
+	inline void timer_add(ProfileKey key, Ticks ticks) const {
+		ThreadStatistics &t = local();
+		ThreadStatistics::add(t.timer_ticks[key], ticks);
+		ThreadStatistics::add<Count>(t.timer_calls[key], 1);
+		ThreadStatistics::add<Count>(t.timer_samples[key], 1);
+	}
+
+	/// Records a call of a timer that was not measured (see
+	/// `ProfileSampler`).
+	inline void timer_skip(ProfileKey key) const {
+		ThreadStatistics::add<Count>(local().timer_calls[key], 1);
+	}
+
+	void timer_start(ProfileKey key) const {
+		local().timer_starts[key] = ProfileClock::now();
+	}
 
-		return timers[std::this_thread::get_id()][s];
+	void timer_end(ProfileKey key) const {
+		timer_add(key, ProfileClock::now() - local().timer_starts[key]);
 	}
 
-	void timer_start(const String &s) {
-		WriteLock m(mutex);
-		auto &d = get_timer(s);
-		assert(!d.started && "timer already started");
-		d.started = true;
-		d.t1 = std::chrono::steady_clock::now();
+	void timer_start(const String &s) const {
+		timer_start(ProfileKeyRegistry::intern(s));
 	}
 
-	void timer_end(const String &s) {
-		WriteLock m(mutex);
-		auto &d = get_timer(s);
-		assert(d.started && "timer already stopped");
-		d.started = false;
-		d.t2 = std::chrono::steady_clock::now();
-		d.duration += d.get_curr_duration_ms();
+	void timer_end(const String &s) const {
+		timer_end(ProfileKeyRegistry::intern(s));
 	}
 
 	// Counter Functions
 
-	Count &get_counter(const String &s) {
-		if (counters.count(s) == 0) {
-			counters[s] = 0;
+	inline void inc_counter(ProfileKey key, Count n = 1) const {
+		ThreadStatistics::add(local().counters[key], n);
+	}
+
+	void inc_counter(const String &s) const {
+		inc_counter(ProfileKeyRegistry::intern(s));
+	}
+
+	// Aggregation
+
+	/**
+	 * @brief      Returns the value of every counter summed over all threads.
+	 *             Counters that were never incremented are left out.
+	 */
+	Map<String, Count> get_counters() const {
+		std::lock_guard<std::mutex> m(mutex);
+		Map<String, Count> ret;
+		ProfileKey num_keys = ProfileKeyRegistry::count();
+
+		for (ProfileKey k = 0; k < num_keys; k++) {
+			Count total = 0;
+			for (auto &t : slots) {
+				total += t->counters[k].load(std::memory_order_relaxed);
+			}
+			if (total > 0) {
+				ret[ProfileKeyRegistry::name(k)] = total;
+			}
 		}
 
-		return counters[s];
+		return ret;
 	}
 
-	void inc_counter(const String &s) {
-		WriteLock m(mutex);
-		get_counter(s)++;
+	/**
+	 * @brief      Returns the cumulative duration (in ms) of every timer, per
+	 *             thread. Timers that were never run are left out. When
+	 *             sampling, the measured duration is scaled by the ratio of
+	 *             calls to measured calls.
+	 */
+	Map<ThreadID, Map<String, long double>> get_timers() const {
+		std::lock_guard<std::mutex> m(mutex);
+		Map<ThreadID, Map<String, long double>> ret;
+		ProfileKey num_keys = ProfileKeyRegistry::count();
+		long double scale = ProfileClock::ms_per_tick();
+
+		for (auto &t : slots) {
+			for (ProfileKey k = 0; k < num_keys; k++) {
+				Count calls = t->timer_calls[k].load(std::memory_order_relaxed);
+				Count samples = t->timer_samples[k].load(std::memory_order_relaxed);
+				if (samples > 0) {
+					ret[t->thread][ProfileKeyRegistry::name(k)] =
+						t->timer_ticks[k].load(std::memory_order_relaxed) * scale *
+						calls / samples;
+				}
+			}
+		}
+
+		return ret;
 	}
 
 	// dump
 
-	String dump() const {
+	String dump(bool include_counters = true) const {
 		using namespace std;
 		stringstream s;
 
+		Map<String, Count> counters;
+		if (include_counters) {
+			counters = get_counters();
+		}
+		auto timers = get_timers();
+
 		if (counters.size() < 1 && timers.size() < 1) {
 			s << endl << "Profiler: No statistics generated" << endl;
 			return s.str();
 		}
 
 		s << endl << "Profiler Statistics:" << endl;
+		if (ProfileSampler::rate > 1) {
+			s << "    (Timings extrapolated from 1 in "
+			  << ProfileSampler::rate << " calls)" << endl;
+		}
 		for (auto k : counters) {
 			s << "    "
 				 << "'" << k.first << "'"
@@ -126,7 +439,7 @@ struct PerformanceStatistics {
 			for (auto k : t.second) {
 				s << "    "
 				 << "'" << k.first << "'"
-				 << ": " << k.second.get_cumul_duration_ms() << " ms" << endl;
+				 << ": " << k.second << " ms" << endl;
 			}
 		}
 
@@ -136,17 +449,24 @@ struct PerformanceStatistics {
 
 /**
  * @brief      The object used to enable the duration capturing mechanism.
+ *             Calls that are not sampled are only counted.
  */
 struct __CalcTime {
-	std::string key;
-	PerformanceStatistics &stat;
+	const PerformanceStatistics &stat;
+	const ProfileKey key;
+	const bool sampled;
+	const ProfileClock::Ticks start;
 
-	__CalcTime(PerformanceStatistics &stat, const std::string &key): key(key), stat(stat) {
-		stat.timer_start(key);
-	}
+	__CalcTime(const PerformanceStatistics &stat, ProfileKey key, bool sampled = true):
+		stat(stat), key(key), sampled(sampled),
+		start(sampled ? ProfileClock::now() : 0) {}
 
 	~__CalcTime() {
-		stat.timer_end(key);
+		if (sampled) {
+			stat.timer_add(key, ProfileClock::now() - start);
+		} else {
+			stat.timer_skip(key);
+		}
 	}
 };
 
@@ -156,7 +476,7 @@ struct __CalcTime {
  *             scope.
  *
  * @param      __stat  PerformanceStatistics object
- * @param      __key   Identifier for this duration
+ * @param      __key   Identifier for this duration (a string literal)
  */
 
 /**
@@ -169,9 +489,11 @@ struct __CalcTime {
 
 #ifdef LHF_ENABLE_PERFORMANCE_METRICS
 #define __lhf_calc_time(__stat, __key) \
-	auto __LHF_TIMER_OBJECT__ = __CalcTime((__stat), (__key))
+	auto __LHF_TIMER_OBJECT__ = __CalcTime( \
+		(__stat), __lhf_profile_key(__key), __lhf_profile_sample())
 #define __lhf_calc_functime(__stat) \
-	auto __LHF_TIMER_OBJECT__ = __CalcTime((__stat), __func__)
+	auto __LHF_TIMER_OBJECT__ = __CalcTime( \
+		(__stat), __lhf_profile_key(__func__), __lhf_profile_sample())
 #else
 #define __lhf_calc_time(__stat, __key)
 #define __lhf_calc_functime(__stat)
@@ -179,4 +501,4 @@ struct __CalcTime {
 
 }
 
-#endif
\ No newline at end of file
+#endif
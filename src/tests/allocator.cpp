@@ -0,0 +1,123 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+#include <memory_resource>
+
+using LHF = lhf::LatticeHashForest<lhf::PmrLHFConfig<int>>;
+using Index = typename LHF::Index;
+
+using NestedLHF = lhf::LatticeHashForest<
+	lhf::PmrLHFConfig<int>,
+	lhf::NestingBase<int, LHF>>;
+
+/// Forwards to another resource and counts the bytes that are outstanding.
+class CountingResource : public std::pmr::memory_resource {
+	std::pmr::memory_resource *upstream;
+
+public:
+	lhf::Size outstanding = 0;
+	lhf::Size allocations = 0;
+
+	CountingResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()):
+		upstream(upstream) {}
+
+protected:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+		outstanding += bytes;
+		allocations++;
+		return upstream->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+		outstanding -= bytes;
+		upstream->deallocate(p, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+		return this == &other;
+	}
+};
+
+TEST(LHF_AllocatorChecks, sets_and_maps_use_the_resource) {
+	CountingResource resource;
+	{
+		LHF l({}, &resource);
+		EXPECT_EQ(l.get_allocator().resource(), &resource);
+
+		Index a = l.register_set({1, 2});
+		Index b = l.register_set({2, 3});
+		Index c = l.set_union(a, b);
+		l.set_intersection(a, b);
+		l.set_difference(c, a);
+
+		EXPECT_EQ(l.get_value(c), (LHF::PropertySet{1, 2, 3}));
+		EXPECT_EQ(l.get_value(c).get_allocator().resource(), &resource);
+		EXPECT_GT(resource.outstanding, 0u);
+
+		// Sets created from the default resource are copied into the LHF's.
+		LHF::PropertySet d = {4, 5};
+		Index e = l.register_set(std::move(d));
+		EXPECT_EQ(l.get_value(e).get_allocator().resource(), &resource);
+	}
+	EXPECT_EQ(resource.outstanding, 0u);
+}
+
+TEST(LHF_AllocatorChecks, monotonic_buffer_resource) {
+	std::pmr::monotonic_buffer_resource arena;
+	CountingResource resource(&arena);
+
+	LHF l({}, &resource);
+	std::vector<Index> s;
+	for (int i = 0; i < 100; i++) {
+		s.push_back(l.register_set({i, i + 1}));
+	}
+
+	Index all = lhf::EMPTY_SET_VALUE;
+	for (const Index &i : s) {
+		all = l.set_union(all, i);
+	}
+
+	EXPECT_EQ(l.size_of(all), 101u);
+	EXPECT_GT(resource.allocations, 0u);
+}
+
+TEST(LHF_AllocatorChecks, nested_lhfs_use_their_own_resources) {
+	CountingResource child_resource, parent_resource;
+	{
+		LHF child({}, &child_resource);
+		NestedLHF l(NestedLHF::RefList{child}, &parent_resource);
+
+		LHF::Index x = child.register_set({1});
+		LHF::Index y = child.register_set({2});
+		NestedLHF::Index a = l.register_set({{1, {x}}});
+		NestedLHF::Index b = l.register_set({{1, {y}}});
+		NestedLHF::Index c = l.set_union(a, b);
+
+		EXPECT_EQ(child.get_value(l.get_value(c).at(0).value0()), (LHF::PropertySet{1, 2}));
+		EXPECT_GT(child_resource.outstanding, 0u);
+		EXPECT_GT(parent_resource.outstanding, 0u);
+	}
+	EXPECT_EQ(child_resource.outstanding, 0u);
+	EXPECT_EQ(parent_resource.outstanding, 0u);
+}
+
+TEST(LHF_AllocatorChecks, deduplicator_uses_the_resource) {
+	using Dedup = lhf::Deduplicator<
+		std::string,
+		lhf::DefaultHash<std::string>,
+		lhf::DefaultEqual<std::string>,
+		lhf::DefaultPrinter<std::string>,
+		std::pmr::polymorphic_allocator<std::byte>>;
+
+	CountingResource resource;
+	{
+		Dedup d(&resource);
+		auto a = d.register_value(std::string("abc"));
+		auto b = d.register_ptr(new std::string("abc"));
+		auto c = d.register_value(std::string("def"));
+		EXPECT_EQ(a, b);
+		EXPECT_NE(a, c);
+		EXPECT_EQ(d.get_value(c), "def");
+		EXPECT_GT(resource.outstanding, 0u);
+	}
+	EXPECT_EQ(resource.outstanding, 0u);
+}
@@ -0,0 +1,84 @@
+#include "common.hpp"
+#include "lhf/lhf.hpp"
+#include <gtest/gtest.h>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+using Request = typename LHF::BatchRequest;
+using Operand = typename LHF::BatchOperand;
+
+TEST(LHF_BatchChecks, batch_matches_sequential_operations) {
+	LHF l;
+	Index a = l.register_set({1, 2, 3});
+	Index b = l.register_set({3, 4, 5});
+	Index c = l.register_set({5, 6});
+
+	lhf::Vector<Request> batch = {
+		Request::set_union(a, b),
+		Request::set_intersection(Operand::result_of(0), c),
+		Request::set_difference(Operand::result_of(0), c),
+		Request::set_insert_single(Operand::result_of(2), 9),
+		Request::set_union(b, a),
+	};
+
+	lhf::Vector<Index> r = l.execute_batch(batch);
+
+	ASSERT_EQ(r.size(), batch.size());
+	EXPECT_EQ(r[0], l.register_set({1, 2, 3, 4, 5}));
+	EXPECT_EQ(r[1], l.register_set({5}));
+	EXPECT_EQ(r[2], l.register_set({1, 2, 3, 4}));
+	EXPECT_EQ(r[3], l.register_set({1, 2, 3, 4, 9}));
+	EXPECT_EQ(r[4], r[0]);
+}
+
+TEST(LHF_BatchChecks, batch_deduplicates_requests) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({2, 3});
+
+	lhf::Vector<Request> batch;
+	for (int i = 0; i < 100; i++) {
+		batch.push_back(Request::set_union(a, b));
+		batch.push_back(Request::set_intersection(b, a));
+	}
+
+	lhf::Vector<Index> r = l.execute_batch(batch);
+
+	for (std::size_t i = 0; i < r.size(); i += 2) {
+		EXPECT_EQ(r[i], r[0]);
+		EXPECT_EQ(r[i + 1], r[1]);
+	}
+	EXPECT_TRUE(l.verify_relation_map_sizes(1, 1, 0, 3));
+}
+
+TEST(LHF_BatchChecks, batch_large_dag) {
+	LHF l;
+	LHF reference;
+	lhf::Vector<Request> batch;
+
+	for (int i = 0; i < 200; i++) {
+		Index s = l.register_set({i, i + 1, i + 2});
+		reference.register_set({i, i + 1, i + 2});
+		batch.push_back(i == 0 ?
+			Request::set_union(s, s) :
+			Request::set_union(Operand::result_of(i - 1), s));
+	}
+
+	lhf::Vector<Index> r = l.execute_batch(batch);
+
+	Index expected = reference.register_set({});
+	for (int i = 0; i < 200; i++) {
+		expected = reference.set_union(expected, reference.register_set({i, i + 1, i + 2}));
+		EXPECT_EQ(l.get_value(r[i]), reference.get_value(expected));
+	}
+}
+
+TEST(LHF_BatchChecks, batch_rejects_forward_references) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	lhf::Vector<Request> batch = {
+		Request::set_union(a, Operand::result_of(1)),
+		Request::set_union(a, a),
+	};
+	ASSERT_THROW(l.execute_batch(batch), lhf::AssertError);
+}
@@ -0,0 +1,174 @@
+#include "common.hpp"
+#include "lhf/lhf.hpp"
+#include <gtest/gtest.h>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+static std::vector<Index> register_singletons(LHF &l, int count) {
+	std::vector<Index> ret;
+	for (int i = 0; i < count; i++) {
+		ret.push_back(l.register_set({i}));
+	}
+	return ret;
+}
+
+TEST(LHF_CacheChecks, capacity_is_enforced) {
+	LHF l;
+	l.set_operation_cache_capacity(16, lhf::CachePolicy::CLOCK);
+	std::vector<Index> s = register_singletons(l, 100);
+
+	for (int i = 1; i < 100; i++) {
+		l.set_union(s[i - 1], s[i]);
+	}
+
+	auto stats = l.get_operation_cache_stats();
+	EXPECT_EQ(stats["unions"].size, 16u);
+	EXPECT_EQ(stats["unions"].capacity, 16u);
+	EXPECT_EQ(stats["unions"].evictions, 99u - 16u);
+	EXPECT_LE(stats["subsets"].size, 16u);
+}
+
+TEST(LHF_CacheChecks, evicted_entries_are_recomputed) {
+	LHF l;
+	l.set_operation_cache_capacity(4, lhf::CachePolicy::CLOCK);
+	std::vector<Index> s = register_singletons(l, 20);
+
+	std::vector<Index> results;
+	for (int i = 1; i < 20; i++) {
+		results.push_back(l.set_union(s[i - 1], s[i]));
+	}
+
+	// The same indices are returned although most edges were evicted.
+	for (int i = 1; i < 20; i++) {
+		EXPECT_EQ(l.set_union(s[i - 1], s[i]), results[i - 1]);
+	}
+}
+
+TEST(LHF_CacheChecks, tinylfu_keeps_frequent_entries) {
+	LHF l;
+	l.set_operation_cache_capacity(8, lhf::CachePolicy::TINYLFU);
+	std::vector<Index> s = register_singletons(l, 200);
+
+	Index hot = l.set_union(s[0], s[1]);
+	for (int i = 2; i < 200; i++) {
+		l.set_union(s[0], s[1]);
+		l.set_intersection(s[0], s[1]);
+		l.set_union(s[i - 1], s[i]);
+	}
+
+	auto stats = l.get_operation_cache_stats();
+	EXPECT_EQ(stats["unions"].size, 8u);
+	EXPECT_GT(stats["unions"].rejections, 0u);
+	EXPECT_TRUE(l.find_cached_operation(lhf::OperationKind::UNION, s[0], s[1]).is_present());
+	EXPECT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, s[0], s[1]).get(), hot);
+}
+
+TEST(LHF_CacheChecks, shrinking_capacity_drops_entries) {
+	LHF l;
+	std::vector<Index> s = register_singletons(l, 50);
+	for (int i = 1; i < 50; i++) {
+		l.set_union(s[i - 1], s[i]);
+	}
+
+	l.set_operation_cache_capacity(10);
+	EXPECT_EQ(l.get_operation_cache_stats()["unions"].size, 10u);
+
+	l.set_operation_cache_capacity(0);
+	EXPECT_EQ(l.get_operation_cache_stats()["unions"].capacity, 0u);
+}
+
+TEST(LHF_CacheChecks, clearing_caches_keeps_sets) {
+	LHF l;
+	std::vector<Index> s = register_singletons(l, 20);
+	std::vector<Index> results;
+	for (int i = 1; i < 20; i++) {
+		results.push_back(l.set_union(s[i - 1], s[i]));
+		l.set_difference(results.back(), s[i]);
+	}
+
+	auto r = l.clear_operation_cache(lhf::OperationKind::UNION);
+	EXPECT_EQ(r.entries, 19u);
+	EXPECT_GE(r.bytes, 19u * LHF::BinaryOperationMap::ENTRY_BYTES);
+	EXPECT_EQ(l.get_operation_cache_stats()["unions"].size, 0u);
+	EXPECT_EQ(l.get_operation_cache_stats()["differences"].size, 19u);
+
+	lhf::Size subsets = l.get_operation_cache_stats()["subsets"].size;
+	r = l.clear_operation_caches();
+	EXPECT_EQ(r.entries, 19u + subsets);
+	EXPECT_EQ(l.get_operation_cache_stats()["differences"].size, 0u);
+	EXPECT_EQ(l.get_operation_cache_stats()["subsets"].size, 0u);
+	EXPECT_EQ(l.clear_subset_cache().entries, 0u);
+
+	// The sets keep their indices.
+	for (int i = 1; i < 20; i++) {
+		EXPECT_FALSE(l.find_cached_operation(lhf::OperationKind::UNION, s[i - 1], s[i]).is_present());
+		EXPECT_EQ(l.set_union(s[i - 1], s[i]), results[i - 1]);
+	}
+}
+
+TEST(LHF_CacheChecks, clearing_entries_of_sets) {
+	using SubsetMap = lhf::InternalMap<lhf::OperationNode, lhf::SubsetRelation>;
+
+	LHF l;
+	std::vector<Index> s = register_singletons(l, 4);
+	Index ab = l.set_union(s[0], s[1]);
+	Index cd = l.set_union(s[2], s[3]);
+	Index all = l.set_union(ab, cd);
+	l.set_intersection(s[0], s[2]);
+
+	// Drops (a, b) -> ab, (ab, cd) -> all and the subset relations of ab.
+	auto before = l.get_operation_cache_stats();
+	auto r = l.clear_operation_cache_entries({ab});
+	auto after = l.get_operation_cache_stats();
+	EXPECT_EQ(after["unions"].size, 1u);
+	EXPECT_EQ(after["intersections"].size, 1u);
+
+	lhf::Size subsets = before["subsets"].size - after["subsets"].size;
+	EXPECT_GT(subsets, 0u);
+	EXPECT_EQ(r.entries, 2u + subsets);
+	EXPECT_EQ(r.bytes,
+		2u * LHF::BinaryOperationMap::ENTRY_BYTES + subsets * SubsetMap::ENTRY_BYTES);
+
+	EXPECT_TRUE(l.find_cached_operation(lhf::OperationKind::UNION, s[2], s[3]).is_present());
+	EXPECT_FALSE(l.find_cached_operation(lhf::OperationKind::UNION, s[0], s[1]).is_present());
+	EXPECT_EQ(l.set_union(ab, cd), all);
+}
+
+TEST(LHF_CacheChecks, clearing_entries_frees_capacity) {
+	LHF l;
+	l.set_operation_cache_capacity(4, lhf::CachePolicy::CLOCK);
+	std::vector<Index> s = register_singletons(l, 10);
+	for (int i = 1; i < 5; i++) {
+		l.set_union(s[0], s[i]);
+	}
+
+	l.clear_operation_cache_entries({s[0]});
+	for (int i = 6; i < 10; i++) {
+		l.set_union(s[5], s[i]);
+	}
+
+	auto stats = l.get_operation_cache_stats();
+	EXPECT_EQ(stats["unions"].size, 4u);
+	EXPECT_EQ(stats["unions"].evictions, 0u);
+}
+
+TEST(LHF_CacheChecks, reinserted_entries_keep_their_slot) {
+	LHF o;
+	std::vector<Index> s = register_singletons(o, 3);
+	Index u = o.set_union(s[0], s[1]);
+	Index v = o.set_union(s[1], s[2]);
+
+	// Merging the same LHF again inserts the entries that are cached already.
+	LHF l;
+	l.set_operation_cache_capacity(4, lhf::CachePolicy::CLOCK);
+	for (int i = 0; i < 3; i++) {
+		l.merge_from(o);
+	}
+
+	auto stats = l.get_operation_cache_stats();
+	EXPECT_EQ(stats["unions"].size, 2u);
+	EXPECT_EQ(stats["unions"].evictions, 0u);
+	EXPECT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, s[0], s[1]).get(), u);
+	EXPECT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, s[1], s[2]).get(), v);
+}
@@ -29,6 +29,10 @@ public:
 		       this->differences.size() == differences &&
 		       this->subsets.size() == subsets;
 	}
+
+#ifdef LHF_ENABLE_EVICTION
+	using lhf::LatticeHashForest<T>::peek_value;
+#endif
 };
 
 typedef ::testing::Types<
@@ -1,5 +1,6 @@
 #include "common.hpp"
 #include <gtest/gtest.h>
+#include <sstream>
 
 using LHF = LHFVerify<lhf::LHFConfig<int>>;
 using Index = typename LHF::Index;
@@ -47,4 +48,166 @@ TEST(LHF_EvictionChecks, eviction_operation_test) {
 	ASSERT_FALSE(l.is_evicted(c));
 }
 
-#endif
\ No newline at end of file
+TEST(LHF_EvictionChecks, evicted_set_is_recomputed_on_access) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({2, 3});
+	Index c = l.set_union(a, b);
+	Index d = l.set_difference(c, a);
+
+	l.evict_set(c);
+	l.evict_set(d);
+	ASSERT_TRUE(l.is_evicted(d));
+
+	EXPECT_EQ(l.get_value(d), LHF::PropertySet({3}));
+	EXPECT_FALSE(l.is_evicted(c));
+	EXPECT_FALSE(l.is_evicted(d));
+	EXPECT_EQ(l.get_eviction_stats().rematerializations, 2u);
+}
+
+TEST(LHF_EvictionChecks, evicted_set_keeps_its_index) {
+	LHF l;
+	Index a = l.register_set({1, 2, 3});
+	l.evict_set(a);
+
+	EXPECT_EQ(l.register_set({1, 2, 3}), a);
+	EXPECT_FALSE(l.is_evicted(a));
+	EXPECT_EQ(l.get_value(a), LHF::PropertySet({1, 2, 3}));
+	EXPECT_EQ(l.get_eviction_stats().evicted_sets, 0u);
+}
+
+TEST(LHF_EvictionChecks, long_chains_of_evicted_sets_are_recomputed) {
+	constexpr int N = 100000;
+	LHF l;
+	std::vector<Index> chain = {l.register_set({0, 1})};
+	for (int k = 1; k <= N; k++) {
+		Index u = l.set_union(chain.back(), l.register_set({k + 1}));
+		chain.push_back(l.set_difference(u, l.register_set({k - 1})));
+		l.evict_set(u);
+	}
+	for (int k = 1; k <= N; k++) {
+		l.evict_set(chain[k]);
+	}
+
+	// Peeking leaves the chain evicted.
+	LHF::PropertySet buffer;
+	EXPECT_EQ(l.peek_value(chain[N], buffer), LHF::PropertySet({N, N + 1}));
+	EXPECT_TRUE(l.is_evicted(chain[N - 1]));
+
+	EXPECT_EQ(l.get_value(chain[N]), LHF::PropertySet({N, N + 1}));
+	EXPECT_FALSE(l.is_evicted(chain[N - 1]));
+	EXPECT_EQ(l.get_value(chain[N / 2]), LHF::PropertySet({N / 2, N / 2 + 1}));
+}
+
+TEST(LHF_EvictionChecks, memory_budget_is_enforced) {
+	LHF l;
+	std::vector<Index> sets;
+	for (int i = 0; i < 100; i++) {
+		std::vector<int> s;
+		for (int j = 0; j < 100; j++) {
+			s.push_back(i * 100 + j);
+		}
+		sets.push_back(l.register_set(s.begin(), s.end()));
+	}
+
+	std::vector<Index> unions = {sets[0]};
+	for (int i = 1; i < 100; i++) {
+		unions.push_back(l.set_union(unions.back(), sets[i]));
+	}
+
+	lhf::Size before = l.get_eviction_stats().resident_bytes;
+	l.set_memory_budget(before / 4);
+
+	auto stats = l.get_eviction_stats();
+	EXPECT_LE(stats.resident_bytes, before / 4);
+	EXPECT_GT(stats.evictions, 0u);
+	EXPECT_GT(stats.freed_bytes, 0u);
+
+	// Sets registered directly cannot be recomputed and are never evicted.
+	for (Index s : sets) {
+		EXPECT_FALSE(l.is_evicted(s));
+	}
+
+	EXPECT_EQ(l.size_of(unions.back()), 10000u);
+	EXPECT_EQ(l.size_of(unions[50]), 5100u);
+	EXPECT_GT(l.get_eviction_stats().rematerializations, 0u);
+}
+
+TEST(LHF_EvictionChecks, registered_sets_are_spilled) {
+	LHF l;
+	l.enable_spill();
+
+	std::vector<Index> sets;
+	for (int i = 0; i < 100; i++) {
+		std::vector<int> s;
+		for (int j = 0; j < 100; j++) {
+			s.push_back(i * 100 + j);
+		}
+		sets.push_back(l.register_set(s.begin(), s.end()));
+	}
+
+	l.set_memory_budget(l.get_eviction_stats().resident_bytes / 4);
+
+	auto stats = l.get_eviction_stats();
+	EXPECT_GT(stats.evictions, 0u);
+	EXPECT_GT(stats.spill_file_bytes, 0u);
+
+	for (int i = 0; i < 100; i++) {
+		const LHF::PropertySet &s = l.get_value(sets[i]);
+		ASSERT_EQ(s.size(), 100u);
+		EXPECT_EQ(s.front().get_key(), i * 100);
+		EXPECT_EQ(s.back().get_key(), i * 100 + 99);
+	}
+
+	EXPECT_GT(l.get_eviction_stats().spill_reads, 0u);
+}
+
+TEST(LHF_EvictionChecks, spilled_set_is_written_once) {
+	LHF l;
+	l.enable_spill();
+	Index a = l.register_set({1, 2, 3});
+
+	l.evict_set(a);
+	lhf::Size bytes = l.get_eviction_stats().spill_file_bytes;
+	EXPECT_EQ(l.size_of(a), 3u);
+
+	l.evict_set(a);
+	EXPECT_EQ(l.get_eviction_stats().spill_file_bytes, bytes);
+	EXPECT_EQ(l.get_value(a), LHF::PropertySet({1, 2, 3}));
+}
+
+#ifdef LHF_ENABLE_SERIALIZATION
+
+TEST(LHF_EvictionChecks, evicted_sets_are_serialized) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({3, 4});
+	Index u = l.set_union(a, b);
+	lhf::slz::JSON expected = l.to_json();
+
+	l.evict_set(u);
+	EXPECT_EQ(l.to_json(), expected);
+	EXPECT_TRUE(l.is_evicted(u));
+}
+
+TEST(LHF_EvictionChecks, evicted_sets_are_streamed) {
+	LHF l;
+	l.enable_spill();
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({3, 4});
+	Index u = l.set_union(a, b);
+	lhf::slz::JSON expected = l.to_json();
+
+	// One set is read back from the spill file, the other recomputed.
+	l.evict_set(a);
+	l.evict_set(u);
+	std::stringstream s;
+	l.to_json_stream(s);
+	EXPECT_EQ(lhf::slz::JSON::parse(s.str()), expected);
+	EXPECT_TRUE(l.is_evicted(a));
+	EXPECT_TRUE(l.is_evicted(u));
+}
+
+#endif
+
+#endif
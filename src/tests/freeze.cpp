@@ -0,0 +1,73 @@
+#include "common.hpp"
+#include "lhf/lhf.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+TEST(LHF_FreezeChecks, frozen_matches_live_lhf) {
+	LHF l;
+	Index a = l.register_set({1, 2, 3});
+	Index b = l.register_set({3, 4, 5});
+	Index c = l.register_set({1, 2});
+	Index u = l.set_union(a, b);
+	Index i = l.set_intersection(a, b);
+	Index d = l.set_difference(a, b);
+	l.set_union(a, c);
+
+	LHF::Frozen f = l.freeze();
+
+	ASSERT_EQ(f.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		const auto &live = l.get_value(k);
+		auto frozen = f.get_value(k);
+		ASSERT_EQ(frozen.size(), live.size());
+		EXPECT_TRUE(std::equal(frozen.begin(), frozen.end(), live.begin()));
+	}
+
+	using lhf::OperationKind;
+	EXPECT_EQ(f.find_cached_operation(OperationKind::UNION, b, a).get(), u);
+	EXPECT_EQ(f.find_cached_operation(OperationKind::INTERSECTION, a, b).get(), i);
+	EXPECT_EQ(f.find_cached_operation(OperationKind::DIFFERENCE, a, b).get(), d);
+	EXPECT_FALSE(f.find_cached_operation(OperationKind::DIFFERENCE, b, a).is_present());
+	EXPECT_EQ(f.is_subset(c, a), l.is_subset(c, a));
+	EXPECT_EQ(f.is_subset(a, c), l.is_subset(a, c));
+
+	EXPECT_TRUE(f.contains(a, 2));
+	EXPECT_FALSE(f.contains(b, 2));
+	EXPECT_EQ(f.find_key(b, 4).get().get_key(), 4);
+	EXPECT_EQ(f.size_of(Index()), 0u);
+}
+
+TEST(LHF_FreezeChecks, concurrent_readers) {
+	LHF l;
+	std::vector<Index> sets;
+	for (int k = 0; k < 64; k++) {
+		sets.push_back(l.register_set({k, k + 1, k + 2}));
+	}
+	for (lhf::Size k = 1; k < sets.size(); k++) {
+		l.set_union(sets[k - 1], sets[k]);
+	}
+
+	const LHF::Frozen f = l.freeze();
+	std::atomic<int> failures = 0;
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			for (lhf::Size k = 1; k < sets.size(); k++) {
+				auto r = f.find_cached_operation(
+					lhf::OperationKind::UNION, sets[k], sets[k - 1]);
+				if (!r.is_present() || f.size_of(r.get()) != 4) {
+					failures++;
+				}
+			}
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	EXPECT_EQ(failures, 0);
+}
@@ -0,0 +1,151 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+using ChildLHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+using NestedLHF = lhf::LatticeHashForest<
+	lhf::LHFConfig<int>,
+	lhf::NestingBase<int, ChildLHF>>;
+
+TEST(LHF_GCChecks, unpinned_sets_are_collected) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({2, 3});
+	Index c = l.set_union(a, b);
+	l.pin(a);
+
+	LHF::CollectionResult r = l.collect();
+	ASSERT_EQ(r.freed_sets, 2);
+	ASSERT_TRUE(r.remap.empty());
+	ASSERT_FALSE(l.is_collected(a));
+	ASSERT_TRUE(l.is_collected(b));
+	ASSERT_TRUE(l.is_collected(c));
+	ASSERT_EQ(l.get_value(a), (LHF::PropertySet{1, 2}));
+
+	// The cached union and the subset relations it recorded referred to
+	// collected sets.
+	ASSERT_EQ(r.purged_entries, 3);
+	ASSERT_FALSE(l.find_cached_operation(lhf::OperationKind::UNION, a, b).is_present());
+
+	// Collected contents can be registered again, under a new index.
+	Index b2 = l.register_set({2, 3});
+	ASSERT_NE(b2, b);
+	ASSERT_EQ(l.set_union(a, b2), l.register_set({1, 2, 3}));
+}
+
+TEST(LHF_GCChecks, pins_are_reference_counted) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	l.pin(a);
+	l.pin(a);
+	l.unpin(a);
+	l.collect();
+	ASSERT_FALSE(l.is_collected(a));
+
+	l.unpin(a);
+	ASSERT_FALSE(l.is_pinned(a));
+	ASSERT_THROW(l.unpin(a), lhf::AssertError);
+	l.collect();
+	ASSERT_TRUE(l.is_collected(a));
+	ASSERT_FALSE(l.is_collected(lhf::EMPTY_SET_VALUE));
+}
+
+TEST(LHF_GCChecks, compaction_renumbers_sets) {
+	LHF l;
+	Index a = l.register_set({1});
+	Index b = l.register_set({2});
+	Index c = l.register_set({3});
+	Index d = l.set_union(a, c);
+	l.set_union(a, b);
+	l.pin(a);
+	l.pin(c);
+	l.pin(d);
+
+	LHF::CollectionResult r = l.collect(true);
+	ASSERT_EQ(r.freed_sets, 2);
+	ASSERT_EQ(r.remap[b.value], LHF::COLLECTED);
+	ASSERT_EQ(l.property_set_count(), 4);
+
+	Index na = r.remap[a.value];
+	Index nc = r.remap[c.value];
+	Index nd = r.remap[d.value];
+	ASSERT_LT(na, nc);
+	ASSERT_LT(nc, nd);
+	ASSERT_EQ(l.get_value(nd), (LHF::PropertySet{1, 3}));
+	ASSERT_EQ(l.register_set({3}), nc);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, na, nc).get(), nd);
+	ASSERT_TRUE(l.is_pinned(nd));
+	ASSERT_EQ(l.set_union(nc, na), nd);
+}
+
+TEST(LHF_GCChecks, nested_sets_are_collected_through_parent) {
+	ChildLHF child;
+	NestedLHF l(NestedLHF::RefList{child});
+
+	ChildLHF::Index x = child.register_set({1, 2});
+	ChildLHF::Index y = child.register_set({3});
+	ChildLHF::Index z = child.register_set({4});
+
+	NestedLHF::Index a = l.register_set({{1, {x}}});
+	l.register_set({{2, {y}}});
+	NestedLHF::Index c = l.register_set({{3, {z}}});
+	l.pin(c);
+
+	NestedLHF::CollectionResult r = l.collect(true);
+	ASSERT_EQ(r.freed_sets, 2);
+	ASSERT_EQ(r.remap[a.value], NestedLHF::COLLECTED);
+
+	const ChildLHF::CollectionResult &cr = child.get_last_collection();
+	ASSERT_EQ(cr.freed_sets, 2);
+	ASSERT_EQ(cr.remap[x.value], ChildLHF::COLLECTED);
+
+	NestedLHF::Index nc = r.remap[c.value];
+	ChildLHF::Index nz = cr.remap[z.value];
+	ASSERT_EQ(nz, ChildLHF::Index(1));
+	ASSERT_EQ(l.get_value(nc).at(0).value0(), nz);
+	ASSERT_EQ(child.get_value(nz), (ChildLHF::PropertySet{4}));
+	ASSERT_EQ(l.register_set({{3, {nz}}}), nc);
+}
+
+#ifdef LHF_ENABLE_SERIALIZATION
+
+TEST(LHF_GCChecks, collected_sets_are_not_serialized) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	l.register_set({3, 4});
+	l.pin(a);
+
+	l.collect(false);
+	ASSERT_THROW(l.to_json(), lhf::slz::SerializationError);
+	std::stringstream s;
+	ASSERT_THROW(l.to_json_stream(s), lhf::slz::SerializationError);
+	ASSERT_TRUE(s.str().empty());
+
+	// Compaction leaves no collected sets behind.
+	l.collect(true);
+	lhf::slz::JSON j = l.to_json();
+	ASSERT_EQ(j["property_sets"], lhf::slz::JSON::parse("[[], [1, 2]]"));
+}
+
+#endif
+
+#ifdef LHF_ENABLE_EVICTION
+
+TEST(LHF_GCChecks, origins_of_evicted_sets_survive) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({2, 3});
+	Index c = l.set_union(a, b);
+	l.pin(c);
+	l.evict_set(c);
+
+	LHF::CollectionResult r = l.collect(true);
+	ASSERT_EQ(r.freed_sets, 0);
+	ASSERT_TRUE(l.is_evicted(r.remap[c.value]));
+	ASSERT_EQ(l.get_value(r.remap[c.value]), (LHF::PropertySet{1, 2, 3}));
+}
+
+#endif
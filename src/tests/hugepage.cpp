@@ -0,0 +1,53 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+
+using LHF = lhf::LatticeHashForest<lhf::HugePageLHFConfig<int>>;
+using Index = typename LHF::Index;
+
+TEST(LHF_HugePageChecks, small_allocations_are_not_mapped) {
+	lhf::HugePageStats before = lhf::get_huge_page_stats();
+	std::vector<int, lhf::HugePageAllocator<int>> v(16, 1);
+	EXPECT_EQ(lhf::get_huge_page_stats().mappings, before.mappings);
+}
+
+#ifdef __linux__
+
+TEST(LHF_HugePageChecks, large_allocations_are_aligned) {
+	lhf::HugePageStats before = lhf::get_huge_page_stats();
+	{
+		std::vector<char, lhf::HugePageAllocator<char>> v(3 * lhf::HUGE_PAGE_SIZE + 1, 'x');
+		EXPECT_EQ(reinterpret_cast<std::uintptr_t>(v.data()) % lhf::HUGE_PAGE_SIZE, 0u);
+		EXPECT_EQ(v.back(), 'x');
+
+		lhf::HugePageStats during = lhf::get_huge_page_stats();
+		EXPECT_EQ(during.mappings, before.mappings + 1);
+		EXPECT_EQ(during.mapped_bytes, before.mapped_bytes + 4 * lhf::HUGE_PAGE_SIZE);
+	}
+	EXPECT_EQ(lhf::get_huge_page_stats().mapped_bytes, before.mapped_bytes);
+}
+
+TEST(LHF_HugePageChecks, large_forest_is_mapped) {
+	lhf::HugePageStats before = lhf::get_huge_page_stats();
+	{
+		LHF l;
+		std::vector<Index> s;
+		for (int i = 0; i < 300000; i++) {
+			s.push_back(l.register_set({i}));
+		}
+
+		// The bucket array of property_set_map (and the storage array, unless
+		// it is split into blocks) has outgrown the threshold.
+		EXPECT_GT(lhf::get_huge_page_stats().mapped_bytes, before.mapped_bytes);
+
+		Index all = l.set_union(s[0], s[1]);
+		for (int i = 2; i < 1000; i++) {
+			all = l.set_union(all, s[i]);
+		}
+		EXPECT_EQ(l.size_of(all), 1000u);
+		EXPECT_EQ(l.get_value(s[12345]), (LHF::PropertySet{12345}));
+	}
+	EXPECT_EQ(lhf::get_huge_page_stats().mapped_bytes, before.mapped_bytes);
+}
+
+#endif
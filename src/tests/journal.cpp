@@ -0,0 +1,156 @@
+#include "common.hpp"
+#include "lhf/lhf.hpp"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+static std::string journal_path(const char *name) {
+	return ::testing::TempDir() + "lhf_journal_" + name;
+}
+
+static void expect_same_sets(const LHF &a, const LHF &b) {
+	ASSERT_EQ(a.property_set_count(), b.property_set_count());
+	for (lhf::Size k = 0; k < a.property_set_count(); k++) {
+		EXPECT_EQ(a.get_value(k), b.get_value(k));
+	}
+}
+
+TEST(LHF_JournalChecks, replay_restores_sets_and_operations) {
+	std::string snapshot = journal_path("replay.snap");
+	std::string journal = journal_path("replay.jrnl");
+
+	LHF l;
+	Index a = l.register_set({1, 2, 3});
+	l.checkpoint(snapshot, journal);
+	ASSERT_TRUE(l.is_journal_enabled());
+	l.disable_journal();
+	l.enable_journal(journal, true);
+
+	Index b = l.register_set({3, 4, 5});
+	Index u = l.set_union(a, b);
+	Index i = l.set_intersection(a, b);
+	Index d = l.set_difference(a, b);
+	l.is_subset(i, a);
+	l.sync_journal();
+
+	LHF r;
+	r.load_snapshot(snapshot);
+	EXPECT_EQ(r.property_set_count(), 2);
+	LHF::JournalReplayResult result = r.replay_journal(journal);
+
+	EXPECT_EQ(result.sets, l.property_set_count() - 2);
+	EXPECT_GT(result.operations, 0);
+	EXPECT_EQ(result.discarded, 0);
+	EXPECT_FALSE(result.torn);
+	expect_same_sets(l, r);
+
+	using lhf::OperationKind;
+	EXPECT_EQ(r.find_cached_operation(OperationKind::UNION, a, b).get(), u);
+	EXPECT_EQ(r.find_cached_operation(OperationKind::INTERSECTION, a, b).get(), i);
+	EXPECT_EQ(r.find_cached_operation(OperationKind::DIFFERENCE, a, b).get(), d);
+
+	// The journal started before `b` was registered.
+	EXPECT_THROW(r.replay_journal(journal), lhf::JournalError);
+
+	l.disable_journal();
+	std::remove(snapshot.c_str());
+	std::remove(journal.c_str());
+}
+
+TEST(LHF_JournalChecks, torn_tail_is_ignored) {
+	std::string journal = journal_path("torn.jrnl");
+
+	LHF l;
+	l.enable_journal(journal);
+	for (int k = 0; k < 100; k++) {
+		l.register_set({k, k + 1});
+	}
+	l.disable_journal();
+
+	std::ifstream in(journal, std::ios::binary);
+	std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	{
+		std::ofstream f(journal, std::ios::binary | std::ios::trunc);
+		f.write(contents.data(), contents.size() - 3);
+	}
+
+	LHF r;
+	LHF::JournalReplayResult result = r.replay_journal(journal);
+	EXPECT_TRUE(result.torn);
+	EXPECT_EQ(result.sets, 99);
+	for (lhf::Size k = 0; k < r.property_set_count(); k++) {
+		EXPECT_EQ(r.get_value(k), l.get_value(k));
+	}
+
+	EXPECT_THROW(
+		lhf::LatticeHashForest<lhf::LHFConfig<long double>>().replay_journal(journal),
+		lhf::JournalError);
+	std::remove(journal.c_str());
+}
+
+TEST(LHF_JournalChecks, torn_record_header_is_detected) {
+	std::string journal = journal_path("torn_header.jrnl");
+
+	LHF l;
+	l.enable_journal(journal);
+	for (int k = 0; k < 10; k++) {
+		l.register_set({k, k + 1});
+	}
+	l.disable_journal();
+
+	std::ifstream in(journal, std::ios::binary);
+	std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+
+	// Cut the last record in the middle of its header.
+	lhf::Size record = sizeof(lhf::JournalRecord) + 2 * sizeof(LHF::PropertyElement);
+	{
+		std::ofstream f(journal, std::ios::binary | std::ios::trunc);
+		f.write(contents.data(), contents.size() - record + sizeof(lhf::JournalRecord) / 2);
+	}
+
+	LHF r;
+	LHF::JournalReplayResult result = r.replay_journal(journal);
+	EXPECT_TRUE(result.torn);
+	EXPECT_EQ(result.sets, 9);
+	std::remove(journal.c_str());
+}
+
+TEST(LHF_JournalChecks, compaction_folds_journal_into_snapshot) {
+	std::string snapshot = journal_path("compact.snap");
+	std::string journal = journal_path("compact.jrnl");
+	std::string output = journal_path("compact.out");
+
+	LHF l;
+	Index a = l.register_set({1, 2, 3});
+	Index b = l.register_set({2, 3, 4});
+	l.set_union(a, b);
+	l.checkpoint(snapshot, journal);
+	l.disable_journal();
+	l.enable_journal(journal, true);
+
+	Index c = l.register_set({5, 6});
+	Index u = l.set_union(b, c);
+	l.sync_journal();
+
+	LHF::compact_journal_async(snapshot, journal, output).get();
+	l.disable_journal();
+
+	LHF::MappedSnapshot m(output);
+	EXPECT_EQ(m.property_set_count(), l.property_set_count());
+	EXPECT_EQ(m.find_cached_operation(lhf::OperationKind::UNION, b, c).get(), u);
+	EXPECT_TRUE(m.find_cached_operation(lhf::OperationKind::UNION, a, b).is_present());
+
+	LHF r;
+	r.load_snapshot(output);
+	expect_same_sets(l, r);
+	EXPECT_EQ(r.set_union(a, b), l.set_union(a, b));
+
+	std::remove(snapshot.c_str());
+	std::remove(journal.c_str());
+	std::remove(output.c_str());
+}
@@ -0,0 +1,77 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+using ChildLHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+using NestedLHF = lhf::LatticeHashForest<
+	lhf::LHFConfig<int>,
+	lhf::NestingBase<int, ChildLHF>>;
+
+TEST(LHF_MemoryChecks, counts_set_contents) {
+	LHF l;
+	lhf::MemoryUsage empty = l.memory_usage();
+	EXPECT_EQ(empty.sets, 1u);
+	EXPECT_EQ(empty.element_bytes, 0u);
+
+	Index a = l.register_set({1, 2, 3});
+	Index b = l.register_set({4});
+	l.set_union(a, b);
+
+	lhf::MemoryUsage m = l.memory_usage();
+	EXPECT_EQ(m.sets, 4u);
+	EXPECT_EQ(m.element_bytes, 8 * sizeof(LHF::PropertyElement));
+	EXPECT_EQ(m.property_set_map.entries, 4u);
+	EXPECT_EQ(m.unions.entries, 1u);
+	EXPECT_EQ(m.unions.node_bytes, LHF::BinaryOperationMap::ENTRY_BYTES);
+	EXPECT_GE(m.holder_bytes, 4 * sizeof(LHF::PropertySet));
+	EXPECT_GT(m.own_bytes(), empty.own_bytes());
+	EXPECT_EQ(m.total_bytes(), m.own_bytes());
+	EXPECT_TRUE(m.children.empty());
+
+	l.clear_operation_caches();
+	EXPECT_EQ(l.memory_usage().unions.entries, 0u);
+}
+
+TEST(LHF_MemoryChecks, collected_sets_are_subtracted) {
+	LHF l;
+	Index a = l.register_set({1, 2});
+	l.register_set({3, 4, 5});
+	l.pin(a);
+
+	EXPECT_EQ(l.memory_usage().element_bytes, 5 * sizeof(LHF::PropertyElement));
+	l.collect();
+	EXPECT_EQ(l.memory_usage().element_bytes, 2 * sizeof(LHF::PropertyElement));
+}
+
+TEST(LHF_MemoryChecks, nested_usage_is_aggregated) {
+	ChildLHF child;
+	NestedLHF l(NestedLHF::RefList{child});
+
+	ChildLHF::Index x = child.register_set({1, 2});
+	l.register_set({{1, {x}}});
+
+	lhf::MemoryUsage m = l.memory_usage();
+	ASSERT_EQ(m.children.size(), 1u);
+	EXPECT_EQ(m.children[0].element_bytes, child.memory_usage().element_bytes);
+	EXPECT_EQ(m.element_bytes, sizeof(NestedLHF::PropertyElement));
+	EXPECT_EQ(m.total_bytes(), m.own_bytes() + child.memory_usage().total_bytes());
+}
+
+#ifdef LHF_ENABLE_EVICTION
+
+TEST(LHF_MemoryChecks, evicted_sets_are_subtracted) {
+	LHF l;
+	Index a = l.register_set({1});
+	Index b = l.register_set({2, 3});
+	Index c = l.set_union(a, b);
+
+	l.evict_set(c);
+	EXPECT_EQ(l.memory_usage().element_bytes, 3 * sizeof(LHF::PropertyElement));
+
+	l.get_value(c);
+	EXPECT_EQ(l.memory_usage().element_bytes, 6 * sizeof(LHF::PropertyElement));
+}
+
+#endif
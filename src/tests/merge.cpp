@@ -0,0 +1,155 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+using ChildLHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+using NestedLHF = lhf::LatticeHashForest<
+	lhf::LHFConfig<int>,
+	lhf::NestingBase<int, ChildLHF>>;
+
+TEST(LHF_MergeChecks, sets_and_caches_are_imported) {
+	LHF l;
+	Index c = l.register_set({1, 2});
+	Index a = l.register_set({3});
+	Index b = l.register_set({1});
+
+	// The other LHF registers the same sets in a different order.
+	LHF o;
+	Index oa = o.register_set({1});
+	Index ob = o.register_set({3});
+	Index oc = o.register_set({1, 2});
+	Index od = o.set_union(oa, ob);
+	Index oe = o.set_difference(oc, oa);
+	ASSERT_EQ(o.set_intersection(oc, ob), lhf::EMPTY_SET_VALUE);
+	ASSERT_EQ(o.set_union(oa, oc), oc);
+	ASSERT_EQ(o.is_subset(oa, oc), lhf::SUBSET);
+
+	lhf::Vector<lhf::IndexValue> r = l.merge_from(o);
+	ASSERT_EQ(r.size(), o.property_set_count());
+	ASSERT_EQ(r[lhf::EMPTY_SET_VALUE], lhf::EMPTY_SET_VALUE);
+	ASSERT_EQ(r[oa.value], b.value);
+	ASSERT_EQ(r[ob.value], a.value);
+	ASSERT_EQ(r[oc.value], c.value);
+	ASSERT_EQ(l.property_set_count(), o.property_set_count());
+
+	Index d = r[od.value], e = r[oe.value];
+	ASSERT_EQ(l.get_value(d), (LHF::PropertySet{1, 3}));
+	ASSERT_EQ(l.get_value(e), (LHF::PropertySet{2}));
+
+	// The operands are in the opposite order here, so the subset relation
+	// is flipped.
+	ASSERT_EQ(l.is_subset(c, b), lhf::SUPERSET);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, a, b).get(), d);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::DIFFERENCE, c, b).get(), e);
+	ASSERT_FALSE(l.find_cached_operation(lhf::OperationKind::DIFFERENCE, b, c).is_present());
+	ASSERT_EQ(
+		l.find_cached_operation(lhf::OperationKind::INTERSECTION, a, c).get(),
+		Index(lhf::EMPTY_SET_VALUE));
+
+	auto before = l.get_operation_cache_stats();
+	ASSERT_EQ(l.set_union(b, a), d);
+	ASSERT_EQ(l.set_union(b, c), c);
+	ASSERT_EQ(l.set_difference(c, b), e);
+	for (auto &s : l.get_operation_cache_stats()) {
+		ASSERT_EQ(s.second.size, before[s.first].size);
+	}
+
+	// Merging again changes nothing.
+	ASSERT_EQ(l.merge_from(o), r);
+	ASSERT_EQ(l.property_set_count(), o.property_set_count());
+
+	lhf::Vector<lhf::IndexValue> self = l.merge_from(l);
+	ASSERT_EQ(self.size(), l.property_set_count());
+	for (lhf::Size i = 0; i < self.size(); i++) {
+		ASSERT_EQ(self[i], i);
+	}
+}
+
+TEST(LHF_MergeChecks, collected_sets_are_skipped) {
+	LHF o;
+	Index a = o.register_set({1});
+	Index b = o.register_set({2});
+	Index c = o.register_set({1, 2});
+	ASSERT_EQ(o.set_union(a, c), c);
+	o.pin(a);
+	o.pin(c);
+	o.collect();
+	ASSERT_TRUE(o.is_collected(b));
+
+	LHF l;
+	lhf::Vector<lhf::IndexValue> r = l.merge_from(o);
+	ASSERT_EQ(r[b.value], LHF::COLLECTED);
+	ASSERT_EQ(l.get_value(r[c.value]), (LHF::PropertySet{1, 2}));
+	ASSERT_EQ(l.property_set_count(), 3);
+	ASSERT_EQ(l.is_subset(r[a.value], r[c.value]), lhf::SUBSET);
+}
+
+TEST(LHF_MergeChecks, nested_sets_are_merged_with_their_children) {
+	ChildLHF child;
+	NestedLHF l(NestedLHF::RefList{child});
+	ChildLHF::Index x = child.register_set({5});
+	NestedLHF::Index a = l.register_set({{1, {x}}});
+
+	ChildLHF other_child;
+	NestedLHF o(NestedLHF::RefList{other_child});
+	ChildLHF::Index oy = other_child.register_set({6});
+	ChildLHF::Index ox = other_child.register_set({5});
+	NestedLHF::Index ob = o.register_set({{1, {oy}}, {2, {ox}}});
+	NestedLHF::Index oa = o.register_set({{1, {ox}}});
+	NestedLHF::Index oc = o.set_union(oa, ob);
+
+	lhf::Vector<lhf::IndexValue> r = l.merge_from(o);
+	ASSERT_EQ(r[oa.value], a.value);
+	ASSERT_EQ(child.property_set_count(), 4);
+
+	ChildLHF::Index y = child.register_set({6});
+	ChildLHF::Index xy = child.set_union(x, y);
+	NestedLHF::Index b = r[ob.value];
+	ASSERT_EQ(l.get_value(b).at(0).value0(), y);
+	ASSERT_EQ(l.get_value(b).at(1).value0(), x);
+	ASSERT_EQ(l.get_value(r[oc.value]).at(0).value0(), xy);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, a, b).get(), r[oc.value]);
+
+	// A child shared by both LHFs is left alone.
+	NestedLHF s(NestedLHF::RefList{child});
+	NestedLHF::Index sa = s.register_set({{3, {y}}});
+	lhf::Size children = child.property_set_count();
+	lhf::Vector<lhf::IndexValue> sr = l.merge_from(s);
+	ASSERT_EQ(child.property_set_count(), children);
+	ASSERT_EQ(l.get_value(sr[sa.value]).at(0).value0(), y);
+}
+
+TEST(LHF_MergeChecks, new_sets_are_appended_in_order) {
+	std::string path = ::testing::TempDir() + "lhf_merge_journal.bin";
+
+	LHF l;
+	Index a = l.register_set({1, 2});
+	l.enable_journal(path, true);
+
+	LHF o;
+	Index ob = o.register_set({5});
+	Index oa = o.register_set({1, 2});
+	Index oc = o.register_set({6});
+	Index ou = o.set_union(ob, oc);
+
+	lhf::Size base = l.property_set_count();
+	lhf::Vector<lhf::IndexValue> r = l.merge_from(o);
+	ASSERT_EQ(r[oa.value], a.value);
+	ASSERT_EQ(r[ob.value], base);
+	ASSERT_EQ(r[oc.value], base + 1);
+	ASSERT_EQ(r[ou.value], base + 2);
+	ASSERT_EQ(l.register_set({5, 6}), Index(r[ou.value]));
+	l.disable_journal();
+
+	// The journal lists the new sets in the order of their indices.
+	LHF j;
+	j.register_set({1, 2});
+	auto replayed = j.replay_journal(path);
+	EXPECT_EQ(replayed.sets, 3u);
+	EXPECT_EQ(j.property_set_count(), l.property_set_count());
+	EXPECT_EQ(j.find_cached_operation(lhf::OperationKind::UNION, r[ob.value], r[oc.value]).get(),
+	          Index(r[ou.value]));
+	std::remove(path.c_str());
+}
@@ -1,4 +1,7 @@
+#include <algorithm>
 #include <chrono>
+#include <iterator>
+#include <vector>
 #include <thread>
 #include "common.hpp"
 #include <gtest/gtest.h>
@@ -50,4 +53,61 @@ TEST(LHF_ParallelChecks, parallel_stress_test) {
 	std::cout << l.dump() << std::endl;
 }
 
-#endif
\ No newline at end of file
+
+struct SmallMergeConfig : lhf::LHFConfig<int> {
+	static constexpr lhf::Size PARALLEL_MERGE_THRESHOLD = 1 << 13;
+};
+
+using MergeLHF = lhf::LatticeHashForest<SmallMergeConfig>;
+using NestedMergeLHF = lhf::LatticeHashForest<
+	SmallMergeConfig,
+	lhf::NestingBase<int, MergeLHF>>;
+
+TEST(LHF_ParallelChecks, large_set_operations) {
+	MergeLHF l;
+	std::vector<int> even, thirds, u, i, d;
+
+	for (int x = 0; x < 300000; x += 2) {
+		even.push_back(x);
+	}
+	for (int x = 0; x < 300000; x += 3) {
+		thirds.push_back(x);
+	}
+
+	std::set_union(even.begin(), even.end(), thirds.begin(), thirds.end(), std::back_inserter(u));
+	std::set_intersection(even.begin(), even.end(), thirds.begin(), thirds.end(), std::back_inserter(i));
+	std::set_difference(even.begin(), even.end(), thirds.begin(), thirds.end(), std::back_inserter(d));
+
+	auto a = l.register_set(even.begin(), even.end());
+	auto b = l.register_set(thirds.begin(), thirds.end());
+
+	auto to_vector = [](const std::vector<int> &s) {
+		return MergeLHF::PropertySet(s.begin(), s.end());
+	};
+
+	EXPECT_EQ(l.get_value(l.set_union(a, b)), to_vector(u));
+	EXPECT_EQ(l.get_value(l.set_intersection(a, b)), to_vector(i));
+	EXPECT_EQ(l.get_value(l.set_difference(a, b)), to_vector(d));
+}
+
+TEST(LHF_ParallelChecks, large_nested_set_operations) {
+	MergeLHF child;
+	NestedMergeLHF l(NestedMergeLHF::RefList{child});
+
+	auto c1 = child.register_set({1, 2});
+	auto c2 = child.register_set({2, 3});
+	auto c12 = child.set_union(c1, c2);
+
+	NestedMergeLHF::PropertySet first, second, expected;
+	for (int x = 0; x < 20000; x++) {
+		first.push_back({x, {c1}});
+		second.push_back({x, {c2}});
+		expected.push_back({x, {c12}});
+	}
+
+	auto a = l.register_set(first);
+	auto b = l.register_set(second);
+	EXPECT_EQ(l.set_union(a, b), l.register_set(expected));
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "common.hpp"
+#include "lhf/profiling.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+TEST(LHF_ProfilingChecks, counters_are_aggregated_across_threads) {
+	lhf::PerformanceStatistics stat;
+	lhf::ProfileKey key = __lhf_profile_key("test.counter");
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			for (int i = 0; i < 1000; i++) {
+				stat.inc_counter(key);
+			}
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	EXPECT_EQ(stat.get_counters()["test.counter"], 4000u);
+}
+
+TEST(LHF_ProfilingChecks, thread_reuses_slot_after_cache_eviction) {
+	// More instances than a thread remembers slots for.
+	constexpr int instances = 32;
+	std::vector<std::unique_ptr<lhf::PerformanceStatistics>> stats;
+	for (int i = 0; i < instances; i++) {
+		stats.emplace_back(new lhf::PerformanceStatistics());
+	}
+
+	lhf::ProfileKey key = __lhf_profile_key("test.evicted");
+	for (int round = 0; round < 3; round++) {
+		for (auto &stat : stats) {
+			stat->inc_counter(key);
+		}
+	}
+
+	for (auto &stat : stats) {
+		EXPECT_EQ(stat->get_counters()["test.evicted"], 3u);
+	}
+}
+
+TEST(LHF_ProfilingChecks, keys_are_interned_once) {
+	EXPECT_EQ(
+		lhf::ProfileKeyRegistry::intern("test.interned"),
+		lhf::ProfileKeyRegistry::intern("test.interned"));
+	EXPECT_EQ(
+		lhf::ProfileKeyRegistry::name(lhf::ProfileKeyRegistry::intern("test.interned")),
+		"test.interned");
+}
+
+TEST(LHF_ProfilingChecks, scoped_timer_records_calls) {
+	lhf::PerformanceStatistics stat;
+	{
+		lhf::__CalcTime t(stat, __lhf_profile_key("test.timer"));
+	}
+	auto timers = stat.get_timers();
+	ASSERT_EQ(timers.size(), 1u);
+	EXPECT_EQ(timers.begin()->second.count("test.timer"), 1u);
+}
+
+TEST(LHF_ProfilingChecks, unsampled_calls_scale_timings) {
+	lhf::PerformanceStatistics stat;
+	lhf::ProfileKey key = __lhf_profile_key("test.sampled");
+
+	stat.timer_add(key, 1000);
+	for (int i = 0; i < 3; i++) {
+		stat.timer_skip(key);
+	}
+
+	long double expected = 4000 * lhf::ProfileClock::ms_per_tick();
+	EXPECT_DOUBLE_EQ(
+		(double) stat.get_timers().begin()->second["test.sampled"],
+		(double) expected);
+}
+
+TEST(LHF_ProfilingChecks, sampler_rate) {
+	std::uint32_t countdown = 1;
+	int sampled = 0;
+	for (int i = 0; i < 100000; i++) {
+		sampled += lhf::ProfileSampler::sample(countdown);
+	}
+	int expected = 100000 / lhf::ProfileSampler::rate;
+	EXPECT_NEAR(sampled, expected, expected / 10 + 1);
+}
+
+#ifdef LHF_ENABLE_PERFORMANCE_METRICS
+
+using LHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+
+TEST(LHF_ProfilingChecks, operation_counters) {
+	LHF l;
+	auto a = l.register_set({1, 2});
+	auto b = l.register_set({2, 3});
+	l.set_union(a, b);
+	l.set_union(a, b);
+	l.set_union(b, a);
+
+	auto perf = l.get_perf();
+	EXPECT_EQ(perf["unions"].cold_misses, 1u);
+	EXPECT_EQ(perf["unions"].hits, 2u);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+using Map = lhf::IncrementalHashMap<int, int>;
+
+TEST(LHF_RehashChecks, entries_survive_migration) {
+	Map m;
+	bool migrated = false;
+
+	for (int i = 0; i < 10000; i++) {
+		EXPECT_TRUE(m.insert({i, 2 * i}));
+		migrated = migrated || m.is_migrating();
+
+		// Lookups see the entries of both tables.
+		if (i % 97 == 0) {
+			for (int j = 0; j <= i; j += 13) {
+				ASSERT_NE(m.find(j), m.end());
+				ASSERT_EQ(m.find(j)->second, 2 * j);
+			}
+		}
+	}
+
+	EXPECT_TRUE(migrated);
+	EXPECT_EQ(m.size(), 10000u);
+	EXPECT_FALSE(m.insert({5, 0}));
+	EXPECT_EQ(m.find(5)->second, 10);
+	EXPECT_EQ(m.find(-1), m.end());
+
+	lhf::Size visited = 0;
+	for (const auto &e : m) {
+		EXPECT_EQ(e.second, 2 * e.first);
+		visited++;
+	}
+	EXPECT_EQ(visited, m.size());
+}
+
+TEST(LHF_RehashChecks, new_table_never_rehashes_during_migration) {
+	Map m;
+	for (int i = 0; i < 100000; i++) {
+		lhf::Size buckets = m.bucket_count();
+		bool migrating = m.is_migrating();
+		m.insert({i, i});
+
+		// The bucket arrays only change when a migration starts or ends.
+		if (migrating && m.is_migrating()) {
+			ASSERT_EQ(m.bucket_count(), buckets);
+		}
+	}
+}
+
+TEST(LHF_RehashChecks, erase_during_migration) {
+	Map m;
+	int i = 0;
+	while (!m.is_migrating()) {
+		m.insert({i, i});
+		i++;
+	}
+
+	for (int j = 0; j < i; j += 2) {
+		EXPECT_EQ(m.erase(j), 1u);
+	}
+	EXPECT_EQ(m.size(), lhf::Size(i / 2));
+
+	for (auto it = m.begin(); it != m.end();) {
+		it = m.erase(it);
+	}
+	EXPECT_TRUE(m.empty());
+}
+
+TEST(LHF_RehashChecks, reserve_presizes_tables) {
+	LHF l;
+	l.reserve(2000, 1000);
+	lhf::MemoryUsage before = l.memory_usage();
+	EXPECT_GE(before.property_set_map.bucket_bytes, 2000 * sizeof(void *));
+
+	std::vector<Index> s;
+	for (int i = 0; i < 900; i++) {
+		s.push_back(l.register_set({i}));
+	}
+	for (int i = 1; i < 900; i++) {
+		l.set_union(s[i - 1], s[i]);
+	}
+
+	lhf::MemoryUsage after = l.memory_usage();
+	EXPECT_EQ(after.property_set_map.bucket_bytes, before.property_set_map.bucket_bytes);
+	EXPECT_EQ(after.unions.bucket_bytes, before.unions.bucket_bytes);
+}
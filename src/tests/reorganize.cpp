@@ -0,0 +1,122 @@
+#include "common.hpp"
+#include <gtest/gtest.h>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+using ChildLHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+using NestedLHF = lhf::LatticeHashForest<
+	lhf::LHFConfig<int>,
+	lhf::NestingBase<int, ChildLHF>>;
+
+TEST(LHF_ReorganizeChecks, hot_sets_are_placed_first) {
+	LHF l;
+	Index a = l.register_set({1});
+	Index b = l.register_set({2});
+	Index c = l.register_set({3});
+	Index d = l.register_set({4});
+	Index e = l.register_set({5});
+	Index f = l.set_union(d, e);
+	Index g = l.set_intersection(f, c);
+	ASSERT_EQ(g, lhf::EMPTY_SET_VALUE);
+
+	lhf::Vector<lhf::IndexValue> r = l.reorganize();
+	ASSERT_EQ(r.size(), 7);
+	ASSERT_EQ(r[lhf::EMPTY_SET_VALUE], lhf::EMPTY_SET_VALUE);
+
+	// f takes part in two operations, and is followed by the set it was
+	// operated on with. a and b were never operated on.
+	ASSERT_EQ(r[f.value], 1);
+	ASSERT_EQ(r[c.value], 2);
+	ASSERT_EQ(r[d.value], 3);
+	ASSERT_EQ(r[e.value], 4);
+	ASSERT_EQ(r[a.value], 5);
+	ASSERT_EQ(r[b.value], 6);
+
+	ASSERT_EQ(l.get_value(r[a.value]), (LHF::PropertySet{1}));
+	ASSERT_EQ(l.get_value(r[b.value]), (LHF::PropertySet{2}));
+	ASSERT_EQ(l.get_value(r[c.value]), (LHF::PropertySet{3}));
+	ASSERT_EQ(l.get_value(r[f.value]), (LHF::PropertySet{4, 5}));
+	ASSERT_EQ(l.register_set({4, 5}), r[f.value]);
+	ASSERT_EQ(l.get_last_renumbering(), r);
+}
+
+TEST(LHF_ReorganizeChecks, caches_are_rewritten) {
+	LHF l;
+	Index a = l.register_set({1});
+	Index b = l.register_set({1, 2});
+	Index c = l.register_set({3});
+	ASSERT_EQ(l.set_union(a, b), b);
+	Index d = l.set_union(b, c);
+	Index e = l.set_difference(d, a);
+
+	auto before = l.get_operation_cache_stats();
+
+	// b becomes the hottest set, so the order of a and b is reversed.
+	lhf::Vector<lhf::IndexValue> r = l.reorganize();
+	Index na = r[a.value], nb = r[b.value], nc = r[c.value];
+	Index nd = r[d.value], ne = r[e.value];
+	ASSERT_LT(nb, na);
+
+	// Subset relations are stored in index order: nb is a superset of na.
+	ASSERT_EQ(l.is_subset(nb, na), lhf::SUPERSET);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, nb, nc).get(), nd);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::UNION, nc, nb).get(), nd);
+	ASSERT_EQ(l.find_cached_operation(lhf::OperationKind::DIFFERENCE, nd, na).get(), ne);
+
+	for (auto &c : l.get_operation_cache_stats()) {
+		ASSERT_EQ(c.second.size, before[c.first].size);
+	}
+	ASSERT_EQ(l.set_union(na, nb), nb);
+	ASSERT_EQ(l.set_union(nc, nb), nd);
+	ASSERT_EQ(l.set_difference(nd, na), ne);
+	ASSERT_EQ(l.get_value(ne), (LHF::PropertySet{2, 3}));
+}
+
+TEST(LHF_ReorganizeChecks, nested_sets_are_rewritten) {
+	ChildLHF child;
+	NestedLHF l(NestedLHF::RefList{child});
+
+	ChildLHF::Index x = child.register_set({1});
+	ChildLHF::Index y = child.register_set({2});
+	ChildLHF::Index z = child.set_union(x, y);
+	child.set_intersection(y, child.register_set({3}));
+
+	NestedLHF::Index a = l.register_set({{1, {x}}});
+	NestedLHF::Index b = l.register_set({{1, {y}}});
+	NestedLHF::Index c = l.set_union(a, b);
+
+	lhf::Vector<lhf::IndexValue> r = l.reorganize();
+	const lhf::Vector<lhf::IndexValue> &cr = child.get_last_renumbering();
+	ASSERT_NE(cr[y.value], y.value);
+
+	ASSERT_EQ(l.get_value(r[c.value]).at(0).value0(), cr[z.value]);
+	ASSERT_EQ(l.register_set({{1, {cr[y.value]}}}), r[b.value]);
+	ASSERT_EQ(l.set_union(r[a.value], r[b.value]), r[c.value]);
+	ASSERT_EQ(child.get_value(cr[z.value]), (ChildLHF::PropertySet{1, 2}));
+}
+
+#ifdef LHF_ENABLE_EVICTION
+
+TEST(LHF_ReorganizeChecks, evicted_sets_survive_reordering) {
+	LHF l;
+	Index a = l.register_set({1});
+	Index b = l.register_set({2});
+	Index c = l.set_union(a, b);
+	Index d = l.register_set({3});
+	Index e = l.set_union(c, d);
+	l.evict_set(c);
+	l.evict_set(e);
+
+	// c moves in front of the operands it is recomputed from.
+	lhf::Vector<lhf::IndexValue> r = l.reorganize();
+	ASSERT_LT(r[c.value], r[a.value]);
+	ASSERT_FALSE(l.is_evicted(r[c.value]));
+	ASSERT_TRUE(l.is_evicted(r[e.value]));
+	ASSERT_EQ(l.get_value(r[e.value]), (LHF::PropertySet{1, 2, 3}));
+
+	l.evict_set(r[c.value]);
+	ASSERT_EQ(l.register_set({1, 2}), r[c.value]);
+}
+
+#endif
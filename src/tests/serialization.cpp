@@ -1,6 +1,8 @@
 #include "common.hpp"
 #include "lhf/lhf.hpp"
 #include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
 #ifdef LHF_ENABLE_SERIALIZATION
@@ -47,4 +49,181 @@ TEST(LHF_SerializationChecks, check_lhf_walk) {
 	ASSERT_EQ(l.dump(), l2.dump());
 }
 
+TEST(LHF_SerializationChecks, stream_matches_json) {
+	PointeeLHF p;
+	PointerLHF l({p, p});
+	auto a = p.register_set({1, 2, 3});
+	auto b = p.register_set({4, 5, 6});
+	auto c = p.set_union(a, b);
+	auto x = l.register_set({{2, {a, b}}, {3, {c, a}}});
+	auto y = l.register_set({{2, {b, b}}});
+	l.set_union(x, y);
+
+	std::stringstream s;
+	lhf::slz::lhf_to_stream(s, l);
+	ASSERT_EQ(lhf::slz::JSON::parse(s.str()), lhf::slz::lhf_to_json(l));
+
+	PointeeLHF p2;
+	PointerLHF l2({p2, p2});
+	lhf::slz::lhf_from_stream(l2, s);
+
+	// The caches are hash maps, so compare their contents rather than dumps.
+	ASSERT_EQ(l2.property_set_count(), l.property_set_count());
+	ASSERT_EQ(p2.property_set_count(), p.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		EXPECT_EQ(l2.property_set_to_string(k), l.property_set_to_string(k));
+	}
+	for (lhf::Size k = 0; k < p.property_set_count(); k++) {
+		EXPECT_EQ(p2.property_set_to_string(k), p.property_set_to_string(k));
+	}
+
+	using lhf::OperationKind;
+	EXPECT_EQ(p2.find_cached_operation(OperationKind::UNION, a, b).get(), c);
+	EXPECT_EQ(p2.is_subset(a, c), lhf::SUBSET);
+	EXPECT_EQ(p2.is_subset(b, c), lhf::SUBSET);
+	EXPECT_EQ(
+		l2.find_cached_operation(OperationKind::UNION, x, y).get(),
+		l.find_cached_operation(OperationKind::UNION, x, y).get());
+}
+
+TEST(LHF_SerializationChecks, stream_reads_bson) {
+	PointeeLHF p;
+	PointerLHF l({p, p});
+	auto a = p.register_set({1, 2, 3});
+	auto b = p.register_set({4, 5, 6});
+	p.set_intersection(a, b);
+	l.register_set({{7, {a, b}}});
+
+	std::vector<std::uint8_t> bson = lhf::slz::json_to_bson(lhf::slz::lhf_to_json(l));
+	std::stringstream s(std::string(bson.begin(), bson.end()));
+
+	PointeeLHF p2;
+	PointerLHF l2({p2, p2});
+	lhf::slz::lhf_from_stream(l2, s, lhf::slz::JSON::input_format_t::bson);
+
+	ASSERT_EQ(l.dump(), l2.dump());
+	ASSERT_EQ(p.dump(), p2.dump());
+}
+
+TEST(LHF_SerializationChecks, stream_rejects_malformed_input) {
+	LHF l;
+	std::stringstream truncated("{\"/\":{\"property_sets\":[[],[1,2");
+	EXPECT_THROW(lhf::slz::lhf_from_stream(l, truncated), lhf::slz::SerializationError);
+
+	std::stringstream not_sets("{\"/\":{\"property_sets\":[1]}}");
+	EXPECT_THROW(lhf::slz::lhf_from_stream(l, not_sets), lhf::slz::SerializationError);
+
+	std::stringstream missing("{\"lhf_version\":\"0.6.0\"}");
+	EXPECT_THROW(lhf::slz::lhf_from_stream(l, missing), lhf::slz::SerializationError);
+}
+
+static std::string bundle_path(const char *name) {
+	return ::testing::TempDir() + "lhf_bundle_" + name + ".bin";
+}
+
+TEST(LHF_SerializationChecks, bundle_round_trip) {
+	PointeeLHF p;
+	PointerLHF l({p, p});
+	auto a = p.register_set({1, 2, 3});
+	auto b = p.register_set({4, 5, 6});
+	auto c = p.set_union(a, b);
+	p.set_difference(a, b);
+	auto x = l.register_set({{2, {a, b}}, {3, {c, a}}});
+	auto y = l.register_set({{2, {b, b}}});
+	l.set_union(x, y);
+
+	std::string path = bundle_path("round_trip");
+	lhf::slz::lhf_to_bundle(l, path);
+
+	PointeeLHF p2;
+	PointerLHF l2({p2, p2});
+	lhf::slz::lhf_from_bundle(l2, path);
+
+	ASSERT_EQ(l2.property_set_count(), l.property_set_count());
+	ASSERT_EQ(p2.property_set_count(), p.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		EXPECT_EQ(l2.property_set_to_string(k), l.property_set_to_string(k));
+	}
+	for (lhf::Size k = 0; k < p.property_set_count(); k++) {
+		EXPECT_EQ(p2.property_set_to_string(k), p.property_set_to_string(k));
+	}
+
+	using lhf::OperationKind;
+	EXPECT_EQ(p2.find_cached_operation(OperationKind::UNION, a, b).get(), c);
+	EXPECT_EQ(
+		p2.find_cached_operation(OperationKind::DIFFERENCE, a, b).get(),
+		p.find_cached_operation(OperationKind::DIFFERENCE, a, b).get());
+	EXPECT_EQ(p2.is_subset(a, c), lhf::SUBSET);
+	EXPECT_EQ(
+		l2.find_cached_operation(OperationKind::UNION, x, y).get(),
+		l.find_cached_operation(OperationKind::UNION, x, y).get());
+
+	std::remove(path.c_str());
+}
+
+using StringPointeeLHF = lhf::LatticeHashForest<lhf::LHFConfig<std::string>>;
+using StringPointerLHF = lhf::LatticeHashForest<
+	lhf::LHFConfig<std::string>,
+	lhf::NestingBase<std::string, StringPointeeLHF, StringPointeeLHF>
+>;
+
+TEST(LHF_SerializationChecks, bundle_shares_keys_and_loads_lazily) {
+	StringPointeeLHF p;
+	StringPointerLHF l({p, p});
+	std::vector<StringPointeeLHF::Index> targets;
+	for (int k = 0; k < 50; k++) {
+		std::string name = "variable_" + std::to_string(k);
+		targets.push_back(p.register_set({name, name + "_field"}));
+	}
+	for (int k = 1; k < 50; k++) {
+		std::string name = "variable_" + std::to_string(k);
+		l.register_set({{name, {targets[k - 1], targets[k]}}});
+		p.set_union(targets[k - 1], targets[k]);
+	}
+
+	std::string path = bundle_path("shared");
+	lhf::slz::lhf_to_bundle(l, path);
+
+	lhf::slz::BundleReader r(path);
+	EXPECT_EQ(r.get_paths(), std::vector<std::string>({"/", "/0/"}));
+	EXPECT_EQ(r.key_count(), 100u);
+
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	EXPECT_LT(lhf::Size(f.tellg()), lhf::slz::lhf_to_json(l).dump().size() / 2);
+
+	// Only the child is loaded.
+	StringPointeeLHF q;
+	r.load("/0/", q);
+	ASSERT_EQ(q.property_set_count(), p.property_set_count());
+	for (lhf::Size k = 0; k < p.property_set_count(); k++) {
+		EXPECT_EQ(q.property_set_to_string(k), p.property_set_to_string(k));
+	}
+	EXPECT_EQ(
+		q.find_cached_operation(lhf::OperationKind::UNION, targets[0], targets[1]).get(),
+		p.find_cached_operation(lhf::OperationKind::UNION, targets[0], targets[1]).get());
+
+	EXPECT_THROW(r.load("/1/", q), lhf::slz::SerializationError);
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SerializationChecks, bundle_rejects_corruption) {
+	LHF l;
+	l.register_set({1, 2, 3});
+	std::string path = bundle_path("corrupt");
+	lhf::slz::lhf_to_bundle(l, path);
+
+	std::ifstream in(path, std::ios::binary);
+	std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	{
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		f.write(contents.data(), contents.size() - 4);
+	}
+
+	LHF r;
+	EXPECT_THROW(lhf::slz::lhf_from_bundle(r, path), lhf::slz::SerializationError);
+	EXPECT_THROW(lhf::slz::lhf_from_bundle(r, path + ".missing"), lhf::slz::SerializationError);
+	std::remove(path.c_str());
+}
+
 #endif
\ No newline at end of file
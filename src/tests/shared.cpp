@@ -0,0 +1,133 @@
+#include "common.hpp"
+#include "lhf/lhf_shared.hpp"
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using SharedLHF = lhf::SharedLatticeHashForest<lhf::LHFConfig<int>>;
+using Index = SharedLHF::Index;
+
+static std::string segment_name(const char *test) {
+	return "/lhf_test_" + std::string(test) + "_" + std::to_string(getpid());
+}
+
+// Removes the segment when a test ends, also if an assertion fails.
+struct SegmentGuard {
+	std::string name;
+
+	~SegmentGuard() {
+		SharedLHF::remove(name);
+	}
+};
+
+static lhf::SharedForestLimits small_limits() {
+	lhf::SharedForestLimits limits;
+	limits.max_sets = 1 << 12;
+	limits.arena_bytes = 1 << 20;
+	limits.operation_slots = 1 << 12;
+	return limits;
+}
+
+static bool contains(SharedLHF::SetView s, std::vector<int> v) {
+	return s.size() == v.size() &&
+		std::equal(s.begin(), s.end(), v.begin(), [](auto &e, int k) { return e.get_key() == k; });
+}
+
+TEST(LHF_SharedChecks, operations_are_shared_between_mappings) {
+	std::string name = segment_name("operations");
+	SegmentGuard guard{name};
+	SharedLHF l = SharedLHF::create(name, small_limits());
+	ASSERT_THROW(SharedLHF::create(name, small_limits()), lhf::SharedMemoryError);
+
+	Index a = l.register_set({1, 2});
+	Index b = l.register_set({2, 3});
+	ASSERT_EQ(l.property_set_count(), 3);
+#ifndef LHF_DISABLE_INTEGRITY_CHECKS
+	ASSERT_THROW(l.register_set({2, 1}), lhf::AssertError);
+#endif
+
+	Index u = l.set_union(a, b);
+	ASSERT_TRUE(contains(l.get_value(u), {1, 2, 3}));
+	ASSERT_EQ(l.set_intersection(a, b), l.register_set_single(2));
+	ASSERT_EQ(l.set_difference(u, a), l.register_set_single(3));
+	ASSERT_EQ(l.set_union(a, u), u);
+	ASSERT_EQ(l.is_subset(a, u), lhf::SUBSET);
+
+	// A second mapping of the segment sees the same sets and caches.
+	SharedLHF m = SharedLHF::open(name);
+	ASSERT_EQ(m.register_set({1, 2, 3}), u);
+	lhf::Size hits = m.get_stats().operation_hits;
+	ASSERT_EQ(m.set_union(b, a), u);
+	ASSERT_EQ(m.get_stats().operation_hits, hits + 1);
+	ASSERT_EQ(m.property_set_count(), l.property_set_count());
+
+	SharedLHF::remove(name);
+	ASSERT_THROW(SharedLHF::open(name), lhf::SharedMemoryError);
+}
+
+TEST(LHF_SharedChecks, other_configurations_are_rejected) {
+	std::string name = segment_name("configuration");
+	SegmentGuard guard{name};
+
+	// Same layout, but another element type.
+	using UnsignedLHF = lhf::SharedLatticeHashForest<lhf::LHFConfig<unsigned>>;
+	UnsignedLHF l = UnsignedLHF::create(name, small_limits());
+	ASSERT_THROW(SharedLHF::open(name), lhf::SharedMemoryError);
+	ASSERT_NO_THROW(UnsignedLHF::open(name));
+}
+
+TEST(LHF_SharedChecks, forked_workers_intern_into_one_forest) {
+	constexpr int WORKERS = 4;
+	constexpr int N = 200;
+
+	std::string name = segment_name("forked");
+	SegmentGuard guard{name};
+	SharedLHF l = SharedLHF::create(name, small_limits());
+
+	std::vector<pid_t> workers;
+	for (int w = 0; w < WORKERS; w++) {
+		pid_t pid = fork();
+		ASSERT_GE(pid, 0);
+		if (pid == 0) {
+			// Every worker builds the same sets, in a different order.
+			bool ok = true;
+			try {
+				SharedLHF f = SharedLHF::open(name);
+				for (int j = 0; j < N; j++) {
+					int i = (j * 7 + w * 50) % N;
+					Index a = f.register_set({i, i + 1});
+					Index b = f.register_set({i + 1, i + 2});
+					Index u = f.set_union(a, b);
+					ok = ok && contains(f.get_value(u), {i, i + 1, i + 2});
+					ok = ok && contains(f.get_value(f.set_difference(u, a)), {i + 2});
+				}
+			} catch (...) {
+				ok = false;
+			}
+			_exit(ok ? 0 : 1);
+		}
+		workers.push_back(pid);
+	}
+
+	for (pid_t pid : workers) {
+		int status;
+		ASSERT_EQ(waitpid(pid, &status, 0), pid);
+		ASSERT_TRUE(WIFEXITED(status));
+		ASSERT_EQ(WEXITSTATUS(status), 0);
+	}
+
+	// The empty set, {i, i + 1} for 0 <= i <= N, the unions and the
+	// differences, each stored once.
+	ASSERT_EQ(l.property_set_count(), 1 + (N + 1) + N + N);
+	ASSERT_GT(l.get_stats().set_hits, 0);
+
+	lhf::Size hits = l.get_stats().operation_hits;
+	for (int i = 0; i < N; i++) {
+		Index a = l.register_set({i, i + 1});
+		Index b = l.register_set({i + 1, i + 2});
+		ASSERT_TRUE(contains(l.get_value(l.set_union(a, b)), {i, i + 1, i + 2}));
+	}
+	ASSERT_EQ(l.get_stats().operation_hits, hits + N);
+	ASSERT_EQ(l.property_set_count(), 1 + (N + 1) + N + N);
+}
@@ -0,0 +1,480 @@
+#include "common.hpp"
+#include "lhf/lhf.hpp"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <climits>
+#include <fstream>
+#include <random>
+#include <thread>
+
+using LHF = LHFVerify<lhf::LHFConfig<int>>;
+using Index = typename LHF::Index;
+
+static std::string snapshot_path(const char *name) {
+	return ::testing::TempDir() + "lhf_snapshot_" + name + ".bin";
+}
+
+TEST(LHF_SnapshotChecks, mapped_snapshot_matches_live_lhf) {
+	LHF l;
+	Index a = l.register_set({1, 2, 3});
+	Index b = l.register_set({3, 4, 5});
+	Index c = l.register_set({1, 2});
+	Index u = l.set_union(a, b);
+	Index i = l.set_intersection(a, b);
+	Index d = l.set_difference(a, b);
+	l.set_union(a, c);
+
+	std::string path = snapshot_path("matches");
+	l.write_snapshot(path);
+	LHF::MappedSnapshot m(path);
+
+	ASSERT_EQ(m.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		const auto &live = l.get_value(k);
+		auto mapped = m.get_value(k);
+		ASSERT_EQ(mapped.size(), live.size());
+		EXPECT_TRUE(std::equal(mapped.begin(), mapped.end(), live.begin()));
+		EXPECT_EQ(m.find_set(live).get(), Index(k));
+	}
+
+	using lhf::OperationKind;
+	EXPECT_EQ(m.find_cached_operation(OperationKind::UNION, b, a).get(), u);
+	EXPECT_EQ(m.find_cached_operation(OperationKind::INTERSECTION, a, b).get(), i);
+	EXPECT_EQ(m.find_cached_operation(OperationKind::DIFFERENCE, a, b).get(), d);
+	EXPECT_FALSE(m.find_cached_operation(OperationKind::DIFFERENCE, b, a).is_present());
+	EXPECT_EQ(m.is_subset(c, a), l.is_subset(c, a));
+	EXPECT_EQ(m.is_subset(a, c), l.is_subset(a, c));
+
+	EXPECT_TRUE(m.contains(a, 2));
+	EXPECT_FALSE(m.contains(b, 2));
+	EXPECT_EQ(m.find_key(b, 4).get().get_key(), 4);
+	EXPECT_FALSE(m.find_set({7, 8}).is_present());
+
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, large_snapshot_and_concurrent_readers) {
+	LHF l;
+	std::vector<Index> sets;
+	for (int k = 0; k < 2000; k++) {
+		sets.push_back(l.register_set({k, k + 1, k + 2}));
+	}
+	for (lhf::Size k = 1; k < sets.size(); k++) {
+		l.set_union(sets[k - 1], sets[k]);
+	}
+
+	std::string path = snapshot_path("large");
+	l.write_snapshot(path);
+	const LHF::MappedSnapshot m(path);
+
+	std::atomic<int> failures = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]() {
+			for (lhf::Size k = 1; k < sets.size(); k++) {
+				auto r = m.find_cached_operation(
+					lhf::OperationKind::UNION, sets[k], sets[k - 1]);
+				if (!r.is_present() || m.size_of(r.get()) != 4 ||
+				    m.find_set(l.get_value(r.get())).get() != r.get()) {
+					failures++;
+				}
+			}
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	EXPECT_EQ(failures, 0);
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, rejects_invalid_snapshots) {
+	std::string path = snapshot_path("invalid");
+
+	{
+		std::ofstream f(path, std::ios::binary);
+		f << std::string(4096, 'x');
+	}
+	EXPECT_THROW(LHF::MappedSnapshot m(path), lhf::SnapshotError);
+
+	LHF l;
+	l.register_set({1, 2, 3});
+	l.write_snapshot(path);
+
+	// Written for a different element type.
+	using DoubleLHF = lhf::LatticeHashForest<lhf::LHFConfig<long double>>;
+	EXPECT_THROW(DoubleLHF::MappedSnapshot m(path), lhf::SnapshotError);
+
+	// Truncated.
+	std::ifstream in(path, std::ios::binary);
+	std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	{
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		f.write(contents.data(), contents.size() - 8);
+	}
+	EXPECT_THROW(LHF::MappedSnapshot m(path), lhf::SnapshotError);
+
+	EXPECT_THROW(LHF::MappedSnapshot m(path + ".missing"), lhf::SnapshotError);
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, load_snapshot_restores_lhf) {
+	LHF l;
+	std::vector<Index> sets;
+	for (int k = 0; k < 10000; k++) {
+		sets.push_back(l.register_set({k, k + 1, k + 2}));
+	}
+	for (lhf::Size k = 1; k < sets.size(); k += 2) {
+		l.set_union(sets[k - 1], sets[k]);
+		l.set_intersection(sets[k - 1], sets[k]);
+	}
+
+	std::string path = snapshot_path("load");
+	l.write_snapshot(path);
+
+	LHF r;
+	r.register_set({42});
+	r.load_snapshot(path);
+
+	ASSERT_EQ(r.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		ASSERT_EQ(r.get_value(k), l.get_value(k));
+		ASSERT_EQ(r.register_set(l.get_value(k)), Index(k));
+	}
+
+	for (lhf::Size k = 1; k < sets.size(); k += 2) {
+		auto u = r.find_cached_operation(lhf::OperationKind::UNION, sets[k - 1], sets[k]);
+		ASSERT_TRUE(u.is_present());
+		EXPECT_EQ(u.get(), l.set_union(sets[k - 1], sets[k]));
+	}
+
+	EXPECT_EQ(r.property_set_count(), l.property_set_count());
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, load_snapshot_rejects_corruption) {
+	LHF l;
+	for (int k = 0; k < 100; k++) {
+		l.register_set({k, k + 1});
+	}
+
+	std::string path = snapshot_path("corrupt");
+	l.write_snapshot(path);
+
+	std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+	f.seekg(-16, std::ios::end);
+	char c = 0;
+	f.read(&c, 1);
+	c ^= 0x5a;
+	f.seekp(-16, std::ios::end);
+	f.write(&c, 1);
+	f.close();
+
+	// Opening only checks the header, verifying reads everything.
+	LHF::MappedSnapshot m(path);
+	EXPECT_THROW(m.verify(), lhf::SnapshotError);
+
+	LHF r;
+	EXPECT_THROW(r.load_snapshot(path), lhf::SnapshotError);
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, stream_vbyte_round_trip) {
+	std::mt19937_64 rng(7);
+	std::vector<std::uint32_t> small;
+	std::vector<std::uint64_t> large;
+	for (int k = 0; k < 1000; k++) {
+		int bits = rng() % 64;
+		large.push_back(rng() >> (63 - bits) >> 1);
+		small.push_back(std::uint32_t(large.back() >> (bits > 32 ? bits - 32 : 0)));
+	}
+
+	std::vector<std::uint8_t> buffer;
+	lhf::StreamVByte<std::uint32_t>::encode(small.data(), small.size(), buffer);
+	EXPECT_EQ(lhf::StreamVByte<std::uint32_t>::encoded_size(buffer.data(), small.size()), buffer.size());
+	std::vector<std::uint32_t> small_out(small.size());
+	lhf::StreamVByte<std::uint32_t>::decode(
+		buffer.data(), small.size(), small_out.data(), buffer.data() + buffer.size());
+	EXPECT_EQ(small, small_out);
+
+	buffer.clear();
+	lhf::StreamVByte<std::uint64_t>::encode(large.data(), large.size(), buffer);
+	std::vector<std::uint64_t> large_out(large.size());
+	lhf::StreamVByte<std::uint64_t>::decode(
+		buffer.data(), large.size(), large_out.data(), buffer.data() + buffer.size());
+	EXPECT_EQ(large, large_out);
+
+	std::vector<long long> keys = {LLONG_MIN, -5, 0, 3, LLONG_MAX};
+	std::vector<std::uint64_t> words;
+	buffer.clear();
+	lhf::SetCodec<long long>::encode(keys.data(), keys.size(), words, buffer);
+	std::vector<long long> keys_out(keys.size());
+	lhf::SetCodec<long long>::decode(
+		buffer.data(), keys.size(), keys_out.data(), words, buffer.data() + buffer.size());
+	EXPECT_EQ(keys, keys_out);
+}
+
+TEST(LHF_SnapshotChecks, delta_encoded_snapshot) {
+	LHF l;
+	std::vector<Index> sets;
+	for (int k = 0; k < 3000; k++) {
+		sets.push_back(l.register_set({-k - 1, k, k + 1, k + 300, k * 1000 + 1000}));
+	}
+	for (lhf::Size k = 1; k < sets.size(); k++) {
+		l.set_union(sets[k - 1], sets[k]);
+	}
+	l.set_difference(sets[0], sets[1]);
+	l.is_subset(sets[0], sets[2]);
+
+	std::string raw_path = snapshot_path("raw");
+	std::string delta_path = snapshot_path("delta");
+	l.write_snapshot(raw_path);
+	l.write_snapshot(delta_path, lhf::SnapshotEncoding::DELTA);
+
+	LHF::MappedSnapshot raw(raw_path);
+	LHF::MappedSnapshot m(delta_path);
+	m.verify();
+	EXPECT_EQ(m.get_encoding(), lhf::SnapshotEncoding::DELTA);
+	EXPECT_LT(m.file_size() * 2, raw.file_size());
+
+	ASSERT_EQ(m.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		const auto &live = l.get_value(k);
+		auto decoded = m.get_value(k);
+		ASSERT_EQ(decoded.size(), live.size());
+		EXPECT_TRUE(std::equal(decoded.begin(), decoded.end(), live.begin()));
+		EXPECT_EQ(m.find_set(live).get(), Index(k));
+	}
+
+	using lhf::OperationKind;
+	for (lhf::Size k = 1; k < sets.size(); k++) {
+		auto decoded = m.find_cached_operation(OperationKind::UNION, sets[k - 1], sets[k]);
+		ASSERT_TRUE(decoded.is_present());
+		EXPECT_EQ(decoded.get(), l.set_union(sets[k - 1], sets[k]));
+	}
+	EXPECT_EQ(
+		m.find_cached_operation(OperationKind::DIFFERENCE, sets[0], sets[1]).get(),
+		l.set_difference(sets[0], sets[1]));
+	EXPECT_EQ(m.is_subset(sets[0], sets[2]), l.is_subset(sets[0], sets[2]));
+
+	LHF r;
+	r.load_snapshot(delta_path);
+	ASSERT_EQ(r.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		EXPECT_EQ(r.get_value(k), l.get_value(k));
+	}
+
+	// Only integral keys can be delta-encoded.
+	using DoubleLHF = lhf::LatticeHashForest<lhf::LHFConfig<double>>;
+	DoubleLHF d;
+	d.register_set({0.5, 1.5});
+	EXPECT_THROW(d.write_snapshot(delta_path, lhf::SnapshotEncoding::DELTA), lhf::SnapshotError);
+
+	std::remove(raw_path.c_str());
+	std::remove(delta_path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, delta_encoded_nested_snapshot) {
+	using ChildLHF = lhf::LatticeHashForest<lhf::LHFConfig<int>>;
+	using NestedLHF = lhf::LatticeHashForest<
+		lhf::LHFConfig<int>,
+		lhf::NestingBase<int, ChildLHF, ChildLHF>>;
+
+	ChildLHF c;
+	NestedLHF l({c, c});
+	std::vector<ChildLHF::Index> children;
+	for (int k = 0; k < 300; k++) {
+		children.push_back(c.register_set({k, k + 1}));
+	}
+
+	std::vector<NestedLHF::Index> sets;
+	for (int k = 0; k < 1000; k++) {
+		sets.push_back(l.register_set({
+			{-k - 1, {children[k % 300], children[(k * 7) % 300]}},
+			{k, {children[(k + 1) % 300], children[0]}},
+			{k + 1000, {children[299], children[k % 13]}}}));
+	}
+	for (lhf::Size k = 1; k < sets.size(); k++) {
+		l.set_union(sets[k - 1], sets[k]);
+	}
+
+	std::string path = snapshot_path("nested_delta");
+	l.write_snapshot(path, lhf::SnapshotEncoding::DELTA);
+
+	NestedLHF::MappedSnapshot m(path);
+	m.verify();
+	ASSERT_EQ(m.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		const auto &live = l.get_value(k);
+		auto decoded = m.get_value(k);
+		ASSERT_EQ(decoded.size(), live.size());
+		for (lhf::Size j = 0; j < live.size(); j++) {
+			EXPECT_EQ(decoded[j].get_key(), live[j].get_key());
+			EXPECT_EQ(decoded[j].get_value(), live[j].get_value());
+		}
+		EXPECT_EQ(m.find_set(live).get(), NestedLHF::Index(k));
+	}
+
+	ChildLHF c2;
+	NestedLHF r({c2, c2});
+	r.load_snapshot(path);
+	ASSERT_EQ(r.property_set_count(), l.property_set_count());
+	for (lhf::Size k = 0; k < l.property_set_count(); k++) {
+		EXPECT_EQ(r.property_set_to_string(k), l.property_set_to_string(k));
+	}
+	EXPECT_EQ(
+		r.find_cached_operation(lhf::OperationKind::UNION, sets[0], sets[1]).get(),
+		l.set_union(sets[0], sets[1]));
+
+	// Nested elements are not trivially copyable, so they cannot be written
+	// to a raw snapshot.
+	EXPECT_THROW(l.write_snapshot(path), lhf::SnapshotError);
+
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, warm_start_reuses_caches) {
+	std::string path = snapshot_path("warm");
+	std::vector<Index> sets;
+	std::vector<Index> unions;
+	{
+		LHF l;
+		for (int k = 0; k < 1000; k++) {
+			sets.push_back(l.register_set({k, k + 1, k + 2}));
+		}
+		for (lhf::Size k = 1; k < sets.size(); k++) {
+			unions.push_back(l.set_union(sets[k - 1], sets[k]));
+		}
+		l.save_warm_start(path, 7);
+	}
+
+	LHF missing;
+	EXPECT_FALSE(missing.warm_start(path + ".missing", 7));
+
+	// A different tag, or a different configuration with the same layout,
+	// is rejected and leaves the LHF unchanged.
+	LHF other;
+	Index a = other.register_set({5});
+	EXPECT_FALSE(other.warm_start(path, 8));
+	EXPECT_EQ(other.property_set_count(), 2);
+	EXPECT_EQ(other.register_set({5}), a);
+
+	using UnsignedLHF = lhf::LatticeHashForest<lhf::LHFConfig<unsigned>>;
+	EXPECT_NE(UnsignedLHF::config_fingerprint(), LHF::config_fingerprint());
+	EXPECT_FALSE(UnsignedLHF().warm_start(path, 7));
+	EXPECT_THROW(UnsignedLHF::MappedSnapshot m(path), lhf::SnapshotError);
+
+	// The second run finds its sets at the same indices, and its unions in
+	// the cache.
+	LHF r;
+	ASSERT_TRUE(r.warm_start(path, 7));
+	EXPECT_EQ(LHF::MappedSnapshot(path).get_tag(), 7);
+	for (int k = 0; k < 1000; k++) {
+		ASSERT_EQ(r.register_set({k, k + 1, k + 2}), sets[k]);
+	}
+
+	lhf::Size count = r.property_set_count();
+	for (lhf::Size k = 1; k < sets.size(); k++) {
+		auto u = r.find_cached_operation(lhf::OperationKind::UNION, sets[k - 1], sets[k]);
+		ASSERT_TRUE(u.is_present());
+		EXPECT_EQ(u.get(), unions[k - 1]);
+		EXPECT_EQ(r.set_union(sets[k - 1], sets[k]), unions[k - 1]);
+	}
+	EXPECT_EQ(r.property_set_count(), count);
+
+	std::remove(path.c_str());
+}
+
+TEST(LHF_SnapshotChecks, snapshot_async_writes_a_cut) {
+	LHF l;
+	std::vector<Index> sets;
+	for (int k = 0; k < 5000; k++) {
+		sets.push_back(l.register_set({k, k + 1, k + 2}));
+	}
+	Index u = l.set_union(sets[0], sets[1]);
+
+	std::string path = snapshot_path("async");
+	lhf::Size cut = l.property_set_count();
+	auto written = l.snapshot_async(path);
+
+	// The LHF keeps changing while the snapshot is written.
+	Index late = l.register_set({-2, -1});
+	l.set_union(sets[2], late);
+	l.set_union(sets[3], sets[4]);
+
+#if defined(LHF_ENABLE_TBB) || defined(LHF_ENABLE_PARALLEL)
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&l, &sets, t]() {
+			for (int k = 0; k < 1000; k++) {
+				l.register_set({100000 * (t + 1) + k});
+				l.set_union(sets[k], sets[k + 1 + t]);
+			}
+		});
+	}
+	auto concurrent = l.snapshot_async(path + ".concurrent");
+	for (std::thread &t : threads) {
+		t.join();
+	}
+	lhf::Size concurrent_cut = concurrent.get();
+	LHF::MappedSnapshot c(path + ".concurrent");
+	ASSERT_EQ(c.property_set_count(), concurrent_cut);
+	for (lhf::Size k = 0; k < c.property_set_count(); k++) {
+		auto s = c.get_value(k);
+		ASSERT_TRUE(std::equal(s.begin(), s.end(), l.get_value(k).begin(), l.get_value(k).end()));
+	}
+	std::remove((path + ".concurrent").c_str());
+#endif
+
+	ASSERT_EQ(written.get(), cut);
+	LHF::MappedSnapshot m(path);
+	ASSERT_EQ(m.property_set_count(), cut);
+	for (lhf::Size k = 0; k < cut; k++) {
+		ASSERT_EQ(m.find_set(l.get_value(k)).get(), Index(k));
+	}
+	EXPECT_FALSE(m.find_set({-2, -1}).is_present());
+
+	using lhf::OperationKind;
+	EXPECT_EQ(m.find_cached_operation(OperationKind::UNION, sets[0], sets[1]).get(), u);
+	EXPECT_FALSE(m.find_cached_operation(OperationKind::UNION, sets[2], late).is_present());
+	EXPECT_FALSE(m.find_cached_operation(OperationKind::UNION, sets[3], sets[4]).is_present());
+
+	LHF r;
+	r.load_snapshot(path);
+	EXPECT_EQ(r.property_set_count(), cut);
+	std::remove(path.c_str());
+}
+
+#ifdef LHF_ENABLE_EVICTION
+
+TEST(LHF_SnapshotChecks, snapshot_async_leaves_evicted_sets_evicted) {
+	LHF l;
+	l.enable_spill();
+	Index a = l.register_set({1, 2, 3});
+	Index b = l.register_set({3, 4});
+	Index u = l.set_union(a, b);
+	Index d = l.set_difference(u, b);
+
+	// `a` is spilled, `u` and `d` are recomputed from their operands.
+	l.evict_set(a);
+	l.evict_set(u);
+	l.evict_set(d);
+
+	std::string path = snapshot_path("async_evicted");
+	ASSERT_EQ(l.snapshot_async(path).get(), l.property_set_count());
+
+	EXPECT_TRUE(l.is_evicted(a));
+	EXPECT_TRUE(l.is_evicted(u));
+	EXPECT_TRUE(l.is_evicted(d));
+	EXPECT_EQ(l.get_eviction_stats().rematerializations, 0u);
+
+	LHF::MappedSnapshot m(path);
+	EXPECT_EQ(m.find_set({1, 2, 3}).get(), a);
+	EXPECT_EQ(m.find_set({1, 2, 3, 4}).get(), u);
+	EXPECT_EQ(m.find_set({1, 2}).get(), d);
+	std::remove(path.c_str());
+}
+
+#endif
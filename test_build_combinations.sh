@@ -37,6 +37,12 @@ run_build_with_flags -DENABLE_TBB=1;
 
 run_build_with_flags -DENABLE_EVICTION=1;
 
+run_build_with_flags -DENABLE_ACCESS_COUNTS=1;
+
+run_build_with_flags -DENABLE_INCREMENTAL_REHASH=1;
+
+run_build_with_flags -DENABLE_PARALLEL=1 -DENABLE_INCREMENTAL_REHASH=1;
+
 run_build_with_flags -DENABLE_SERIALIZATION=1;
 
 run_build_with_flags -DDISABLE_INTEGRITY_CHECKS=1;
@@ -47,6 +53,8 @@ run_build_with_flags -DENABLE_PERFORMANCE_METRICS=0 -DENABLE_DEBUG=0;
 
 run_build_with_flags -DENABLE_PERFORMANCE_METRICS=1 -DENABLE_DEBUG=0;
 
+run_build_with_flags -DENABLE_PERFORMANCE_METRICS=1 -DPERFORMANCE_SAMPLING_RATE=8;
+
 run_build_with_flags \
 	-DENABLE_PERFORMANCE_METRICS=0 \
 	-DENABLE_DEBUG=0 \